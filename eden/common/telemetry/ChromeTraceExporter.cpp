@@ -0,0 +1,244 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "eden/common/telemetry/ChromeTraceExporter.h"
+
+#include <fmt/format.h>
+#include <folly/json/json.h>
+#include <folly/logging/xlog.h>
+#include <algorithm>
+#include <iterator>
+#include <ostream>
+#include <string_view>
+
+namespace facebook::eden {
+
+namespace {
+
+constexpr std::string_view kCategory = "eden";
+
+/**
+ * Trace event timestamps are in microseconds, with fractions allowed.
+ */
+void appendMicros(std::string& out, std::chrono::nanoseconds ns) {
+  auto count = ns.count();
+  // A tracepoint from before the first one added is negative.
+  uint64_t magnitude = count < 0 ? 0 - static_cast<uint64_t>(count) : count;
+  fmt::format_to(
+      std::back_inserter(out),
+      "{}{}.{:03}",
+      count < 0 ? "-" : "",
+      magnitude / 1000,
+      magnitude % 1000);
+}
+
+void appendString(std::string& out, folly::StringPiece str) {
+  folly::json::escapeString(str, out, folly::json::serialization_opts{});
+}
+
+} // namespace
+
+ChromeTraceExporter::ChromeTraceExporter(std::ostream& out) : out_{out} {}
+
+void ChromeTraceExporter::add(const CompactTracePoint& point) {
+  XCHECK(!finished_) << "add() called after finish()";
+  if (!base_) {
+    base_ = point.timestamp;
+  }
+  lastTimestamp_ = std::max(lastTimestamp_, point.timestamp);
+  if (point.start) {
+    startBlock(point);
+  } else if (point.stop) {
+    stopBlock(point);
+  } else {
+    writeInstant(point);
+  }
+}
+
+void ChromeTraceExporter::finish() {
+  XCHECK(!finished_) << "finish() called twice";
+  // Copy out first, since closeBlock modifies openBlocks_.
+  std::vector<std::pair<uint64_t, OpenBlock>> unfinished{
+      openBlocks_.begin(), openBlocks_.end()};
+  std::sort(unfinished.begin(), unfinished.end(), [](auto& a, auto& b) {
+    return a.second.start < b.second.start;
+  });
+  for (const auto& [blockId, block] : unfinished) {
+    writeComplete(blockId, block, lastTimestamp_, /*finished=*/false);
+    closeBlock(blockId, block);
+  }
+
+  if (!started_) {
+    out_ << "{\"traceEvents\":[";
+  }
+  out_ << "\n]";
+  if (base_) {
+    // As a string: nanoseconds since the epoch don't fit in a double.
+    out_ << ",\"otherData\":{\"baseTimestampNs\":\"" << base_->count()
+         << "\"}";
+  }
+  out_ << "}\n";
+  out_.flush();
+  finished_ = true;
+}
+
+ChromeTraceExporter::Trace& ChromeTraceExporter::traceFor(uint64_t traceId) {
+  auto [it, inserted] = traces_.try_emplace(traceId);
+  auto& trace = it->second;
+  if (inserted) {
+    trace.pid = nextPid_++;
+    // Name the process after the trace. Trace IDs don't fit in a pid, which
+    // JSON readers parse as a double.
+    beginEvent();
+    fmt::format_to(
+        std::back_inserter(line_),
+        "\"ph\":\"M\",\"name\":\"process_name\",\"pid\":{},"
+        "\"args\":{{\"name\":\"trace {:#x}\"}}}}",
+        trace.pid,
+        traceId);
+    endEvent();
+  }
+  return trace;
+}
+
+void ChromeTraceExporter::appendTimestamp(
+    std::chrono::nanoseconds timestamp) {
+  appendMicros(line_, timestamp - *base_);
+}
+
+void ChromeTraceExporter::startBlock(const CompactTracePoint& point) {
+  // Replacing the open block would leave its id on its lane's stack forever.
+  if (openBlocks_.find(point.blockId) != openBlocks_.end()) {
+    ++repeatedStarts_;
+    return;
+  }
+  auto& trace = traceFor(point.traceId);
+
+  // Stay on the parent's lane if this block nests directly inside it.
+  // Otherwise, say when a sibling is still running, take the first idle lane,
+  // and draw a flow arrow from the parent.
+  auto parent = openBlocks_.find(point.parentBlockId);
+  bool hasParent = point.parentBlockId != 0 && parent != openBlocks_.end() &&
+      parent->second.traceId == point.traceId;
+  // Copied out, since inserting below may rehash.
+  uint32_t parentLane = hasParent ? parent->second.lane : 0;
+  uint32_t lane;
+  if (hasParent && trace.lanes[parentLane].back() == point.parentBlockId) {
+    lane = parentLane;
+  } else {
+    auto idle = std::find_if(
+        trace.lanes.begin(), trace.lanes.end(), [](const auto& stack) {
+          return stack.empty();
+        });
+    lane = static_cast<uint32_t>(idle - trace.lanes.begin());
+    if (idle == trace.lanes.end()) {
+      trace.lanes.emplace_back();
+    }
+  }
+  trace.lanes[lane].push_back(point.blockId);
+  openBlocks_.emplace(
+      point.blockId,
+      OpenBlock{
+          point.timestamp,
+          point.name,
+          point.traceId,
+          point.parentBlockId,
+          lane});
+
+  if (hasParent && lane != parentLane) {
+    for (bool begin : {true, false}) {
+      beginEvent();
+      fmt::format_to(
+          std::back_inserter(line_),
+          "\"ph\":\"{}\",\"name\":\"spawn\",\"cat\":\"{}\",\"id\":\"{:#x}\","
+          "\"pid\":{},\"tid\":{},\"ts\":",
+          begin ? 's' : 'f',
+          kCategory,
+          point.blockId,
+          trace.pid,
+          (begin ? parentLane : lane) + 1);
+      appendTimestamp(point.timestamp);
+      line_ += begin ? "}" : ",\"bp\":\"e\"}";
+      endEvent();
+    }
+  }
+}
+
+void ChromeTraceExporter::stopBlock(const CompactTracePoint& point) {
+  auto it = openBlocks_.find(point.blockId);
+  if (it == openBlocks_.end()) {
+    ++orphanedStops_;
+    return;
+  }
+  auto block = it->second;
+  writeComplete(point.blockId, block, point.timestamp, /*finished=*/true);
+  closeBlock(point.blockId, block);
+}
+
+void ChromeTraceExporter::closeBlock(uint64_t blockId, const OpenBlock& block) {
+  openBlocks_.erase(blockId);
+  // Usually the innermost block, unless a child outlived its parent.
+  auto& stack = traces_.find(block.traceId)->second.lanes[block.lane];
+  stack.erase(std::find(stack.begin(), stack.end(), blockId));
+}
+
+void ChromeTraceExporter::writeComplete(
+    uint64_t blockId,
+    const OpenBlock& block,
+    std::chrono::nanoseconds end,
+    bool finished) {
+  auto pid = traces_.find(block.traceId)->second.pid;
+  beginEvent();
+  line_ += "\"ph\":\"X\",\"name\":";
+  appendString(line_, block.name ? block.name : "(unnamed)");
+  fmt::format_to(
+      std::back_inserter(line_),
+      ",\"cat\":\"{}\",\"pid\":{},\"tid\":{},\"ts\":",
+      kCategory,
+      pid,
+      block.lane + 1);
+  appendTimestamp(block.start);
+  line_ += ",\"dur\":";
+  appendMicros(line_, std::max(end - block.start, decltype(end){0}));
+  fmt::format_to(
+      std::back_inserter(line_),
+      ",\"args\":{{\"blockId\":\"{:#x}\",\"parentBlockId\":\"{:#x}\"{}}}}}",
+      blockId,
+      block.parentBlockId,
+      finished ? "" : ",\"unfinished\":true");
+  endEvent();
+}
+
+void ChromeTraceExporter::writeInstant(const CompactTracePoint& point) {
+  auto& trace = traceFor(point.traceId);
+  auto it = openBlocks_.find(point.blockId);
+  uint32_t lane = it != openBlocks_.end() ? it->second.lane : 0;
+  beginEvent();
+  line_ += "\"ph\":\"i\",\"s\":\"t\",\"name\":";
+  appendString(line_, point.name ? point.name : "(tracepoint)");
+  fmt::format_to(
+      std::back_inserter(line_),
+      ",\"cat\":\"{}\",\"pid\":{},\"tid\":{},\"ts\":",
+      kCategory,
+      trace.pid,
+      lane + 1);
+  appendTimestamp(point.timestamp);
+  line_ += "}";
+  endEvent();
+}
+
+void ChromeTraceExporter::beginEvent() {
+  line_.clear();
+  line_ += started_ ? ",\n{" : "{\"traceEvents\":[\n{";
+  started_ = true;
+}
+
+void ChromeTraceExporter::endEvent() {
+  out_.write(line_.data(), line_.size());
+}
+
+} // namespace facebook::eden
@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <folly/container/F14Map.h>
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "eden/common/telemetry/Tracing.h"
+
+namespace facebook::eden {
+
+/**
+ * Streams CompactTracePoints into Chrome's trace event JSON format, which
+ * chrome://tracing and the Perfetto UI load directly.
+ *
+ * Tracepoints may be added in as many batches as desired, typically one per
+ * call to getAllTracepoints(), each in timestamp order. Only blocks that have
+ * started but not yet stopped, plus a few lane stacks per traceId, are held in
+ * memory; everything else is written out as soon as it is complete, so a long
+ * trace never needs to be materialized.
+ *
+ * Each traceId is shown as one process for the whole export. Each block
+ * becomes one complete event when it stops, on a lane (thread) within its
+ * trace: a child goes on its parent's lane when it nests there, and otherwise
+ * on another lane with a flow arrow from its parent. Every event carries its
+ * blockId and parentBlockId as arguments.
+ *
+ * Event timestamps are relative to the first tracepoint added. JSON readers
+ * parse numbers as doubles, which can only resolve a steady_clock or epoch
+ * timestamp in microseconds to a fraction of a microsecond. The absolute
+ * first timestamp, in nanoseconds, is kept as a string in the document's
+ * otherData.baseTimestampNs.
+ */
+class ChromeTraceExporter {
+ public:
+  /**
+   * out must outlive the exporter. Nothing is written until the first add().
+   */
+  explicit ChromeTraceExporter(std::ostream& out);
+
+  ChromeTraceExporter(const ChromeTraceExporter&) = delete;
+  ChromeTraceExporter& operator=(const ChromeTraceExporter&) = delete;
+
+  void add(const CompactTracePoint& point);
+
+  void add(const std::vector<CompactTracePoint>& points) {
+    for (const auto& point : points) {
+      add(point);
+    }
+  }
+
+  /**
+   * Writes blocks that never stopped, ending them at the last timestamp seen
+   * and marking them unfinished, and completes the JSON document. No further
+   * tracepoints may be added.
+   */
+  void finish();
+
+  /**
+   * Blocks that have started but not stopped.
+   */
+  size_t openBlocks() const noexcept {
+    return openBlocks_.size();
+  }
+
+  /**
+   * Stop tracepoints whose start was never added, for instance because an
+   * earlier getAllTracepoints() consumed it. They are skipped.
+   */
+  size_t orphanedStops() const noexcept {
+    return orphanedStops_;
+  }
+
+  /**
+   * Start tracepoints for a blockId that was already open, for instance
+   * because blockIds were reused. They are skipped, and the earlier block
+   * stays open.
+   */
+  size_t repeatedStarts() const noexcept {
+    return repeatedStarts_;
+  }
+
+ private:
+  struct OpenBlock {
+    std::chrono::nanoseconds start;
+    const char* name;
+    uint64_t traceId;
+    uint64_t parentBlockId;
+    uint32_t lane;
+  };
+
+  struct Trace {
+    uint32_t pid;
+    // Stacks of open blocks, one per lane, innermost last.
+    std::vector<std::vector<uint64_t>> lanes;
+  };
+
+  // Appends a timestamp, relative to base_, as the trace format expects.
+  void appendTimestamp(std::chrono::nanoseconds timestamp);
+
+  void startBlock(const CompactTracePoint& point);
+  void stopBlock(const CompactTracePoint& point);
+  void writeInstant(const CompactTracePoint& point);
+  void writeComplete(
+      uint64_t blockId,
+      const OpenBlock& block,
+      std::chrono::nanoseconds end,
+      bool finished);
+
+  Trace& traceFor(uint64_t traceId);
+  void closeBlock(uint64_t blockId, const OpenBlock& block);
+
+  // Begins a new event in line_, after the separator from the previous one.
+  void beginEvent();
+  // Writes line_ to out_.
+  void endEvent();
+
+  std::ostream& out_;
+  // Reused for formatting each event.
+  std::string line_;
+  bool started_ = false;
+  bool finished_ = false;
+
+  folly::F14FastMap<uint64_t, OpenBlock> openBlocks_;
+  // Every trace seen so far, kept for the exporter's lifetime so that a trace
+  // keeps its pid and lanes even after all its blocks have stopped.
+  folly::F14FastMap<uint64_t, Trace> traces_;
+  uint32_t nextPid_ = 1;
+  // The first timestamp added, which all event timestamps are relative to.
+  std::optional<std::chrono::nanoseconds> base_;
+  std::chrono::nanoseconds lastTimestamp_{0};
+  size_t orphanedStops_ = 0;
+  size_t repeatedStarts_ = 0;
+};
+
+} // namespace facebook::eden
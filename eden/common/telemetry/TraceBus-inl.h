@@ -7,31 +7,52 @@
 
 #include <folly/logging/xlog.h>
 #include <folly/system/ThreadName.h>
+#include <algorithm>
+#include <bit>
 
 namespace facebook::eden {
 
 template <typename TraceEvent>
 std::shared_ptr<TraceBus<TraceEvent>> TraceBus<TraceEvent>::create(
     std::string name,
-    size_t bufferCapacity) {
+    size_t bufferCapacity,
+    TraceBusOptions options) {
   return std::make_shared<TraceBus<TraceEvent>>(
-      PrivateConstructorTag{}, std::move(name), bufferCapacity);
+      PrivateConstructorTag{}, std::move(name), bufferCapacity, options);
 }
 
 template <typename TraceEvent>
 TraceBus<TraceEvent>::TraceBus(
     PrivateConstructorTag,
     std::string name,
-    size_t bufferCapacity)
-    : name_{std::move(name)}, bufferCapacity_{bufferCapacity} {
+    size_t bufferCapacity,
+    TraceBusOptions options)
+    : name_{std::move(name)},
+      bufferCapacity_{bufferCapacity},
+      options_{options} {
   XCHECK_GT(bufferCapacity_, 0u) << "Buffer capacity must not be zero";
 
-  state_.unsafeGetUnlocked().writeBuffer.reserve(bufferCapacity_);
-
   // Allocate the backbuffer here rather than in the thread so std::bad_alloc
   // can be caught.
   std::vector<TraceEvent> readBuffer;
-  readBuffer.reserve(bufferCapacity);
+  if (options_.backend == TraceBusBackend::ShardedRings) {
+    size_t shards = options_.shards;
+    if (shards == 0) {
+      shards = std::max(1u, std::thread::hardware_concurrency());
+    }
+    shards = std::bit_ceil(shards);
+    // The ring algorithm needs at least two cells to tell full from empty.
+    size_t shardCapacity = std::bit_ceil(
+        std::max<size_t>(2, (bufferCapacity_ + shards - 1) / shards));
+    rings_.reserve(shards);
+    for (size_t i = 0; i < shards; ++i) {
+      rings_.push_back(std::make_unique<Ring>(shardCapacity));
+    }
+    readBuffer.reserve(shards * shardCapacity);
+  } else {
+    state_.unsafeGetUnlocked().writeBuffer.reserve(bufferCapacity_);
+    readBuffer.reserve(bufferCapacity);
+  }
 
   std::string threadName = "tracebus-" + name_;
 
@@ -49,6 +70,13 @@ TraceBus<TraceEvent>::~TraceBus() {
   emptyCV_.notify_one();
   thread_.join();
 
+  // The background thread has finished delivering, but lanes on the dispatch
+  // executor may still be observing.
+  {
+    auto running = runningLanes_.lock();
+    lanesIdleCV_.wait(running.as_lock(), [&] { return *running == 0; });
+  }
+
   auto& state = state_.unsafeGetUnlocked();
   auto* p = state.subscriptions;
   while (p) {
@@ -63,18 +91,41 @@ template <typename... Args>
 void TraceBus<TraceEvent>::publish(Args&&... args) noexcept {
   static_assert(std::is_nothrow_constructible_v<TraceEvent, Args&&...>);
 
+  if (!rings_.empty()) {
+    auto index = detail::traceBusProducerIndex() & (rings_.size() - 1);
+    publishToRing(*rings_[index], std::forward<Args>(args)...);
+    return;
+  }
+
   bool wake;
   {
     auto state = state_.lock();
     XCHECK(!state->done) << "Illegal to publish concurrently with destruction";
     if (state->writeBuffer.size() == bufferCapacity_) {
       // If the buffer is full then the capacity is potentially set too low. Log
-      // an appropriate warning and then block until we have room to append the
-      // current event.
+      // an appropriate warning and then make room according to the policy.
       logFullOnce();
-      fullCV_.wait(state.as_lock(), [&] {
-        return state->writeBuffer.size() < bufferCapacity_;
-      });
+      switch (options_.fullPolicy) {
+        case TraceBusFullPolicy::Block:
+          fullCV_.wait(state.as_lock(), [&] {
+            return state->writeBuffer.size() < bufferCapacity_;
+          });
+          break;
+        case TraceBusFullPolicy::DropNewest:
+          dropped_.fetch_add(1, std::memory_order_relaxed);
+          return;
+        case TraceBusFullPolicy::DropOldest: {
+          // Overwrite in place rather than erasing from the front, which would
+          // be linear. threadLoop rotates the batch back into order.
+          auto* oldest = &state->writeBuffer[state->oldest];
+          std::destroy_at(oldest);
+          std::construct_at(oldest, std::forward<Args>(args)...);
+          state->oldest = (state->oldest + 1) % bufferCapacity_;
+          state->sequenceNumber++;
+          dropped_.fetch_add(1, std::memory_order_relaxed);
+          return;
+        }
+      }
     }
     wake = state->writeBuffer.empty();
     state->writeBuffer.emplace_back(std::forward<Args>(args)...);
@@ -85,15 +136,66 @@ void TraceBus<TraceEvent>::publish(Args&&... args) noexcept {
   }
 }
 
+template <typename TraceEvent>
+template <typename... Args>
+void TraceBus<TraceEvent>::publishToRing(Ring& ring, Args&&... args) noexcept {
+  // tryPush only consumes args when it succeeds, so they may be forwarded
+  // again after a failure.
+  if (!ring.tryPush(std::forward<Args>(args)...)) {
+    logFullOnce();
+    switch (options_.fullPolicy) {
+      case TraceBusFullPolicy::Block:
+        blockedPublishers_.fetch_add(1, std::memory_order_relaxed);
+        // Pairs with the fence in threadLoop: either it sees this publisher
+        // waiting, or the push below sees the room it made.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        {
+          auto state = state_.lock();
+          fullCV_.wait(state.as_lock(), [&] {
+            return ring.tryPush(std::forward<Args>(args)...);
+          });
+        }
+        blockedPublishers_.fetch_sub(1, std::memory_order_relaxed);
+        break;
+      case TraceBusFullPolicy::DropNewest:
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+      case TraceBusFullPolicy::DropOldest:
+        do {
+          if (ring.tryPop([](TraceEvent&&) noexcept {})) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+          }
+        } while (!ring.tryPush(std::forward<Args>(args)...));
+        break;
+    }
+  }
+
+  // Pairs with the fence in threadLoop: either it sees this event before
+  // sleeping, or this sees it sleeping. Only one publisher takes the lock to
+  // wake it.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (consumerSleeping_.load(std::memory_order_relaxed) &&
+      consumerSleeping_.exchange(false, std::memory_order_relaxed)) {
+    state_.lock()->wake = true;
+    emptyCV_.notify_one();
+  }
+}
+
 template <typename TraceEvent>
 TraceSubscriptionHandle<TraceEvent> TraceBus<TraceEvent>::subscribe(
-    std::shared_ptr<Subscriber> subscriber) {
-  auto* sub = new Subscription{std::move(subscriber)};
+    std::shared_ptr<Subscriber> subscriber,
+    TraceSubscriptionOptions<TraceEvent> options) {
+  auto kinds = options.kinds;
+  auto* sub = new Subscription{std::make_shared<Lane>(
+      std::move(subscriber),
+      std::move(options),
+      delivered_.load(std::memory_order_acquire))};
   // noexcept:
   auto state = state_.lock();
   sub->next = state->subscriptions;
   state->subscriptions = sub;
   hasSubscription_.store(true, std::memory_order_release);
+  subscribedKinds_.fetch_or(kinds, std::memory_order_release);
 
   return SubscriptionHandle{sub, this->weak_from_this()};
 }
@@ -104,7 +206,8 @@ void TraceBus<TraceEvent>::unsubscribe(void* subscription) noexcept {
 
   auto state = state_.lock();
   // Signal to threadLoop that `sub` should be deleted.
-  sub->unsubscribe = state->sequenceNumber;
+  sub->unsubscribe =
+      rings_.empty() ? state->sequenceNumber : ringsPushed() + 1;
 
   // At this point, the memory referenced by `sub` must not be accessed as it
   // may be deleted at any moment.
@@ -113,19 +216,24 @@ void TraceBus<TraceEvent>::unsubscribe(void* subscription) noexcept {
 template <typename TraceEvent>
 void TraceBus<TraceEvent>::logFullOnce() noexcept {
   folly::call_once(logIfFullFlag_, [&]() noexcept {
+    const char* action = options_.fullPolicy == TraceBusFullPolicy::Block
+        ? "blocking"
+        : "dropping";
     try {
       XLOGF(
           WARN,
-          "TraceBus({}) is full; blocking. Is capacity {} sufficient?",
+          "TraceBus({}) is full; {}. Is capacity {} sufficient?",
           name_,
+          action,
           bufferCapacity_);
     } catch (std::exception& e) {
       fprintf(
           stderr,
-          "TraceBus(%s) is full; blocking. Is capacity %" PRIu64
+          "TraceBus(%s) is full; %s. Is capacity %" PRIu64
           "sufficient?\n"
           "Logging failed with %s\n",
           name_.c_str(),
+          action,
           uint64_t{bufferCapacity_},
           e.what());
       fflush(stderr);
@@ -133,18 +241,68 @@ void TraceBus<TraceEvent>::logFullOnce() noexcept {
   });
 }
 
+template <typename TraceEvent>
+void TraceBus<TraceEvent>::drainRings(
+    std::vector<TraceEvent>& readBuffer) noexcept {
+  static_assert(std::is_nothrow_move_constructible_v<TraceEvent>);
+  // readBuffer has room for every ring to be full, so this never allocates.
+  for (auto& ring : rings_) {
+    for (size_t i = 0; i < ring->capacity(); ++i) {
+      if (!ring->tryPop([&](TraceEvent&& event) noexcept {
+            readBuffer.push_back(std::move(event));
+          })) {
+        break;
+      }
+    }
+  }
+}
+
+template <typename TraceEvent>
+bool TraceBus<TraceEvent>::ringsEmpty() const noexcept {
+  return std::all_of(rings_.begin(), rings_.end(), [](const auto& ring) {
+    return ring->pushed() == ring->popped();
+  });
+}
+
+template <typename TraceEvent>
+uint64_t TraceBus<TraceEvent>::ringsPushed() const noexcept {
+  uint64_t total = 0;
+  for (auto& ring : rings_) {
+    total += ring->pushed();
+  }
+  return total;
+}
+
+template <typename TraceEvent>
+uint64_t TraceBus<TraceEvent>::ringsPopped() const noexcept {
+  uint64_t total = 0;
+  for (auto& ring : rings_) {
+    total += ring->popped();
+  }
+  return total;
+}
+
 template <typename TraceEvent>
 void TraceBus<TraceEvent>::threadLoop(
     std::vector<TraceEvent>& readBuffer) noexcept {
-  // This function does no allocation and throws no exceptions.
+  // This function throws no exceptions, and does no allocation except to hand
+  // batches to a dispatch executor.
 
+  const bool sharded = !rings_.empty();
   bool done = false;
   uint64_t lastObservedSequenceNumber = 0;
-  while (!done) {
+  while (!done || (sharded && !ringsEmpty())) {
     XCHECK(readBuffer.empty())
         << "Avoid waiting while holding references to things";
 
+    if (sharded) {
+      consumerSleeping_.store(true, std::memory_order_relaxed);
+      // Pairs with the fence in publishToRing.
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
     Subscription* head;
+    size_t oldest;
     {
       auto state = state_.lock();
 
@@ -178,49 +336,338 @@ void TraceBus<TraceEvent>::threadLoop(
       // of events published after unsubscription.
       //
       // This probably isn't important.
-      lastObservedSequenceNumber = state->sequenceNumber;
+      if (!sharded) {
+        lastObservedSequenceNumber = state->sequenceNumber;
+      }
 
       if (state->subscriptions == nullptr) {
         hasSubscription_.store(false, std::memory_order_release);
       }
+      // Lanes whose subscriber threw observe nothing more, so publishers
+      // needn't build events for them.
+      uint64_t kinds = 0;
+      for (auto* sub = state->subscriptions; sub; sub = sub->next) {
+        if (!sub->lane->hasThrownException.load(std::memory_order_relaxed)) {
+          kinds |= sub->lane->options.kinds;
+        }
+      }
+      subscribedKinds_.store(kinds, std::memory_order_release);
 
       // If no events are buffered, sleep until events are delivered or we are
       // signaled to terminate.
-      emptyCV_.wait(state.as_lock(), [&] {
-        return state->done || !state->writeBuffer.empty();
-      });
-      std::swap(state->writeBuffer, readBuffer);
+      if (sharded) {
+        emptyCV_.wait(state.as_lock(), [&] {
+          return state->done || state->wake || !ringsEmpty();
+        });
+        state->wake = false;
+        consumerSleeping_.store(false, std::memory_order_relaxed);
+      } else {
+        emptyCV_.wait(state.as_lock(), [&] {
+          return state->done || !state->writeBuffer.empty();
+        });
+        std::swap(state->writeBuffer, readBuffer);
+      }
+      oldest = std::exchange(state->oldest, 0);
       done = state->done;
 
       head = state->subscriptions;
     }
 
-    // If the publish buffer filled, it's possible a publisher is waiting for
-    // space, so wake them.
-    if (readBuffer.size() == bufferCapacity_) {
+    if (sharded) {
+      drainRings(readBuffer);
+      // Every event counted here has been drained, by this thread or by a
+      // DropOldest publisher.
+      lastObservedSequenceNumber = ringsPopped() + 1;
+
+      // Pairs with the fence in publishToRing.
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (blockedPublishers_.load(std::memory_order_relaxed) > 0) {
+        // Taking the lock ensures a blocked publisher is either waiting or
+        // has yet to retry its push.
+        {
+          auto state = state_.lock();
+        }
+        fullCV_.notify_all();
+      }
+      if (readBuffer.empty()) {
+        continue;
+      }
+    } else if (readBuffer.size() == bufferCapacity_) {
+      // If the publish buffer filled, it's possible a publisher is waiting
+      // for space, so wake them.
       fullCV_.notify_all();
     }
 
+    // Published before the batch is handed over, so lanes never observe past
+    // it.
+    uint64_t end =
+        delivered_.load(std::memory_order_relaxed) + readBuffer.size();
+    delivered_.store(end, std::memory_order_release);
+
+    if (options_.dispatchExecutor && !readBuffer.empty() &&
+        dispatchToLanes(head, readBuffer, oldest, end)) {
+      continue;
+    }
+
     for (auto* sub = head; sub; sub = sub->next) {
-      if (sub->hasThrownException) {
-        continue;
+      auto& lane = *sub->lane;
+      if (options_.dispatchExecutor) {
+        // The batch could not be queued. Observing it here is only safe if
+        // the lane has nothing queued or running, since it would otherwise
+        // race with its task and overtake earlier batches. Only this thread
+        // schedules lanes, so an idle lane stays idle while we observe.
+        std::lock_guard lock{lane.mutex};
+        if (lane.scheduled || !lane.backlog.empty()) {
+          lane.skippedEvents.fetch_add(
+              readBuffer.size(), std::memory_order_relaxed);
+          continue;
+        }
       }
       const TraceEvent* begin = readBuffer.data();
-      const TraceEvent* end = begin + readBuffer.size();
-      try {
-        sub->subscriber->observeBatch(begin, end);
-      } catch (const std::exception& e) {
-        sub->hasThrownException = true;
-        XLOGF(
-            ERR,
-            "Subscription: {} threw {}, unsubscribing.",
-            sub->subscriber->name(),
-            e.what());
+      if (oldest == 0) {
+        observeSelected(lane, begin, begin + readBuffer.size());
+      } else {
+        // With DropOldest, the buffer wrapped around at `oldest`.
+        observeSelected(lane, begin + oldest, begin + readBuffer.size());
+        observeSelected(lane, begin, begin + oldest);
       }
+      lane.observed.store(end, std::memory_order_release);
     }
 
     readBuffer.clear();
   }
 }
 
+template <typename TraceEvent>
+void TraceBus<TraceEvent>::observe(
+    Lane& lane,
+    const TraceEvent* begin,
+    const TraceEvent* end) noexcept {
+  if (lane.hasThrownException.load(std::memory_order_relaxed)) {
+    return;
+  }
+  try {
+    lane.subscriber->observeBatch(begin, end);
+  } catch (const std::exception& e) {
+    lane.hasThrownException.store(true, std::memory_order_relaxed);
+    XLOGF(
+        ERR,
+        "Subscription: {} threw {}, unsubscribing.",
+        lane.subscriber->name(),
+        e.what());
+  }
+}
+
+template <typename TraceEvent>
+template <typename Fn>
+void TraceBus<TraceEvent>::forEachSelectedRun(
+    Lane& lane,
+    const TraceEvent* begin,
+    const TraceEvent* end,
+    Fn&& fn) noexcept {
+  if (!lane.selective()) {
+    fn(begin, end);
+    return;
+  }
+  if (lane.hasThrownException.load(std::memory_order_relaxed)) {
+    return;
+  }
+
+  const auto& options = lane.options;
+  try {
+    const TraceEvent* run = nullptr;
+    for (const auto* p = begin; p != end; ++p) {
+      bool selected = (!options.filter || options.filter(*p)) &&
+          (options.sampleEvery <= 1 ||
+           lane.filtered++ % options.sampleEvery == 0);
+      if (selected && !run) {
+        run = p;
+      } else if (!selected && run) {
+        fn(run, p);
+        run = nullptr;
+      }
+    }
+    if (run) {
+      fn(run, end);
+    }
+  } catch (const std::exception& e) {
+    lane.hasThrownException.store(true, std::memory_order_relaxed);
+    XLOGF(
+        ERR,
+        "Subscription: {} filter threw {}, unsubscribing.",
+        lane.subscriber->name(),
+        e.what());
+  }
+}
+
+template <typename TraceEvent>
+void TraceBus<TraceEvent>::observeSelected(
+    Lane& lane,
+    const TraceEvent* begin,
+    const TraceEvent* end) noexcept {
+  forEachSelectedRun(
+      lane, begin, end, [&](const TraceEvent* first, const TraceEvent* last) {
+        observe(lane, first, last);
+      });
+}
+
+template <typename TraceEvent>
+bool TraceBus<TraceEvent>::dispatchToLanes(
+    Subscription* head,
+    std::vector<TraceEvent>& batch,
+    size_t oldest,
+    uint64_t end) noexcept {
+  // Lanes observe at their own pace, so the batch needs its own storage
+  // rather than readBuffer, which is reused as soon as this returns.
+  std::shared_ptr<std::vector<TraceEvent>> events;
+  try {
+    events = std::make_shared<std::vector<TraceEvent>>();
+    events->reserve(batch.size());
+  } catch (const std::bad_alloc&) {
+    return false;
+  }
+  auto rotated = batch.begin() + oldest;
+  events->insert(
+      events->end(),
+      std::make_move_iterator(rotated),
+      std::make_move_iterator(batch.end()));
+  events->insert(
+      events->end(),
+      std::make_move_iterator(batch.begin()),
+      std::make_move_iterator(rotated));
+  batch.clear();
+
+  for (auto* sub = head; sub; sub = sub->next) {
+    auto lane = sub->lane;
+    // A lane whose subscriber threw observes nothing more, but still records
+    // its progress, in order with any batches queued before it threw, so
+    // that it shows no lag.
+    bool thrown = lane->hasThrownException.load(std::memory_order_relaxed);
+
+    // Select on this thread, so lanes only see what they asked for.
+    std::shared_ptr<std::vector<Run>> runs;
+    if (lane->selective() && !thrown) {
+      try {
+        runs = std::make_shared<std::vector<Run>>();
+        // Selected runs are separated by at least one event.
+        runs->reserve(events->size() / 2 + 1);
+      } catch (const std::bad_alloc&) {
+        lane->skippedEvents.fetch_add(
+            events->size(), std::memory_order_relaxed);
+        continue;
+      }
+      const TraceEvent* data = events->data();
+      forEachSelectedRun(
+          *lane,
+          data,
+          data + events->size(),
+          [&](const TraceEvent* first, const TraceEvent* last) {
+            runs->emplace_back(first - data, last - data);
+          });
+    }
+
+    bool schedule;
+    {
+      std::lock_guard lock{lane->mutex};
+      if ((thrown || (runs && runs->empty())) && !lane->scheduled) {
+        // Nothing to observe, and nothing queued ahead of it.
+        lane->observed.store(end, std::memory_order_release);
+        continue;
+      }
+      if (lane->backlog.size() >= options_.maxLaneBacklog) {
+        if (!thrown) {
+          lane->skippedEvents.fetch_add(
+              events->size(), std::memory_order_relaxed);
+        }
+        continue;
+      }
+      try {
+        lane->backlog.push_back(Batch{events, std::move(runs), end});
+      } catch (const std::bad_alloc&) {
+        lane->skippedEvents.fetch_add(
+            events->size(), std::memory_order_relaxed);
+        continue;
+      }
+      schedule = !std::exchange(lane->scheduled, true);
+    }
+    if (!schedule) {
+      continue;
+    }
+
+    ++*runningLanes_.lock();
+    try {
+      options_.dispatchExecutor->add([this, lane] { runLane(*lane); });
+    } catch (const std::exception& e) {
+      XLOGF(
+          ERR,
+          "TraceBus({}) could not schedule {}: {}. Observing inline.",
+          name_,
+          lane->subscriber->name(),
+          e.what());
+      runLane(*lane);
+    }
+  }
+  return true;
+}
+
+template <typename TraceEvent>
+void TraceBus<TraceEvent>::runLane(Lane& lane) noexcept {
+  for (;;) {
+    Batch batch;
+    {
+      std::lock_guard lock{lane.mutex};
+      if (lane.backlog.empty()) {
+        lane.scheduled = false;
+        break;
+      }
+      batch = std::move(lane.backlog.front());
+      lane.backlog.pop_front();
+    }
+    const auto* events = batch.events->data();
+    if (batch.runs) {
+      for (auto [first, last] : *batch.runs) {
+        observe(lane, events + first, events + last);
+      }
+    } else {
+      observe(lane, events, events + batch.events->size());
+    }
+    lane.observed.store(batch.end, std::memory_order_release);
+  }
+
+  // Notify while holding the lock: once it is released, the destructor may
+  // free this TraceBus.
+  auto running = runningLanes_.lock();
+  if (--*running == 0) {
+    lanesIdleCV_.notify_all();
+  }
+}
+
+template <typename TraceEvent>
+std::vector<TraceSubscriberLag> TraceBus<TraceEvent>::getSubscriberLag() {
+  std::vector<TraceSubscriberLag> result;
+  auto state = state_.lock();
+  for (auto* sub = state->subscriptions; sub; sub = sub->next) {
+    if (sub->unsubscribe) {
+      continue;
+    }
+    auto& lane = *sub->lane;
+    // Observed is loaded first, so it can't be ahead of delivered_.
+    auto observed = lane.observed.load(std::memory_order_acquire);
+    result.push_back(TraceSubscriberLag{
+        lane.subscriber->name(),
+        delivered_.load(std::memory_order_acquire) - observed,
+        lane.skippedEvents.load(std::memory_order_relaxed)});
+  }
+  return result;
+}
+
+template <typename TraceEvent>
+uint64_t TraceBus<TraceEvent>::getMaxSubscriberLag() {
+  uint64_t maxLag = 0;
+  for (auto& lag : getSubscriberLag()) {
+    maxLag = std::max(maxLag, lag.events);
+  }
+  return maxLag;
+}
+
 } // namespace facebook::eden
@@ -7,13 +7,21 @@
 
 #pragma once
 
+#include <folly/Executor.h>
 #include <folly/Synchronized.h>
+#include <folly/lang/Align.h>
 #include <folly/synchronization/CallOnce.h>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <cstdint>
+#include <deque>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <thread>
 #include <utility>
+#include <vector>
 
 namespace facebook::eden {
 
@@ -31,6 +39,232 @@ struct TraceEventBase {
 template <typename TraceEvent>
 class TraceBus;
 
+/**
+ * What publish() does when the buffer is full.
+ */
+enum class TraceBusFullPolicy {
+  /** Wait for the background thread to make room. Loses nothing. */
+  Block,
+  /** Discard the event being published. */
+  DropNewest,
+  /** Discard the oldest buffered event to make room. */
+  DropOldest,
+};
+
+/**
+ * How published events are buffered until the background thread takes them.
+ */
+enum class TraceBusBackend {
+  /**
+   * A single buffer behind a mutex. Events from all publishers are observed
+   * in the order they were published.
+   */
+  Locked,
+  /**
+   * Lock-free rings, one per shard, with each publishing thread always using
+   * the same shard. Publishers on different shards never contend, at the cost
+   * of global ordering: events are only observed in publish order relative to
+   * other events from the same thread.
+   */
+  ShardedRings,
+};
+
+struct TraceBusOptions {
+  TraceBusFullPolicy fullPolicy = TraceBusFullPolicy::Block;
+  TraceBusBackend backend = TraceBusBackend::Locked;
+  /**
+   * Number of rings for TraceBusBackend::ShardedRings, rounded up to a power
+   * of two. Zero picks one per hardware thread. bufferCapacity is split among
+   * them.
+   */
+  size_t shards = 0;
+  /**
+   * If set, subscribers observe batches on this executor rather than on the
+   * TraceBus's background thread. Each subscriber gets its own lane, which
+   * observes batches in order and never concurrently, so a slow subscriber
+   * only falls behind by itself instead of holding up the others.
+   *
+   * The TraceBus destructor waits for the lanes to finish, so it must not run
+   * on this executor unless the executor has other threads free.
+   */
+  folly::Executor::KeepAlive<> dispatchExecutor;
+  /**
+   * Batches a lane may have waiting before further batches are skipped for
+   * that subscriber. Bounds the memory a stuck subscriber can hold.
+   */
+  size_t maxLaneBacklog = 64;
+};
+
+/**
+ * Narrows which events a subscription observes. The TraceBus applies these on
+ * its background thread, once per batch, and only hands the subscriber the
+ * selected events.
+ */
+template <typename TraceEvent>
+struct TraceSubscriptionOptions {
+  /**
+   * If set, only events for which this returns true are observed. Called on
+   * the background thread, so it should be cheap. If it throws, the
+   * subscription is unsubscribed, as if the subscriber had thrown.
+   */
+  std::function<bool(const TraceEvent&)> filter;
+  /**
+   * Observe only every Nth event that passes the filter. 0 and 1 observe all
+   * of them.
+   */
+  uint32_t sampleEvery = 1;
+  /**
+   * Event kinds this subscription is interested in, one bit per kind, for
+   * TraceBus::hasSubscription(kind). What a kind is, and how it is numbered,
+   * is up to the TraceEvent type. This only informs publishers; use filter to
+   * actually exclude events of other kinds.
+   */
+  uint64_t kinds = ~uint64_t{0};
+};
+
+/**
+ * How far a subscriber has fallen behind, from TraceBus::getSubscriberLag().
+ */
+struct TraceSubscriberLag {
+  std::string name;
+  /**
+   * Events delivered by the TraceBus that the subscriber has yet to finish
+   * observing.
+   */
+  uint64_t events = 0;
+  /**
+   * Events never delivered to the subscriber because its lane's backlog was
+   * full, or memory ran out while queueing them.
+   */
+  uint64_t skippedEvents = 0;
+};
+
+namespace detail {
+
+/**
+ * A small number unique to the calling thread, for spreading publishers
+ * across shards.
+ */
+inline size_t traceBusProducerIndex() noexcept {
+  static std::atomic<size_t> next{0};
+  thread_local size_t index = next.fetch_add(1, std::memory_order_relaxed);
+  return index;
+}
+
+/**
+ * Bounded lock-free queue (Vyukov's array-based design) that any thread may
+ * push to or pop from. Each cell carries a sequence number saying whether it
+ * is ready to be written or read on the current lap.
+ */
+template <typename T>
+class TraceRing {
+ public:
+  /**
+   * capacity must be a power of two.
+   */
+  explicit TraceRing(size_t capacity)
+      : cells_{std::make_unique<Cell[]>(capacity)}, mask_{capacity - 1} {
+    for (size_t i = 0; i < capacity; ++i) {
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  ~TraceRing() {
+    while (tryPop([](T&&) noexcept {})) {
+    }
+  }
+
+  TraceRing(const TraceRing&) = delete;
+  TraceRing& operator=(const TraceRing&) = delete;
+
+  size_t capacity() const noexcept {
+    return mask_ + 1;
+  }
+
+  /**
+   * Constructs a T from args in the next free cell. Returns false, leaving
+   * args untouched, if the ring is full.
+   */
+  template <typename... Args>
+  bool tryPush(Args&&... args) noexcept {
+    uint64_t pos = enqueuePos_.load(std::memory_order_relaxed);
+    Cell* cell;
+    for (;;) {
+      cell = &cells_[pos & mask_];
+      auto seq = cell->sequence.load(std::memory_order_acquire);
+      auto diff = static_cast<int64_t>(seq - pos);
+      if (diff == 0) {
+        if (enqueuePos_.compare_exchange_weak(
+                pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = enqueuePos_.load(std::memory_order_relaxed);
+      }
+    }
+    new (cell->storage) T(std::forward<Args>(args)...);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * Passes the oldest event to consume as an rvalue and destroys it. Returns
+   * false if the ring is empty, or if its oldest cell is still being written.
+   */
+  template <typename Fn>
+  bool tryPop(Fn&& consume) noexcept {
+    uint64_t pos = dequeuePos_.load(std::memory_order_relaxed);
+    Cell* cell;
+    for (;;) {
+      cell = &cells_[pos & mask_];
+      auto seq = cell->sequence.load(std::memory_order_acquire);
+      auto diff = static_cast<int64_t>(seq - (pos + 1));
+      if (diff == 0) {
+        if (dequeuePos_.compare_exchange_weak(
+                pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = dequeuePos_.load(std::memory_order_relaxed);
+      }
+    }
+    auto* event = std::launder(reinterpret_cast<T*>(cell->storage));
+    consume(std::move(*event));
+    event->~T();
+    cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+    return true;
+  }
+
+  /** Events ever pushed. */
+  uint64_t pushed() const noexcept {
+    return enqueuePos_.load(std::memory_order_relaxed);
+  }
+
+  /** Events ever popped. */
+  uint64_t popped() const noexcept {
+    return dequeuePos_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  struct Cell {
+    std::atomic<uint64_t> sequence;
+    alignas(T) unsigned char storage[sizeof(T)];
+  };
+
+  const std::unique_ptr<Cell[]> cells_;
+  const size_t mask_;
+  alignas(folly::hardware_destructive_interference_size)
+      std::atomic<uint64_t> enqueuePos_{0};
+  alignas(folly::hardware_destructive_interference_size)
+      std::atomic<uint64_t> dequeuePos_{0};
+};
+
+} // namespace detail
+
 /**
  * Base class for subscribers.
  */
@@ -52,7 +286,8 @@ class TraceEventSubscriber {
    * Called on the TraceBus's background thread with a batch of published
    * events. Avoid blocking operations or operations that require heavy CPU
    * usage, as there is only one background thread per TraceBus, and it can back
-   * up.
+   * up. With TraceBusOptions::dispatchExecutor, this is instead called on the
+   * executor, and only delays this subscriber.
    */
   virtual void observeBatch(const TraceEvent* begin, const TraceEvent* end) = 0;
 
@@ -156,6 +391,10 @@ class TraceSubscriptionHandle {
  *
  * Ideally, capacity would be dynamically determined with algorithms similar to
  * network protocols, but a small fixed-size buffer should be sufficient.
+ *
+ * TraceBusOptions trades that reliability for publisher latency where needed:
+ * a full buffer can drop events instead of blocking, and the sharded backend
+ * removes the lock publishers otherwise share.
  */
 template <typename TraceEvent>
 class TraceBus : public std::enable_shared_from_this<TraceBus<TraceEvent>> {
@@ -174,7 +413,8 @@ class TraceBus : public std::enable_shared_from_this<TraceBus<TraceEvent>> {
    */
   static std::shared_ptr<TraceBus> create(
       std::string name,
-      size_t bufferCapacity);
+      size_t bufferCapacity,
+      TraceBusOptions options = {});
 
   /**
    * Use `create` instead. TraceBus must be managed by shared_ptr.
@@ -182,7 +422,8 @@ class TraceBus : public std::enable_shared_from_this<TraceBus<TraceEvent>> {
   TraceBus(
       PrivateConstructorTag,
       std::string threadName,
-      size_t bufferCapacity);
+      size_t bufferCapacity,
+      TraceBusOptions options);
 
   /**
    * Blocks until all published events have been observed by all registered
@@ -199,6 +440,14 @@ class TraceBus : public std::enable_shared_from_this<TraceBus<TraceEvent>> {
   template <typename... Args>
   void publish(Args&&... event) noexcept;
 
+  /**
+   * Number of events discarded because the buffer was full. Always zero with
+   * TraceBusFullPolicy::Block.
+   */
+  uint64_t droppedCount() const noexcept {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
   /**
    * Subscribe to published events. If the subscriber throws, it will
    * automatically be unsubscribed.
@@ -217,7 +466,8 @@ class TraceBus : public std::enable_shared_from_this<TraceBus<TraceEvent>> {
    * TraceBus must be the final member of a `final` class.
    */
   [[nodiscard]] SubscriptionHandle subscribe(
-      std::shared_ptr<Subscriber> subscriber);
+      std::shared_ptr<Subscriber> subscriber,
+      TraceSubscriptionOptions<TraceEvent> options = {});
 
   /**
    * Convenient `subscribe` wrapper that registers a function object.
@@ -225,10 +475,12 @@ class TraceBus : public std::enable_shared_from_this<TraceBus<TraceEvent>> {
   template <typename Fn>
   [[nodiscard]] SubscriptionHandle subscribeFunction(
       std::string name,
-      Fn&& fn) {
+      Fn&& fn,
+      TraceSubscriptionOptions<TraceEvent> options = {}) {
     return subscribe(
         std::make_shared<FnTraceEventSubscriber<Fn, TraceEvent>>(
-            std::move(name), std::forward<Fn>(fn)));
+            std::move(name), std::forward<Fn>(fn)),
+        std::move(options));
   }
 
   /**
@@ -242,6 +494,31 @@ class TraceBus : public std::enable_shared_from_this<TraceBus<TraceEvent>> {
     return hasSubscription_.load(std::memory_order_acquire);
   }
 
+  /**
+   * Like hasSubscription(), but only counts subscriptions interested in the
+   * given kind of event (see TraceSubscriptionOptions::kinds), so publishers
+   * can skip building events nobody wants. Subscriptions whose subscriber
+   * threw stop counting once the background thread notices. kind must be
+   * less than 64.
+   */
+  bool hasSubscription(size_t kind) const {
+    return subscribedKinds_.load(std::memory_order_acquire) &
+        (uint64_t{1} << kind);
+  }
+
+  /**
+   * Per-subscriber lag: how many delivered events each subscriber has yet to
+   * observe, measured in sequence numbers of delivered events. Only nonzero
+   * while a batch is being observed, unless subscribers run on a
+   * dispatchExecutor.
+   */
+  std::vector<TraceSubscriberLag> getSubscriberLag();
+
+  /**
+   * The largest lag in getSubscriberLag(), for exporting as a counter.
+   */
+  uint64_t getMaxSubscriberLag();
+
   TraceBus(TraceBus&&) = delete;
   TraceBus(const TraceBus&) = delete;
   TraceBus& operator=(TraceBus&&) = delete;
@@ -258,13 +535,112 @@ class TraceBus : public std::enable_shared_from_this<TraceBus<TraceEvent>> {
 
   void logFullOnce() noexcept;
 
+  using Ring = detail::TraceRing<TraceEvent>;
+
+  template <typename... Args>
+  void publishToRing(Ring& ring, Args&&... args) noexcept;
+
+  // Moves events from the rings into readBuffer, up to its capacity.
+  void drainRings(std::vector<TraceEvent>& readBuffer) noexcept;
+
+  bool ringsEmpty() const noexcept;
+
+  // Sums of Ring::pushed() and Ring::popped(), which stand in for the
+  // sequence numbers of the locked backend.
+  uint64_t ringsPushed() const noexcept;
+  uint64_t ringsPopped() const noexcept;
+
   void threadLoop(std::vector<TraceEvent>& readbuffer) noexcept;
 
-  struct Subscription {
+  struct Subscription;
+
+  // Offsets of a contiguous range of selected events within a batch.
+  using Run = std::pair<size_t, size_t>;
+
+  struct Batch {
+    std::shared_ptr<const std::vector<TraceEvent>> events;
+    // The runs of events the lane selected, or null for all of them.
+    std::shared_ptr<const std::vector<Run>> runs;
+    // Sequence number following the batch's last event.
+    uint64_t end = 0;
+  };
+
+  // Where a subscriber observes batches. Without a dispatch executor, the
+  // background thread observes on each lane directly. Otherwise, batches wait
+  // in the backlog until a task on the executor observes them. Tasks hold a
+  // reference, so a lane can outlive its Subscription.
+  struct Lane {
+    Lane(
+        std::shared_ptr<Subscriber> subscriber,
+        TraceSubscriptionOptions<TraceEvent> options,
+        uint64_t observed)
+        : subscriber{std::move(subscriber)},
+          options{std::move(options)},
+          observed{observed} {}
+
+    // Whether only some events are observed.
+    bool selective() const noexcept {
+      return options.filter || options.sampleEvery > 1;
+    }
+
     const std::shared_ptr<Subscriber> subscriber;
+    const TraceSubscriptionOptions<TraceEvent> options;
+
+    // Accessed only on the background thread. Events that passed the filter,
+    // for sampling.
+    uint64_t filtered = 0;
 
-    // Accessed only on background thread. Set if the subscriber throws.
-    bool hasThrownException = false;
+    // Set if the subscriber throws.
+    std::atomic<bool> hasThrownException{false};
+
+    // Sequence number following the last event observed, comparable with
+    // delivered_.
+    std::atomic<uint64_t> observed;
+
+    std::atomic<uint64_t> skippedEvents{0};
+
+    std::mutex mutex;
+    // Protected by mutex.
+    std::deque<Batch> backlog;
+    // Protected by mutex. Set while a task is queued or running.
+    bool scheduled = false;
+  };
+
+  void observe(
+      Lane& lane,
+      const TraceEvent* begin,
+      const TraceEvent* end) noexcept;
+
+  // Calls fn(runBegin, runEnd) for each run of consecutive events in
+  // [begin, end) that the lane's filter and sampling select.
+  template <typename Fn>
+  void forEachSelectedRun(
+      Lane& lane,
+      const TraceEvent* begin,
+      const TraceEvent* end,
+      Fn&& fn) noexcept;
+
+  // Observes the events in [begin, end) that the lane selects.
+  void observeSelected(
+      Lane& lane,
+      const TraceEvent* begin,
+      const TraceEvent* end) noexcept;
+
+  // Hands the batch to each lane's backlog, scheduling lanes as needed, and
+  // clears batch. Returns false, leaving batch untouched, if it could not be
+  // copied for the lanes; idle lanes then observe it inline, and busy ones
+  // count it as skipped.
+  bool dispatchToLanes(
+      Subscription* head,
+      std::vector<TraceEvent>& batch,
+      size_t oldest,
+      uint64_t end) noexcept;
+
+  // Runs on the dispatch executor until the lane's backlog is empty.
+  void runLane(Lane& lane) noexcept;
+
+  struct Subscription {
+    const std::shared_ptr<Lane> lane;
 
     // If nonzero, unsubscription has been requested after the corresponding
     // sequenceNumber events have been observed. Only written or read while the
@@ -283,19 +659,47 @@ class TraceBus : public std::enable_shared_from_this<TraceBus<TraceEvent>> {
     bool done = false;
     Subscription* subscriptions = nullptr;
     std::vector<TraceEvent> writeBuffer;
+    // With TraceBusFullPolicy::DropOldest, writeBuffer is used as a circular
+    // buffer once full, and this is the index of its oldest event.
+    size_t oldest = 0;
     // Incremented every publish()
     uint64_t sequenceNumber = 1;
+    // Set by ring publishers to wake the background thread.
+    bool wake = false;
   };
 
   const std::string name_;
   const size_t bufferCapacity_;
+  const TraceBusOptions options_;
 
   folly::Synchronized<State, std::mutex> state_;
   std::atomic_bool hasSubscription_{false};
-  // Encodes the condition done || !writeBuffer.empty()
+  // Union of the kinds of the current subscriptions whose subscriber has not
+  // thrown.
+  std::atomic<uint64_t> subscribedKinds_{0};
+  std::atomic<uint64_t> dropped_{0};
+  // Encodes the condition done || !writeBuffer.empty(), or done || wake with
+  // rings.
   std::condition_variable emptyCV_;
-  // Encodes the condition writeBuffer.size() < bufferCapacity_
+  // Encodes the condition writeBuffer.size() < bufferCapacity_, or that the
+  // waiting publisher's ring has room.
   std::condition_variable fullCV_;
+
+  // Only for TraceBusBackend::ShardedRings; empty otherwise.
+  std::vector<std::unique_ptr<Ring>> rings_;
+  // Set while the background thread is about to sleep, so ring publishers
+  // know to wake it.
+  std::atomic<bool> consumerSleeping_{false};
+  // Ring publishers waiting in fullCV_.
+  std::atomic<size_t> blockedPublishers_{0};
+
+  // Events handed to subscribers so far; the sequence numbers lag is measured
+  // against. Only written by the background thread.
+  std::atomic<uint64_t> delivered_{0};
+  // Lanes with a task on the dispatch executor.
+  folly::Synchronized<size_t, std::mutex> runningLanes_{0};
+  std::condition_variable lanesIdleCV_;
+
   folly::once_flag logIfFullFlag_;
   std::thread thread_;
 
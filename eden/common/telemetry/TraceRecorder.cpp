@@ -0,0 +1,431 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "eden/common/telemetry/TraceRecorder.h"
+
+#include <folly/Exception.h>
+#include <folly/FileUtil.h>
+#include <folly/Memory.h>
+#include <folly/lang/Bits.h>
+#include <folly/logging/xlog.h>
+#include <folly/portability/Fcntl.h>
+#include <folly/portability/SysStat.h>
+#include <folly/portability/Unistd.h>
+#include <folly/system/ThreadName.h>
+#include <algorithm>
+#include <cstdio>
+
+namespace facebook::eden {
+
+namespace {
+
+constexpr char kMagic[8] = {'E', 'D', 'E', 'N', 'T', 'R', 'C', 'E'};
+constexpr uint32_t kFormatVersion = 1;
+
+// Integers in the file are little-endian.
+struct FileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t recordSize;
+};
+static_assert(sizeof(FileHeader) == 16);
+
+using RecordLength = uint32_t;
+
+// O_DIRECT requires offsets, sizes, and buffers aligned to the logical block
+// size. 4 KiB satisfies every filesystem we run on.
+constexpr size_t kBlockSize = 4096;
+
+// Buffers between the subscriber and the writer thread: one being filled,
+// the rest queued or free.
+constexpr size_t kBufferCount = 4;
+
+std::string rotatedPath(const std::string& path, size_t index) {
+  return index == 0 ? path : path + "." + std::to_string(index);
+}
+
+bool exists(const std::string& path) {
+  struct stat st;
+  return ::stat(path.c_str(), &st) == 0;
+}
+
+} // namespace
+
+void TraceLogWriter::AlignedFree::operator()(char* p) const noexcept {
+  folly::aligned_free(p);
+}
+
+TraceLogWriter::TraceLogWriter(TraceRecorderOptions options, size_t recordSize)
+    : options_{std::move(options)},
+      recordSize_{recordSize},
+      framedSize_{sizeof(RecordLength) + recordSize} {
+  XCHECK_GE(options_.maxFiles, 1u);
+  XCHECK_GE(options_.maxFileSize, sizeof(FileHeader) + framedSize_)
+      << "maxFileSize must fit at least one record";
+  XCHECK_GE(options_.bufferSize, framedSize_)
+      << "bufferSize must fit at least one record";
+
+  {
+    auto state = state_.lock();
+    state->active.reserve(options_.bufferSize);
+    for (size_t i = 1; i < kBufferCount; ++i) {
+      state->free.emplace_back().reserve(options_.bufferSize);
+    }
+  }
+
+  // Room for a full buffer plus the partial block left from the last write.
+  stagingCapacity_ =
+      (options_.bufferSize + 2 * kBlockSize - 1) / kBlockSize * kBlockSize;
+  staging_.reset(
+      static_cast<char*>(folly::aligned_malloc(stagingCapacity_, kBlockSize)));
+  if (!staging_) {
+    throw std::bad_alloc{};
+  }
+
+  openFile();
+  // Put the header on disk now, so the file is a valid, empty log before
+  // anything is appended or flushed.
+  writeTail();
+
+  writerThread_ = std::thread([this] {
+    folly::setThreadName("TraceLogWriter");
+    writerThread();
+  });
+}
+
+TraceLogWriter::~TraceLogWriter() {
+  state_.lock()->stop = true;
+  workAvailable_.notify_one();
+  writerThread_.join();
+}
+
+void TraceLogWriter::append(const void* records, size_t count) {
+  auto* record = static_cast<const char*>(records);
+  bool notify = false;
+  {
+    auto state = state_.lock();
+    XCHECK(!state->stop) << "append() called during destruction";
+    if (state->failed) {
+      dropped_.fetch_add(count, std::memory_order_relaxed);
+      return;
+    }
+    for (size_t i = 0; i < count; ++i, record += recordSize_) {
+      auto& active = state->active;
+      if (active.size() + framedSize_ > options_.bufferSize) {
+        if (state->free.empty()) {
+          // The writer is behind. Drop rather than block the TraceBus.
+          dropped_.fetch_add(count - i, std::memory_order_relaxed);
+          break;
+        }
+        state->pending.push_back(std::move(active));
+        ++state->buffersQueued;
+        active = std::move(state->free.back());
+        state->free.pop_back();
+        notify = true;
+      }
+      // Capacity was reserved up front, so this never reallocates.
+      auto length =
+          folly::Endian::little(static_cast<RecordLength>(recordSize_));
+      auto* lengthBytes = reinterpret_cast<const char*>(&length);
+      active.insert(active.end(), lengthBytes, lengthBytes + sizeof(length));
+      active.insert(active.end(), record, record + recordSize_);
+    }
+  }
+  if (notify) {
+    workAvailable_.notify_one();
+  }
+}
+
+void TraceLogWriter::flush() {
+  auto state = state_.lock();
+  // Only what has been appended so far: the buffers already queued, and the
+  // active one, which is queued next. Later appends don't hold this up.
+  auto target = state->buffersQueued + (state->active.empty() ? 0 : 1);
+  if (target <= state->flushCompleted) {
+    return;
+  }
+  state->flushRequested = std::max(state->flushRequested, target);
+  workAvailable_.notify_one();
+  flushed_.wait(state.as_lock(), [&] {
+    return state->failed || state->flushCompleted >= target;
+  });
+}
+
+void TraceLogWriter::writerThread() noexcept {
+  std::vector<char> buffer;
+  // Buffers taken from pending so far, counted like buffersQueued.
+  uint64_t taken = 0;
+  for (;;) {
+    bool flushDue;
+    bool stopping;
+    {
+      auto state = state_.lock();
+      if (buffer.capacity() != 0) {
+        buffer.clear();
+        state->free.push_back(std::move(buffer));
+        buffer = {};
+      }
+
+      workAvailable_.wait_for(state.as_lock(), options_.flushInterval, [&] {
+        return state->stop || !state->pending.empty() ||
+            state->flushRequested > state->flushCompleted;
+      });
+      // Write what there is if nothing has filled up in time, or if a flush
+      // is waiting for the active buffer.
+      bool flushNeedsActive = state->flushRequested > state->buffersQueued;
+      if (!state->active.empty() && !state->free.empty() &&
+          (state->pending.empty() || flushNeedsActive)) {
+        state->pending.push_back(std::move(state->active));
+        ++state->buffersQueued;
+        state->active = std::move(state->free.back());
+        state->free.pop_back();
+      }
+      stopping = state->stop;
+      if (!state->pending.empty()) {
+        buffer = std::move(state->pending.front());
+        state->pending.pop_front();
+        ++taken;
+      }
+      flushDue = state->flushRequested > state->flushCompleted &&
+          taken >= state->flushRequested;
+    }
+
+    try {
+      if (!buffer.empty()) {
+        writeRecords(buffer.data(), buffer.size());
+        if (!flushDue) {
+          continue;
+        }
+      }
+      // Everything up to the last buffer taken has been handed to
+      // appendToFile.
+      writeTail();
+      if (stopping && buffer.empty()) {
+        finishFile();
+      }
+    } catch (const std::exception& e) {
+      XLOGF(
+          ERR,
+          "Failed to write trace log {}: {}. Giving up!",
+          options_.path,
+          e.what());
+      {
+        auto state = state_.lock();
+        state->failed = true;
+        size_t records = 0;
+        for (auto& pending : state->pending) {
+          records += pending.size() / framedSize_;
+        }
+        records += state->active.size() / framedSize_;
+        dropped_.fetch_add(records, std::memory_order_relaxed);
+        state->pending.clear();
+        state->active.clear();
+      }
+      flushed_.notify_all();
+      return;
+    }
+
+    state_.lock()->flushCompleted = taken;
+    flushed_.notify_all();
+    if (stopping && buffer.empty()) {
+      return;
+    }
+  }
+}
+
+void TraceLogWriter::writeRecords(const char* data, size_t size) {
+  while (size > 0) {
+    size_t room = options_.maxFileSize - fileSize_;
+    size_t n = std::min(size, room / framedSize_ * framedSize_);
+    if (n == 0) {
+      finishFile();
+      openFile();
+      continue;
+    }
+    appendToFile(data, n);
+    data += n;
+    size -= n;
+  }
+}
+
+void TraceLogWriter::appendToFile(const char* data, size_t size) {
+  while (size > 0) {
+    size_t n = std::min(size, stagingCapacity_ - stagingSize_);
+    std::memcpy(staging_.get() + stagingSize_, data, n);
+    stagingSize_ += n;
+    fileSize_ += n;
+    data += n;
+    size -= n;
+    tailDirty_ = true;
+
+    // Write whole blocks and keep the remainder, so every write is aligned.
+    size_t blocks = stagingSize_ / kBlockSize * kBlockSize;
+    if (blocks == 0) {
+      continue;
+    }
+    if (folly::pwriteFull(file_.fd(), staging_.get(), blocks, written_) < 0) {
+      folly::throwSystemError("failed to write to ", options_.path);
+    }
+    written_ += blocks;
+    stagingSize_ -= blocks;
+    std::memmove(staging_.get(), staging_.get() + blocks, stagingSize_);
+  }
+}
+
+void TraceLogWriter::writeTail() {
+  if (!tailDirty_ || stagingSize_ == 0) {
+    return;
+  }
+  // The tail is rewritten in place by the next write, so readers always see
+  // every record written so far. With O_DIRECT it is padded with zeroes to a
+  // whole block, which readers take as the end of the log, and finishFile
+  // truncates the padding away.
+  size_t size = stagingSize_;
+  if (fileDirect_) {
+    size = (size + kBlockSize - 1) / kBlockSize * kBlockSize;
+    std::memset(staging_.get() + stagingSize_, 0, size - stagingSize_);
+  }
+  if (folly::pwriteFull(file_.fd(), staging_.get(), size, written_) < 0) {
+    folly::throwSystemError("failed to write to ", options_.path);
+  }
+  tailDirty_ = false;
+}
+
+void TraceLogWriter::openFile() {
+  // Make room by deleting the oldest file, then shift the rest up by one.
+  for (size_t index = options_.maxFiles - 1; index > 0; --index) {
+    auto from = rotatedPath(options_.path, index - 1);
+    auto to = rotatedPath(options_.path, index);
+    if (::rename(from.c_str(), to.c_str()) != 0 && errno != ENOENT) {
+      folly::throwSystemError("failed to rotate ", from, " to ", to);
+    }
+  }
+  if (options_.maxFiles == 1) {
+    ::unlink(options_.path.c_str());
+  }
+
+  int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+  fileDirect_ = false;
+#ifdef O_DIRECT
+  if (options_.directIO && !directUnsupported_) {
+    int fd = ::open(options_.path.c_str(), flags | O_DIRECT, 0644);
+    if (fd >= 0) {
+      file_ = folly::File{fd, /*ownsFd=*/true};
+      fileDirect_ = true;
+    } else if (errno == EINVAL) {
+      XLOGF(
+          WARN,
+          "O_DIRECT is unsupported for {}; using buffered writes",
+          options_.path);
+      directUnsupported_ = true;
+    } else {
+      folly::throwSystemError("failed to open ", options_.path);
+    }
+  }
+#endif
+  if (!fileDirect_) {
+    file_ = folly::File{options_.path, flags, 0644};
+  }
+
+  FileHeader header;
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = folly::Endian::little(kFormatVersion);
+  header.recordSize =
+      folly::Endian::little(static_cast<uint32_t>(recordSize_));
+  fileSize_ = 0;
+  written_ = 0;
+  stagingSize_ = 0;
+  appendToFile(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+void TraceLogWriter::finishFile() {
+  writeTail();
+  if (fileDirect_ && ::ftruncate(file_.fd(), fileSize_) != 0) {
+    folly::throwSystemError("failed to truncate ", options_.path);
+  }
+  file_.close();
+}
+
+TraceLogReader::TraceLogReader(const std::string& path, size_t recordSize)
+    : file_{path, O_RDONLY | O_CLOEXEC},
+      recordSize_{recordSize},
+      buffer_(std::max<size_t>(
+          64 * 1024,
+          2 * (sizeof(RecordLength) + recordSize))) {
+  FileHeader header;
+  auto n = folly::readFull(file_.fd(), &header, sizeof(header));
+  if (n < 0) {
+    folly::throwSystemError("failed to read ", path);
+  }
+  if (static_cast<size_t>(n) != sizeof(header) ||
+      std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) {
+    throw std::runtime_error(path + " is not a trace log");
+  }
+  header.version = folly::Endian::little(header.version);
+  header.recordSize = folly::Endian::little(header.recordSize);
+  if (header.version != kFormatVersion) {
+    throw std::runtime_error(
+        path + " has unsupported trace log version " +
+        std::to_string(header.version));
+  }
+  if (header.recordSize != recordSize_) {
+    throw std::runtime_error(
+        path + " holds records of " + std::to_string(header.recordSize) +
+        " bytes, not " + std::to_string(recordSize_));
+  }
+}
+
+const void* TraceLogReader::next() {
+  const size_t framedSize = sizeof(RecordLength) + recordSize_;
+  if (size_ - position_ < framedSize && !eof_) {
+    std::memmove(buffer_.data(), buffer_.data() + position_, size_ - position_);
+    size_ -= position_;
+    position_ = 0;
+    auto n = folly::readFull(
+        file_.fd(), buffer_.data() + size_, buffer_.size() - size_);
+    if (n < 0) {
+      folly::throwSystemError("failed to read trace log");
+    }
+    size_ += n;
+    eof_ = size_ < buffer_.size();
+  }
+  if (size_ - position_ < framedSize) {
+    // The end of the file, or a record cut short by a crash.
+    return nullptr;
+  }
+
+  RecordLength length;
+  std::memcpy(&length, buffer_.data() + position_, sizeof(length));
+  length = folly::Endian::little(length);
+  if (length == 0) {
+    // Zero padding after the last record.
+    return nullptr;
+  }
+  if (length != recordSize_) {
+    throw std::runtime_error(
+        "corrupt trace log: record of " + std::to_string(length) +
+        " bytes, expected " + std::to_string(recordSize_));
+  }
+  const void* record = buffer_.data() + position_ + sizeof(length);
+  position_ += framedSize;
+  return record;
+}
+
+std::vector<std::string> traceLogFiles(const std::string& path) {
+  std::vector<std::string> files;
+  for (size_t index = 0;; ++index) {
+    auto file = rotatedPath(path, index);
+    if (!exists(file)) {
+      break;
+    }
+    files.push_back(std::move(file));
+  }
+  std::reverse(files.begin(), files.end());
+  return files;
+}
+
+} // namespace facebook::eden
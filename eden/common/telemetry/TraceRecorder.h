@@ -0,0 +1,319 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <folly/File.h>
+#include <folly/Synchronized.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "eden/common/telemetry/TraceBus.h"
+
+namespace facebook::eden {
+
+struct TraceRecorderOptions {
+  /**
+   * The newest file is written here. Older files are rotated to path.1,
+   * path.2, and so on, with path.1 the most recent of them. Files from a
+   * previous recording at this path are rotated out of the way on open.
+   */
+  std::string path;
+  /**
+   * Rotate to a new file when the current one would exceed this size.
+   */
+  size_t maxFileSize = 64 * 1024 * 1024;
+  /**
+   * Files kept, including the one being written. Together with maxFileSize,
+   * this caps the disk space used: the oldest file is deleted on rotation.
+   */
+  size_t maxFiles = 4;
+  /**
+   * Size of each in-memory buffer. Records are dropped if the writer falls
+   * behind by more than a few buffers.
+   */
+  size_t bufferSize = 1024 * 1024;
+  /**
+   * Write with O_DIRECT, bypassing the page cache so a long recording does not
+   * evict more useful data. Falls back to buffered writes where the
+   * filesystem does not support it.
+   */
+  bool directIO = false;
+  /**
+   * Partially filled buffers are written out at least this often.
+   */
+  std::chrono::milliseconds flushInterval{1000};
+};
+
+/**
+ * Writes fixed-size records to a rotating, length-prefixed binary log, on a
+ * dedicated thread. This is the type-erased part of TraceRecorder.
+ *
+ * Each file starts with a header naming the record size, followed by records
+ * of a 32-bit little-endian length and that many bytes of payload. Records
+ * never span files.
+ */
+class TraceLogWriter {
+ public:
+  /**
+   * Opens the first file. Throws if that fails; later I/O errors are logged
+   * and stop the recording.
+   */
+  TraceLogWriter(TraceRecorderOptions options, size_t recordSize);
+
+  /**
+   * Writes out everything appended so far and closes the file.
+   */
+  ~TraceLogWriter();
+
+  TraceLogWriter(const TraceLogWriter&) = delete;
+  TraceLogWriter& operator=(const TraceLogWriter&) = delete;
+
+  /**
+   * Queues count records of recordSize bytes each, laid out contiguously at
+   * records. Does not block on I/O: records that don't fit in the free
+   * buffers are dropped.
+   */
+  void append(const void* records, size_t count);
+
+  /**
+   * Blocks until everything appended so far has been written to the file.
+   */
+  void flush();
+
+  /**
+   * Records dropped because the writer fell behind or failed.
+   */
+  uint64_t droppedCount() const noexcept {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  struct AlignedFree {
+    void operator()(char* p) const noexcept;
+  };
+
+  void writerThread() noexcept;
+
+  // Writes whole records, rotating files at record boundaries.
+  void writeRecords(const char* data, size_t size);
+  void appendToFile(const char* data, size_t size);
+  // Writes the buffered tail of the file, padded to a block with O_DIRECT.
+  void writeTail();
+  void openFile();
+  void finishFile();
+
+  struct State {
+    bool stop = false;
+    // Set if the writer has given up after an error.
+    bool failed = false;
+    std::vector<char> active;
+    std::deque<std::vector<char>> pending;
+    std::vector<std::vector<char>> free;
+    // Buffers moved to pending so far.
+    uint64_t buffersQueued = 0;
+    // flush() waits until the first flushRequested buffers are in the file.
+    uint64_t flushRequested = 0;
+    // The first flushCompleted buffers have been written out, tail included.
+    uint64_t flushCompleted = 0;
+  };
+
+  const TraceRecorderOptions options_;
+  const size_t recordSize_;
+  // Length prefix plus payload.
+  const size_t framedSize_;
+
+  folly::Synchronized<State, std::mutex> state_;
+  std::condition_variable workAvailable_;
+  std::condition_variable flushed_;
+  std::atomic<uint64_t> dropped_{0};
+
+  // The rest is only accessed by the writer thread, after construction.
+
+  folly::File file_;
+  bool fileDirect_ = false;
+  // Set once opening with O_DIRECT has failed, so rotation doesn't retry.
+  bool directUnsupported_ = false;
+  // Logical size of the current file.
+  size_t fileSize_ = 0;
+  // Bytes of the file already written, excluding the tail in staging_.
+  size_t written_ = 0;
+  // Block-aligned staging area for the end of the file. Holds less than one
+  // block between writes.
+  std::unique_ptr<char, AlignedFree> staging_;
+  size_t stagingCapacity_ = 0;
+  size_t stagingSize_ = 0;
+  bool tailDirty_ = false;
+
+  std::thread writerThread_;
+};
+
+/**
+ * Reads the records of one file written by TraceLogWriter.
+ */
+class TraceLogReader {
+ public:
+  /**
+   * Throws if the file cannot be opened, is not a trace log, or holds records
+   * of a different size.
+   */
+  TraceLogReader(const std::string& path, size_t recordSize);
+
+  /**
+   * Returns the next record's payload, valid until the following call, or
+   * nullptr at the end of the log. A record cut short by a crash ends the
+   * log; any other malformed record throws.
+   */
+  const void* next();
+
+ private:
+  folly::File file_;
+  const size_t recordSize_;
+  std::vector<char> buffer_;
+  size_t position_ = 0;
+  size_t size_ = 0;
+  bool eof_ = false;
+};
+
+/**
+ * The files of a recording at path, oldest first.
+ */
+std::vector<std::string> traceLogFiles(const std::string& path);
+
+/**
+ * Subscriber that records every observed event to disk, for later analysis or
+ * replay with TraceLogFile. Serialization is a copy of the event's bytes, so
+ * the TraceEvent type must be trivially copyable, hold no pointers that need
+ * to survive a restart, and keep its layout between writing and reading.
+ */
+template <typename TraceEvent>
+class TraceRecorder final : public TraceEventSubscriber<TraceEvent> {
+  static_assert(std::is_trivially_copyable_v<TraceEvent>);
+  using Base = TraceEventSubscriber<TraceEvent>;
+
+ public:
+  TraceRecorder(std::string name, TraceRecorderOptions options)
+      : Base{std::move(name)},
+        writer_{std::move(options), sizeof(TraceEvent)} {}
+
+  void observeBatch(const TraceEvent* begin, const TraceEvent* end) override {
+    writer_.append(begin, end - begin);
+  }
+
+  /**
+   * Blocks until every observed event has been written.
+   */
+  void flush() {
+    writer_.flush();
+  }
+
+  uint64_t droppedCount() const noexcept {
+    return writer_.droppedCount();
+  }
+
+ private:
+  TraceLogWriter writer_;
+};
+
+/**
+ * The events recorded in one file, as an input range.
+ */
+template <typename TraceEvent>
+class TraceLogFile {
+  static_assert(std::is_trivially_copyable_v<TraceEvent>);
+
+ public:
+  explicit TraceLogFile(const std::string& path)
+      : reader_{path, sizeof(TraceEvent)} {}
+
+  class iterator {
+   public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = TraceEvent;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const TraceEvent*;
+    using reference = const TraceEvent&;
+
+    iterator() = default;
+
+    reference operator*() const {
+      return event_;
+    }
+    pointer operator->() const {
+      return &event_;
+    }
+    iterator& operator++() {
+      advance();
+      return *this;
+    }
+    void operator++(int) {
+      advance();
+    }
+    bool operator==(const iterator& that) const {
+      return reader_ == that.reader_;
+    }
+
+   private:
+    explicit iterator(TraceLogReader* reader) : reader_{reader} {
+      advance();
+    }
+
+    void advance() {
+      if (auto* record = reader_->next()) {
+        std::memcpy(&event_, record, sizeof(TraceEvent));
+      } else {
+        reader_ = nullptr;
+      }
+    }
+
+    TraceLogReader* reader_ = nullptr;
+    TraceEvent event_;
+
+    friend TraceLogFile;
+  };
+
+  /**
+   * May only be called once: the file is read as it is iterated.
+   */
+  iterator begin() {
+    return iterator{&reader_};
+  }
+  iterator end() {
+    return iterator{};
+  }
+
+ private:
+  TraceLogReader reader_;
+};
+
+/**
+ * Publishes every event of the recording at path to bus, oldest first, and
+ * returns how many there were.
+ */
+template <typename TraceEvent>
+size_t replayTraceLog(const std::string& path, TraceBus<TraceEvent>& bus) {
+  size_t count = 0;
+  for (const auto& file : traceLogFiles(path)) {
+    for (const auto& event : TraceLogFile<TraceEvent>{file}) {
+      bus.publish(event);
+      ++count;
+    }
+  }
+  return count;
+}
+
+} // namespace facebook::eden
@@ -0,0 +1,225 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "eden/common/telemetry/ChromeTraceExporter.h"
+
+#include <fmt/format.h>
+#include <folly/json/json.h>
+#include <folly/portability/GTest.h>
+#include <sstream>
+
+using namespace facebook::eden;
+using namespace std::chrono_literals;
+
+namespace {
+
+CompactTracePoint point(
+    std::chrono::nanoseconds timestamp,
+    uint64_t traceId,
+    uint64_t blockId,
+    uint64_t parentBlockId,
+    const char* name,
+    bool start,
+    bool stop) {
+  CompactTracePoint tp;
+  tp.timestamp = timestamp;
+  tp.traceId = traceId;
+  tp.blockId = blockId;
+  tp.parentBlockId = parentBlockId;
+  tp.name = name;
+  tp.start = start;
+  tp.stop = stop;
+  return tp;
+}
+
+CompactTracePoint start(
+    std::chrono::nanoseconds ts,
+    uint64_t trace,
+    uint64_t block,
+    uint64_t parent,
+    const char* name) {
+  return point(ts, trace, block, parent, name, true, false);
+}
+
+CompactTracePoint stop(std::chrono::nanoseconds ts, uint64_t block) {
+  return point(ts, 0, block, 0, nullptr, false, true);
+}
+
+std::vector<folly::dynamic> eventsWithPhase(
+    const folly::dynamic& trace,
+    folly::StringPiece phase) {
+  std::vector<folly::dynamic> events;
+  for (const auto& event : trace["traceEvents"]) {
+    if (event["ph"].asString() == phase) {
+      events.push_back(event);
+    }
+  }
+  return events;
+}
+
+const folly::dynamic& completeEvent(
+    const std::vector<folly::dynamic>& events,
+    folly::StringPiece name) {
+  for (const auto& event : events) {
+    if (event["name"].asString() == name) {
+      return event;
+    }
+  }
+  throw std::runtime_error{fmt::format("no event named {}", name)};
+}
+
+} // namespace
+
+TEST(ChromeTraceExporterTest, empty_trace_is_valid_json) {
+  std::ostringstream out;
+  ChromeTraceExporter exporter{out};
+  exporter.finish();
+  auto trace = folly::parseJson(out.str());
+  EXPECT_EQ(0, trace["traceEvents"].size());
+}
+
+TEST(ChromeTraceExporterTest, reconstructs_blocks_across_batches) {
+  std::ostringstream out;
+  ChromeTraceExporter exporter{out};
+
+  // Batches as getAllTracepoints() would return them: blocks may start in one
+  // and stop in a later one.
+  exporter.add(std::vector<CompactTracePoint>{
+      start(1000ns, 100, 1, 0, "root"),
+      start(1500ns, 200, 10, 0, "other \"trace\""),
+      stop(1800ns, 10),
+      start(2000ns, 100, 2, 1, "nested"),
+      start(2500ns, 100, 3, 1, "overlapping"),
+  });
+  EXPECT_EQ(3, exporter.openBlocks());
+  exporter.add(std::vector<CompactTracePoint>{
+      stop(3000ns, 2),
+      stop(5000ns, 1),
+      stop(5500ns, 42),
+      stop(6000ns, 3),
+      start(7000ns, 200, 20, 0, "unfinished"),
+  });
+  EXPECT_EQ(1, exporter.openBlocks());
+  EXPECT_EQ(1, exporter.orphanedStops());
+  exporter.finish();
+  EXPECT_EQ(0, exporter.openBlocks());
+
+  auto trace = folly::parseJson(out.str());
+
+  // One process per trace, even though trace 200 had no open blocks between
+  // 1800 and 7000.
+  EXPECT_EQ(2, eventsWithPhase(trace, "M").size());
+
+  auto complete = eventsWithPhase(trace, "X");
+  ASSERT_EQ(5, complete.size());
+
+  // Timestamps are relative to the first tracepoint, at 1000ns.
+  EXPECT_EQ("1000", trace["otherData"]["baseTimestampNs"].asString());
+  const auto& root = completeEvent(complete, "root");
+  EXPECT_EQ(0.0, root["ts"].asDouble());
+  EXPECT_EQ(4.0, root["dur"].asDouble());
+  EXPECT_EQ("0x1", root["args"]["blockId"].asString());
+
+  // Nested directly inside root, so it shares root's lane.
+  const auto& nested = completeEvent(complete, "nested");
+  EXPECT_EQ(root["pid"], nested["pid"]);
+  EXPECT_EQ(root["tid"], nested["tid"]);
+  EXPECT_EQ("0x1", nested["args"]["parentBlockId"].asString());
+
+  // Started while its sibling was running, so it goes on another lane with a
+  // flow from root.
+  const auto& overlapping = completeEvent(complete, "overlapping");
+  EXPECT_EQ(root["pid"], overlapping["pid"]);
+  EXPECT_NE(root["tid"], overlapping["tid"]);
+  EXPECT_EQ(3.5, overlapping["dur"].asDouble());
+  auto flowStarts = eventsWithPhase(trace, "s");
+  auto flowEnds = eventsWithPhase(trace, "f");
+  ASSERT_EQ(1, flowStarts.size());
+  ASSERT_EQ(1, flowEnds.size());
+  EXPECT_EQ(root["tid"], flowStarts[0]["tid"]);
+  EXPECT_EQ(overlapping["tid"], flowEnds[0]["tid"]);
+  EXPECT_EQ(flowStarts[0]["id"], flowEnds[0]["id"]);
+
+  const auto& other = completeEvent(complete, "other \"trace\"");
+  EXPECT_NE(root["pid"], other["pid"]);
+  EXPECT_EQ(0.3, other["dur"].asDouble());
+
+  const auto& unfinished = completeEvent(complete, "unfinished");
+  EXPECT_EQ(other["pid"], unfinished["pid"]);
+  EXPECT_EQ(0.0, unfinished["dur"].asDouble());
+  EXPECT_TRUE(unfinished["args"]["unfinished"].asBool());
+  EXPECT_FALSE(root["args"].count("unfinished"));
+}
+
+TEST(ChromeTraceExporterTest, instant_tracepoints) {
+  std::ostringstream out;
+  ChromeTraceExporter exporter{out};
+  exporter.add(start(1000ns, 1, 1, 0, "block"));
+  exporter.add(point(1200ns, 1, 1, 0, "checkpoint", false, false));
+  exporter.add(stop(2000ns, 1));
+  exporter.finish();
+
+  auto trace = folly::parseJson(out.str());
+  auto instants = eventsWithPhase(trace, "i");
+  ASSERT_EQ(1, instants.size());
+  EXPECT_EQ("checkpoint", instants[0]["name"].asString());
+  EXPECT_EQ(0.2, instants[0]["ts"].asDouble());
+  EXPECT_EQ(
+      completeEvent(eventsWithPhase(trace, "X"), "block")["tid"],
+      instants[0]["tid"]);
+}
+
+TEST(ChromeTraceExporterTest, repeated_start_is_skipped) {
+  std::ostringstream out;
+  ChromeTraceExporter exporter{out};
+  exporter.add(start(1000ns, 1, 1, 0, "first"));
+  exporter.add(start(1500ns, 1, 1, 0, "again"));
+  EXPECT_EQ(1, exporter.repeatedStarts());
+  EXPECT_EQ(1, exporter.openBlocks());
+  exporter.add(stop(2000ns, 1));
+  EXPECT_EQ(0, exporter.openBlocks());
+  // The lane went idle, so the next block reuses it.
+  exporter.add(start(3000ns, 1, 2, 0, "next"));
+  exporter.add(stop(4000ns, 2));
+  exporter.finish();
+
+  auto trace = folly::parseJson(out.str());
+  auto complete = eventsWithPhase(trace, "X");
+  ASSERT_EQ(2, complete.size());
+  const auto& first = completeEvent(complete, "first");
+  EXPECT_EQ(1.0, first["dur"].asDouble());
+  EXPECT_EQ(first["tid"], completeEvent(complete, "next")["tid"]);
+}
+
+TEST(ChromeTraceExporterTest, epoch_timestamps_keep_nanosecond_precision) {
+  // A realistic timestamp: October 2025, in nanoseconds since the epoch. As
+  // microseconds in a double, it would only resolve to 0.25us.
+  constexpr std::chrono::nanoseconds base{1760000000123456789};
+  std::ostringstream out;
+  ChromeTraceExporter exporter{out};
+  exporter.add(start(base, 1, 1, 0, "outer"));
+  exporter.add(start(base + 1001ns, 1, 2, 1, "inner"));
+  exporter.add(point(base + 1003ns, 1, 2, 0, "checkpoint", false, false));
+  exporter.add(stop(base + 1007ns, 2));
+  exporter.add(stop(base + 3600s + 1ns, 1));
+  exporter.finish();
+
+  auto trace = folly::parseJson(out.str());
+  EXPECT_EQ(
+      "1760000000123456789", trace["otherData"]["baseTimestampNs"].asString());
+
+  auto complete = eventsWithPhase(trace, "X");
+  const auto& outer = completeEvent(complete, "outer");
+  EXPECT_EQ(0.0, outer["ts"].asDouble());
+  EXPECT_EQ(3600000000.001, outer["dur"].asDouble());
+  const auto& inner = completeEvent(complete, "inner");
+  EXPECT_EQ(1.001, inner["ts"].asDouble());
+  EXPECT_EQ(0.006, inner["dur"].asDouble());
+  auto instants = eventsWithPhase(trace, "i");
+  ASSERT_EQ(1, instants.size());
+  EXPECT_EQ(1.003, instants[0]["ts"].asDouble());
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include "eden/common/telemetry/TraceBus.h"
+
+using namespace facebook::eden;
+
+namespace {
+
+std::shared_ptr<TraceBus<uint64_t>> bus;
+TraceBus<uint64_t>::SubscriptionHandle handle;
+
+} // namespace
+
+// state.range(0) selects the TraceBusBackend.
+static void TraceBus_publish_from_multiple_threads(benchmark::State& state) {
+  if (state.thread_index() == 0) {
+    bus = TraceBus<uint64_t>::create(
+        "bus",
+        4096,
+        {.backend = static_cast<TraceBusBackend>(state.range(0))});
+    handle = bus->subscribeFunction(
+        "sub", [](uint64_t value) { benchmark::DoNotOptimize(value); });
+  }
+
+  uint64_t i = 0;
+  for (auto _ : state) {
+    bus->publish(i++);
+  }
+  state.SetItemsProcessed(state.iterations());
+
+  if (state.thread_index() == 0) {
+    handle.reset();
+    bus.reset();
+  }
+}
+BENCHMARK(TraceBus_publish_from_multiple_threads)
+    ->Arg(static_cast<int64_t>(TraceBusBackend::Locked))
+    ->Arg(static_cast<int64_t>(TraceBusBackend::ShardedRings))
+    ->Threads(8);
+
+BENCHMARK_MAIN();
@@ -7,10 +7,14 @@
 
 #include "eden/common/telemetry/TraceBus.h"
 
+#include <folly/executors/CPUThreadPoolExecutor.h>
 #include <folly/futures/Promise.h>
 #include <folly/portability/GTest.h>
+#include <folly/synchronization/Baton.h>
+#include <algorithm>
 #include <atomic>
 #include <thread>
+#include <vector>
 
 using namespace std::literals;
 using namespace facebook::eden;
@@ -125,3 +129,313 @@ TEST(TraceBusTest, hasSubscriber) {
   }
   ASSERT_FALSE(bus->hasSubscription());
 }
+
+namespace {
+
+/**
+ * Publishes 0 through 9 to a bus of capacity 4 whose only subscriber is stuck
+ * on event 0, so six of the remaining nine events don't fit.
+ */
+std::vector<int> publishIntoStuckBus(
+    TraceBusOptions options,
+    uint64_t& dropped) {
+  std::vector<int> values;
+  folly::Baton<> observing;
+  folly::Baton<> release;
+  auto bus = TraceBus<int>::create("bus", 4, options);
+  auto handle = bus->subscribeFunction("sub", [&](int v) {
+    values.push_back(v);
+    if (v == 0) {
+      observing.post();
+      release.wait();
+    }
+  });
+
+  bus->publish(0);
+  observing.wait();
+  for (int i = 1; i < 10; ++i) {
+    bus->publish(i);
+  }
+  dropped = bus->droppedCount();
+  release.post();
+  bus.reset();
+  return values;
+}
+
+constexpr TraceBusBackend kBackends[] = {
+    TraceBusBackend::Locked,
+    TraceBusBackend::ShardedRings,
+};
+
+struct ProducerEvent {
+  size_t producer;
+  size_t index;
+};
+
+} // namespace
+
+TEST(TraceBusTest, drop_newest_when_full) {
+  for (auto backend : kBackends) {
+    uint64_t dropped;
+    auto values = publishIntoStuckBus(
+        {.fullPolicy = TraceBusFullPolicy::DropNewest,
+         .backend = backend,
+         .shards = 1},
+        dropped);
+    EXPECT_EQ(5, dropped);
+    EXPECT_EQ((std::vector<int>{0, 1, 2, 3, 4}), values);
+  }
+}
+
+TEST(TraceBusTest, drop_oldest_when_full) {
+  for (auto backend : kBackends) {
+    uint64_t dropped;
+    auto values = publishIntoStuckBus(
+        {.fullPolicy = TraceBusFullPolicy::DropOldest,
+         .backend = backend,
+         .shards = 1},
+        dropped);
+    EXPECT_EQ(5, dropped);
+    EXPECT_EQ((std::vector<int>{0, 6, 7, 8, 9}), values);
+  }
+}
+
+TEST(TraceBusTest, sharded_rings_preserve_per_thread_order) {
+  constexpr size_t kProducers = 4;
+  constexpr size_t kEvents = 10000;
+  std::vector<size_t> next(kProducers, 0);
+  bool ordered = true;
+  {
+    auto bus = TraceBus<ProducerEvent>::create(
+        "bus", 64, {.backend = TraceBusBackend::ShardedRings, .shards = 2});
+    auto handle = bus->subscribeFunction("sub", [&](ProducerEvent event) {
+      ordered = ordered && event.index == next[event.producer];
+      next[event.producer] = event.index + 1;
+    });
+
+    std::vector<std::thread> producers;
+    for (size_t p = 0; p < kProducers; ++p) {
+      producers.emplace_back([&, p] {
+        for (size_t i = 0; i < kEvents; ++i) {
+          bus->publish(ProducerEvent{p, i});
+        }
+      });
+    }
+    for (auto& producer : producers) {
+      producer.join();
+    }
+    EXPECT_EQ(0, bus->droppedCount());
+  }
+
+  EXPECT_TRUE(ordered);
+  EXPECT_EQ(std::vector<size_t>(kProducers, kEvents), next);
+}
+
+TEST(TraceBusTest, multi_producer_delivers_every_event) {
+  // Throughput is measured in TraceBusBenchmark.
+  constexpr size_t kProducers = 8;
+  constexpr size_t kEvents = 10000;
+  for (auto backend : kBackends) {
+    std::atomic<size_t> observed{0};
+    {
+      auto bus = TraceBus<ProducerEvent>::create(
+          "bus", 4096, {.backend = backend});
+      auto handle = bus->subscribeFunction("sub", [&](const ProducerEvent&) {
+        observed.fetch_add(1, std::memory_order_relaxed);
+      });
+
+      std::vector<std::thread> producers;
+      for (size_t p = 0; p < kProducers; ++p) {
+        producers.emplace_back([&, p] {
+          for (size_t i = 0; i < kEvents; ++i) {
+            bus->publish(ProducerEvent{p, i});
+          }
+        });
+      }
+      for (auto& producer : producers) {
+        producer.join();
+      }
+    }
+
+    EXPECT_EQ(kProducers * kEvents, observed.load());
+  }
+}
+
+TEST(TraceBusTest, slow_subscriber_only_delays_its_own_lane) {
+  constexpr int kEvents = 100;
+  folly::CPUThreadPoolExecutor executor{2};
+  folly::Baton<> fastDone;
+  folly::Baton<> release;
+  std::vector<int> slowValues;
+  int fastCount = 0;
+  {
+    auto bus = TraceBus<int>::create(
+        "bus",
+        kEvents,
+        {.dispatchExecutor = folly::getKeepAliveToken(executor),
+         .maxLaneBacklog = kEvents});
+    auto slow = bus->subscribeFunction("slow", [&](int v) {
+      if (slowValues.empty()) {
+        release.wait();
+      }
+      slowValues.push_back(v);
+    });
+    auto fast = bus->subscribeFunction("fast", [&](int) {
+      if (++fastCount == kEvents) {
+        fastDone.post();
+      }
+    });
+
+    for (int i = 0; i < kEvents; ++i) {
+      bus->publish(i);
+    }
+    fastDone.wait();
+
+    // The fast lane records its progress just after its last batch returns.
+    auto deadline = std::chrono::steady_clock::now() + 10s;
+    std::vector<TraceSubscriberLag> lag;
+    do {
+      std::this_thread::yield();
+      lag = bus->getSubscriberLag();
+      std::sort(lag.begin(), lag.end(), [](const auto& a, const auto& b) {
+        return a.name < b.name;
+      });
+    } while (lag[0].events != 0 && std::chrono::steady_clock::now() < deadline);
+
+    ASSERT_EQ(2, lag.size());
+    EXPECT_EQ("fast", lag[0].name);
+    EXPECT_EQ(0, lag[0].events);
+    EXPECT_EQ("slow", lag[1].name);
+    EXPECT_EQ(kEvents, lag[1].events);
+    EXPECT_EQ(0, lag[1].skippedEvents);
+    EXPECT_EQ(kEvents, bus->getMaxSubscriberLag());
+
+    release.post();
+  }
+
+  // Destroying the bus waited for the slow lane, which observed in order.
+  ASSERT_EQ(kEvents, slowValues.size());
+  for (int i = 0; i < kEvents; ++i) {
+    EXPECT_EQ(i, slowValues[i]);
+  }
+}
+
+TEST(TraceBusTest, lane_that_threw_reports_no_lag) {
+  folly::CPUThreadPoolExecutor executor{2};
+  auto bus = TraceBus<int>::create(
+      "bus", 10, {.dispatchExecutor = folly::getKeepAliveToken(executor)});
+  std::atomic<int> observed{0};
+  auto thrower = bus->subscribeFunction(
+      "thrower", [](int) { throw std::runtime_error{"boom"}; });
+  auto counter = bus->subscribeFunction("counter", [&](int) { ++observed; });
+
+  auto deadline = std::chrono::steady_clock::now() + 10s;
+  for (int i = 0; i < 100; ++i) {
+    bus->publish(i);
+    while (observed.load() <= i &&
+           std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::yield();
+    }
+  }
+  ASSERT_EQ(100, observed.load());
+
+  while (bus->getMaxSubscriberLag() != 0 &&
+         std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::yield();
+  }
+  for (const auto& lag : bus->getSubscriberLag()) {
+    EXPECT_EQ(0, lag.events) << lag.name;
+    EXPECT_EQ(0, lag.skippedEvents) << lag.name;
+  }
+}
+
+TEST(TraceBusTest, filtered_and_sampled_subscriptions) {
+  folly::CPUThreadPoolExecutor executor{2};
+  for (bool useExecutor : {false, true}) {
+    std::vector<int> even;
+    std::vector<int> sampled;
+    std::vector<int> both;
+    {
+      TraceBusOptions options;
+      if (useExecutor) {
+        options.dispatchExecutor = folly::getKeepAliveToken(executor);
+      }
+      auto bus = TraceBus<int>::create("bus", 8, options);
+      auto isEven = [](int v) { return v % 2 == 0; };
+      auto h1 = bus->subscribeFunction(
+          "even", [&](int v) { even.push_back(v); }, {.filter = isEven});
+      auto h2 = bus->subscribeFunction(
+          "sampled", [&](int v) { sampled.push_back(v); }, {.sampleEvery = 3});
+      auto h3 = bus->subscribeFunction(
+          "both",
+          [&](int v) { both.push_back(v); },
+          {.filter = isEven, .sampleEvery = 2});
+      for (int i = 0; i < 30; ++i) {
+        bus->publish(i);
+      }
+    }
+
+    std::vector<int> expectedEven, expectedSampled, expectedBoth;
+    for (int i = 0; i < 30; ++i) {
+      if (i % 2 == 0) {
+        expectedEven.push_back(i);
+      }
+      if (i % 3 == 0) {
+        expectedSampled.push_back(i);
+      }
+      if (i % 4 == 0) {
+        expectedBoth.push_back(i);
+      }
+    }
+    EXPECT_EQ(expectedEven, even);
+    EXPECT_EQ(expectedSampled, sampled);
+    EXPECT_EQ(expectedBoth, both);
+  }
+}
+
+TEST(TraceBusTest, hasSubscription_by_kind) {
+  auto bus = TraceBus<int>::create("bus", 10);
+  EXPECT_FALSE(bus->hasSubscription(0));
+
+  auto h1 = bus->subscribeFunction("kind1", [](int) {}, {.kinds = 1u << 1});
+  auto h3 = bus->subscribeFunction("kind3", [](int) {}, {.kinds = 1u << 3});
+  EXPECT_FALSE(bus->hasSubscription(0));
+  EXPECT_TRUE(bus->hasSubscription(1));
+  EXPECT_TRUE(bus->hasSubscription(3));
+
+  h3.reset();
+  bus->publish(1);
+
+  // As with hasSubscription(), the kinds are updated once the background
+  // thread notices the subscriber has been removed.
+  auto deadline = std::chrono::steady_clock::now() + 10s;
+  while (bus->hasSubscription(3) &&
+         std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::yield();
+  }
+  EXPECT_FALSE(bus->hasSubscription(3));
+  EXPECT_TRUE(bus->hasSubscription(1));
+
+  auto all = bus->subscribeFunction("all", [](int) {});
+  EXPECT_TRUE(bus->hasSubscription(0));
+  EXPECT_TRUE(bus->hasSubscription(63));
+}
+
+TEST(TraceBusTest, hasSubscription_by_kind_ignores_subscribers_that_threw) {
+  auto bus = TraceBus<int>::create("bus", 10);
+  auto h1 = bus->subscribeFunction("kind1", [](int) {}, {.kinds = 1u << 1});
+  auto h2 = bus->subscribeFunction(
+      "kind2",
+      [](int) { throw std::runtime_error{"boom"}; },
+      {.kinds = 1u << 2});
+  EXPECT_TRUE(bus->hasSubscription(2));
+
+  bus->publish(2);
+  auto deadline = std::chrono::steady_clock::now() + 10s;
+  while (bus->hasSubscription(2) &&
+         std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::yield();
+  }
+  EXPECT_FALSE(bus->hasSubscription(2));
+  EXPECT_TRUE(bus->hasSubscription(1));
+}
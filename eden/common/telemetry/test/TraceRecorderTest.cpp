@@ -0,0 +1,207 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "eden/common/telemetry/TraceRecorder.h"
+
+#include <folly/FileUtil.h>
+#include <folly/portability/GTest.h>
+#include <folly/portability/SysStat.h>
+#include <folly/portability/Unistd.h>
+#include <folly/testing/TestUtil.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace facebook::eden;
+
+namespace {
+
+struct Event {
+  uint64_t id;
+  uint32_t kind;
+  uint32_t value;
+};
+
+size_t fileSize(const std::string& path) {
+  struct stat st;
+  EXPECT_EQ(0, ::stat(path.c_str(), &st));
+  return st.st_size;
+}
+
+/**
+ * Records events 0 through count - 1 through a TraceBus.
+ */
+void record(const TraceRecorderOptions& options, uint64_t count) {
+  auto recorder = std::make_shared<TraceRecorder<Event>>("recorder", options);
+  {
+    auto bus = TraceBus<Event>::create("bus", 256);
+    auto handle = bus->subscribe(recorder);
+    for (uint64_t i = 0; i < count; ++i) {
+      bus->publish(Event{i, static_cast<uint32_t>(i % 7), 42});
+    }
+  }
+  recorder->flush();
+  EXPECT_EQ(0, recorder->droppedCount());
+}
+
+std::vector<Event> readAll(const std::string& path) {
+  std::vector<Event> events;
+  for (const auto& file : traceLogFiles(path)) {
+    for (const auto& event : TraceLogFile<Event>{file}) {
+      events.push_back(event);
+    }
+  }
+  return events;
+}
+
+} // namespace
+
+TEST(TraceRecorderTest, record_and_read_back) {
+  folly::test::TemporaryDirectory dir;
+  TraceRecorderOptions options;
+  options.path = (dir.path() / "trace").string();
+  record(options, 10000);
+
+  auto events = readAll(options.path);
+  ASSERT_EQ(10000, events.size());
+  for (uint64_t i = 0; i < events.size(); ++i) {
+    EXPECT_EQ(i, events[i].id);
+    EXPECT_EQ(i % 7, events[i].kind);
+    EXPECT_EQ(42, events[i].value);
+  }
+}
+
+TEST(TraceRecorderTest, rotation_caps_disk_usage) {
+  folly::test::TemporaryDirectory dir;
+  TraceRecorderOptions options;
+  options.path = (dir.path() / "trace").string();
+  options.maxFileSize = 4096;
+  options.maxFiles = 3;
+  record(options, 10000);
+
+  auto files = traceLogFiles(options.path);
+  ASSERT_EQ(3, files.size());
+  EXPECT_EQ(options.path, files.back());
+  for (const auto& file : files) {
+    EXPECT_LE(fileSize(file), options.maxFileSize);
+  }
+
+  // The oldest records were rotated away; the newest survive, in order.
+  auto events = readAll(options.path);
+  ASSERT_FALSE(events.empty());
+  EXPECT_LT(events.size(), 3 * 4096 / sizeof(Event));
+  EXPECT_EQ(9999, events.back().id);
+  for (size_t i = 1; i < events.size(); ++i) {
+    EXPECT_EQ(events[i - 1].id + 1, events[i].id);
+  }
+}
+
+TEST(TraceRecorderTest, direct_io_leaves_no_padding) {
+  folly::test::TemporaryDirectory dir;
+  TraceRecorderOptions options;
+  options.path = (dir.path() / "trace").string();
+  options.directIO = true;
+  record(options, 1001);
+
+  // Falls back to buffered writes on filesystems without O_DIRECT, like
+  // tmpfs; either way, the file ends with the last record.
+  EXPECT_EQ(16 + 1001 * (4 + sizeof(Event)), fileSize(options.path));
+  EXPECT_EQ(1001, readAll(options.path).size());
+}
+
+TEST(TraceRecorderTest, truncated_record_ends_the_log) {
+  folly::test::TemporaryDirectory dir;
+  TraceRecorderOptions options;
+  options.path = (dir.path() / "trace").string();
+  record(options, 100);
+
+  ASSERT_EQ(0, ::truncate(options.path.c_str(), fileSize(options.path) - 3));
+  EXPECT_EQ(99, readAll(options.path).size());
+}
+
+TEST(TraceRecorderTest, rejects_mismatched_record_size) {
+  folly::test::TemporaryDirectory dir;
+  TraceRecorderOptions options;
+  options.path = (dir.path() / "trace").string();
+  record(options, 1);
+
+  EXPECT_THROW(TraceLogFile<uint64_t>{options.path}, std::runtime_error);
+}
+
+TEST(TraceRecorderTest, integers_are_little_endian) {
+  folly::test::TemporaryDirectory dir;
+  TraceRecorderOptions options;
+  options.path = (dir.path() / "trace").string();
+  record(options, 1);
+
+  std::string contents;
+  ASSERT_TRUE(folly::readFile(options.path.c_str(), contents));
+  ASSERT_EQ(16 + 4 + sizeof(Event), contents.size());
+  // The header's version and record size, then the record's length prefix.
+  EXPECT_EQ(std::string("\x01\0\0\0\x10\0\0\0", 8), contents.substr(8, 8));
+  EXPECT_EQ(std::string("\x10\0\0\0", 4), contents.substr(16, 4));
+}
+
+TEST(TraceRecorderTest, flush_completes_under_steady_appends) {
+  folly::test::TemporaryDirectory dir;
+  TraceRecorderOptions options;
+  options.path = (dir.path() / "trace").string();
+  options.maxFileSize = 1024 * 1024 * 1024;
+  options.bufferSize = 64 * 1024;
+  TraceLogWriter writer{options, sizeof(Event)};
+
+  // Appending in batches fills buffers faster than the writer empties them,
+  // so the writer never finds the queue idle.
+  std::atomic<bool> stop{false};
+  std::atomic<uint64_t> appended{0};
+  std::thread appender{[&] {
+    std::vector<Event> batch(256);
+    for (uint64_t i = 0; !stop.load(std::memory_order_relaxed);) {
+      for (auto& event : batch) {
+        event = Event{i++, 0, 0};
+      }
+      writer.append(batch.data(), batch.size());
+      appended.store(i, std::memory_order_release);
+    }
+  }};
+
+  // Each flush covers what was appended before it, however busy the writer
+  // is with what came after.
+  for (uint64_t i = 1; i <= 20; ++i) {
+    while (appended.load(std::memory_order_acquire) < i * 10000) {
+      std::this_thread::yield();
+    }
+    auto before = appended.load(std::memory_order_acquire);
+    writer.flush();
+    auto records = (fileSize(options.path) - 16) / (4 + sizeof(Event));
+    EXPECT_GE(records + writer.droppedCount(), before);
+  }
+
+  stop = true;
+  appender.join();
+}
+
+TEST(TraceRecorderTest, replay_into_bus) {
+  folly::test::TemporaryDirectory dir;
+  TraceRecorderOptions options;
+  options.path = (dir.path() / "trace").string();
+  options.maxFileSize = 4096;
+  options.maxFiles = 100;
+  record(options, 1000);
+
+  std::vector<uint64_t> ids;
+  {
+    auto bus = TraceBus<Event>::create("replay", 16);
+    auto handle = bus->subscribeFunction(
+        "sub", [&](const Event& event) { ids.push_back(event.id); });
+    EXPECT_EQ(1000, replayTraceLog(options.path, *bus));
+  }
+  ASSERT_EQ(1000, ids.size());
+  for (uint64_t i = 0; i < ids.size(); ++i) {
+    EXPECT_EQ(i, ids[i]);
+  }
+}
@@ -0,0 +1,638 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+#include <folly/FBVector.h>
+#include <algorithm>
+#include <initializer_list>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "eden/common/utils/CaseSensitivity.h"
+#include "eden/common/utils/PathFuncs.h"
+#include "eden/common/utils/Throw.h"
+
+namespace facebook::eden {
+
+/** An ordered associative container from one of our path types to an
+ * arbitrary value type, with the same API as PathMap.
+ *
+ * PathMap keeps its entries in a single sorted vector, so an insert or erase
+ * anywhere but at the end shifts the whole tail, and populating a large
+ * directory in random order is quadratic. ChunkedPathMap instead:
+ * - keeps each entry in its own node, linked in sorted order. Nodes never
+ *   move, so iterators, pointers and references stay valid across inserts
+ *   and across erases of other entries, as with std::map.
+ * - indexes the nodes with a list of sorted chunks of at most kMaxChunkSize
+ *   node pointers. A lookup is a binary search over the chunks followed by a
+ *   binary search within one chunk; an insert or erase shifts at most one
+ *   chunk, splitting it when it fills up and merging it with, or refilling it
+ *   from, a neighbour when it runs low.
+ * - lookups can be made using the Piece variant of the key type without
+ *   allocating, with the same case sensitivity semantics as PathMap.
+ *
+ * Prefer PathMap for small or mostly read-only maps: it uses less memory and
+ * iterates faster.
+ */
+template <typename Value, typename Key = PathComponent>
+class ChunkedPathMap {
+  using Pair = std::pair<Key, Value>;
+  using Piece = typename Key::piece_type;
+
+  struct Link {
+    Link* prev;
+    Link* next;
+  };
+
+  struct Node : Link {
+    template <typename... Args>
+    explicit Node(Args&&... args) : value(std::forward<Args>(args)...) {}
+
+    Pair value;
+  };
+
+  using Chunk = std::vector<Node*>;
+
+  /// Where a key is, or would be inserted: chunks_[chunk][pos].
+  struct Position {
+    size_t chunk;
+    size_t pos;
+  };
+
+  template <typename Ref, typename Ptr>
+  class Iterator {
+   public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = Pair;
+    using difference_type = std::ptrdiff_t;
+    using pointer = Ptr;
+    using reference = Ref;
+
+    Iterator() = default;
+
+    /// Allow conversion from iterator to const_iterator, but not back.
+    template <typename R, typename P>
+      requires std::is_convertible_v<P, Ptr>
+    /* implicit */ Iterator(const Iterator<R, P>& other)
+        : link_{other.link_} {}
+
+    reference operator*() const {
+      return static_cast<Node*>(link_)->value;
+    }
+
+    pointer operator->() const {
+      return &static_cast<Node*>(link_)->value;
+    }
+
+    Iterator& operator++() {
+      link_ = link_->next;
+      return *this;
+    }
+
+    Iterator operator++(int) {
+      auto tmp = *this;
+      ++*this;
+      return tmp;
+    }
+
+    Iterator& operator--() {
+      link_ = link_->prev;
+      return *this;
+    }
+
+    Iterator operator--(int) {
+      auto tmp = *this;
+      --*this;
+      return tmp;
+    }
+
+    friend bool operator==(const Iterator& a, const Iterator& b) {
+      return a.link_ == b.link_;
+    }
+
+    friend bool operator!=(const Iterator& a, const Iterator& b) {
+      return a.link_ != b.link_;
+    }
+
+   private:
+    explicit Iterator(Link* link) : link_{link} {}
+
+    Link* link_{nullptr};
+
+    template <typename R, typename P>
+    friend class Iterator;
+    friend class ChunkedPathMap;
+  };
+
+ public:
+  /// Chunks are split in half when they would grow beyond this size.
+  static constexpr size_t kMaxChunkSize = 256;
+  /// A chunk that drops below this size is merged with a neighbour, or
+  /// refilled from it if the two would not fit in one chunk.
+  static constexpr size_t kMinChunkSize = kMaxChunkSize / 4;
+
+  // Various type aliases to satisfy container concepts.
+  using key_type = Key;
+  using mapped_type = Value;
+  using value_type = Pair;
+  using reference = Pair&;
+  using const_reference = const Pair&;
+  using pointer = Pair*;
+  using const_pointer = const Pair*;
+  using iterator = Iterator<Pair&, Pair*>;
+  using const_iterator = Iterator<const Pair&, const Pair*>;
+  using reverse_iterator = std::reverse_iterator<iterator>;
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+  using size_type = size_t;
+  using difference_type = std::ptrdiff_t;
+
+  // Construct empty.
+  explicit ChunkedPathMap(CaseSensitivity caseSensitive)
+      : caseSensitive_{caseSensitive} {
+    resetList();
+  }
+
+  // Populate from an initializer_list.
+  ChunkedPathMap(
+      std::initializer_list<value_type> init,
+      CaseSensitivity caseSensitive)
+      : ChunkedPathMap(init.begin(), init.end(), caseSensitive) {}
+
+  // Populate from a pair of input iterators.
+  template <typename InputIterator>
+  ChunkedPathMap(
+      InputIterator first,
+      InputIterator last,
+      CaseSensitivity caseSensitive)
+      : ChunkedPathMap{caseSensitive} {
+    for (; first != last; ++first) {
+      insert(*first);
+    }
+  }
+
+  // Initialize using given vector of entries, sorting and deduping if needed.
+  // The earliest of several equal entries wins, as with PathMap.
+  ChunkedPathMap(
+      folly::fbvector<value_type>&& entries,
+      CaseSensitivity caseSensitive)
+      : ChunkedPathMap{caseSensitive} {
+    auto less = [&](const value_type& a, const value_type& b) {
+      return isLess(a.first, b.first);
+    };
+    if (!std::is_sorted(entries.begin(), entries.end(), less)) {
+      std::stable_sort(entries.begin(), entries.end(), less);
+    }
+    for (auto& entry : entries) {
+      if (size_ == 0 || isLess(lastNode()->value.first, entry.first)) {
+        appendSorted(new Node(std::move(entry)), kMaxChunkSize / 2);
+      }
+    }
+  }
+
+  ChunkedPathMap(const ChunkedPathMap& other)
+      : ChunkedPathMap{other.caseSensitive_} {
+    for (const auto& entry : other) {
+      appendSorted(new Node(entry), kMaxChunkSize / 2);
+    }
+  }
+
+  ChunkedPathMap& operator=(const ChunkedPathMap& other) {
+    ChunkedPathMap(other).swap(*this);
+    return *this;
+  }
+
+  ChunkedPathMap(ChunkedPathMap&& other) noexcept
+      : caseSensitive_{other.caseSensitive_} {
+    resetList();
+    swap(other);
+  }
+
+  ChunkedPathMap& operator=(ChunkedPathMap&& other) noexcept {
+    other.swap(*this);
+    return *this;
+  }
+
+  ~ChunkedPathMap() {
+    clear();
+  }
+
+  iterator begin() noexcept {
+    return iterator{head_.next};
+  }
+  const_iterator begin() const noexcept {
+    return const_iterator{head_.next};
+  }
+  const_iterator cbegin() const noexcept {
+    return begin();
+  }
+  iterator end() noexcept {
+    return iterator{&head_};
+  }
+  const_iterator end() const noexcept {
+    return const_iterator{const_cast<Link*>(&head_)};
+  }
+  const_iterator cend() const noexcept {
+    return end();
+  }
+  reverse_iterator rbegin() noexcept {
+    return reverse_iterator{end()};
+  }
+  const_reverse_iterator rbegin() const noexcept {
+    return const_reverse_iterator{end()};
+  }
+  const_reverse_iterator crbegin() const noexcept {
+    return rbegin();
+  }
+  reverse_iterator rend() noexcept {
+    return reverse_iterator{begin()};
+  }
+  const_reverse_iterator rend() const noexcept {
+    return const_reverse_iterator{begin()};
+  }
+  const_reverse_iterator crend() const noexcept {
+    return rend();
+  }
+
+  size_type size() const noexcept {
+    return size_;
+  }
+
+  bool empty() const noexcept {
+    return size_ == 0;
+  }
+
+  size_type max_size() const noexcept {
+    return std::numeric_limits<difference_type>::max() / sizeof(Node);
+  }
+
+  /** Reserves room in the chunk index for count entries. Entries are
+   * allocated individually, so this does not preallocate them. */
+  void reserve(size_type count) {
+    chunks_.reserve(count / (kMaxChunkSize / 2) + 1);
+  }
+
+  void clear() noexcept {
+    Link* link = head_.next;
+    while (link != &head_) {
+      Link* next = link->next;
+      delete static_cast<Node*>(link);
+      link = next;
+    }
+    chunks_.clear();
+    size_ = 0;
+    resetList();
+  }
+
+  // Swap contents with another map.
+  void swap(ChunkedPathMap& other) noexcept {
+    std::swap(head_, other.head_);
+    std::swap(size_, other.size_);
+    fixupList();
+    other.fixupList();
+    std::swap(chunks_, other.chunks_);
+    std::swap(caseSensitive_, other.caseSensitive_);
+  }
+
+  /** Returns an iterator to the first entry that is not less than key. */
+  iterator lower_bound(Piece key) {
+    return iterator{linkAt(lowerBound(key))};
+  }
+
+  const_iterator lower_bound(Piece key) const {
+    return const_iterator{linkAt(lowerBound(key))};
+  }
+
+  /** Find using the Piece representation of a key.
+   * Does not allocate a copy of the key string.
+   */
+  iterator find(Piece key) {
+    return iterator{findLink(key)};
+  }
+
+  /** Find using the Piece representation of a key.
+   * Does not allocate a copy of the key string.
+   */
+  const_iterator find(Piece key) const {
+    return const_iterator{findLink(key)};
+  }
+
+  /** Insert a new key-value pair.
+   * If the key already exists, it is left unaltered.
+   * Returns a pair consisting of an iterator to the position for key and
+   * a boolean that is true if an insert took place. */
+  std::pair<iterator, bool> insert(const value_type& val) {
+    auto position = lowerBound(val.first);
+    if (auto* found = matchAt(position, val.first)) {
+      return std::make_pair(iterator{found}, false);
+    }
+    return std::make_pair(iterator{insertAt(position, new Node(val))}, true);
+  }
+
+  /** Emplace a new key-value pair by constructing it in-place.
+   * If the key already exists, it is left unaltered.
+   * If an insertion happens, the args are forwarded to the Value
+   * constructor.
+   * Returns a pair consisting of an iterator to the position for key and
+   * a boolean that is true if an insert took place. */
+  template <typename... Args>
+  std::pair<iterator, bool> emplace(Piece key, Args&&... args) {
+    auto position = lowerBound(key);
+    if (auto* found = matchAt(position, key)) {
+      return std::make_pair(iterator{found}, false);
+    }
+    auto* node = new Node(
+        std::piecewise_construct,
+        std::forward_as_tuple(key),
+        std::forward_as_tuple(std::forward<Args>(args)...));
+    return std::make_pair(iterator{insertAt(position, node)}, true);
+  }
+
+  /** Returns a reference to the map position for key, creating it needed.
+   * If the key is already present, no additional allocations are performed.
+   */
+  mapped_type& operator[](Piece key) {
+    return emplace(key).first->second;
+  }
+
+  /** Returns a reference to the map position for key, if present.
+   * Throws std::out_of_range if the key is not present (this const
+   * form is not allowed to mutate the map). */
+  const mapped_type& operator[](Piece key) const {
+    return at(key);
+  }
+
+  /** Returns a reference to the map position for key, if present.
+   * Throws std::out_of_range if the key is not present. */
+  mapped_type& at(Piece key) {
+    auto iter = find(key);
+    if (iter == end()) {
+      throwf<std::out_of_range>("no such key {}", key);
+    }
+    return iter->second;
+  }
+
+  /** Returns a reference to the map position for key, if present.
+   * Throws std::out_of_range if the key is not present. */
+  const mapped_type& at(Piece key) const {
+    const auto iter = find(key);
+    if (iter == end()) {
+      throwf<std::out_of_range>("no such key {}", key);
+    }
+    return iter->second;
+  }
+
+  /** Erase the value associated with key.
+   * Does not allocate any additional memory to look up the key.
+   * Returns the number of matching elements that were erased; this is
+   * always either 1 or 0. */
+  size_type erase(Piece key) {
+    auto position = lowerBound(key);
+    if (!matchAt(position, key)) {
+      return 0;
+    }
+    eraseAt(position);
+    return 1;
+  }
+
+  /** Erase the entry at pos. Only iterators to that entry are invalidated.
+   * Returns an iterator to the following entry. */
+  iterator erase(const_iterator pos) {
+    auto next = iterator{pos.link_->next};
+    eraseAt(lowerBound(pos->first));
+    return next;
+  }
+
+  /** Erase the entries in [first, last). */
+  iterator erase(const_iterator first, const_iterator last) {
+    while (first != last) {
+      first = erase(first);
+    }
+    return iterator{last.link_};
+  }
+
+  /** Returns 1 if there is an entry with the given key and 0 otherwise. */
+  size_type count(Piece key) const {
+    return find(key) != end();
+  }
+
+  CaseSensitivity getCaseSensitivity() const {
+    return caseSensitive_;
+  }
+
+  /// Equality operator.
+  friend bool operator==(const ChunkedPathMap& lhs, const ChunkedPathMap& rhs) {
+    return lhs.size_ == rhs.size_ &&
+        std::equal(lhs.begin(), lhs.end(), rhs.begin());
+  }
+
+  /// Inequality operator.
+  friend bool operator!=(const ChunkedPathMap& lhs, const ChunkedPathMap& rhs) {
+    return !(lhs == rhs);
+  }
+
+ private:
+  template <typename A, typename B>
+  bool isLess(const A& a, const B& b) const {
+    return isPathPieceLess(Piece(a), Piece(b), caseSensitive_);
+  }
+
+  void resetList() noexcept {
+    head_.prev = &head_;
+    head_.next = &head_;
+  }
+
+  /// Point the first and last nodes back at head_ after it was swapped.
+  void fixupList() noexcept {
+    if (size_ == 0) {
+      resetList();
+    } else {
+      head_.next->prev = &head_;
+      head_.prev->next = &head_;
+    }
+  }
+
+  Node* lastNode() const {
+    return static_cast<Node*>(head_.prev);
+  }
+
+  Position lowerBound(Piece key) const {
+    // The first chunk whose last entry is not less than key.
+    auto chunkIt = std::partition_point(
+        chunks_.begin(), chunks_.end(), [&](const Chunk& chunk) {
+          return isLess(chunk.back()->value.first, key);
+        });
+    if (chunkIt == chunks_.end()) {
+      // key sorts after every entry: insert at the end of the last chunk.
+      return chunks_.empty()
+          ? Position{0, 0}
+          : Position{chunks_.size() - 1, chunks_.back().size()};
+    }
+    auto posIt =
+        std::partition_point(chunkIt->begin(), chunkIt->end(), [&](Node* n) {
+          return isLess(n->value.first, key);
+        });
+    return Position{
+        static_cast<size_t>(chunkIt - chunks_.begin()),
+        static_cast<size_t>(posIt - chunkIt->begin())};
+  }
+
+  Link* linkAt(Position position) const {
+    if (position.chunk < chunks_.size() &&
+        position.pos < chunks_[position.chunk].size()) {
+      return chunks_[position.chunk][position.pos];
+    }
+    return const_cast<Link*>(&head_);
+  }
+
+  /// Returns the node at position if its key is equal to key.
+  Node* matchAt(Position position, Piece key) const {
+    auto* link = linkAt(position);
+    if (link == &head_) {
+      return nullptr;
+    }
+    auto* node = static_cast<Node*>(link);
+    return isLess(key, node->value.first) ? nullptr : node;
+  }
+
+  Link* findLink(Piece key) const {
+    auto* node = matchAt(lowerBound(key), key);
+    return node ? node : const_cast<Link*>(&head_);
+  }
+
+  static void linkBefore(Link* next, Node* node) noexcept {
+    node->prev = next->prev;
+    node->next = next;
+    next->prev->next = node;
+    next->prev = node;
+  }
+
+  /// Append a node that sorts after every other entry.
+  void appendSorted(Node* node, size_t chunkSize) {
+    std::unique_ptr<Node> guard{node};
+    if (chunks_.empty() || chunks_.back().size() >= chunkSize) {
+      chunks_.emplace_back().reserve(kMaxChunkSize);
+    }
+    chunks_.back().push_back(node);
+    guard.release();
+    linkBefore(&head_, node);
+    ++size_;
+  }
+
+  Link* insertAt(Position position, Node* node) {
+    std::unique_ptr<Node> guard{node};
+    if (chunks_.empty()) {
+      chunks_.emplace_back().reserve(kMaxChunkSize);
+    }
+    auto& chunk = chunks_[position.chunk];
+    // lowerBound only returns the end of a chunk for the last one, so the
+    // node goes before chunk[pos] or at the end of the list.
+    Link* next = linkAt(position);
+
+    chunk.insert(chunk.begin() + position.pos, node);
+    guard.release();
+    linkBefore(next, node);
+    ++size_;
+
+    if (chunk.size() > kMaxChunkSize) {
+      split(position.chunk);
+    }
+    return node;
+  }
+
+  void split(size_t index) {
+    auto& chunk = chunks_[index];
+    auto mid = chunk.begin() + chunk.size() / 2;
+    Chunk upper;
+    upper.reserve(kMaxChunkSize);
+    upper.assign(mid, chunk.end());
+    chunk.erase(mid, chunk.end());
+    chunks_.insert(chunks_.begin() + index + 1, std::move(upper));
+  }
+
+  void eraseAt(Position position) {
+    auto& chunk = chunks_[position.chunk];
+    Node* node = chunk[position.pos];
+    chunk.erase(chunk.begin() + position.pos);
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    delete node;
+    --size_;
+
+    if (chunk.empty()) {
+      chunks_.erase(chunks_.begin() + position.chunk);
+    } else if (chunk.size() < kMinChunkSize) {
+      rebalance(position.chunk);
+    }
+  }
+
+  /// Bring a small chunk back to at least kMinChunkSize entries, unless it is
+  /// the only one: fold it into its smaller neighbour, or, if the two would
+  /// fill most of a chunk, even out their sizes instead. Either way, only the
+  /// index changes; nodes stay where they are.
+  void rebalance(size_t index) {
+    if (chunks_.size() < 2) {
+      return;
+    }
+    size_t neighbour;
+    if (index == 0) {
+      neighbour = 1;
+    } else if (index + 1 == chunks_.size()) {
+      neighbour = index - 1;
+    } else {
+      neighbour = chunks_[index - 1].size() <= chunks_[index + 1].size()
+          ? index - 1
+          : index + 1;
+    }
+    auto first = std::min(index, neighbour);
+    auto second = std::max(index, neighbour);
+    // Leave a merged chunk some room, so that a few inserts don't split it
+    // right away.
+    if (chunks_[first].size() + chunks_[second].size() <=
+        kMaxChunkSize * 3 / 4) {
+      mergeInto(first, second);
+    } else {
+      balance(first, second);
+    }
+  }
+
+  /// Append chunks_[second] to chunks_[first] and drop it.
+  void mergeInto(size_t first, size_t second) {
+    auto& dest = chunks_[first];
+    auto& src = chunks_[second];
+    dest.insert(dest.end(), src.begin(), src.end());
+    chunks_.erase(chunks_.begin() + second);
+  }
+
+  /// Move entries across the boundary of chunks_[first] and the chunk after
+  /// it so that both hold half of their entries.
+  void balance(size_t first, size_t second) {
+    auto& a = chunks_[first];
+    auto& b = chunks_[second];
+    size_t target = (a.size() + b.size()) / 2;
+    if (a.size() < target) {
+      auto moved = b.begin() + (target - a.size());
+      a.insert(a.end(), b.begin(), moved);
+      b.erase(b.begin(), moved);
+    } else {
+      auto moved = a.end() - (a.size() - target);
+      b.insert(b.begin(), moved, a.end());
+      a.erase(moved, a.end());
+    }
+  }
+
+  Link head_;
+  std::vector<Chunk> chunks_;
+  size_t size_{0};
+  CaseSensitivity caseSensitive_;
+};
+
+} // namespace facebook::eden
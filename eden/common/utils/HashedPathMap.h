@@ -0,0 +1,303 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <folly/container/F14Map.h>
+#include <folly/hash/SpookyHashV2.h>
+#include <utility>
+
+#include "eden/common/utils/CaseSensitivity.h"
+#include "eden/common/utils/PathFuncs.h"
+#include "eden/common/utils/Throw.h"
+
+namespace facebook::eden {
+
+namespace detail {
+
+/**
+ * Hash of a path that agrees with isPathPieceEqual(..., Insensitive): ASCII
+ * letters are folded to lower case before hashing.
+ */
+template <typename Piece>
+size_t hashPathPieceCaseInsensitive(const Piece& piece) {
+  folly::hash::SpookyHashV2 hash;
+  hash.Init(0, 0);
+
+  auto update = [&](std::string_view s) {
+    char buf[256];
+    while (!s.empty()) {
+      size_t n = std::min(s.size(), sizeof(buf));
+      for (size_t i = 0; i < n; ++i) {
+        buf[i] = AsciiLessThanCaseInsensitive::toLower(s[i]);
+      }
+      hash.Update(buf, n);
+      s.remove_prefix(n);
+    }
+  };
+
+  if constexpr (
+      folly::kIsWindows &&
+      !std::is_same_v<Piece, PathComponentPiece>) {
+    // Composed paths compare component by component on Windows, so the
+    // separators must not contribute to the hash.
+    for (auto component : piece.components()) {
+      update(component.view());
+    }
+  } else {
+    update(piece.view());
+  }
+
+  uint64_t hash1, hash2;
+  hash.Final(&hash1, &hash2);
+  return hash1;
+}
+
+} // namespace detail
+
+/**
+ * An unordered associative container from one of our path types to an
+ * arbitrary value type.
+ *
+ * This is the hash based counterpart of PathMap, for very large directories
+ * where lookups dominate and sorted iteration is not needed:
+ * - lookups are O(1) rather than an O(log n) binary search, and inserts do not
+ *   shift the other entries around.
+ * - lookups can be made using the Piece variant of the key type without
+ *   allocating.
+ * - with a Hashed key type (HashedRelativePath, HashedAbsolutePath) the key's
+ *   hash is computed once, when the key is built, rather than on every rehash
+ *   or lookup. This only applies to case sensitive maps: case insensitive maps
+ *   must fold the key before hashing it.
+ * - iteration order is unspecified, and insert and erase operations may
+ *   invalidate iterators.
+ */
+template <typename Value, typename Key = HashedRelativePath>
+class HashedPathMap {
+  using Piece = typename Key::piece_type;
+
+  struct Hash {
+    using is_transparent = void;
+
+    size_t operator()(const Key& key) const {
+      if (caseSensitive_ == CaseSensitivity::Sensitive) {
+        return detail::hash_value(key);
+      }
+      return detail::hashPathPieceCaseInsensitive(key.piece());
+    }
+
+    size_t operator()(const Piece& piece) const {
+      if (caseSensitive_ == CaseSensitivity::Sensitive) {
+        return detail::hash_value(piece);
+      }
+      return detail::hashPathPieceCaseInsensitive(piece);
+    }
+
+    size_t operator()(const HashedPathLiteral<Piece>& literal) const {
+      if (caseSensitive_ == CaseSensitivity::Sensitive) {
+        return literal.hash();
+      }
+      return detail::hashPathPieceCaseInsensitive(literal.piece());
+    }
+
+    CaseSensitivity caseSensitive_;
+  };
+
+  struct Equal {
+    using is_transparent = void;
+
+    template <typename A, typename B>
+    bool operator()(const A& a, const B& b) const {
+      return isPathPieceEqual(toPiece(a), toPiece(b), caseSensitive_);
+    }
+
+    static Piece toPiece(Piece piece) {
+      return piece;
+    }
+
+    CaseSensitivity caseSensitive_;
+  };
+
+  using Map = folly::F14FastMap<Key, Value, Hash, Equal>;
+
+ public:
+  using key_type = Key;
+  using mapped_type = Value;
+  using value_type = typename Map::value_type;
+  using iterator = typename Map::iterator;
+  using const_iterator = typename Map::const_iterator;
+  using size_type = typename Map::size_type;
+
+  explicit HashedPathMap(CaseSensitivity caseSensitive)
+      : map_{0, Hash{caseSensitive}, Equal{caseSensitive}},
+        caseSensitive_{caseSensitive} {}
+
+  HashedPathMap(
+      std::initializer_list<std::pair<Key, Value>> init,
+      CaseSensitivity caseSensitive)
+      : HashedPathMap{caseSensitive} {
+    reserve(init.size());
+    for (const auto& entry : init) {
+      insert(entry);
+    }
+  }
+
+  iterator begin() {
+    return map_.begin();
+  }
+  const_iterator begin() const {
+    return map_.begin();
+  }
+  iterator end() {
+    return map_.end();
+  }
+  const_iterator end() const {
+    return map_.end();
+  }
+
+  size_type size() const {
+    return map_.size();
+  }
+
+  bool empty() const {
+    return map_.empty();
+  }
+
+  void clear() {
+    map_.clear();
+  }
+
+  void reserve(size_type count) {
+    map_.reserve(count);
+  }
+
+  /** Find using the Piece representation of a key.
+   * Does not allocate a copy of the key string.
+   */
+  iterator find(Piece key) {
+    return map_.find(key);
+  }
+
+  const_iterator find(Piece key) const {
+    return map_.find(key);
+  }
+
+  /** Find using a path literal, such as ".hg"_hrelpath. In a case sensitive
+   * map, this uses the hash computed at compile time.
+   */
+  iterator find(const HashedPathLiteral<Piece>& key) {
+    return map_.find(key);
+  }
+
+  const_iterator find(const HashedPathLiteral<Piece>& key) const {
+    return map_.find(key);
+  }
+
+  /** Find using a stored key. With a Hashed key type in a case sensitive map,
+   * this does not rehash the key.
+   */
+  iterator find(const Key& key) {
+    return map_.find(key);
+  }
+
+  const_iterator find(const Key& key) const {
+    return map_.find(key);
+  }
+
+  /** Insert a new key-value pair.
+   * If the key already exists, it is left unaltered.
+   * Returns a pair consisting of an iterator to the position for key and
+   * a boolean that is true if an insert took place. */
+  std::pair<iterator, bool> insert(const std::pair<Key, Value>& val) {
+    return map_.insert(val);
+  }
+
+  std::pair<iterator, bool> insert(std::pair<Key, Value>&& val) {
+    return map_.insert(std::move(val));
+  }
+
+  /** Emplace a new key-value pair by constructing it in-place.
+   * If the key already exists, it is left unaltered and no copy of the key is
+   * made. If an insertion happens, the args are forwarded to the Value
+   * constructor. */
+  template <typename... Args>
+  std::pair<iterator, bool> emplace(Piece key, Args&&... args) {
+    auto iter = map_.find(key);
+    if (iter != map_.end()) {
+      return std::make_pair(iter, false);
+    }
+    return map_.try_emplace(Key{key}, std::forward<Args>(args)...);
+  }
+
+  /** Returns a reference to the map position for key, creating it needed.
+   * If the key is already present, no additional allocations are performed.
+   */
+  mapped_type& operator[](Piece key) {
+    return emplace(key).first->second;
+  }
+
+  /** Returns a reference to the map position for key, if present.
+   * Throws std::out_of_range if the key is not present. */
+  mapped_type& at(Piece key) {
+    auto iter = find(key);
+    if (iter == end()) {
+      throwf<std::out_of_range>("no such key {}", key);
+    }
+    return iter->second;
+  }
+
+  const mapped_type& at(Piece key) const {
+    auto iter = find(key);
+    if (iter == end()) {
+      throwf<std::out_of_range>("no such key {}", key);
+    }
+    return iter->second;
+  }
+
+  /** Erase the value associated with key.
+   * Returns the number of matching elements that were erased; this is
+   * always either 1 or 0. */
+  size_type erase(Piece key) {
+    auto iter = find(key);
+    if (iter == end()) {
+      return 0;
+    }
+    map_.erase(iter);
+    return 1;
+  }
+
+  iterator erase(const_iterator pos) {
+    return map_.erase(pos);
+  }
+
+  /** Returns 1 if there is an entry with the given key and 0 otherwise. */
+  size_type count(Piece key) const {
+    return find(key) != end();
+  }
+
+  size_type count(const HashedPathLiteral<Piece>& key) const {
+    return find(key) != end();
+  }
+
+  CaseSensitivity getCaseSensitivity() const {
+    return caseSensitive_;
+  }
+
+  friend bool operator==(const HashedPathMap& lhs, const HashedPathMap& rhs) {
+    return lhs.map_ == rhs.map_;
+  }
+
+  friend bool operator!=(const HashedPathMap& lhs, const HashedPathMap& rhs) {
+    return lhs.map_ != rhs.map_;
+  }
+
+ private:
+  Map map_;
+  CaseSensitivity caseSensitive_;
+};
+
+} // namespace facebook::eden
@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "eden/common/utils/InternedPathComponent.h"
+
+#include <folly/Synchronized.h>
+#include <folly/container/F14Map.h>
+#include <folly/hash/SpookyHashV2.h>
+#include <folly/memory/Malloc.h>
+#include <array>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "eden/common/utils/Throw.h"
+
+namespace facebook::eden {
+
+namespace detail {
+
+constinit InternedNameIndex internedNameIndex;
+
+void InternedNameIndex::store(uint32_t id, InternedName name) {
+  auto& slot = segments_[id >> kSegmentBits];
+  auto* segment = slot.load(std::memory_order_acquire);
+  if (!segment) {
+    // Ids are allocated across shards concurrently, so two threads may race
+    // to create the same segment.
+    auto fresh = std::make_unique<InternedName[]>(kSegmentSize);
+    if (slot.compare_exchange_strong(
+            segment, fresh.get(), std::memory_order_acq_rel)) {
+      segment = fresh.release();
+      allocatedBytes_.fetch_add(
+          sizeof(InternedName) * kSegmentSize, std::memory_order_relaxed);
+    }
+  }
+  segment[id & (kSegmentSize - 1)] = name;
+}
+
+} // namespace detail
+
+namespace {
+
+constexpr size_t kShardCount = 64;
+constexpr size_t kArenaChunkSize = 64 * 1024;
+
+/**
+ * The longest string folly::fbstring stores without a heap allocation.
+ */
+constexpr size_t kFbstringMaxSmallSize = 23;
+
+size_t owningPathComponentBytes(size_t size) {
+  return size <= kFbstringMaxSmallSize ? 0 : folly::goodMallocSize(size + 1);
+}
+
+struct ShardState {
+  folly::F14FastMap<std::string_view, uint32_t> ids;
+  std::vector<std::unique_ptr<char[]>> chunks;
+  char* next{nullptr};
+  size_t remaining{0};
+  size_t allocatedBytes{0};
+
+  /**
+   * Copy name into the shard's arena.
+   */
+  std::string_view copy(std::string_view name) {
+    if (name.size() > kArenaChunkSize / 4) {
+      // Rather than waste the rest of the current chunk, give unusually long
+      // names their own allocation.
+      chunks.push_back(std::make_unique<char[]>(name.size()));
+      allocatedBytes += name.size();
+      std::memcpy(chunks.back().get(), name.data(), name.size());
+      return std::string_view{chunks.back().get(), name.size()};
+    }
+    if (name.size() > remaining) {
+      chunks.push_back(std::make_unique<char[]>(kArenaChunkSize));
+      allocatedBytes += kArenaChunkSize;
+      next = chunks.back().get();
+      remaining = kArenaChunkSize;
+    }
+    char* dest = next;
+    std::memcpy(dest, name.data(), name.size());
+    next += name.size();
+    remaining -= name.size();
+    return std::string_view{dest, name.size()};
+  }
+};
+
+struct alignas(64) Shard {
+  folly::Synchronized<ShardState> state;
+  std::atomic<size_t> internCalls{0};
+  std::atomic<size_t> owningBytes{0};
+};
+
+class InternTable {
+ public:
+  uint32_t intern(std::string_view name) {
+    auto& shard = shards_[folly::hash::SpookyHashV2::Hash64(
+                              name.data(), name.size(), 0) %
+                          kShardCount];
+    shard.internCalls.fetch_add(1, std::memory_order_relaxed);
+    shard.owningBytes.fetch_add(
+        owningPathComponentBytes(name.size()), std::memory_order_relaxed);
+
+    {
+      auto state = shard.state.rlock();
+      auto it = state->ids.find(name);
+      if (it != state->ids.end()) {
+        return it->second;
+      }
+    }
+
+    auto state = shard.state.wlock();
+    auto it = state->ids.find(name);
+    if (it != state->ids.end()) {
+      return it->second;
+    }
+
+    auto id = nextId_.fetch_add(1, std::memory_order_relaxed);
+    if (id == std::numeric_limits<uint32_t>::max()) {
+      nextId_.store(id, std::memory_order_relaxed);
+      throw_<std::length_error>(
+          "InternedPathComponent table is full, cannot intern ", name);
+    }
+    auto stored = state->copy(name);
+    // The name must be readable through the index before another thread can
+    // observe the id, which happens no earlier than the unlock below.
+    detail::internedNameIndex.store(
+        id,
+        detail::InternedName{
+            stored.data(), static_cast<uint32_t>(stored.size())});
+    state->ids.emplace(stored, id);
+    return id;
+  }
+
+  InternedPathComponent::Stats getStats() {
+    InternedPathComponent::Stats stats{};
+    size_t owningBytes = 0;
+    for (auto& shard : shards_) {
+      stats.internCalls += shard.internCalls.load(std::memory_order_relaxed);
+      owningBytes += shard.owningBytes.load(std::memory_order_relaxed);
+      auto state = shard.state.rlock();
+      stats.uniqueNames += state->ids.size();
+      stats.tableBytes += state->allocatedBytes;
+    }
+    stats.tableBytes += detail::internedNameIndex.getAllocatedBytes();
+    stats.bytesSaved = static_cast<int64_t>(owningBytes) -
+        static_cast<int64_t>(stats.tableBytes);
+    return stats;
+  }
+
+ private:
+  std::array<Shard, kShardCount> shards_;
+  std::atomic<uint32_t> nextId_{0};
+};
+
+InternTable& getInternTable() {
+  // Leaked so that InternedPathComponents in other static objects remain
+  // usable during shutdown.
+  static auto* table = new InternTable;
+  return *table;
+}
+
+} // namespace
+
+InternedPathComponent::InternedPathComponent(PathComponentPiece piece)
+    : id_{getInternTable().intern(piece.view())} {}
+
+InternedPathComponent::Stats InternedPathComponent::getStats() {
+  return getInternTable().getStats();
+}
+
+size_t estimateInterningSavings(const InternedPathComponent& path) {
+  return owningPathComponentBytes(path.view().size());
+}
+
+} // namespace facebook::eden
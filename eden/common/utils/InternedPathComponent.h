@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <fmt/format.h>
+#include <folly/hash/Hash.h>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "eden/common/utils/PathFuncs.h"
+
+namespace facebook::eden {
+
+namespace detail {
+
+/**
+ * Location of an interned name. Names are never freed, so a view into the
+ * table remains valid for the life of the process.
+ */
+struct InternedName {
+  const char* data;
+  uint32_t size;
+};
+
+/**
+ * Maps 32-bit ids to the names they were assigned to. Ids are handed out in
+ * insertion order and stored in fixed size segments that are allocated on
+ * demand and never move, so lookups are a pair of loads with no locking.
+ */
+class InternedNameIndex {
+ public:
+  static constexpr uint32_t kSegmentBits = 16;
+  static constexpr uint32_t kSegmentSize = uint32_t{1} << kSegmentBits;
+  static constexpr uint32_t kMaxSegments = uint32_t{1}
+      << (32 - kSegmentBits);
+
+  InternedName lookup(uint32_t id) const noexcept {
+    auto* segment =
+        segments_[id >> kSegmentBits].load(std::memory_order_acquire);
+    return segment[id & (kSegmentSize - 1)];
+  }
+
+  /**
+   * Record the name for a freshly allocated id. Must happen before the id is
+   * published to other threads.
+   */
+  void store(uint32_t id, InternedName name);
+
+  /// Bytes allocated for segments so far.
+  size_t getAllocatedBytes() const noexcept {
+    return allocatedBytes_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  std::atomic<InternedName*> segments_[kMaxSegments]{};
+  std::atomic<size_t> allocatedBytes_{0};
+};
+
+/**
+ * The process-wide index. It is constant-initialized, so it may be used from
+ * other static initializers.
+ */
+extern InternedNameIndex internedNameIndex;
+
+} // namespace detail
+
+/**
+ * A PathComponent whose bytes live in a process-wide interning table.
+ *
+ * Directory listings repeat the same few thousand names ("src", "BUCK",
+ * "__init__.py", ...) millions of times. A PathComponent owns a separate heap
+ * copy of each one; an InternedPathComponent is a 4-byte id into a shared
+ * table instead, so every occurrence of a name after the first costs nothing
+ * beyond the id.
+ *
+ * Equality and hashing use the id: two InternedPathComponents are equal if
+ * and only if their bytes are. Ordering uses the bytes so that it agrees with
+ * PathComponent, which lets InternedPathComponent be used as the Key of a
+ * PathMap.
+ *
+ * Interned names are never released. Only use this for names drawn from a
+ * bounded vocabulary, such as the entries of source control trees.
+ */
+class InternedPathComponent {
+ public:
+  using piece_type = PathComponentPiece;
+  using stored_type = InternedPathComponent;
+
+  /// Intern an already validated component.
+  explicit InternedPathComponent(PathComponentPiece piece);
+
+  /// Validate and intern.
+  explicit InternedPathComponent(std::string_view name)
+      : InternedPathComponent(PathComponentPiece{name}) {}
+
+  /// Reconstruct from a value previously returned by id().
+  static InternedPathComponent fromId(uint32_t id) noexcept {
+    return InternedPathComponent{id};
+  }
+
+  uint32_t id() const noexcept {
+    return id_;
+  }
+
+  std::string_view view() const noexcept {
+    auto name = detail::internedNameIndex.lookup(id_);
+    return std::string_view{name.data, name.size};
+  }
+
+  PathComponentPiece piece() const noexcept {
+    return PathComponentPiece{view(), detail::SkipPathSanityCheck{}};
+  }
+
+  /* implicit */ operator PathComponentPiece() const noexcept {
+    return piece();
+  }
+
+  explicit operator std::string_view() const noexcept {
+    return view();
+  }
+
+  std::string asString() const {
+    return std::string{view()};
+  }
+
+  PathComponent copy() const {
+    return PathComponent{view(), detail::SkipPathSanityCheck{}};
+  }
+
+  friend bool operator==(
+      const InternedPathComponent& a,
+      const InternedPathComponent& b) noexcept {
+    return a.id_ == b.id_;
+  }
+
+  friend bool operator!=(
+      const InternedPathComponent& a,
+      const InternedPathComponent& b) noexcept {
+    return a.id_ != b.id_;
+  }
+
+  friend bool operator<(
+      const InternedPathComponent& a,
+      const InternedPathComponent& b) noexcept {
+    return a.id_ != b.id_ && a.view() < b.view();
+  }
+
+  friend bool isPathPieceEqual(
+      const InternedPathComponent& a,
+      const InternedPathComponent& b,
+      CaseSensitivity caseSensitive) {
+    if (a.id_ == b.id_) {
+      return true;
+    }
+    return caseSensitive == CaseSensitivity::Insensitive &&
+        isPathPieceEqual(a.piece(), b.piece(), caseSensitive);
+  }
+
+  friend bool isPathPieceLess(
+      const InternedPathComponent& a,
+      const InternedPathComponent& b,
+      CaseSensitivity caseSensitive) {
+    return a.id_ != b.id_ &&
+        isPathPieceLess(a.piece(), b.piece(), caseSensitive);
+  }
+
+  struct Stats {
+    /// Number of distinct names in the table.
+    size_t uniqueNames;
+    /// Number of times a name was interned, including repeats.
+    size_t internCalls;
+    /// Bytes allocated by the table for name storage and the id index.
+    size_t tableBytes;
+    /**
+     * Heap bytes that every interned name would have cost had each call
+     * produced an owning PathComponent instead, minus tableBytes. This is
+     * cumulative: names are never released, so it does not go down when
+     * InternedPathComponents are destroyed.
+     */
+    int64_t bytesSaved;
+  };
+
+  static Stats getStats();
+
+ private:
+  explicit InternedPathComponent(uint32_t id) noexcept : id_{id} {}
+
+  uint32_t id_;
+};
+
+static_assert(sizeof(InternedPathComponent) == sizeof(uint32_t));
+
+inline size_t hash_value(const InternedPathComponent& path) {
+  return folly::hash::twang_mix64(path.id());
+}
+
+/**
+ * An InternedPathComponent owns no memory of its own; the name is charged to
+ * the shared table, see InternedPathComponent::getStats().
+ */
+inline size_t estimateIndirectMemoryUsage(const InternedPathComponent&) {
+  return 0;
+}
+
+/**
+ * Returns the heap bytes an owning PathComponent holding the same name would
+ * use; this is what interning saves for each instance beyond the first.
+ */
+size_t estimateInterningSavings(const InternedPathComponent& path);
+
+} // namespace facebook::eden
+
+namespace std {
+template <>
+struct hash<facebook::eden::InternedPathComponent> {
+  size_t operator()(const facebook::eden::InternedPathComponent& s) const {
+    return facebook::eden::hash_value(s);
+  }
+};
+} // namespace std
+
+template <>
+struct fmt::formatter<facebook::eden::InternedPathComponent>
+    : formatter<string_view> {
+  template <typename Context>
+  auto format(const facebook::eden::InternedPathComponent& p, Context& ctx)
+      const {
+    return formatter<string_view>::format(p.view(), ctx);
+  }
+};
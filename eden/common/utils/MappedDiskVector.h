@@ -8,15 +8,26 @@
 #pragma once
 
 #include <folly/portability/Unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstdint>
+#include <exception>
 #include <functional>
+#include <future>
+#include <optional>
+#include <string>
+#include <thread>
 #include <type_traits>
+#include <utility>
+#include <vector>
 
 #include <eden/common/utils/Bug.h>
 #include <folly/Exception.h>
 #include <folly/File.h>
 #include <folly/FileUtil.h>
 #include <folly/Range.h>
+#include <folly/String.h>
 #include <folly/logging/xlog.h>
 
 #ifndef _WIN32
@@ -25,6 +36,11 @@
 #include <sys/mman.h>
 #endif
 
+#ifdef __linux__
+#include <linux/magic.h>
+#include <sys/vfs.h>
+#endif
+
 namespace facebook::eden {
 
 namespace detail {
@@ -42,6 +58,12 @@ inline size_t roundUpToNonzeroPageSize(size_t s) {
   return std::max(kPageSize, (s + kPageSize - 1) & ~(kPageSize - 1));
 }
 
+/**
+ * The PMD size on x86-64 and on arm64 with 4 KB base pages: the unit a
+ * transparent huge page maps, and so the alignment huge-page mode keeps.
+ */
+constexpr size_t kHugePageSize = 2 * 1024 * 1024;
+
 /**
  * Enforce required properties of
  */
@@ -79,13 +101,84 @@ template <typename T, typename... OldVersions>
 struct Migrator;
 } // namespace detail
 
+template <typename T, typename From>
+class MappedDiskVectorMigration;
+
+/**
+ * Tuning knobs for MappedDiskVector::open() and createOrOverwrite().  The
+ * defaults reproduce the historical behavior.
+ */
+struct MappedDiskVectorOptions {
+  /**
+   * Crash-consistent appends.  The header records a committed entry count
+   * alongside the live one, and open() ignores any records appended after the
+   * last commit, so a crash can never expose a partially written record.
+   *
+   * Records are flushed to disk with msync before the committed count
+   * advances, and the count itself is flushed afterwards.  In-place writes to
+   * already-committed records through operator[] become durable at the next
+   * commit but, unlike appends, are not atomic.
+   */
+  bool durable{false};
+
+  /**
+   * In durable mode, emplace_back() commits once the oldest uncommitted
+   * append is this old, so that a burst of appends shares a single pair of
+   * flushes.  Zero commits every append.
+   *
+   * There is no timer: the check only runs on emplace_back(), so appends
+   * that end a burst stay uncommitted until the next append, an explicit
+   * commit(), or destruction.  Callers that need to bound how long that can
+   * take must call commit() themselves.
+   */
+  std::chrono::milliseconds commitInterval{100};
+
+  /**
+   * Back the mapping with huge pages to cut TLB misses when scanning large
+   * vectors.  The file grows in kHugePageSize steps and the mapping is
+   * aligned to match and advised with MADV_HUGEPAGE.  Whether the kernel
+   * actually uses transparent huge pages for the file depends on its version
+   * and filesystem; when it doesn't, this behaves like regular pages.
+   *
+   * Files on hugetlbfs always use that filesystem's page size, regardless of
+   * this option.  There, running out of reserved huge pages surfaces as a
+   * std::system_error from open() or emplace_back().
+   */
+  bool hugePages{false};
+
+  /**
+   * When nonzero, reserve this many bytes of address space up front and grow
+   * the file into it in place, so the mapping never moves.  That lets one
+   * writer thread call emplace_back() while any number of reader threads use
+   * size() and operator[] without a lock.  emplace_back() throws
+   * std::length_error once the file would outgrow the reservation.
+   *
+   * Address space is cheap on 64-bit platforms: a 1 TB reservation costs no
+   * memory until the file grows into it.
+   */
+  size_t addressSpaceReservation{0};
+
+  /**
+   * open() faults in the whole mapping before returning so that disk errors
+   * surface as exceptions rather than SIGBUS.  On a cold page cache that is
+   * bound by read latency, so split it across this many threads to keep
+   * more reads in flight.
+   */
+  size_t openPopulateThreads{1};
+};
+
 /**
  * MappedDiskVector is roughly analogous to std::vector, except it's backed by
  * a persistent memory-mapped file.
  *
  * MappedDiskVector is not thread-safe - the caller is
  * responsible for synchronization. It is safe for multiple threads to
- * simultaneously read, however.
+ * simultaneously read, however.  With
+ * MappedDiskVectorOptions::addressSpaceReservation, those reads may also run
+ * concurrently with a single thread calling emplace_back(): size() is
+ * published with release semantics after each record is constructed, so a
+ * reader may access any index below a size() it has observed.  pop_back() and
+ * writes through operator[] still need external synchronization.
  *
  * While alive, MappedDiskVector does acquire an exclusive flock on the
  * underlying fd to avoid multiple processes manipulating it at the same time.
@@ -101,6 +194,13 @@ struct Migrator;
  * an instance of the type of the right. When migrating from C to A above,
  * the new file will contain values constructed with C{B{oldA}}.
  *
+ * With MappedDiskVectorOptions::durable, appends are grouped into commits and
+ * only committed records survive a crash.  See MappedDiskVectorOptions.
+ *
+ * For tables too large to convert before serving reads,
+ * MappedDiskVectorMigration converts from one old record type in the
+ * background instead.
+ *
  * This type needs to be split into two: the non-template, untyped storage
  * class that manages resizing the file and mapping and parsing the header,
  * and the typed view that owns the storage and exposes it as a typed vector.
@@ -131,6 +231,14 @@ class MappedDiskVector {
   static MappedDiskVector open(
       folly::StringPiece path,
       std::function<void()> afterMmap = nullptr) {
+    return open<OldVersions...>(path, {}, std::move(afterMmap));
+  }
+
+  template <typename... OldVersions>
+  static MappedDiskVector open(
+      folly::StringPiece path,
+      const MappedDiskVectorOptions& options,
+      std::function<void()> afterMmap = nullptr) {
     folly::File file{path, O_RDWR | O_CREAT | O_CLOEXEC, 0600};
 
     if (!file.try_lock()) {
@@ -142,31 +250,11 @@ class MappedDiskVector {
         fstat(file.fd(), &st), "fstat failed on MappedDiskVector path ", path);
 
     if (st.st_size == 0) {
-      return initializeFromScratch(std::move(file));
-    }
-
-    Header header;
-    ssize_t readBytes =
-        folly::preadNoInt(file.fd(), &header, sizeof(header), 0);
-    if (readBytes == -1) {
-      folly::throwSystemError("failed to read MappedDiskVector header");
-    } else if (readBytes != sizeof(header)) {
-      XLOGF(
-          WARNING,
-          "file contains incomplete header: only read {} bytes",
-          readBytes);
-      throw std::runtime_error("Incomplete MappedDiskVector header");
+      return initializeFromScratch(std::move(file), options);
     }
 
-    if (kMagic != header.magic || header.version != 1 ||
-        static_cast<ssize_t>(sizeof(header)) > st.st_size ||
-        header.recordSize == 0 ||
-        // careful not to overflow by multiplying entryCount by recordSize
-        header.entryCount > (st.st_size - sizeof(header)) / header.recordSize ||
-        header.unused != 0) {
-      throw std::runtime_error(
-          "Invalid header: this is probably not a MappedDiskVector file");
-    }
+    Header header = readHeader(file.fd(), st.st_size);
+    size_t entryCount = header.entryCount;
 
     // Verify that every given record type has a unique VERSION value.
     // This check could be done at compile time.
@@ -194,7 +282,7 @@ class MappedDiskVector {
                 header.recordSize));
       }
       return MappedDiskVector{
-          std::move(file), st.st_size, header.entryCount, std::move(afterMmap)};
+          std::move(file), st.st_size, entryCount, options, afterMmap};
     }
 
     // Try to migrate from an old record format if any match.
@@ -211,12 +299,18 @@ class MappedDiskVector {
                   " but file has ",
                   header.recordSize));
         }
+        // Open the original in its own mode, so that a failed migration
+        // leaves it as it was.
+        MappedDiskVectorOptions originalOptions;
+        originalOptions.durable = header.version == kDurableVersion;
         return detail::Migrator<T, OldVersions...>::migrateFrom(
             path,
             std::move(file),
             st.st_size,
-            header.entryCount,
+            entryCount,
             i,
+            originalOptions,
+            options,
             [](const auto& from) { return T{from}; });
       }
     }
@@ -238,14 +332,16 @@ class MappedDiskVector {
    * Creates a new MappedDiskVector at the specified path, overwriting any that
    * was there prior.
    */
-  static MappedDiskVector createOrOverwrite(folly::StringPiece path) {
+  static MappedDiskVector createOrOverwrite(
+      folly::StringPiece path,
+      const MappedDiskVectorOptions& options = {}) {
     folly::File file{
         path, O_RDWR | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, 0600};
     if (!file.try_lock()) {
       folly::throwSystemError("failed to acquire lock on ", path);
     }
 
-    return initializeFromScratch(std::move(file));
+    return initializeFromScratch(std::move(file), options);
   }
 
   explicit MappedDiskVector() = delete;
@@ -254,41 +350,48 @@ class MappedDiskVector {
 
   MappedDiskVector(MappedDiskVector&& other) : file_(std::move(other.file_)) {
     begin_ = other.begin_;
-    end_ = other.end_;
+    end_.store(other.end_.load(std::memory_order_relaxed));
     map_ = other.map_;
     mapSizeInBytes_ = other.mapSizeInBytes_;
+    reservedBytes_ = other.reservedBytes_;
+    options_ = other.options_;
+    firstUncommittedAppend_ = other.firstUncommittedAppend_;
+    geometry_ = other.geometry_;
 
     other.begin_ = nullptr;
-    other.end_ = nullptr;
+    other.end_.store(nullptr);
     other.map_ = nullptr;
     other.mapSizeInBytes_ = 0;
+    other.reservedBytes_ = 0;
   }
 
   MappedDiskVector& operator=(MappedDiskVector&& other) {
-    if (map_) {
-      munmap(map_, mapSizeInBytes_);
-    }
+    unmap();
 
     file_ = std::move(other.file_);
     begin_ = other.begin_;
-    end_ = other.end_;
+    end_.store(other.end_.load(std::memory_order_relaxed));
     map_ = other.map_;
     mapSizeInBytes_ = other.mapSizeInBytes_;
+    reservedBytes_ = other.reservedBytes_;
+    options_ = other.options_;
+    firstUncommittedAppend_ = other.firstUncommittedAppend_;
+    geometry_ = other.geometry_;
 
     other.begin_ = nullptr;
-    other.end_ = nullptr;
+    other.end_.store(nullptr);
     other.map_ = nullptr;
     other.mapSizeInBytes_ = 0;
+    other.reservedBytes_ = 0;
+    return *this;
   }
 
   ~MappedDiskVector() {
-    if (map_) {
-      munmap(map_, mapSizeInBytes_);
-    }
+    unmap();
   }
 
   size_t size() const {
-    return end_ - begin_;
+    return end_.load(std::memory_order_acquire) - begin_;
   }
 
   size_t capacity() const {
@@ -309,6 +412,37 @@ class MappedDiskVector {
     populateForWrite(begin_ + index, sizeof(T));
   }
 
+  /**
+   * Hints that records [begin, end) will be read soon, so the kernel starts
+   * reading them in without blocking the caller.
+   */
+  void prefetch(size_t begin, size_t end) const {
+    auto [addr, length] = pageRange(begin, end);
+    if (length) {
+      madvise(addr, length, MADV_WILLNEED);
+    }
+  }
+
+  /**
+   * Faults records [begin, end) into the mapping on a background thread,
+   * so that a later scan touches no missing pages at all.  Errors, such as
+   * EIO from the backing store, are reported through the future.
+   *
+   * The returned future comes from std::async, so destroying it blocks until
+   * the prefetch is done: keep it for as long as the caller should not wait.
+   * For a hint that never blocks, use prefetch().
+   *
+   * The vector must not be destroyed, nor grown unless it has an
+   * addressSpaceReservation, before the future is ready.
+   */
+  [[nodiscard]] std::future<void> prefetchAsync(size_t begin, size_t end)
+      const {
+    auto [addr, length] = pageRange(begin, end);
+    return std::async(std::launch::async, [addr = addr, length = length] {
+      populateForRead(addr, length);
+    });
+  }
+
   template <typename... Args>
   void emplace_back(Args&&... args) {
     if (!hasRoom(1)) {
@@ -317,88 +451,189 @@ class MappedDiskVector {
           "Growth must expand the file more than a single record");
 
       size_t oldSize = size();
-      size_t newFileSize =
-          mapSizeInBytes_ + GROWTH_IN_PAGES * detail::kPageSize;
+      size_t newFileSize = mapSizeInBytes_ + geometry_.growthBytes;
 
       // Always keep the file size a whole number of pages.
       XCHECK_EQ(0ul, newFileSize % detail::kPageSize);
 
-      extendFile(file_.fd(), newFileSize);
-
-#ifdef __APPLE__
-      auto newMap = mmap(
-          nullptr,
-          newFileSize,
-          PROT_READ | PROT_WRITE,
-          MAP_SHARED,
-          file_.fd(),
-          0);
-#else
-      auto newMap = mremap(map_, mapSizeInBytes_, newFileSize, MREMAP_MAYMOVE);
-#endif
-      if (newMap == MAP_FAILED) {
-        folly::throwSystemError(
-            folly::to<std::string>(
-                "mremap failed when growing capacity from ",
-                mapSizeInBytes_,
-                " to ",
-                newFileSize));
+      if (reservedBytes_) {
+        growInPlace(newFileSize);
+      } else {
+        growByRemapping(newFileSize);
       }
-
-#ifdef __APPLE__
-      munmap(map_, mapSizeInBytes_);
-#endif
-      map_ = newMap;
-      mapSizeInBytes_ = newFileSize;
-
-      begin_ = reinterpret_cast<T*>(static_cast<Header*>(newMap) + 1);
-      end_ = begin_ + oldSize;
+      end_.store(begin_ + oldSize, std::memory_order_relaxed);
 
       // Pre-fault the newly grown region. map_ is page-aligned (mmap/mremap
-      // guarantee) and the old mapping size is a multiple of GROWTH_IN_PAGES *
-      // kPageSize, so the address is system-page-aligned on all platforms.
+      // guarantee) and the old mapping size is a multiple of growthBytes, so
+      // the address is system-page-aligned on all platforms.
       populateForWrite(
-          static_cast<char*>(map_) +
-              (mapSizeInBytes_ - GROWTH_IN_PAGES * detail::kPageSize),
-          GROWTH_IN_PAGES * detail::kPageSize);
+          static_cast<char*>(map_) + (mapSizeInBytes_ - geometry_.growthBytes),
+          geometry_.growthBytes);
     }
 
-    T* out = end_;
+    // Only this thread writes end_, but readers must not see the new size
+    // before the record it covers is constructed.
+    T* out = end_.load(std::memory_order_relaxed);
     populateForWrite(out, sizeof(T));
     new (out) T{std::forward<Args>(args)...}; // may throw
-    end_ = out + 1;
+    end_.store(out + 1, std::memory_order_release);
 
     ++header().entryCount;
+
+    if (options_.durable) {
+      auto now = std::chrono::steady_clock::now();
+      if (header().entryCount == header().committedCount + 1) {
+        firstUncommittedAppend_ = now;
+      }
+      if (now - firstUncommittedAppend_ >= options_.commitInterval) {
+        commit();
+      }
+    }
   }
 
   void pop_back() {
     // TODO: It might be worth eliminating the end_ pointer and always adding
     // header().entryCount to begin_.
-    XDCHECK_GT(end_, begin_);
-    --end_;
+    T* end = end_.load(std::memory_order_relaxed);
+    XDCHECK_GT(end, begin_);
+    end_.store(end - 1, std::memory_order_relaxed);
     --header().entryCount;
+
+    // The next emplace_back() overwrites this slot in place, so the shrink
+    // must be on disk before that can happen or a crash could resurrect a
+    // half-overwritten record.
+    if (header().committedCount > header().entryCount) {
+      commit();
+    }
+  }
+
+  /**
+   * In durable mode, flushes every record to disk and then advances the
+   * committed entry count to size().  Without durability this only flushes.
+   * Throws std::system_error if either flush fails, in which case the
+   * committed count on disk is unchanged.
+   */
+  void commit() {
+    // Records first, so the committed count never covers data that is not
+    // yet on disk, then the header that publishes them.
+    syncRange(
+        map_,
+        reinterpret_cast<char*>(end_.load(std::memory_order_relaxed)) -
+            static_cast<char*>(map_));
+    if (options_.durable) {
+      header().committedCount = header().entryCount;
+      syncRange(map_, sizeof(Header));
+    }
+  }
+
+  /**
+   * The number of records that would survive a crash right now.  Always
+   * size() when not in durable mode.
+   */
+  size_t committedSize() const {
+    return options_.durable ? header().committedCount : size();
+  }
+
+  /**
+   * Removes every record for which isTombstone returns true, sliding the
+   * survivors down in their original order, then commits and truncates the
+   * file to what the survivors need.  Once the new layout is on disk,
+   * onMove(from, to) is called for every survivor whose index changed so that
+   * callers holding indices can update them.  Returns the number of records
+   * removed.
+   *
+   * The vector stays open and usable throughout, but indices change, so like
+   * pop_back() this needs external synchronization with readers.
+   *
+   * Survivors are moved over committed records in place, so compaction is not
+   * crash-atomic: a crash part way through leaves some of them duplicated.
+   * Durable vectors therefore reject it with std::logic_error.  Rewrite those
+   * with createOrOverwrite() into a temporary file and rename it into place
+   * instead.
+   */
+  template <typename IsTombstone, typename OnMove>
+  size_t compact(IsTombstone isTombstone, OnMove onMove) {
+    if (options_.durable) {
+      throw std::logic_error(
+          "MappedDiskVector::compact() is not crash-atomic and cannot be used "
+          "on a durable vector");
+    }
+
+    size_t oldSize = size();
+    // One bit per record, so that moves can be reported after the commit.
+    std::vector<bool> removed(oldSize);
+    size_t out = 0;
+    for (size_t in = 0; in < oldSize; ++in) {
+      if (isTombstone(std::as_const(begin_[in]))) {
+        removed[in] = true;
+        continue;
+      }
+      if (in != out) {
+        begin_[out] = std::move(begin_[in]);
+      }
+      ++out;
+    }
+    if (out == oldSize) {
+      return 0;
+    }
+
+    end_.store(begin_ + out, std::memory_order_release);
+    header().entryCount = out;
+    // The new count must be on disk before the file shrinks beneath the old
+    // one, or a crash would leave a header that overruns the file.
+    commit();
+
+    out = 0;
+    for (size_t in = 0; in < oldSize; ++in) {
+      if (!removed[in]) {
+        if (in != out) {
+          onMove(in, out);
+        }
+        ++out;
+      }
+    }
+
+    size_t needed = sizeof(Header) + out * sizeof(T);
+    size_t newFileSize = std::max(
+        geometry_.growthBytes,
+        (needed + geometry_.growthBytes - 1) / geometry_.growthBytes *
+            geometry_.growthBytes);
+    if (newFileSize < mapSizeInBytes_) {
+      shrinkTo(newFileSize);
+    }
+    return oldSize - out;
+  }
+
+  template <typename IsTombstone>
+  size_t compact(IsTombstone isTombstone) {
+    return compact(std::move(isTombstone), [](size_t, size_t) {});
   }
 
   T& front() {
-    XDCHECK_GT(end_, begin_);
+    XDCHECK_GT(size(), 0);
     return begin_[0];
   }
 
   T& back() {
-    XDCHECK_GT(end_, begin_);
-    return end_[-1];
+    XDCHECK_GT(size(), 0);
+    return end_.load(std::memory_order_acquire)[-1];
   }
 
  private:
   static constexpr uint32_t kMagic = 0x0056444d; // "MDV\0"
 
+  // Durable files use version 2 so that older readers, which would treat every
+  // appended record as valid, refuse them.
+  static constexpr uint32_t kVersion = 1;
+  static constexpr uint32_t kDurableVersion = 2;
+
   struct Header {
     uint32_t magic;
-    uint32_t version; // 1
+    uint32_t version; // kVersion or kDurableVersion
     uint32_t recordVersion; // T::VERSION
     uint32_t recordSize; // sizeof(T)
     uint64_t entryCount; // end() - begin()
-    uint64_t unused; // for alignment
+    uint64_t committedCount; // entries that survive a crash; 0 in kVersion
   };
   static_assert(
       32 == sizeof(Header),
@@ -409,6 +644,259 @@ class MappedDiskVector {
 
   static constexpr size_t GROWTH_IN_PAGES = 256;
 
+  /**
+   * How the file is laid out in memory: the step it grows by, which its size
+   * is always a multiple of, and which kind of huge pages back it, if any.
+   */
+  struct Geometry {
+    size_t growthBytes{GROWTH_IN_PAGES * detail::kPageSize};
+    bool transparentHugePages{false};
+    bool hugetlbfs{false};
+
+    bool hugePages() const {
+      return transparentHugePages || hugetlbfs;
+    }
+  };
+
+  static Geometry geometryFor(int fd, const MappedDiskVectorOptions& options) {
+    Geometry geometry;
+#ifdef __linux__
+    struct statfs fs;
+    if (fstatfs(fd, &fs) == 0 && fs.f_type == HUGETLBFS_MAGIC) {
+      geometry.hugetlbfs = true;
+      geometry.growthBytes =
+          std::max(geometry.growthBytes, static_cast<size_t>(fs.f_bsize));
+      return geometry;
+    }
+#else
+    (void)fd;
+#endif
+    if (options.hugePages) {
+      geometry.growthBytes =
+          std::max(geometry.growthBytes, detail::kHugePageSize);
+#ifdef MADV_HUGEPAGE
+      geometry.transparentHugePages = true;
+#endif
+    }
+    return geometry;
+  }
+
+  /**
+   * mmap size bytes of fd.  A transparent huge page can only back a
+   * kHugePageSize-aligned range, so for those the mapping is carved out of a
+   * larger anonymous reservation at an aligned address.  A nonzero
+   * reservation keeps that many bytes of address space, counted from the
+   * start of the mapping, reserved for growInPlace().  Returns MAP_FAILED on
+   * error.
+   */
+  static void* mapFile(
+      int fd,
+      size_t size,
+      const Geometry& geometry,
+      size_t reservation = 0) {
+    if (!reservation && !geometry.transparentHugePages) {
+      return mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+
+    reservation = std::max(reservation, size);
+    size_t alignment =
+        geometry.hugePages() ? geometry.growthBytes : systemPageSize();
+    auto* reserved = static_cast<char*>(mmap(
+        nullptr,
+        reservation + alignment,
+        PROT_NONE,
+        MAP_PRIVATE | MAP_ANONYMOUS,
+        -1,
+        0));
+    if (reserved == MAP_FAILED) {
+      return MAP_FAILED;
+    }
+    auto* aligned = reinterpret_cast<char*>(
+        (reinterpret_cast<uintptr_t>(reserved) + alignment - 1) &
+        ~(alignment - 1));
+    if (aligned != reserved) {
+      munmap(reserved, aligned - reserved);
+    }
+    munmap(aligned + reservation, reserved + alignment - aligned);
+
+    void* map = mapFileAt(fd, aligned, 0, size, geometry);
+    if (map == MAP_FAILED) {
+      int err = errno;
+      munmap(aligned, reservation);
+      errno = err;
+    }
+    return map;
+  }
+
+  // Map [offset, offset + size) of fd over addr, which must lie in address
+  // space this vector has reserved.
+  static void* mapFileAt(
+      int fd,
+      void* addr,
+      size_t offset,
+      size_t size,
+      const Geometry& geometry) {
+    void* map = mmap(
+        addr,
+        size,
+        PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_FIXED,
+        fd,
+        static_cast<off_t>(offset));
+#ifdef MADV_HUGEPAGE
+    if (map != MAP_FAILED && geometry.transparentHugePages &&
+        madvise(map, size, MADV_HUGEPAGE) != 0) {
+      // Kernel built without transparent huge pages.  Regular pages work.
+      XLOGF(DBG3, "MADV_HUGEPAGE unavailable: {}", folly::errnoStr(errno));
+    }
+#else
+    (void)geometry;
+#endif
+    return map;
+  }
+
+  // Extend the file into the reserved address space right after the
+  // mapping.  Records never move, so concurrent readers are unaffected.
+  void growInPlace(size_t newFileSize) {
+    if (newFileSize > reservedBytes_) {
+      throw std::length_error(
+          folly::to<std::string>(
+              "MappedDiskVector outgrew its address space reservation of ",
+              reservedBytes_,
+              " bytes"));
+    }
+
+    extendFile(file_.fd(), newFileSize);
+
+    auto* tail = static_cast<char*>(map_) + mapSizeInBytes_;
+    size_t length = newFileSize - mapSizeInBytes_;
+    if (mapFileAt(file_.fd(), tail, mapSizeInBytes_, length, geometry_) ==
+        MAP_FAILED) {
+      int err = errno;
+      // A failed MAP_FIXED may already have unmapped the range.  Reserve it
+      // again so nothing else lands inside this vector's address space.
+      mmap(
+          tail,
+          length,
+          PROT_NONE,
+          MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED,
+          -1,
+          0);
+      errno = err;
+      folly::throwSystemError(
+          folly::to<std::string>(
+              "mmap failed when growing capacity from ",
+              mapSizeInBytes_,
+              " to ",
+              newFileSize));
+    }
+    mapSizeInBytes_ = newFileSize;
+  }
+
+  // Release the file beyond newFileSize.  The mapping stays where it is; with
+  // a reservation, the released range goes back to being reserved.
+  void shrinkTo(size_t newFileSize) {
+    auto* tail = static_cast<char*>(map_) + newFileSize;
+    size_t length = mapSizeInBytes_ - newFileSize;
+    // Unmap before truncating so no access can land on a page past EOF.
+    if (reservedBytes_) {
+      if (mmap(
+              tail,
+              length,
+              PROT_NONE,
+              MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED,
+              -1,
+              0) == MAP_FAILED) {
+        folly::throwSystemError("failed to release MappedDiskVector pages");
+      }
+    } else {
+      munmap(tail, length);
+    }
+    mapSizeInBytes_ = newFileSize;
+
+    if (folly::ftruncateNoInt(file_.fd(), newFileSize) != 0) {
+      folly::throwSystemError("failed to truncate MappedDiskVector file");
+    }
+  }
+
+  void growByRemapping(size_t newFileSize) {
+    extendFile(file_.fd(), newFileSize);
+
+    // mremap may move the mapping to an address that is not huge-page
+    // aligned, and older kernels refuse to mremap hugetlb mappings at all,
+    // so huge-page mappings are replaced instead.
+    void* newMap;
+    bool replaced = true;
+#ifndef __APPLE__
+    if (!geometry_.hugePages()) {
+      newMap = mremap(map_, mapSizeInBytes_, newFileSize, MREMAP_MAYMOVE);
+      replaced = false;
+    } else
+#endif
+    {
+      newMap = mapFile(file_.fd(), newFileSize, geometry_);
+    }
+    if (newMap == MAP_FAILED) {
+      folly::throwSystemError(
+          folly::to<std::string>(
+              "mremap failed when growing capacity from ",
+              mapSizeInBytes_,
+              " to ",
+              newFileSize));
+    }
+
+    if (replaced) {
+      munmap(map_, mapSizeInBytes_);
+    }
+    map_ = newMap;
+    mapSizeInBytes_ = newFileSize;
+
+    begin_ = reinterpret_cast<T*>(static_cast<Header*>(newMap) + 1);
+  }
+
+  /**
+   * Reads and sanity-checks the header of a nonempty file.  The returned
+   * entryCount only covers records that are safe to read.
+   */
+  static Header readHeader(int fd, off_t fileSize) {
+    Header header;
+    ssize_t readBytes = folly::preadNoInt(fd, &header, sizeof(header), 0);
+    if (readBytes == -1) {
+      folly::throwSystemError("failed to read MappedDiskVector header");
+    } else if (readBytes != sizeof(header)) {
+      XLOGF(
+          WARNING,
+          "file contains incomplete header: only read {} bytes",
+          readBytes);
+      throw std::runtime_error("Incomplete MappedDiskVector header");
+    }
+
+    if (kMagic != header.magic ||
+        (header.version != kVersion && header.version != kDurableVersion) ||
+        static_cast<ssize_t>(sizeof(header)) > fileSize ||
+        header.recordSize == 0 ||
+        // careful not to overflow by multiplying entryCount by recordSize
+        header.entryCount > (fileSize - sizeof(header)) / header.recordSize ||
+        (header.version == kVersion && header.committedCount != 0)) {
+      throw std::runtime_error(
+          "Invalid header: this is probably not a MappedDiskVector file");
+    }
+
+    // Records appended after the last commit of a durable file may have been
+    // torn by a crash. Drop them.  (The committed count can only exceed the
+    // live one if a crash interrupted pop_back(), which leaves the popped
+    // record intact but still popped.)
+    if (header.version == kDurableVersion &&
+        header.committedCount < header.entryCount) {
+      XLOGF(
+          WARNING,
+          "Discarding {} uncommitted MappedDiskVector records",
+          header.entryCount - header.committedCount);
+      header.entryCount = header.committedCount;
+    }
+    return header;
+  }
+
   // Pre-fault pages with write intent to detect disk-full errors as exceptions
   // instead of SIGBUS. Even when fallocate succeeds, pages may be unwritable:
   // btrfs can exhaust data space while metadata space remains, thin-provisioned
@@ -442,6 +930,100 @@ class MappedDiskVector {
 #endif
   }
 
+  // Fault in [addr, addr + length) without write intent.  MADV_POPULATE_READ
+  // needs Linux 5.14; elsewhere touch a byte per page.
+  static void populateForRead(const void* addr, size_t length) {
+#if defined(__linux__) && defined(MADV_POPULATE_READ)
+    if (madvise(const_cast<void*>(addr), length, MADV_POPULATE_READ) == 0) {
+      return;
+    }
+    if (errno != EINVAL) {
+      folly::throwSystemError("failed to populate MappedDiskVector pages");
+    }
+#endif
+    auto* p = static_cast<const volatile char*>(addr);
+    for (size_t offset = 0; offset < length; offset += systemPageSize()) {
+      (void)p[offset];
+    }
+  }
+
+  // The whole pages covering records [begin, end), clamped to size().
+  std::pair<char*, size_t> pageRange(size_t begin, size_t end) const {
+    end = std::min(end, size());
+    if (begin >= end) {
+      return {nullptr, 0};
+    }
+    auto start = reinterpret_cast<uintptr_t>(begin_ + begin);
+    auto stop = reinterpret_cast<uintptr_t>(begin_ + end);
+    auto pageSize = systemPageSize();
+    start -= start % pageSize;
+    return {reinterpret_cast<char*>(start), stop - start};
+  }
+
+  // populateForWrite() the whole of a freshly opened mapping, in equal
+  // page-aligned slices across up to threads threads.
+  static void populateInParallel(void* map, size_t length, size_t threads) {
+    auto pageSize = systemPageSize();
+    size_t pages = (length + pageSize - 1) / pageSize;
+    threads = std::clamp<size_t>(threads, 1, pages);
+    if (threads == 1) {
+      populateForWrite(map, length);
+      return;
+    }
+
+    size_t slice = (pages + threads - 1) / threads * pageSize;
+    std::vector<std::future<void>> slices;
+    for (size_t offset = 0; offset < length; offset += slice) {
+      slices.push_back(std::async(std::launch::async, [=] {
+        populateForWrite(
+            static_cast<char*>(map) + offset, std::min(slice, length - offset));
+      }));
+    }
+    // Wait for every slice before rethrowing, since the caller unmaps.
+    std::exception_ptr error;
+    for (auto& f : slices) {
+      try {
+        f.get();
+      } catch (...) {
+        if (!error) {
+          error = std::current_exception();
+        }
+      }
+    }
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+
+  // msync the pages covering [addr, addr + length).
+  void syncRange(const void* addr, size_t length) {
+    auto start = reinterpret_cast<uintptr_t>(addr);
+    auto alignedStart = start - (start % systemPageSize());
+    if (msync(
+            reinterpret_cast<void*>(alignedStart),
+            start + length - alignedStart,
+            MS_SYNC) != 0) {
+      folly::throwSystemError("msync failed on MappedDiskVector");
+    }
+  }
+
+  // Commits anything outstanding and releases the mapping.  Never throws: a
+  // failed final commit only loses appends since the last successful one.
+  void unmap() noexcept {
+    if (!map_) {
+      return;
+    }
+    if (options_.durable && header().committedCount != header().entryCount) {
+      try {
+        commit();
+      } catch (const std::exception& ex) {
+        XLOGF(ERR, "Final MappedDiskVector commit failed: {}", ex.what());
+      }
+    }
+    munmap(map_, std::max(mapSizeInBytes_, reservedBytes_));
+    map_ = nullptr;
+  }
+
   static size_t systemPageSize() {
     static const size_t pageSize = [] {
       auto value = sysconf(_SC_PAGESIZE);
@@ -472,64 +1054,96 @@ class MappedDiskVector {
 #endif
   }
 
-  static MappedDiskVector initializeFromScratch(folly::File file) {
+  static MappedDiskVector initializeFromScratch(
+      folly::File file,
+      const MappedDiskVectorOptions& options) {
     // Start the file large enough to handle the header and a little under one
     // round one of growth.
-    constexpr size_t initialSize = GROWTH_IN_PAGES * detail::kPageSize;
     static_assert(
-        initialSize >= sizeof(Header) + sizeof(T),
+        GROWTH_IN_PAGES * detail::kPageSize >= sizeof(Header) + sizeof(T),
         "Initial size must include enough space for the header and at least one element.");
+    auto geometry = geometryFor(file.fd(), options);
+    size_t initialSize = geometry.growthBytes;
     extendFile(file.fd(), initialSize);
 
     Header header;
     header.magic = kMagic;
-    header.version = 1;
+    header.version = options.durable ? kDurableVersion : kVersion;
     header.recordVersion = T::VERSION;
     header.recordSize = sizeof(T);
     header.entryCount = 0;
-    header.unused = 0;
-    ssize_t written = folly::pwriteNoInt(file.fd(), &header, sizeof(header), 0);
-    if (-1 == written) {
-      folly::throwSystemError("Failed to write initial header");
-    }
-    if (written != sizeof(header)) {
-      throw std::runtime_error("Failed to write complete initial header");
+    header.committedCount = 0;
+    if (geometry.hugetlbfs) {
+      // hugetlbfs does not implement write(), so go through a mapping.
+      auto map = mapFile(file.fd(), initialSize, geometry);
+      if (map == MAP_FAILED) {
+        folly::throwSystemError("Failed to map initial header");
+      }
+      memcpy(map, &header, sizeof(header));
+      munmap(map, initialSize);
+    } else {
+      ssize_t written =
+          folly::pwriteNoInt(file.fd(), &header, sizeof(header), 0);
+      if (-1 == written) {
+        folly::throwSystemError("Failed to write initial header");
+      }
+      if (written != sizeof(header)) {
+        throw std::runtime_error("Failed to write complete initial header");
+      }
     }
 
-    return MappedDiskVector{std::move(file), initialSize, header.entryCount};
+    MappedDiskVector vector{
+        std::move(file),
+        static_cast<off_t>(initialSize),
+        header.entryCount,
+        options};
+    if (options.durable) {
+      // Otherwise a crash could leave a file whose header never made it out.
+      vector.commit();
+    }
+    return vector;
   }
 
   explicit MappedDiskVector(
       folly::File file,
       off_t fileSize,
       size_t currentEntryCount,
+      const MappedDiskVectorOptions& options = {},
       const std::function<void()>& afterMmap = nullptr)
-      : file_(std::move(file)) {
+      : options_(options),
+        geometry_(geometryFor(file.fd(), options)),
+        file_(std::move(file)) {
     // It's worth keeping the file and mapping a whole number of pages to
     // avoid wasting an partial page at the end.  Note that this is an
     // optimization and it doesn't matter if kPageSize differs from the
     // system page size.
     size_t desiredSize = detail::roundUpToNonzeroPageSize(fileSize);
+    if (fileSize != static_cast<ssize_t>(desiredSize) && fileSize) {
+      XLOGF(
+          WARNING,
+          "Warning: MappedDiskVector file size not multiple of page size: {}",
+          fileSize);
+    }
+    // Huge pages additionally need the whole mapping to be a multiple of the
+    // huge page size.  This also upgrades files created without huge pages.
+    if (geometry_.hugePages()) {
+      desiredSize = (desiredSize + geometry_.growthBytes - 1) /
+          geometry_.growthBytes * geometry_.growthBytes;
+    }
     if (fileSize != static_cast<ssize_t>(desiredSize)) {
-      if (fileSize) {
-        XLOGF(
-            WARNING,
-            "Warning: MappedDiskVector file size not multiple of page size: {}",
-            fileSize);
-      }
       extendFile(file_.fd(), desiredSize);
     }
 
-    // Call readahead() here?  Offer it as optional functionality?
-    // InodeTable needs to traverse every record immediately after opening.
+    // Growth happens in whole steps, so round the reservation to match.
+    size_t reservation = 0;
+    if (options.addressSpaceReservation) {
+      reservation = std::max(
+          desiredSize,
+          (options.addressSpaceReservation + geometry_.growthBytes - 1) /
+              geometry_.growthBytes * geometry_.growthBytes);
+    }
 
-    auto map = mmap(
-        nullptr,
-        desiredSize,
-        PROT_READ | PROT_WRITE,
-        MAP_SHARED,
-        file_.fd(),
-        0);
+    auto map = mapFile(file_.fd(), desiredSize, geometry_, reservation);
     if (map == MAP_FAILED) {
       folly::throwSystemError("mmap failed on file open");
     }
@@ -539,9 +1153,9 @@ class MappedDiskVector {
     }
 
     try {
-      populateForWrite(map, desiredSize);
+      populateInParallel(map, desiredSize, options.openPopulateThreads);
     } catch (...) {
-      munmap(map, desiredSize);
+      munmap(map, std::max(desiredSize, reservation));
       throw;
     }
 
@@ -549,23 +1163,42 @@ class MappedDiskVector {
 
     map_ = map;
     mapSizeInBytes_ = desiredSize;
+    reservedBytes_ = reservation;
     static_assert(
         alignof(Header) >= alignof(T),
         "T must not have stricter alignment requirements than Header");
     begin_ = reinterpret_cast<T*>(static_cast<Header*>(map) + 1);
-    end_ = begin_ + currentEntryCount;
+    end_.store(begin_ + currentEntryCount, std::memory_order_relaxed);
 
     // Just double-check that the accessed region is within the map.
     XCHECK_LE(
-        reinterpret_cast<char*>(end_),
+        reinterpret_cast<char*>(begin_ + currentEntryCount),
         static_cast<char*>(map_) + mapSizeInBytes_);
+
+    // Bring the header in line with the requested mode.  Uncommitted records
+    // of a durable file were already dropped from currentEntryCount.
+    auto& h = header();
+    if (h.entryCount != currentEntryCount) {
+      h.entryCount = currentEntryCount;
+    }
+    if (options_.durable) {
+      if (h.version != kDurableVersion ||
+          h.committedCount != currentEntryCount) {
+        h.version = kDurableVersion;
+        commit();
+      }
+    } else if (h.version != kVersion) {
+      h.committedCount = 0;
+      h.version = kVersion;
+    }
   }
 
   bool hasRoom(size_t amount) const {
     // Technically, the expression (end_ + amount) is constructing a pointer
     // past the end of the "object" (mmap) and is thus UB.  But hopefully no
     // compiler can see that.
-    return reinterpret_cast<char*>(end_ + amount) <=
+    return reinterpret_cast<char*>(
+               end_.load(std::memory_order_relaxed) + amount) <=
         static_cast<char*>(map_) + mapSizeInBytes_;
   }
 
@@ -582,11 +1215,11 @@ class MappedDiskVector {
   }
 
   T* end() {
-    return end_;
+    return end_.load(std::memory_order_acquire);
   }
 
   const T* end() const {
-    return end_;
+    return end_.load(std::memory_order_acquire);
   }
 
   Header& header() {
@@ -599,15 +1232,24 @@ class MappedDiskVector {
 
   // these two should be at the front of the struct
   T* begin_{nullptr};
-  T* end_{nullptr};
+  // Written only by the appending thread; see the class comment.
+  std::atomic<T*> end_{nullptr};
 
   void* map_{nullptr};
   size_t mapSizeInBytes_{0}; // must be nonzero, multiple of page size
+  size_t reservedBytes_{0}; // address space owned from map_; 0 if none
+
+  MappedDiskVectorOptions options_;
+  // In durable mode, when the oldest append not yet committed was made.
+  std::chrono::steady_clock::time_point firstUncommittedAppend_;
+  Geometry geometry_;
 
   folly::File file_;
 
   template <typename T_, typename... OldVersions>
   friend struct detail::Migrator;
+  template <typename T_, typename From>
+  friend class MappedDiskVectorMigration;
 };
 
 namespace detail {
@@ -620,6 +1262,8 @@ struct Migrator<T> {
       off_t /*fileSize*/,
       size_t /*currentEntryCount*/,
       size_t /*oldVersionIndex*/,
+      const MappedDiskVectorOptions& /*originalOptions*/,
+      const MappedDiskVectorOptions& /*options*/,
       ConvertFn /*convert*/) {
     EDEN_BUG() << "oldVersionIndex >= sizeof...(OldVersions)";
   }
@@ -634,6 +1278,8 @@ struct Migrator<T, First, Rest...> {
       off_t fileSize,
       size_t currentEntryCount,
       size_t oldVersionIndex,
+      const MappedDiskVectorOptions& originalOptions,
+      const MappedDiskVectorOptions& options,
       ConvertFn convert) {
     using namespace folly::literals;
 
@@ -644,16 +1290,22 @@ struct Migrator<T, First, Rest...> {
       // Load it, migrate each element to a new temporary file, and move the
       // temporary file over the original.
       MappedDiskVector<First> original{
-          std::move(file), fileSize, currentEntryCount};
+          std::move(file), fileSize, currentEntryCount, originalOptions};
 
       auto tmpPath = folly::to<std::string>(path, ".tmp");
-      auto newVector = MappedDiskVector<T>::createOrOverwrite(tmpPath);
+      auto newVector = MappedDiskVector<T>::createOrOverwrite(tmpPath, options);
       try {
         // TODO: newVector.reserve
         for (size_t i = 0; i < original.size(); ++i) {
           newVector.emplace_back(convert(original[i]));
         }
 
+        // A durable vector must not be renamed into place before its
+        // contents are on disk.
+        if (options.durable) {
+          newVector.commit();
+        }
+
         if (rename(tmpPath.c_str(), path.str().c_str())) {
           folly::throwSystemError(
               "rename() failed while migrating MDV formats");
@@ -672,10 +1324,232 @@ struct Migrator<T, First, Rest...> {
         fileSize,
         currentEntryCount,
         oldVersionIndex - 1,
+        originalOptions,
+        options,
         [=](const auto& from) { return convert(First{from}); });
   }
 };
 
 } // namespace detail
 
+/**
+ * Converts a MappedDiskVector file from record type From to T while the
+ * records stay readable, for tables large enough that
+ * MappedDiskVector<T>::open<From>() would stall startup converting them all.
+ *
+ * start() returns as soon as the file is open.  get() returns any record as a
+ * T, converting on the fly until its chunk has been migrated.  Chunks are
+ * converted into path + ".tmp" by migrateChunk(), either called by the owner
+ * or from the background thread started by runInBackground(), and finish()
+ * moves the converted file into place and reopens it as a MappedDiskVector<T>.
+ *
+ * Converted records go to a sibling file rather than being rewritten in place
+ * because sizeof(T) generally differs from sizeof(From).  The original file is
+ * untouched until finish(), so a crash at any point loses only progress, and
+ * its records must not be modified in the meantime.
+ *
+ * get() and size() may be called from any thread.  Only one thread at a time
+ * may call migrateChunk().  The object must not outlive or move away from a
+ * running background thread, so it is neither copyable nor movable.
+ */
+template <typename T, typename From>
+class MappedDiskVectorMigration {
+ public:
+  static constexpr size_t kDefaultChunkSize = 64 * 1024;
+
+  /**
+   * Opens path.  If it holds From records, migration begins; if it already
+   * holds T records (or is new), there is nothing to migrate and done() is
+   * immediately true.  Anything else throws as MappedDiskVector::open() does.
+   */
+  static MappedDiskVectorMigration start(
+      folly::StringPiece path,
+      const MappedDiskVectorOptions& options = {},
+      size_t chunkSize = kDefaultChunkSize) {
+    using Target = MappedDiskVector<T>;
+
+    folly::File file{path, O_RDWR | O_CREAT | O_CLOEXEC, 0600};
+    if (!file.try_lock()) {
+      folly::throwSystemError("failed to acquire lock on ", path);
+    }
+    struct stat st;
+    folly::checkUnixError(
+        fstat(file.fd(), &st), "fstat failed on MappedDiskVector path ", path);
+
+    auto header = st.st_size ? Target::readHeader(file.fd(), st.st_size)
+                             : typename Target::Header{};
+    if (st.st_size == 0 || header.recordVersion != From::VERSION) {
+      file.close();
+      return MappedDiskVectorMigration{
+          path, options, chunkSize, std::nullopt, Target::open(path, options)};
+    }
+
+    if (sizeof(From) != header.recordSize) {
+      throw std::runtime_error(
+          folly::to<std::string>(
+              "Record version matches old record type but record size differs. ",
+              "Expected ",
+              sizeof(From),
+              " but file has ",
+              header.recordSize));
+    }
+
+    // Open the original in its own mode so that doing so rewrites nothing.
+    MappedDiskVectorOptions originalOptions;
+    originalOptions.durable = header.version == Target::kDurableVersion;
+    MappedDiskVector<From> original{
+        std::move(file), st.st_size, header.entryCount, originalOptions};
+
+    // Readers of the target race its appends, so it needs a fixed address.
+    // The reservation only has to cover this migration: finish() reopens the
+    // file with the caller's options.
+    auto targetOptions = options;
+    targetOptions.addressSpaceReservation = std::max(
+        options.addressSpaceReservation,
+        (original.size() + 1) * sizeof(T) + 2 * detail::kHugePageSize);
+    auto target = Target::createOrOverwrite(tmpPath(path), targetOptions);
+
+    return MappedDiskVectorMigration{
+        path, options, chunkSize, std::move(original), std::move(target)};
+  }
+
+  MappedDiskVectorMigration(const MappedDiskVectorMigration&) = delete;
+  MappedDiskVectorMigration& operator=(const MappedDiskVectorMigration&) =
+      delete;
+
+  /**
+   * Abandons an unfinished migration, leaving the original file as it was.
+   */
+  ~MappedDiskVectorMigration() {
+    stopBackground();
+    if (original_) {
+      target_.reset();
+      unlink(tmpPath(path_).c_str());
+    }
+  }
+
+  size_t size() const {
+    return original_ ? original_->size() : target_->size();
+  }
+
+  /**
+   * Record index as a T, whether or not it has been migrated yet.
+   */
+  T get(size_t index) const {
+    if (original_ && index >= target_->size()) {
+      return T{(*original_)[index]};
+    }
+    return (*target_)[index];
+  }
+
+  /**
+   * Records converted so far.
+   */
+  size_t migrated() const {
+    return target_->size();
+  }
+
+  bool done() const {
+    return !original_ || target_->size() == original_->size();
+  }
+
+  /**
+   * Converts the next chunk.  Returns whether any records remain.
+   */
+  bool migrateChunk() {
+    if (!original_) {
+      return false;
+    }
+    size_t begin = target_->size();
+    size_t end = std::min(original_->size(), begin + chunkSize_);
+    for (size_t i = begin; i < end; ++i) {
+      target_->emplace_back(T{(*original_)[i]});
+    }
+    return end < original_->size();
+  }
+
+  /**
+   * Converts the remaining chunks on a new thread.  finish() waits for it.
+   * An exception there stops the migration and is rethrown by finish().
+   */
+  void runInBackground() {
+    XCHECK(!thread_.joinable());
+    thread_ = std::thread{[this] {
+      try {
+        while (!stop_.load(std::memory_order_relaxed) && migrateChunk()) {
+        }
+      } catch (...) {
+        error_ = std::current_exception();
+      }
+    }};
+  }
+
+  /**
+   * Converts whatever is left, replaces the original file with the converted
+   * one, and returns it opened with the options given to start().
+   */
+  MappedDiskVector<T> finish() {
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+    if (!original_) {
+      return std::move(*target_);
+    }
+
+    while (migrateChunk()) {
+    }
+    if (options_.durable) {
+      // The converted records must be on disk before they replace the
+      // originals.
+      target_->commit();
+    }
+    auto tmp = tmpPath(path_);
+    if (rename(tmp.c_str(), path_.c_str())) {
+      folly::throwSystemError("rename() failed while migrating MDV formats");
+    }
+    // Release both locks before reopening: flock is per open file.
+    target_.reset();
+    original_.reset();
+    return MappedDiskVector<T>::open(path_, options_);
+  }
+
+ private:
+  MappedDiskVectorMigration(
+      folly::StringPiece path,
+      const MappedDiskVectorOptions& options,
+      size_t chunkSize,
+      std::optional<MappedDiskVector<From>> original,
+      MappedDiskVector<T> target)
+      : path_{path.str()},
+        options_{options},
+        chunkSize_{std::max<size_t>(chunkSize, 1)},
+        original_{std::move(original)},
+        target_{std::move(target)} {}
+
+  static std::string tmpPath(folly::StringPiece path) {
+    return folly::to<std::string>(path, ".tmp");
+  }
+
+  void stopBackground() {
+    stop_.store(true, std::memory_order_relaxed);
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+  }
+
+  std::string path_;
+  MappedDiskVectorOptions options_;
+  size_t chunkSize_;
+  // Unset when there is nothing to migrate; target_ is then the final vector.
+  std::optional<MappedDiskVector<From>> original_;
+  std::optional<MappedDiskVector<T>> target_;
+
+  std::thread thread_;
+  std::atomic<bool> stop_{false};
+  std::exception_ptr error_;
+};
+
 } // namespace facebook::eden
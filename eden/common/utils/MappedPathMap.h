@@ -0,0 +1,563 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <folly/portability/Unistd.h>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include <folly/Exception.h>
+#include <folly/File.h>
+#include <folly/FileUtil.h>
+#include <folly/Range.h>
+#include <folly/logging/xlog.h>
+
+#include "eden/common/utils/CaseSensitivity.h"
+#include "eden/common/utils/MappedDiskVector.h"
+#include "eden/common/utils/PathFuncs.h"
+#include "eden/common/utils/PathMap.h"
+#include "eden/common/utils/Throw.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <folly/portability/SysMman.h>
+#include <sys/mman.h>
+#endif
+
+namespace facebook::eden {
+
+namespace detail {
+
+/**
+ * On-disk layout of a MappedPathMap file:
+ *
+ *   MappedPathMapHeader
+ *   MappedPathMapKey[entryCount]     sorted in the map's order
+ *   padding to kMappedPathMapAlign
+ *   Value[entryCount]                values[i] belongs to keys[i]
+ *   char[blobSize]                   the key strings, back to back
+ */
+struct MappedPathMapHeader {
+  uint32_t magic;
+  uint32_t version; // 1
+  uint32_t valueVersion; // Value::VERSION
+  uint32_t valueSize; // sizeof(Value)
+  uint64_t entryCount;
+  uint64_t blobSize;
+  uint32_t caseSensitive; // CaseSensitivity
+  uint32_t unused[3];
+};
+static_assert(
+    48 == sizeof(MappedPathMapHeader),
+    "changing the header size would invalidate all files");
+
+struct MappedPathMapKey {
+  uint32_t offset; // into the blob
+  uint32_t length;
+};
+
+constexpr uint32_t kMappedPathMapMagic = 0x004d504d; // "MPM\0"
+constexpr size_t kMappedPathMapAlign = 16;
+
+/**
+ * Byte offsets of each section, which follow from the entry count and value
+ * size alone.
+ */
+struct MappedPathMapLayout {
+  MappedPathMapLayout(uint64_t entryCount, size_t valueSize, uint64_t blobSize)
+      : keysOffset{sizeof(MappedPathMapHeader)},
+        valuesOffset{
+            (keysOffset + entryCount * sizeof(MappedPathMapKey) +
+             kMappedPathMapAlign - 1) &
+            ~(kMappedPathMapAlign - 1)},
+        blobOffset{valuesOffset + entryCount * valueSize},
+        fileSize{blobOffset + blobSize} {}
+
+  uint64_t keysOffset;
+  uint64_t valuesOffset;
+  uint64_t blobOffset;
+  uint64_t fileSize;
+};
+
+template <typename Value>
+struct MappedPathMapValueRequirements {
+  static_assert(
+      std::is_trivially_copyable_v<Value>,
+      "MappedPathMap values are read straight from the mapping");
+  static_assert(
+      alignof(Value) <= kMappedPathMapAlign,
+      "Value must not have stricter alignment than the values section");
+
+  using type = typename RecordTypeRequirements<Value>::type;
+};
+
+} // namespace detail
+
+/**
+ * Write map to path in the format read by MappedPathMap, replacing any file
+ * that was there.
+ *
+ * The file is written to a temporary path alongside, synced, and renamed into
+ * place, so a crash never leaves a partial file at path, and a MappedPathMap
+ * that already has the old file open keeps seeing the old contents.
+ */
+template <
+    typename Value,
+    typename = typename detail::MappedPathMapValueRequirements<Value>::type>
+void writeMappedPathMap(
+    folly::StringPiece path,
+    const PathMap<Value, PathComponent>& map) {
+  using namespace detail;
+
+  uint64_t blobSize = 0;
+  for (const auto& [key, value] : map) {
+    blobSize += key.view().size();
+  }
+  if (blobSize > std::numeric_limits<uint32_t>::max()) {
+    throw std::length_error("PathMap keys too large for MappedPathMap");
+  }
+
+  MappedPathMapLayout layout{map.size(), sizeof(Value), blobSize};
+  std::string buffer(layout.fileSize, '\0');
+
+  MappedPathMapHeader header{};
+  header.magic = kMappedPathMapMagic;
+  header.version = 1;
+  header.valueVersion = Value::VERSION;
+  header.valueSize = sizeof(Value);
+  header.entryCount = map.size();
+  header.blobSize = blobSize;
+  header.caseSensitive = static_cast<uint32_t>(map.getCaseSensitivity());
+  std::memcpy(buffer.data(), &header, sizeof(header));
+
+  char* keys = buffer.data() + layout.keysOffset;
+  char* values = buffer.data() + layout.valuesOffset;
+  char* blob = buffer.data() + layout.blobOffset;
+  uint32_t blobPos = 0;
+  for (const auto& [key, value] : map) {
+    auto name = key.view();
+    MappedPathMapKey entry{blobPos, static_cast<uint32_t>(name.size())};
+    std::memcpy(keys, &entry, sizeof(entry));
+    std::memcpy(values, &value, sizeof(Value));
+    std::memcpy(blob + blobPos, name.data(), name.size());
+    keys += sizeof(entry);
+    values += sizeof(Value);
+    blobPos += entry.length;
+  }
+
+  auto tmpPath = folly::to<std::string>(path, ".tmp");
+  try {
+    folly::File file{
+        tmpPath, O_RDWR | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, 0600};
+    if (!file.try_lock()) {
+      folly::throwSystemError("failed to acquire lock on ", tmpPath);
+    }
+    if (folly::writeFull(file.fd(), buffer.data(), buffer.size()) == -1) {
+      folly::throwSystemError("failed to write MappedPathMap ", tmpPath);
+    }
+    if (folly::fsyncNoInt(file.fd()) == -1) {
+      folly::throwSystemError("failed to sync MappedPathMap ", tmpPath);
+    }
+    if (rename(tmpPath.c_str(), path.str().c_str())) {
+      folly::throwSystemError("rename() failed while writing MappedPathMap");
+    }
+  } catch (const std::exception&) {
+    unlink(tmpPath.c_str());
+    throw;
+  }
+}
+
+/**
+ * A read-only view of a PathMap<Value> that was saved with
+ * writeMappedPathMap().
+ *
+ * Opening the file maps it into memory, checks its header, and checks that
+ * every key lies within the file, so that a truncated or corrupt file is
+ * rejected rather than read out of bounds. Nothing more is done: keys and
+ * values are read straight from the mapping, so opening does not allocate
+ * and neither do lookups. Keys are ordered, compared and looked up with the
+ * case sensitivity of the map that was written.
+ *
+ * As with MappedDiskVector, Value must be a trivially copyable record type
+ * with a VERSION constant, which is checked along with sizeof(Value) on open.
+ * There is no migration from older value versions; rewrite the file instead.
+ *
+ * While alive, MappedPathMap holds a shared flock on the file.
+ */
+template <
+    typename Value,
+    typename = typename detail::MappedPathMapValueRequirements<Value>::type>
+class MappedPathMap {
+ public:
+  using key_type = PathComponentPiece;
+  using mapped_type = Value;
+  using value_type = std::pair<PathComponentPiece, const Value&>;
+  using size_type = size_t;
+  using difference_type = std::ptrdiff_t;
+
+  /**
+   * Iterates over the entries in order. Like the path iterators, dereferencing
+   * produces a new pair rather than a reference into the map.
+   */
+  class const_iterator {
+   public:
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = MappedPathMap::value_type;
+    using difference_type = std::ptrdiff_t;
+    using reference = value_type;
+
+    struct pointer {
+      value_type entry;
+      const value_type* operator->() const {
+        return &entry;
+      }
+    };
+
+    const_iterator() = default;
+
+    value_type operator*() const {
+      return map_->entry(index_);
+    }
+
+    pointer operator->() const {
+      return pointer{map_->entry(index_)};
+    }
+
+    value_type operator[](difference_type n) const {
+      return map_->entry(index_ + n);
+    }
+
+    const_iterator& operator++() {
+      ++index_;
+      return *this;
+    }
+
+    const_iterator operator++(int) {
+      auto tmp = *this;
+      ++index_;
+      return tmp;
+    }
+
+    const_iterator& operator--() {
+      --index_;
+      return *this;
+    }
+
+    const_iterator operator--(int) {
+      auto tmp = *this;
+      --index_;
+      return tmp;
+    }
+
+    const_iterator& operator+=(difference_type n) {
+      index_ += n;
+      return *this;
+    }
+
+    const_iterator& operator-=(difference_type n) {
+      index_ -= n;
+      return *this;
+    }
+
+    friend const_iterator operator+(const_iterator it, difference_type n) {
+      return it += n;
+    }
+
+    friend const_iterator operator+(difference_type n, const_iterator it) {
+      return it += n;
+    }
+
+    friend const_iterator operator-(const_iterator it, difference_type n) {
+      return it -= n;
+    }
+
+    difference_type operator-(const const_iterator& other) const {
+      return static_cast<difference_type>(index_) -
+          static_cast<difference_type>(other.index_);
+    }
+
+    bool operator==(const const_iterator& other) const {
+      XDCHECK_EQ(map_, other.map_);
+      return index_ == other.index_;
+    }
+
+    auto operator<=>(const const_iterator& other) const {
+      XDCHECK_EQ(map_, other.map_);
+      return index_ <=> other.index_;
+    }
+
+   private:
+    friend class MappedPathMap;
+
+    const_iterator(const MappedPathMap* map, size_t index)
+        : map_{map}, index_{index} {}
+
+    const MappedPathMap* map_{nullptr};
+    size_t index_{0};
+  };
+  using iterator = const_iterator;
+
+  /**
+   * Opens the file at path, which must have been written by
+   * writeMappedPathMap() with the same Value type.
+   */
+  static MappedPathMap open(folly::StringPiece path) {
+    using namespace detail;
+
+    folly::File file{path, O_RDONLY | O_CLOEXEC};
+    if (!file.try_lock_shared()) {
+      folly::throwSystemError("failed to acquire lock on ", path);
+    }
+
+    struct stat st;
+    folly::checkUnixError(
+        fstat(file.fd(), &st), "fstat failed on MappedPathMap path ", path);
+    uint64_t fileSize = st.st_size;
+
+    MappedPathMapHeader header;
+    ssize_t readBytes =
+        folly::preadNoInt(file.fd(), &header, sizeof(header), 0);
+    if (readBytes == -1) {
+      folly::throwSystemError("failed to read MappedPathMap header");
+    } else if (readBytes != sizeof(header)) {
+      XLOGF(
+          WARNING,
+          "file contains incomplete header: only read {} bytes",
+          readBytes);
+      throw std::runtime_error("Incomplete MappedPathMap header");
+    }
+
+    if (kMappedPathMapMagic != header.magic || header.version != 1 ||
+        header.caseSensitive > 1 ||
+        // careful not to overflow computing the layout from entryCount
+        header.entryCount > fileSize / sizeof(MappedPathMapKey) ||
+        header.blobSize > fileSize) {
+      throw std::runtime_error(
+          "Invalid header: this is probably not a MappedPathMap file");
+    }
+
+    if (Value::VERSION != header.valueVersion ||
+        sizeof(Value) != header.valueSize) {
+      throw std::runtime_error(
+          folly::to<std::string>(
+              "Unexpected value size and version. "
+              "Expected size=",
+              sizeof(Value),
+              ", version=",
+              Value::VERSION,
+              " but got size=",
+              header.valueSize,
+              ", version=",
+              header.valueVersion));
+    }
+
+    MappedPathMapLayout layout{
+        header.entryCount, sizeof(Value), header.blobSize};
+    if (layout.fileSize != fileSize) {
+      throw std::runtime_error(
+          folly::to<std::string>(
+              "MappedPathMap file size does not match its header. Expected ",
+              layout.fileSize,
+              " but file has ",
+              fileSize));
+    }
+
+    auto map = mmap(nullptr, fileSize, PROT_READ, MAP_SHARED, file.fd(), 0);
+    if (map == MAP_FAILED) {
+      folly::throwSystemError("mmap failed on MappedPathMap open");
+    }
+
+    MappedPathMap result{
+        std::move(file),
+        map,
+        fileSize,
+        header.entryCount,
+        static_cast<CaseSensitivity>(header.caseSensitive),
+        layout};
+    result.checkKeys(header.blobSize);
+    return result;
+  }
+
+  MappedPathMap(const MappedPathMap&) = delete;
+  MappedPathMap& operator=(const MappedPathMap&) = delete;
+
+  MappedPathMap(MappedPathMap&& other) noexcept
+      : file_{std::move(other.file_)},
+        map_{std::exchange(other.map_, nullptr)},
+        mapSizeInBytes_{std::exchange(other.mapSizeInBytes_, 0)},
+        size_{std::exchange(other.size_, 0)},
+        caseSensitive_{other.caseSensitive_},
+        keys_{std::exchange(other.keys_, nullptr)},
+        values_{std::exchange(other.values_, nullptr)},
+        blob_{std::exchange(other.blob_, nullptr)} {}
+
+  MappedPathMap& operator=(MappedPathMap&& other) noexcept {
+    if (this != &other) {
+      unmap();
+      file_ = std::move(other.file_);
+      map_ = std::exchange(other.map_, nullptr);
+      mapSizeInBytes_ = std::exchange(other.mapSizeInBytes_, 0);
+      size_ = std::exchange(other.size_, 0);
+      caseSensitive_ = other.caseSensitive_;
+      keys_ = std::exchange(other.keys_, nullptr);
+      values_ = std::exchange(other.values_, nullptr);
+      blob_ = std::exchange(other.blob_, nullptr);
+    }
+    return *this;
+  }
+
+  ~MappedPathMap() {
+    unmap();
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  CaseSensitivity getCaseSensitivity() const {
+    return caseSensitive_;
+  }
+
+  const_iterator begin() const {
+    return const_iterator{this, 0};
+  }
+
+  const_iterator end() const {
+    return const_iterator{this, size_};
+  }
+
+  const_iterator cbegin() const {
+    return begin();
+  }
+
+  const_iterator cend() const {
+    return end();
+  }
+
+  /** Returns the first entry whose key is not less than key. */
+  const_iterator lower_bound(PathComponentPiece key) const {
+    size_t first = 0;
+    size_t count = size_;
+    while (count > 0) {
+      size_t step = count / 2;
+      size_t mid = first + step;
+      if (isPathPieceLess(this->key(mid), key, caseSensitive_)) {
+        first = mid + 1;
+        count -= step + 1;
+      } else {
+        count = step;
+      }
+    }
+    return const_iterator{this, first};
+  }
+
+  /** Find using the Piece representation of a key. */
+  const_iterator find(PathComponentPiece key) const {
+    auto iter = lower_bound(key);
+    if (iter != end() &&
+        !isPathPieceLess(key, this->key(iter.index_), caseSensitive_)) {
+      return iter;
+    }
+    return end();
+  }
+
+  /** Returns 1 if there is an entry with the given key and 0 otherwise. */
+  size_type count(PathComponentPiece key) const {
+    return find(key) != end();
+  }
+
+  /** Returns the value for key, or throws std::out_of_range. */
+  const Value& at(PathComponentPiece key) const {
+    auto iter = find(key);
+    if (iter == end()) {
+      throwf<std::out_of_range>("no such key {}", key);
+    }
+    return value(iter.index_);
+  }
+
+  const Value& operator[](PathComponentPiece key) const {
+    return at(key);
+  }
+
+ private:
+  MappedPathMap(
+      folly::File file,
+      void* map,
+      size_t mapSizeInBytes,
+      size_t size,
+      CaseSensitivity caseSensitive,
+      const detail::MappedPathMapLayout& layout)
+      : file_{std::move(file)},
+        map_{map},
+        mapSizeInBytes_{mapSizeInBytes},
+        size_{size},
+        caseSensitive_{caseSensitive},
+        keys_{reinterpret_cast<const detail::MappedPathMapKey*>(
+            static_cast<const char*>(map) + layout.keysOffset)},
+        values_{reinterpret_cast<const Value*>(
+            static_cast<const char*>(map) + layout.valuesOffset)},
+        blob_{static_cast<const char*>(map) + layout.blobOffset} {}
+
+  void unmap() {
+    if (map_) {
+      munmap(map_, mapSizeInBytes_);
+      map_ = nullptr;
+    }
+  }
+
+  /// key() trusts the offsets and lengths in the file, so check them once.
+  void checkKeys(uint64_t blobSize) const {
+    for (size_t i = 0; i < size_; ++i) {
+      const auto& entry = keys_[i];
+      if (static_cast<uint64_t>(entry.offset) + entry.length > blobSize) {
+        throw std::runtime_error(
+            folly::to<std::string>(
+                "MappedPathMap key ",
+                i,
+                " lies outside the key blob of ",
+                blobSize,
+                " bytes"));
+      }
+    }
+  }
+
+  PathComponentPiece key(size_t index) const {
+    const auto& entry = keys_[index];
+    return PathComponentPiece{
+        std::string_view{blob_ + entry.offset, entry.length},
+        detail::SkipPathSanityCheck{}};
+  }
+
+  const Value& value(size_t index) const {
+    return values_[index];
+  }
+
+  value_type entry(size_t index) const {
+    return value_type{key(index), value(index)};
+  }
+
+  folly::File file_;
+  void* map_{nullptr};
+  size_t mapSizeInBytes_{0};
+  size_t size_{0};
+  CaseSensitivity caseSensitive_{kPathMapDefaultCaseSensitive};
+  const detail::MappedPathMapKey* keys_{nullptr};
+  const Value* values_{nullptr};
+  const char* blob_{nullptr};
+};
+
+} // namespace facebook::eden
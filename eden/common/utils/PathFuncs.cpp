@@ -226,6 +226,112 @@ folly::Expected<RelativePath, int> joinAndNormalize(
   }
 }
 
+namespace {
+/**
+ * Append the components of path to out, resolving "." and ".." components
+ * the same way canonicalPathData() does. The path being built starts at
+ * offset start in out. Returns false if a ".." component would climb above
+ * it. Otherwise, unchanged is set to the length of the prefix of out that
+ * the call left as it was.
+ */
+bool appendNormalized(
+    std::string& out,
+    size_t start,
+    std::string_view path,
+    size_t& unchanged) {
+  unchanged = out.size();
+  size_t pos = 0;
+  while (pos < path.size()) {
+    size_t end = pos;
+    while (end < path.size() && !detail::isDirSeparator(path[end])) {
+      ++end;
+    }
+    auto component = path.substr(pos, end - pos);
+    pos = end + 1;
+
+    if (component.empty() || component == ".") {
+      continue;
+    }
+    if (component == "..") {
+      if (out.size() == start) {
+        return false;
+      }
+      auto separator = out.rfind(kDirSeparator);
+      out.resize(
+          separator == std::string::npos || separator < start ? start
+                                                              : separator);
+      unchanged = std::min(unchanged, out.size());
+      continue;
+    }
+    if (out.size() != start) {
+      out.push_back(kDirSeparator);
+    }
+    out.append(component);
+  }
+  return true;
+}
+
+/**
+ * Throws if any component of path is not a valid PathComponent, as
+ * constructing a RelativePath from them would.
+ */
+void checkComponents(std::string_view path) {
+  while (!path.empty()) {
+    auto separator = path.find(kDirSeparator);
+    auto component = path.substr(0, separator);
+    if (!component.empty()) {
+      detail::PathComponentSanityCheck{}(component);
+    }
+    if (separator == std::string_view::npos) {
+      break;
+    }
+    path.remove_prefix(separator + 1);
+  }
+}
+} // namespace
+
+NormalizedPathBatch joinAndNormalizeBatch(
+    RelativePathPiece base,
+    std::span<const std::string_view> paths) {
+  NormalizedPathBatch batch;
+  auto& arena = batch.arena_;
+
+  // A normalized path is never longer than the joined input, so this is
+  // enough room for every result and arena never reallocates.
+  size_t capacity = base.view().size();
+  for (auto path : paths) {
+    capacity += base.view().size() + 1 + path.size();
+  }
+  arena.reserve(capacity);
+  batch.entries_.reserve(paths.size());
+
+  // base is already normalized, apart from its separators on Windows. Do
+  // that once at the front of the arena and copy it for each path.
+  size_t unchanged;
+  appendNormalized(arena, 0, base.view(), unchanged);
+  const size_t baseLength = arena.size();
+
+  for (auto path : paths) {
+    size_t start = arena.size();
+    if (path.starts_with(kDirSeparator)) {
+      batch.entries_.push_back({start, 0, EPERM});
+      continue;
+    }
+    arena.append(arena, 0, baseLength);
+    if (!appendNormalized(arena, start, path, unchanged)) {
+      arena.resize(start);
+      batch.entries_.push_back({start, 0, EXDEV});
+      continue;
+    }
+    // The copy of base was already valid; only check what path changed.
+    // Components that a later ".." removed are never checked, as with
+    // joinAndNormalize().
+    checkComponents(std::string_view{arena}.substr(unchanged));
+    batch.entries_.push_back({start, arena.size() - start, 0});
+  }
+  return batch;
+}
+
 Expected<AbsolutePath, int> realpathExpected(const char* path) {
   auto pathBuffer = ::realpath(path, nullptr);
   if (!pathBuffer) {
@@ -16,12 +16,19 @@
 #include <folly/FBVector.h>
 #include <folly/String.h>
 #include <folly/hash/Hash.h>
+#include <folly/lang/Bits.h>
 #include <folly/logging/xlog.h>
+#include <bit>
+#include <cstring>
 #include <iterator>
+#include <limits>
+#include <memory>
 #include <optional>
+#include <span>
 #include <type_traits>
 
 #include "eden/common/utils/CaseSensitivity.h"
+#include "eden/common/utils/PathScan.h"
 #include "eden/common/utils/String.h"
 #include "eden/common/utils/StringConv.h"
 #include "eden/common/utils/Throw.h"
@@ -206,6 +213,21 @@ class RelativePathBase;
 template <typename STR>
 class AbsolutePathBase;
 
+template <typename Piece>
+class HashedPathString;
+
+class InlinePathString;
+
+/**
+ * True for the Storage types of stored (owning) paths that can take over an
+ * std::string without copying it.
+ */
+template <typename Storage>
+constexpr bool kIsMovableFromString = std::is_same_v<Storage, std::string>;
+
+template <typename Piece>
+constexpr bool kIsMovableFromString<HashedPathString<Piece>> = true;
+
 } // namespace detail
 
 /**
@@ -242,12 +264,28 @@ class PathComponentNotUtf8 : public PathComponentValidationError {
 using PathComponent = detail::PathComponentBase<folly::fbstring>;
 using PathComponentPiece = detail::PathComponentBase<std::string_view>;
 
+/**
+ * A PathComponent with a fixed 32 byte layout that keeps names of up to 31
+ * bytes inline. See InlinePathString.
+ */
+using InlinePathComponent = detail::PathComponentBase<detail::InlinePathString>;
+
 using RelativePath = detail::RelativePathBase<std::string>;
 using RelativePathPiece = detail::RelativePathBase<std::string_view>;
 
 using AbsolutePath = detail::AbsolutePathBase<std::string>;
 using AbsolutePathPiece = detail::AbsolutePathBase<std::string_view>;
 
+/**
+ * Stored paths that compute their hash_value() once, at construction, and
+ * keep it through copies and moves. Useful as keys of hash based containers
+ * such as HashedPathMap.
+ */
+using HashedRelativePath =
+    detail::RelativePathBase<detail::HashedPathString<RelativePathPiece>>;
+using HashedAbsolutePath =
+    detail::AbsolutePathBase<detail::HashedPathString<AbsolutePathPiece>>;
+
 enum class CompareResult {
   EQUAL,
   BEFORE,
@@ -271,6 +309,99 @@ struct AsciiLessThanCaseInsensitive {
 
 namespace detail {
 
+/**
+ * Word-at-a-time kernels for ASCII case insensitive comparison.
+ *
+ * These agree exactly with comparing byte by byte with
+ * AsciiLessThanCaseInsensitive (for ordering) or folly::AsciiCaseInsensitive
+ * (for equality), including comparing the first differing bytes as char, but
+ * fold and compare 8 bytes per step and locate the first differing byte with
+ * a bit scan.
+ */
+struct AsciiCaseFold {
+  static constexpr uint64_t kOnes = 0x0101010101010101;
+  static constexpr uint64_t kHighBits = 0x8080808080808080;
+
+  static uint64_t load(const char* p) noexcept {
+    uint64_t word;
+    std::memcpy(&word, p, sizeof(word));
+    // Make the first byte in memory the least significant one, so that the
+    // lowest set bit of a difference belongs to the first differing byte.
+    return folly::Endian::little(word);
+  }
+
+  /// Lower case the ASCII letters in each byte of word.
+  static uint64_t toLower(uint64_t word) noexcept {
+    uint64_t ascii = word & ~kHighBits;
+    // The high bit of each byte is set if the byte is >= 'A', resp. > 'Z'.
+    // Only the low 7 bits take part, so there is no carry between bytes.
+    uint64_t geA = ascii + kOnes * (0x80 - 'A');
+    uint64_t gtZ = ascii + kOnes * (0x80 - 'Z' - 1);
+    uint64_t isUpper = geA & ~gtZ & ~word & kHighBits;
+    return word | (isUpper >> 2);
+  }
+
+  static size_t firstDifference(uint64_t diff) noexcept {
+    return std::countr_zero(diff) / 8;
+  }
+};
+
+/**
+ * Returns a negative value, zero or a positive value when a sorts before, the
+ * same as, or after b, ignoring ASCII case.
+ */
+inline int compareAsciiCaseInsensitive(
+    std::string_view a,
+    std::string_view b) noexcept {
+  size_t common = std::min(a.size(), b.size());
+  size_t i = 0;
+  for (; i + 8 <= common; i += 8) {
+    uint64_t wa = AsciiCaseFold::toLower(AsciiCaseFold::load(a.data() + i));
+    uint64_t wb = AsciiCaseFold::toLower(AsciiCaseFold::load(b.data() + i));
+    if (uint64_t diff = wa ^ wb) {
+      auto shift = AsciiCaseFold::firstDifference(diff) * 8;
+      // Compare as char, not unsigned char, to order bytes above 0x7f like
+      // AsciiLessThanCaseInsensitive does.
+      auto ca = static_cast<char>(wa >> shift);
+      auto cb = static_cast<char>(wb >> shift);
+      return ca < cb ? -1 : 1;
+    }
+  }
+  for (; i < common; ++i) {
+    char ca = AsciiLessThanCaseInsensitive::toLower(a[i]);
+    char cb = AsciiLessThanCaseInsensitive::toLower(b[i]);
+    if (ca != cb) {
+      return ca < cb ? -1 : 1;
+    }
+  }
+  return a.size() < b.size() ? -1 : (a.size() == b.size() ? 0 : 1);
+}
+
+/// Returns true if a and b are equal, ignoring ASCII case.
+inline bool equalAsciiCaseInsensitive(
+    std::string_view a,
+    std::string_view b) noexcept {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  size_t i = 0;
+  for (; i + 8 <= a.size(); i += 8) {
+    uint64_t wa = AsciiCaseFold::load(a.data() + i);
+    uint64_t wb = AsciiCaseFold::load(b.data() + i);
+    if (wa != wb &&
+        AsciiCaseFold::toLower(wa) != AsciiCaseFold::toLower(wb)) {
+      return false;
+    }
+  }
+  for (; i < a.size(); ++i) {
+    if (AsciiLessThanCaseInsensitive::toLower(a[i]) !=
+        AsciiLessThanCaseInsensitive::toLower(b[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
 // Helper for equality testing, borrowed from
 // folly::detail::ComparableAsStringPiece in folly/Range.h
 template <typename A, typename B, typename Stored, typename Piece>
@@ -333,12 +464,8 @@ struct PathOperators {
           if (caseSensitive == CaseSensitivity::Sensitive) {
             return leftStringPiece < rightStringPiece;
           } else {
-            return std::lexicographical_compare(
-                leftStringPiece.begin(),
-                leftStringPiece.end(),
-                rightStringPiece.begin(),
-                rightStringPiece.end(),
-                AsciiLessThanCaseInsensitive{});
+            return detail::compareAsciiCaseInsensitive(
+                       leftStringPiece, rightStringPiece) < 0;
           }
         }
 
@@ -359,12 +486,8 @@ struct PathOperators {
       if (caseSensitive == CaseSensitivity::Sensitive) {
         return leftStringPiece < rightStringPiece;
       } else {
-        return std::lexicographical_compare(
-            leftStringPiece.begin(),
-            leftStringPiece.end(),
-            rightStringPiece.begin(),
-            rightStringPiece.end(),
-            AsciiLessThanCaseInsensitive{});
+        return detail::compareAsciiCaseInsensitive(
+                   leftStringPiece, rightStringPiece) < 0;
       }
     }
   }
@@ -403,12 +526,8 @@ struct PathOperators {
           if (caseSensitive == CaseSensitivity::Sensitive) {
             return leftStringPiece == rightStringPiece;
           } else {
-            return std::equal(
-                leftStringPiece.begin(),
-                leftStringPiece.end(),
-                rightStringPiece.begin(),
-                rightStringPiece.end(),
-                folly::AsciiCaseInsensitive{});
+            return detail::equalAsciiCaseInsensitive(
+                leftStringPiece, rightStringPiece);
           }
         }
 
@@ -429,12 +548,8 @@ struct PathOperators {
       if (caseSensitive == CaseSensitivity::Sensitive) {
         return leftStringPiece == rightStringPiece;
       } else {
-        return std::equal(
-            leftStringPiece.begin(),
-            leftStringPiece.end(),
-            rightStringPiece.begin(),
-            rightStringPiece.end(),
-            folly::AsciiCaseInsensitive{});
+        return detail::equalAsciiCaseInsensitive(
+            leftStringPiece, rightStringPiece);
       }
     }
   }
@@ -561,31 +676,31 @@ class PathBase :
   /** Move construct from a Stored value.
    * Skips sanity checks.
    * The template gunk only enables this constructor if we are the
-   * Stored flavor of this type.
+   * Stored (or Hashed) flavor of this type.
    * */
   template <
       /* need to alias Storage as StorageAlias because we can't directly use
-       * the class template parameter in the is_same check below */
+       * the class template parameter in the check below */
       typename StorageAlias = Storage,
       typename = typename std::enable_if<
-          std::is_same<StorageAlias, std::string>::value>::type>
+          kIsMovableFromString<StorageAlias>>::type>
   constexpr explicit PathBase(Stored&& other) noexcept(
       std::is_nothrow_move_constructible_v<Storage>)
       : path_{
-            kPathsAreCopiedOnMove ? Storage{other.path_}
-                                  : std::move(other.path_)} {}
+            kPathsAreCopiedOnMove ? Storage{other.value()}
+                                  : Storage{std::move(other).value()}} {}
 
   /** Move construct from an std::string value.
    * Applies sanity checks.
    * The template gunk only enables this constructor if we are the
-   * Stored flavor of this type.
+   * Stored (or Hashed) flavor of this type.
    * */
   template <
       /* need to alias Storage as StorageAlias because we can't directly use
-       * the class template parameter in the is_same check below */
+       * the class template parameter in the check below */
       typename StorageAlias = Storage,
       typename = typename std::enable_if<
-          std::is_same<StorageAlias, std::string>::value>::type>
+          kIsMovableFromString<StorageAlias>>::type>
   constexpr explicit PathBase(std::string&& str)
       : path_(detail::move_or_copy(str)) {
     SanityChecker()(path_);
@@ -594,14 +709,14 @@ class PathBase :
   /** Move construct from an std::string value.
    * Skips sanity checks.
    * The template gunk only enables this constructor if we are the
-   * Stored flavor of this type.
+   * Stored (or Hashed) flavor of this type.
    * */
   template <
       /* need to alias Storage as StorageAlias because we can't directly use
-       * the class template parameter in the is_same check below */
+       * the class template parameter in the check below */
       typename StorageAlias = Storage,
       typename = typename std::enable_if<
-          std::is_same<StorageAlias, std::string>::value>::type>
+          kIsMovableFromString<StorageAlias>>::type>
   constexpr explicit PathBase(std::string&& str, SkipPathSanityCheck)
       : path_(detail::move_or_copy(str)) {}
 
@@ -702,9 +817,24 @@ class PathBase :
 #endif
 };
 
+/**
+ * Returns true if a vectorized scan proved val valid. On false, the caller
+ * runs the byte-at-a-time checks, which either throw the precise error or
+ * accept val.
+ */
+inline bool isPathScanValid(PathScanResult result, std::string_view val) {
+  return result == PathScanResult::Ascii ||
+      (result == PathScanResult::NonAscii && isValidUtf8(val));
+}
+
 /// Asserts that val is a well formed path component
 struct PathComponentSanityCheck {
   constexpr void operator()(std::string_view val) const {
+    if (!std::is_constant_evaluated() &&
+        detail::isPathScanValid(detail::scanPathComponent(val), val)) {
+      return;
+    }
+
     for (auto c : val) {
       if (isDirSeparator(c)) {
         throw_<PathComponentContainsDirectorySeparator>(
@@ -1161,6 +1291,272 @@ class PathIteratorRange {
   iterator end_;
 };
 
+/**
+ * Precomputed component boundaries of a composed path.
+ *
+ * The component and path iterators above look for the next separator on every
+ * increment, so walking the same path several times, or walking it backwards,
+ * rescans it each time. PathComponentIndex finds all the separators once, with
+ * a vectorized scan, and then answers component(n), prefix(k) and suffix(k) in
+ * constant time. Paths with up to kInlineComponents components are indexed
+ * without allocating.
+ *
+ * Like a Piece, the index refers to the path's storage rather than copying
+ * it, and must not outlive it. Its iterators refer to the index itself, so
+ * keep it in a local rather than iterating over a temporary:
+ *
+ *   auto index = path.componentIndex();
+ *   for (auto component : index.rcomponents()) { ... }
+ */
+template <typename Piece>
+class PathComponentIndex {
+  enum class Kind { Component, Prefix };
+
+ public:
+  static constexpr size_t kInlineComponents = 16;
+
+  template <Kind kind>
+  class Iterator;
+
+  using component_iterator = Iterator<Kind::Component>;
+  using reverse_component_iterator = std::reverse_iterator<component_iterator>;
+  using component_iterator_range = PathIteratorRange<component_iterator>;
+  using reverse_component_iterator_range =
+      PathIteratorRange<reverse_component_iterator>;
+  using iterator = Iterator<Kind::Prefix>;
+  using reverse_iterator = std::reverse_iterator<iterator>;
+  using iterator_range = PathIteratorRange<iterator>;
+  using reverse_iterator_range = PathIteratorRange<reverse_iterator>;
+
+  explicit PathComponentIndex(Piece path) : path_{path.view()} {
+    XCHECK_LE(path_.size(), std::numeric_limits<uint32_t>::max() - 1);
+    size_t base =
+        std::is_same_v<Piece, AbsolutePathPiece> ? kRootStr.size() : 0;
+    auto rest = path_.substr(base);
+    if (rest.empty()) {
+      inline_[0] = static_cast<uint32_t>(base);
+      return;
+    }
+
+    // Separators are written one slot in, then turned into the start of the
+    // component that follows them.
+    size_t separators =
+        findPathSeparators(rest, inline_ + 1, kInlineComponents - 1);
+    uint32_t* starts = inline_;
+    if (separators >= kInlineComponents) {
+      heap_ = std::make_unique<uint32_t[]>(separators + 2);
+      findPathSeparators(rest, heap_.get() + 1, separators);
+      starts = heap_.get();
+    }
+    size_ = separators + 1;
+    starts[0] = static_cast<uint32_t>(base);
+    for (size_t i = 1; i < size_; ++i) {
+      starts[i] += static_cast<uint32_t>(base + 1);
+    }
+    starts[size_] = static_cast<uint32_t>(path_.size() + 1);
+  }
+
+  PathComponentIndex(const PathComponentIndex& other)
+      : path_{other.path_}, size_{other.size_} {
+    copyStartsFrom(other);
+  }
+
+  PathComponentIndex& operator=(const PathComponentIndex& other) {
+    if (this != &other) {
+      path_ = other.path_;
+      size_ = other.size_;
+      heap_.reset();
+      copyStartsFrom(other);
+    }
+    return *this;
+  }
+
+  PathComponentIndex(PathComponentIndex&&) noexcept = default;
+  PathComponentIndex& operator=(PathComponentIndex&&) noexcept = default;
+
+  /// The path being indexed.
+  Piece path() const {
+    return Piece{path_, SkipPathSanityCheck{}};
+  }
+
+  /// The number of components in the path.
+  size_t size() const {
+    return size_;
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  /// Return the n-th component, counting from 0.
+  PathComponentPiece component(size_t n) const {
+    XDCHECK_LT(n, size_);
+    const uint32_t* starts = this->starts();
+    return PathComponentPiece{
+        path_.substr(starts[n], starts[n + 1] - 1 - starts[n]),
+        SkipPathSanityCheck{}};
+  }
+
+  PathComponentPiece operator[](size_t n) const {
+    return component(n);
+  }
+
+  /**
+   * Return the first k components: the ancestor at depth k. prefix(0) is the
+   * empty path for a RelativePath and the root for an AbsolutePath, and
+   * prefix(size()) is the path itself.
+   */
+  Piece prefix(size_t k) const {
+    XDCHECK_LE(k, size_);
+    size_t length = k == 0 ? starts()[0] : starts()[k] - 1;
+    return Piece{path_.substr(0, length), SkipPathSanityCheck{}};
+  }
+
+  /**
+   * Return the path with its first k components removed. suffix(0) is the
+   * path itself, minus the root for an AbsolutePath, and suffix(size()) is
+   * empty.
+   */
+  RelativePathPiece suffix(size_t k) const;
+
+  /// Equivalent to the path's components().
+  component_iterator_range components() const {
+    return component_iterator_range(
+        component_iterator{this, 0}, component_iterator{this, size_});
+  }
+
+  /// Equivalent to the path's rcomponents().
+  reverse_component_iterator_range rcomponents() const {
+    return reverse_component_iterator_range(
+        reverse_component_iterator{component_iterator{this, size_}},
+        reverse_component_iterator{component_iterator{this, 0}});
+  }
+
+  /**
+   * Equivalent to the path's paths(): every ancestor and then the path
+   * itself. This starts with the root for an AbsolutePath, but not with the
+   * empty path for a RelativePath.
+   */
+  iterator_range paths() const {
+    return iterator_range(
+        iterator{this, firstPath()}, iterator{this, size_ + 1});
+  }
+
+  /// Equivalent to the path's rpaths().
+  reverse_iterator_range rpaths() const {
+    return reverse_iterator_range(
+        reverse_iterator{iterator{this, size_ + 1}},
+        reverse_iterator{iterator{this, firstPath()}});
+  }
+
+  /**
+   * Like paths(), but always starting with prefix(0), which is the empty path
+   * for a RelativePath.
+   */
+  iterator_range allPaths() const {
+    return iterator_range(iterator{this, 0}, iterator{this, size_ + 1});
+  }
+
+  /**
+   * Iterates over components or prefixes by position. Like the other path
+   * iterators, dereferencing returns a new Piece rather than a reference.
+   * That is allowed for a C++20 bidirectional_iterator, which is what
+   * std::reverse_iterator needs for rcomponents() and rpaths().
+   */
+  template <Kind kind>
+  class Iterator {
+   public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type =
+        std::conditional_t<kind == Kind::Component, PathComponentPiece, Piece>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = value_type;
+
+    Iterator() = default;
+    Iterator(const PathComponentIndex* index, size_t pos)
+        : index_{index}, pos_{pos} {}
+
+    value_type operator*() const {
+      if constexpr (kind == Kind::Component) {
+        return index_->component(pos_);
+      } else {
+        return index_->prefix(pos_);
+      }
+    }
+
+    Iterator& operator++() {
+      ++pos_;
+      return *this;
+    }
+
+    Iterator operator++(int) {
+      auto tmp = *this;
+      ++pos_;
+      return tmp;
+    }
+
+    Iterator& operator--() {
+      --pos_;
+      return *this;
+    }
+
+    Iterator operator--(int) {
+      auto tmp = *this;
+      --pos_;
+      return tmp;
+    }
+
+    difference_type operator-(const Iterator& other) const {
+      return static_cast<difference_type>(pos_) -
+          static_cast<difference_type>(other.pos_);
+    }
+
+    bool operator==(const Iterator& other) const {
+      XDCHECK_EQ(index_, other.index_);
+      return pos_ == other.pos_;
+    }
+
+    bool operator!=(const Iterator& other) const {
+      return !(*this == other);
+    }
+
+   private:
+    const PathComponentIndex* index_{nullptr};
+    size_t pos_{0};
+  };
+
+ private:
+  /**
+   * starts()[i] is the offset of the i-th component in path_. For a
+   * non-empty path, one extra entry holds path_.size() + 1, as if the path
+   * ended with a separator, so that every component ends at the next start
+   * minus one.
+   */
+  const uint32_t* starts() const {
+    return heap_ ? heap_.get() : inline_;
+  }
+
+  size_t firstPath() const {
+    return std::is_same_v<Piece, AbsolutePathPiece> ? 0 : 1;
+  }
+
+  void copyStartsFrom(const PathComponentIndex& other) {
+    if (other.heap_) {
+      heap_ = std::make_unique<uint32_t[]>(size_ + 1);
+      std::memcpy(
+          heap_.get(), other.heap_.get(), (size_ + 1) * sizeof(uint32_t));
+    } else {
+      std::memcpy(inline_, other.inline_, sizeof(inline_));
+    }
+  }
+
+  std::string_view path_;
+  size_t size_{0};
+  std::unique_ptr<uint32_t[]> heap_;
+  uint32_t inline_[kInlineComponents + 1];
+};
+
 /** Represents any number of PathComponents composed together.
  * This is a base implementation that powers both RelativePath
  * and AbsolutePath so that we can share the definition of the methods below.
@@ -1225,6 +1621,14 @@ class ComposedPathBase : public PathBase<Storage, SanityChecker, Stored, Piece>,
         reverse_component_iterator{p},
         reverse_component_iterator{p, reverse_component_iterator::END});
   }
+
+  /**
+   * Scan this path once and return an index of its components, for callers
+   * that need random access to them or walk them more than once.
+   */
+  PathComponentIndex<Piece> componentIndex() const {
+    return PathComponentIndex<Piece>{this->piece()};
+  }
 };
 
 /// Asserts that val is formed of multiple well formed PathComponents.
@@ -1251,6 +1655,12 @@ struct ComposedPathSanityCheck {
   constexpr void operator()(
       std::string_view val,
       std::optional<char> pathSeparator = std::nullopt) const {
+    if (!std::is_constant_evaluated() &&
+        detail::isPathScanValid(
+            detail::scanComposedPath(val, pathSeparator), val)) {
+      return;
+    }
+
     size_t start = 0;
     while (true) {
       auto next = nextSeparator(val, start, pathSeparator);
@@ -1765,14 +2175,14 @@ class AbsolutePathBase : public ComposedPathBase<
 
   /** Convert to a c-string for use in syscalls
    * The template gunk only enables this constructor if we are the
-   * Stored flavor of this type.
+   * Stored (or Hashed) flavor of this type.
    * */
   template <
       /* need to alias Storage as StorageAlias because we can't directly use
-       * the class template parameter in the is_same check below */
+       * the class template parameter in the check below */
       typename StorageAlias = Storage,
       typename = typename std::enable_if<
-          std::is_same<StorageAlias, std::string>::value>::type>
+          kIsMovableFromString<StorageAlias>>::type>
   const char* c_str() const {
     return this->path_.c_str();
   }
@@ -1954,6 +2364,13 @@ class PathSuffixIterator {
   size_t start_{0};
 };
 
+template <typename Piece>
+RelativePathPiece PathComponentIndex<Piece>::suffix(size_t k) const {
+  XDCHECK_LE(k, size_);
+  size_t start = std::min<size_t>(starts()[k], path_.size());
+  return RelativePathPiece{path_.substr(start), SkipPathSanityCheck{}};
+}
+
 template <typename Storage>
 typename RelativePathBase<Storage>::suffix_iterator_range
 RelativePathBase<Storage>::suffixes() const {
@@ -2018,6 +2435,277 @@ size_t hash_value(
   }
 }
 
+/**
+ * Storage for composed paths that caches hash_value(Piece) of its contents.
+ *
+ * The hash is computed when the string is set and travels with it through
+ * copies and moves, so hashing a HashedRelativePath or HashedAbsolutePath is
+ * a load rather than a pass over the path (or over each of its components on
+ * Windows). The contents are immutable, like those of every other path type.
+ */
+template <typename Piece>
+class HashedPathString {
+ public:
+  HashedPathString() : hash_{computeHash({})} {}
+
+  HashedPathString(const char* data, size_t size)
+      : str_{data, size}, hash_{computeHash(str_)} {}
+
+  explicit HashedPathString(const std::string& str)
+      : str_{str}, hash_{computeHash(str_)} {}
+
+  explicit HashedPathString(std::string&& str) noexcept
+      : str_{std::move(str)}, hash_{computeHash(str_)} {}
+
+  HashedPathString(const HashedPathString&) = default;
+  HashedPathString& operator=(const HashedPathString&) = default;
+
+  HashedPathString(HashedPathString&& other) noexcept
+      : str_{std::move(other.str_)}, hash_{other.hash_} {
+    other.str_.clear();
+    other.hash_ = computeHash({});
+  }
+
+  HashedPathString& operator=(HashedPathString&& other) noexcept {
+    str_ = std::move(other.str_);
+    hash_ = other.hash_;
+    other.str_.clear();
+    other.hash_ = computeHash({});
+    return *this;
+  }
+
+  /* implicit */ operator std::string_view() const noexcept {
+    return str_;
+  }
+
+  size_t hash() const noexcept {
+    return hash_;
+  }
+
+  const std::string& str() const& noexcept {
+    return str_;
+  }
+
+  std::string&& str() && noexcept {
+    return std::move(str_);
+  }
+
+  // The read-only subset of std::string used by the path types.
+
+  const char* data() const noexcept {
+    return str_.data();
+  }
+
+  const char* c_str() const noexcept {
+    return str_.c_str();
+  }
+
+  size_t size() const noexcept {
+    return str_.size();
+  }
+
+  size_t capacity() const noexcept {
+    return str_.capacity();
+  }
+
+  bool empty() const noexcept {
+    return str_.empty();
+  }
+
+  char operator[](size_t pos) const noexcept {
+    return str_[pos];
+  }
+
+  std::string_view substr(size_t pos) const {
+    return std::string_view{str_}.substr(pos);
+  }
+
+  friend bool operator==(
+      const HashedPathString& a,
+      const HashedPathString& b) noexcept {
+    return a.hash_ == b.hash_ && a.str_ == b.str_;
+  }
+
+ private:
+  static size_t computeHash(std::string_view str) noexcept {
+    return hash_value(Piece{str, SkipPathSanityCheck{}});
+  }
+
+  std::string str_;
+  size_t hash_;
+};
+
+template <
+    typename HashedPiece,
+    typename SanityChecker,
+    typename Stored,
+    typename Piece>
+size_t hash_value(const detail::ComposedPathBase<
+                  HashedPathString<HashedPiece>,
+                  SanityChecker,
+                  Stored,
+                  Piece>& path) {
+  return path.value().hash();
+}
+
+/**
+ * Fixed layout storage for PathComponents.
+ *
+ * The size and inline capacity of std::string and folly::fbstring depend on
+ * the standard library and platform. An InlinePathString is always 32 bytes
+ * and keeps names of up to kMaxInlineSize bytes inside the object, which
+ * covers the vast majority of file names. Longer names are spilled to an
+ * exact-size heap allocation.
+ *
+ * Moving never allocates: it copies the 32 bytes and resets the source to the
+ * empty string. Like any small string storage, moving an inline name moves
+ * its bytes, so pieces of the source are invalidated (see
+ * kPathsAreCopiedOnMove); unlike std::string, which names are affected no
+ * longer varies between platforms.
+ *
+ * The last byte holds kMaxInlineSize minus the size of an inline name, which
+ * doubles as the nul terminator of a name of exactly kMaxInlineSize bytes, or
+ * kHeapTag when the name lives on the heap.
+ */
+class InlinePathString {
+ public:
+  static constexpr size_t kMaxInlineSize = 31;
+
+  InlinePathString() noexcept {
+    setInline(nullptr, 0);
+  }
+
+  InlinePathString(const char* data, size_t size) {
+    if (size <= kMaxInlineSize) {
+      setInline(data, size);
+    } else {
+      auto* heap = new char[size + 1];
+      std::memcpy(heap, data, size);
+      heap[size] = '\0';
+      setHeap(Heap{heap, size});
+    }
+  }
+
+  InlinePathString(const InlinePathString& other)
+      : InlinePathString{other.data(), other.size()} {}
+
+  InlinePathString& operator=(const InlinePathString& other) {
+    if (this != &other) {
+      *this = InlinePathString{other};
+    }
+    return *this;
+  }
+
+  InlinePathString(InlinePathString&& other) noexcept {
+    std::memcpy(bytes_, other.bytes_, sizeof(bytes_));
+    other.setInline(nullptr, 0);
+  }
+
+  InlinePathString& operator=(InlinePathString&& other) noexcept {
+    if (this != &other) {
+      freeHeap();
+      std::memcpy(bytes_, other.bytes_, sizeof(bytes_));
+      other.setInline(nullptr, 0);
+    }
+    return *this;
+  }
+
+  ~InlinePathString() {
+    freeHeap();
+  }
+
+  /* implicit */ operator std::string_view() const noexcept {
+    if (isInline()) {
+      return std::string_view{bytes_, kMaxInlineSize - tag()};
+    }
+    auto heap = this->heap();
+    return std::string_view{heap.data, heap.size};
+  }
+
+  bool isInline() const noexcept {
+    return tag() != kHeapTag;
+  }
+
+  // The read-only subset of std::string used by the path types.
+
+  const char* data() const noexcept {
+    return isInline() ? bytes_ : heap().data;
+  }
+
+  const char* c_str() const noexcept {
+    return data();
+  }
+
+  size_t size() const noexcept {
+    return isInline() ? kMaxInlineSize - tag() : heap().size;
+  }
+
+  size_t capacity() const noexcept {
+    return isInline() ? kMaxInlineSize : heap().size;
+  }
+
+  bool empty() const noexcept {
+    return size() == 0;
+  }
+
+  char operator[](size_t pos) const noexcept {
+    return data()[pos];
+  }
+
+ private:
+  struct Heap {
+    char* data;
+    size_t size;
+  };
+
+  static constexpr uint8_t kHeapTag = 0x80;
+
+  uint8_t tag() const noexcept {
+    return static_cast<uint8_t>(bytes_[kMaxInlineSize]);
+  }
+
+  Heap heap() const noexcept {
+    Heap heap;
+    std::memcpy(&heap, bytes_, sizeof(heap));
+    return heap;
+  }
+
+  void setInline(const char* data, size_t size) noexcept {
+    // Zero the unused bytes so that the representation only depends on the
+    // name, and so that the name is nul terminated.
+    std::memset(bytes_, 0, sizeof(bytes_));
+    if (size != 0) {
+      std::memcpy(bytes_, data, size);
+    }
+    bytes_[kMaxInlineSize] = static_cast<char>(kMaxInlineSize - size);
+  }
+
+  void setHeap(Heap heap) noexcept {
+    std::memset(bytes_, 0, sizeof(bytes_));
+    std::memcpy(bytes_, &heap, sizeof(heap));
+    bytes_[kMaxInlineSize] = static_cast<char>(kHeapTag);
+  }
+
+  void freeHeap() noexcept {
+    if (!isInline()) {
+      delete[] heap().data;
+    }
+  }
+
+  alignas(Heap) char bytes_[kMaxInlineSize + 1];
+};
+
+static_assert(sizeof(InlinePathString) == 32);
+static_assert(std::is_nothrow_move_constructible_v<InlinePathString>);
+
+/**
+ * A spilled name is allocated with its nul terminator, which capacity() does
+ * not count.
+ */
+inline size_t estimateIndirectMemoryUsage(const InlinePathString& s) {
+  return s.isInline() ? 0 : folly::goodMallocSize(s.size() + 1);
+}
+
 } // namespace detail
 
 // I'm not really a fan of operator overloading, but these
@@ -2123,6 +2811,66 @@ folly::Expected<RelativePath, int> joinAndNormalize(
     RelativePathPiece base,
     string_view path);
 
+/**
+ * The results of joinAndNormalizeBatch().
+ *
+ * Every normalized path is stored in one buffer owned by this object, so the
+ * RelativePathPieces it returns are only valid for as long as it is.
+ */
+class NormalizedPathBatch {
+ public:
+  NormalizedPathBatch() = default;
+
+  size_t size() const {
+    return entries_.size();
+  }
+
+  bool empty() const {
+    return entries_.empty();
+  }
+
+  /**
+   * The result for the i-th input path: the same as joinAndNormalize() would
+   * have returned, but pointing into this batch.
+   */
+  folly::Expected<RelativePathPiece, int> operator[](size_t i) const {
+    const auto& entry = entries_[i];
+    if (entry.error != 0) {
+      return folly::makeUnexpected(entry.error);
+    }
+    return RelativePathPiece{
+        std::string_view{arena_}.substr(entry.offset, entry.length),
+        detail::SkipPathSanityCheck{}};
+  }
+
+ private:
+  struct Entry {
+    size_t offset;
+    size_t length;
+    int error;
+  };
+
+  friend NormalizedPathBatch joinAndNormalizeBatch(
+      RelativePathPiece base,
+      std::span<const std::string_view> paths);
+
+  std::string arena_;
+  std::vector<Entry> entries_;
+};
+
+/**
+ * Equivalent to calling joinAndNormalize(base, path) for each of paths, but
+ * writes all of the results into a single buffer, sized up front, rather
+ * than allocating a RelativePath for each one.
+ *
+ * Like joinAndNormalize(), throws PathComponentValidationError if a
+ * component of a result is not a valid PathComponent, for instance because
+ * it contains a nul byte or is not valid UTF-8.
+ */
+NormalizedPathBatch joinAndNormalizeBatch(
+    RelativePathPiece base,
+    std::span<const std::string_view> paths);
+
 /**
  * Convert an arbitrary unsanitized input string to a normalized AbsolutePath.
  *
@@ -2281,23 +3029,201 @@ inline std::string absolutePathToThrift(AbsolutePathPiece path) {
   return path.stringWithoutUNC();
 }
 
+namespace detail {
+
+constexpr uint64_t spookyRot64(uint64_t x, int k) {
+  return (x << k) | (x >> (64 - k));
+}
+
+/// Reads n little endian bytes of s starting at pos.
+constexpr uint64_t spookyLoad(std::string_view s, size_t pos, size_t n) {
+  uint64_t value = 0;
+  for (size_t i = 0; i < n; ++i) {
+    value |= uint64_t{static_cast<uint8_t>(s[pos + i])} << (8 * i);
+  }
+  return value;
+}
+
+/// SpookyHash hashes inputs shorter than this with its short message path.
+inline constexpr size_t kSpookyShortLimit = 192;
+
+/**
+ * A constexpr version of folly::hash::SpookyHashV2::Hash64(data, size, 0) for
+ * inputs shorter than kSpookyShortLimit. Like SpookyHash itself, it reads
+ * the input as little endian words.
+ */
+constexpr uint64_t spookyShortHash64(std::string_view s) {
+  constexpr uint64_t kConst = 0xdeadbeefdeadbeefULL;
+  uint64_t a = 0;
+  uint64_t b = 0;
+  uint64_t c = kConst;
+  uint64_t d = kConst;
+
+  auto mix = [&] {
+    c = spookyRot64(c, 50), c += d, a ^= c;
+    d = spookyRot64(d, 52), d += a, b ^= d;
+    a = spookyRot64(a, 30), a += b, c ^= a;
+    b = spookyRot64(b, 41), b += c, d ^= b;
+    c = spookyRot64(c, 54), c += d, a ^= c;
+    d = spookyRot64(d, 48), d += a, b ^= d;
+    a = spookyRot64(a, 38), a += b, c ^= a;
+    b = spookyRot64(b, 37), b += c, d ^= b;
+    c = spookyRot64(c, 62), c += d, a ^= c;
+    d = spookyRot64(d, 34), d += a, b ^= d;
+    a = spookyRot64(a, 5), a += b, c ^= a;
+    b = spookyRot64(b, 36), b += c, d ^= b;
+  };
+
+  size_t length = s.size();
+  size_t pos = 0;
+  size_t remainder = length % 32;
+  if (length > 15) {
+    for (size_t end = (length / 32) * 32; pos < end; pos += 32) {
+      c += spookyLoad(s, pos, 8);
+      d += spookyLoad(s, pos + 8, 8);
+      mix();
+      a += spookyLoad(s, pos + 16, 8);
+      b += spookyLoad(s, pos + 24, 8);
+    }
+    if (remainder >= 16) {
+      c += spookyLoad(s, pos, 8);
+      d += spookyLoad(s, pos + 8, 8);
+      mix();
+      pos += 16;
+      remainder -= 16;
+    }
+  }
+
+  // The last 0..15 bytes, and the length.
+  d += uint64_t{length} << 56;
+  if (remainder == 0) {
+    c += kConst;
+    d += kConst;
+  } else if (remainder <= 8) {
+    c += spookyLoad(s, pos, remainder);
+  } else {
+    c += spookyLoad(s, pos, 8);
+    d += spookyLoad(s, pos + 8, remainder - 8);
+  }
+
+  d ^= c, c = spookyRot64(c, 15), d += c;
+  a ^= d, d = spookyRot64(d, 52), a += d;
+  b ^= a, a = spookyRot64(a, 26), b += a;
+  c ^= b, b = spookyRot64(b, 51), c += b;
+  d ^= c, c = spookyRot64(c, 28), d += c;
+  a ^= d, d = spookyRot64(d, 9), a += d;
+  b ^= a, a = spookyRot64(a, 47), b += a;
+  c ^= b, b = spookyRot64(b, 54), c += b;
+  d ^= c, c = spookyRot64(c, 32), d += c;
+  a ^= d, d = spookyRot64(d, 25), a += d;
+  b ^= a, a = spookyRot64(a, 63), b += a;
+  return a;
+}
+
+} // namespace detail
+
+/**
+ * A path literal that also carries hash_value() of its contents. Both the
+ * sanity checks and the hash are computed at compile time. These are created
+ * with the _hpc and _hrelpath literals below, and convert implicitly to Piece.
+ *
+ * HashedPathMap uses the carried hash instead of hashing the literal on every
+ * lookup, so finding a well-known name such as ".hg"_hpc costs the same as
+ * finding a HashedRelativePath. Literals of kSpookyShortLimit bytes or more
+ * are not supported.
+ */
+template <typename Piece>
+class HashedPathLiteral {
+ public:
+  consteval explicit HashedPathLiteral(std::string_view str)
+      : piece_{str}, hash_{computeHash(str)} {}
+
+  constexpr Piece piece() const noexcept {
+    return piece_;
+  }
+
+  /* implicit */ constexpr operator Piece() const noexcept {
+    return piece_;
+  }
+
+  std::string_view view() const noexcept {
+    return piece_.view();
+  }
+
+  /// Equal to hash_value(piece()).
+  constexpr size_t hash() const noexcept {
+    return hash_;
+  }
+
+  friend bool operator==(const HashedPathLiteral& a, const Piece& b) {
+    return a.piece_ == b;
+  }
+
+ private:
+  static consteval size_t computeHash(std::string_view str) {
+    if (str.size() >= detail::kSpookyShortLimit) {
+      throw std::length_error("path literal too long to hash at compile time");
+    }
+    if constexpr (
+        folly::kIsWindows && !std::is_same_v<Piece, PathComponentPiece>) {
+      // hash_value of a composed path hashes its components back to back,
+      // without the separators.
+      char components[detail::kSpookyShortLimit] = {};
+      size_t size = 0;
+      for (char c : str) {
+        if (!detail::isDirSeparator(c)) {
+          components[size++] = c;
+        }
+      }
+      return detail::spookyShortHash64(std::string_view{components, size});
+    } else {
+      return detail::spookyShortHash64(str);
+    }
+  }
+
+  Piece piece_;
+  size_t hash_;
+};
+
 /**
  * Convenient literals for constructing path types.
+ *
+ * The literals are validated at compile time: an invalid path, such as
+ * "a/b"_pc or "/abs"_relpath, fails to compile, and a valid one costs nothing
+ * at runtime beyond the string_view it wraps. The _hpc and _hrelpath variants
+ * additionally carry their hash; see HashedPathLiteral.
  */
 inline namespace path_literals {
-constexpr inline PathComponentPiece operator""_pc(
-    const char* str,
-    size_t len) noexcept {
+consteval PathComponentPiece operator""_pc(const char* str, size_t len) {
   return PathComponentPiece{std::string_view{str, len}};
 }
 
-inline RelativePathPiece operator""_relpath(
-    const char* str,
-    size_t len) noexcept {
+consteval RelativePathPiece operator""_relpath(const char* str, size_t len) {
   return RelativePathPiece{std::string_view{str, len}};
 }
+
+consteval HashedPathLiteral<PathComponentPiece> operator""_hpc(
+    const char* str,
+    size_t len) {
+  return HashedPathLiteral<PathComponentPiece>{std::string_view{str, len}};
+}
+
+consteval HashedPathLiteral<RelativePathPiece> operator""_hrelpath(
+    const char* str,
+    size_t len) {
+  return HashedPathLiteral<RelativePathPiece>{std::string_view{str, len}};
+}
 } // namespace path_literals
 
+/**
+ * Gets memory usage of the name inside the PathComponentBase
+ */
+template <typename StringType>
+size_t estimateIndirectMemoryUsage(
+    const detail::PathComponentBase<StringType>& path) {
+  return estimateIndirectMemoryUsage(path.value());
+}
+
 /**
  * Gets memory usage of the path inside the RelativePathBase
  */
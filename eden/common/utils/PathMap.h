@@ -6,12 +6,18 @@
  */
 
 #pragma once
+#include <folly/Executor.h>
 #include <folly/FBVector.h>
 #include <folly/Portability.h>
+#include <folly/synchronization/Baton.h>
 #include <algorithm>
+#include <atomic>
 #include <functional>
 #include <iterator>
+#include <memory>
+#include <numeric>
 #include <utility>
+#include <vector>
 
 #include "eden/common/utils/CaseSensitivity.h"
 #include "eden/common/utils/PathFuncs.h"
@@ -116,56 +122,22 @@ class PathMap : private folly::fbvector<std::pair<Key, Value>> {
       : PathMap(init.begin(), init.end(), caseSensitive) {}
 
   // Populate from a pair of input iterators.
+  // Entries are sorted once rather than inserted one at a time; as with
+  // insert(), the earliest of several equal entries wins.
   template <typename InputIterator>
   PathMap(
       InputIterator first,
       InputIterator last,
       CaseSensitivity caseSensitive)
-      : compare_(caseSensitive) {
-    // The std::distance call is O(1) if the iterators are random-access, but
-    // O(n) otherwise.  We're fine with the O(n) on the basis that if n is large
-    // enough to matter, the cost of iterating will be dwarfed by the cost
-    // of growing the storage several times during population.
-    this->reserve(std::distance(first, last));
-    for (; first != last; ++first) {
-      insert(*first);
-    }
+      : Vector(first, last), compare_(caseSensitive) {
+    sortAndDedupe();
   }
 
   // Initialize using given vector of entries, sorting and deduping if needed.
   // This is more efficient than calling PathMap::emplace n times.
   PathMap(Vector&& entries, CaseSensitivity caseSensitive)
       : Vector(std::move(entries)), compare_(caseSensitive) {
-    Vector& vec = *this;
-
-    // In practice, Sapling yields tree entries naively sorted. On case
-    // sensitive filesystems, the natural sorting will match what we want and
-    // should never contain duplicates, so we will hit our fast path below and
-    // avoid sorting. On case insensitive filesystems, if the entries don't
-    // happen to be sorted (or there are case insensitive collisions), we will
-    // hit the slow path below to sort and/or dedupe.
-
-    bool needsSortAndOrDedupe = false;
-    for (size_t idx = 0; idx < vec.size(); idx++) {
-      if (idx > 0 && !compare_(vec[idx - 1].first, vec[idx].first)) {
-        needsSortAndOrDedupe = true;
-        break;
-      }
-    }
-
-    if (needsSortAndOrDedupe) {
-      // Need to sort and/or remove duplicates. The earliest entry "wins".
-
-      // Stable sort so earliest entry remains first after sort.
-      std::stable_sort(vec.begin(), vec.end(), compare_);
-
-      // Unique out the duplicates.
-      auto last = std::unique(vec.begin(), vec.end(), [=](auto& a, auto& b) {
-        // NB: assumes Key is PathComponent (but so does Compare).
-        return isPathPieceEqual(a.first, b.first, caseSensitive);
-      });
-      vec.erase(last, vec.end());
-    }
+    sortAndDedupe();
   }
 
   // Inherit the underlying vector copy/assignment.
@@ -358,6 +330,41 @@ class PathMap : private folly::fbvector<std::pair<Key, Value>> {
 
   template <typename V, typename K>
   friend class PathMapMutator;
+
+ private:
+  void sortAndDedupe() {
+    Vector& vec = *this;
+
+    // In practice, Sapling yields tree entries naively sorted. On case
+    // sensitive filesystems, the natural sorting will match what we want and
+    // should never contain duplicates, so we will hit our fast path below and
+    // avoid sorting. On case insensitive filesystems, if the entries don't
+    // happen to be sorted (or there are case insensitive collisions), we will
+    // hit the slow path below to sort and/or dedupe.
+
+    bool needsSortAndOrDedupe = false;
+    for (size_t idx = 0; idx < vec.size(); idx++) {
+      if (idx > 0 && !compare_(vec[idx - 1].first, vec[idx].first)) {
+        needsSortAndOrDedupe = true;
+        break;
+      }
+    }
+
+    if (needsSortAndOrDedupe) {
+      // Need to sort and/or remove duplicates. The earliest entry "wins".
+
+      // Stable sort so earliest entry remains first after sort.
+      std::stable_sort(vec.begin(), vec.end(), compare_);
+
+      // Unique out the duplicates.
+      auto caseSensitive = compare_.caseSensitive_;
+      auto last = std::unique(vec.begin(), vec.end(), [=](auto& a, auto& b) {
+        // NB: assumes Key is PathComponent (but so does Compare).
+        return isPathPieceEqual(a.first, b.first, caseSensitive);
+      });
+      vec.erase(last, vec.end());
+    }
+  }
 };
 
 // Implementations of the equality operators; gcc hates us if we
@@ -379,6 +386,152 @@ bool operator!=(const PathMap<V, K>& lhs, const PathMap<V, K>& rhs) {
   return vector != rhs;
 }
 
+namespace detail {
+
+/**
+ * Runs fn(0), ..., fn(count - 1), spread across the calling thread and the
+ * executor, and returns once all of them have completed.
+ *
+ * The calling thread takes part and only waits for calls that another thread
+ * has already started, so this cannot deadlock even when it is itself
+ * running on a saturated executor.
+ */
+template <typename Fn>
+void parallelForEach(size_t count, folly::Executor* executor, const Fn& fn) {
+  if (!executor || count <= 1) {
+    for (size_t i = 0; i < count; ++i) {
+      fn(i);
+    }
+    return;
+  }
+
+  struct State {
+    explicit State(size_t count, const Fn& fn) : count{count}, fn{fn} {}
+
+    /// Runs calls until none are left. Returns true if this thread ran the
+    /// call that completed the batch.
+    bool drain() {
+      bool last = false;
+      for (auto i = next.fetch_add(1); i < count; i = next.fetch_add(1)) {
+        fn(i);
+        last = done.fetch_add(1) + 1 == count;
+      }
+      return last;
+    }
+
+    const size_t count;
+    // Only dereferenced while a call is outstanding, so tasks that start
+    // after the batch is finished never touch it.
+    const Fn& fn;
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> done{0};
+    folly::Baton<> finished;
+  };
+
+  auto state = std::make_shared<State>(count, fn);
+  for (size_t i = 1; i < count; ++i) {
+    executor->add([state] {
+      if (state->drain()) {
+        state->finished.post();
+      }
+    });
+  }
+  if (!state->drain()) {
+    state->finished.wait();
+  }
+}
+
+} // namespace detail
+
+/**
+ * Build a PathMap from unsorted entries, sorting them in parallel on executor.
+ *
+ * When several entries are equal under caseSensitive, the one that comes
+ * first in entries wins, as with the PathMap constructors. If entries is an
+ * rvalue its elements are moved from, otherwise they are copied.
+ *
+ * The entries are stable sorted by index in chunks, one task per chunk, and
+ * the chunks are then merged pairwise, in parallel, so the keys themselves
+ * are only moved once: straight into the final vector, which is allocated at
+ * its final size. With no executor, everything runs on the calling thread.
+ *
+ * To apply changes to an existing PathMap, use PathMapMutator, whose
+ * finalize() merges in parallel in the same way.
+ */
+template <typename Value, typename Key = PathComponent, typename Range>
+PathMap<Value, Key> buildPathMap(
+    Range&& entries,
+    CaseSensitivity caseSensitive,
+    folly::Executor* executor = nullptr) {
+  using Piece = typename Key::piece_type;
+  // Sorting chunks smaller than this on another thread costs more than it
+  // saves.
+  constexpr size_t kMinChunkSize = 16 * 1024;
+  constexpr size_t kMaxChunks = 64;
+
+  const size_t size = std::size(entries);
+  auto keyAt = [&](size_t index) {
+    return Piece{std::begin(entries)[index].first};
+  };
+  auto less = [&](size_t a, size_t b) {
+    return isPathPieceLess(keyAt(a), keyAt(b), caseSensitive);
+  };
+
+  size_t chunks = 1;
+  while (chunks < kMaxChunks && chunks * 2 * kMinChunkSize <= size) {
+    chunks *= 2;
+  }
+  auto chunkBegin = [&](size_t chunk) {
+    return chunk * size / chunks;
+  };
+
+  std::vector<size_t> order(size);
+  std::vector<size_t> scratch(chunks > 1 ? size : 0);
+  std::iota(order.begin(), order.end(), 0);
+
+  detail::parallelForEach(chunks, executor, [&](size_t chunk) {
+    std::stable_sort(
+        order.begin() + chunkBegin(chunk),
+        order.begin() + chunkBegin(chunk + 1),
+        less);
+  });
+
+  // std::merge takes from the first range on ties, and the first range
+  // always holds the lower indices, so each round stays stable.
+  for (size_t width = 1; width < chunks; width *= 2) {
+    detail::parallelForEach(chunks / (width * 2), executor, [&](size_t pair) {
+      auto begin = chunkBegin(pair * width * 2);
+      auto mid = chunkBegin(pair * width * 2 + width);
+      auto end = chunkBegin((pair + 1) * width * 2);
+      std::merge(
+          order.begin() + begin,
+          order.begin() + mid,
+          order.begin() + mid,
+          order.begin() + end,
+          scratch.begin() + begin,
+          less);
+    });
+    order.swap(scratch);
+  }
+
+  folly::fbvector<std::pair<Key, Value>> sorted;
+  sorted.reserve(size);
+  for (auto index : order) {
+    if (!sorted.empty() &&
+        !isPathPieceLess(
+            Piece{sorted.back().first}, keyAt(index), caseSensitive)) {
+      continue;
+    }
+    auto& entry = std::begin(entries)[index];
+    if constexpr (std::is_rvalue_reference_v<Range&&>) {
+      sorted.emplace_back(std::move(entry));
+    } else {
+      sorted.emplace_back(entry);
+    }
+  }
+  return PathMap<Value, Key>{std::move(sorted), caseSensitive};
+}
+
 /**
  * Collate two path maps with different value types.
  *
@@ -7,16 +7,44 @@
 
 #pragma once
 
+#include <folly/Executor.h>
 #include <folly/FBVector.h>
 #include <folly/logging/xlog.h>
 #include <algorithm>
-#include <unordered_set>
+#include <bit>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <type_traits>
 #include <utility>
+#include <vector>
 
 #include "eden/common/utils/PathMap.h"
 
 namespace facebook::eden {
 
+/** The kinds of change that PathMapMutator::applyChanges() understands. */
+enum class PathMapChangeKind : uint8_t {
+  /// Insert the entry. An existing entry with the same key is left unaltered,
+  /// as with emplace().
+  Add,
+  /// Erase the entry with this key, if there is one.
+  Remove,
+  /// Insert the entry, or overwrite the value of an existing one, as with
+  /// insert_or_assign().
+  Update,
+};
+
+/** One element of the sorted change stream passed to applyChanges(). */
+template <typename Value, typename Key = PathComponent>
+struct PathMapChange {
+  PathMapChangeKind kind;
+  Key key;
+  /// Ignored for Remove.
+  Value value;
+};
+
 /**
  * PathMap wrapper for efficient batch updates. Optimized for emplace() calls in
  * sorted order (like checkout).
@@ -24,8 +52,9 @@ namespace facebook::eden {
  * PathMap erase/emplace operations are O(n) due to element shifting.
  * PathMapMutator defers them:
  *
- * - Erased entries are tracked by index and removed in one pass.
- * - New entries are appended to a sorted suffix and merged in O(n).
+ * - Erased entries are marked in a bitmap, by index, and removed in one pass.
+ * - New entries are appended to a sorted suffix and merged in O(n). When both
+ *   sides are large, finalize() can split the merge across an executor.
  * - If the suffix is appended out of order, the mutator compacts itself
  *   back into a clean sorted state before continuing. This is for correctness -
  *   the assumption is emplace() is called in sorted order.
@@ -34,6 +63,10 @@ namespace facebook::eden {
  * underlying PathMap vector. This avoids allocating a separate vector.
  *
  * Call finalize() to produce the resultant PathMap.
+ *
+ * A batch of changes that is already sorted, such as a diff between two
+ * trees, can instead be passed to applyChanges(), which applies all of them
+ * in a single merge with the existing entries.
  */
 template <typename Value, typename Key = PathComponent>
 class PathMapMutator {
@@ -87,7 +120,7 @@ class PathMapMutator {
   }
 
   void erase(iterator it) {
-    erased_.insert(indexOf(it));
+    setErased(indexOf(it), true);
   }
 
   size_type erase(Piece key) {
@@ -108,7 +141,7 @@ class PathMapMutator {
         return {it, false};
       }
       // Reuse the erased slot.
-      erased_.erase(indexOf(it));
+      setErased(indexOf(it), false);
       it->first = Key(key);
       it->second = Value(std::forward<Args>(args)...);
       return {it, true};
@@ -150,7 +183,7 @@ class PathMapMutator {
         return {it, false};
       }
       // Erased slot: revive it.
-      erased_.erase(indexOf(it));
+      setErased(indexOf(it), false);
       it->first = Key(key);
       it->second = std::forward<V>(value);
       return {it, true};
@@ -168,8 +201,119 @@ class PathMapMutator {
     return {vec().end() - 1, true};
   }
 
-  Map finalize() {
+  /**
+   * Apply a batch of changes, sorted by key in the map's order with no two
+   * for the same key, in one linear merge with the existing entries.
+   *
+   * changes may be any input range of PathMapChange<Value, Key>, and is only
+   * walked once. If it is an rvalue, keys and values are moved out of it.
+   * As with emplace(), sorted input is an assumption rather than a
+   * requirement: from the first change that is out of order onwards, the
+   * changes are applied one at a time instead.
+   */
+  template <typename Range>
+  void applyChanges(Range&& changes) {
     compact();
+
+    auto take = [](auto& field) -> decltype(auto) {
+      if constexpr (std::is_rvalue_reference_v<Range&&>) {
+        return std::move(field);
+      } else {
+        return static_cast<const std::remove_reference_t<decltype(field)>&>(
+            field);
+      }
+    };
+
+    Vector& current = vec();
+    Vector merged;
+    merged.reserve(current.size());
+    auto it = current.begin();
+    auto finishMerge = [&] {
+      merged.insert(
+          merged.end(),
+          std::make_move_iterator(it),
+          std::make_move_iterator(current.end()));
+      current.swap(merged);
+      suffixStart_ = current.size();
+    };
+
+    // A copy of the previous key, since it may have been moved from.
+    std::string previous;
+    bool first = true;
+    bool merging = true;
+    for (auto&& change : changes) {
+      Piece key{change.key};
+      if (merging && !first &&
+          !compare_(Piece{previous, detail::SkipPathSanityCheck{}}, key)) {
+        XLOGF(
+            WARN,
+            "PathMapMutator: change for {} is out of order, "
+            "applying the rest one at a time",
+            key.view());
+        finishMerge();
+        merging = false;
+      }
+      if (!merging) {
+        switch (change.kind) {
+          case PathMapChangeKind::Add:
+            emplace(key, take(change.value));
+            break;
+          case PathMapChangeKind::Remove:
+            erase(key);
+            break;
+          case PathMapChangeKind::Update:
+            insert_or_assign(key, take(change.value));
+            break;
+        }
+        continue;
+      }
+      previous.assign(key.view());
+      first = false;
+
+      while (it != current.end() && compare_(it->first, key)) {
+        merged.push_back(std::move(*it));
+        ++it;
+      }
+      bool exists = it != current.end() && !compare_(key, it->first);
+
+      switch (change.kind) {
+        case PathMapChangeKind::Add:
+          if (exists) {
+            merged.push_back(std::move(*it));
+          } else {
+            merged.emplace_back(take(change.key), take(change.value));
+          }
+          break;
+        case PathMapChangeKind::Remove:
+          break;
+        case PathMapChangeKind::Update:
+          if (exists) {
+            merged.emplace_back(std::move(it->first), take(change.value));
+          } else {
+            merged.emplace_back(take(change.key), take(change.value));
+          }
+          break;
+      }
+      if (exists) {
+        ++it;
+      }
+    }
+    if (merging) {
+      finishMerge();
+    }
+  }
+
+  /**
+   * Produce the resultant PathMap. If executor is given and both the
+   * original entries and the newly emplaced ones are numerous, they are
+   * merged in parallel on it.
+   *
+   * Both sides are already sorted, so unlike buildPathMap() there is nothing
+   * to sort here, only the merge; it is split up with the same
+   * detail::parallelForEach().
+   */
+  Map finalize(folly::Executor* executor = nullptr) {
+    compact(executor);
     return std::move(map_);
   }
 
@@ -196,49 +340,183 @@ class PathMapMutator {
     auto prefixEnd = vec().begin() + suffixStart_;
     auto it = std::lower_bound(vec().begin(), prefixEnd, key, compare_);
     if (it != prefixEnd && !compare_(key, it->first)) {
-      return {it, erased_.count(indexOf(it)) > 0};
+      return {it, isErased(indexOf(it))};
     }
     if (vec().size() > suffixStart_) {
       auto sit = std::lower_bound(
           vec().begin() + suffixStart_, vec().end(), key, compare_);
       if (sit != vec().end() && !compare_(key, sit->first)) {
-        return {sit, erased_.count(indexOf(sit)) > 0};
+        return {sit, isErased(indexOf(sit))};
       }
     }
     return {vec().end(), false};
   }
 
+  bool isErased(size_t index) const {
+    size_t word = index / 64;
+    return word < erased_.size() && (erased_[word] >> (index % 64)) & 1;
+  }
+
+  void setErased(size_t index, bool erased) {
+    size_t word = index / 64;
+    if (word >= erased_.size()) {
+      if (!erased) {
+        return;
+      }
+      erased_.resize((vec().size() + 63) / 64);
+    }
+    uint64_t bit = uint64_t{1} << (index % 64);
+    if (erased != static_cast<bool>(erased_[word] & bit)) {
+      erased_[word] ^= bit;
+      if (erased) {
+        ++erasedCount_;
+      } else {
+        --erasedCount_;
+      }
+    }
+  }
+
   /// Remove erased entries and merge prefix + suffix into sorted order.
-  void compact() {
-    size_t idx = 0;
-    size_t prefixErased = 0;
-    vec().erase(
-        std::remove_if(
-            vec().begin(),
-            vec().end(),
-            [&](const Pair&) {
-              bool removed = erased_.count(idx) > 0;
-              if (removed && idx < suffixStart_) {
-                ++prefixErased;
-              }
-              ++idx;
-              return removed;
-            }),
-        vec().end());
-    suffixStart_ -= prefixErased;
+  void compact(folly::Executor* executor = nullptr) {
+    if (erasedCount_ != 0) {
+      // Walk only the set bits, sliding the kept entries down over the gaps.
+      size_t out = 0;
+      size_t in = 0;
+      size_t prefixErased = 0;
+      auto keepUntil = [&](size_t end) {
+        if (out != in) {
+          std::move(
+              vec().begin() + in, vec().begin() + end, vec().begin() + out);
+        }
+        out += end - in;
+      };
+      for (size_t word = 0; word < erased_.size(); ++word) {
+        for (uint64_t bits = erased_[word]; bits; bits &= bits - 1) {
+          size_t index = word * 64 + std::countr_zero(bits);
+          keepUntil(index);
+          in = index + 1;
+          if (index < suffixStart_) {
+            ++prefixErased;
+          }
+        }
+      }
+      keepUntil(vec().size());
+      vec().erase(vec().begin() + out, vec().end());
+      suffixStart_ -= prefixErased;
+    }
     erased_.clear();
+    erasedCount_ = 0;
+
+    merge(executor);
+    suffixStart_ = vec().size();
+  }
 
+  /// Merge the sorted prefix and suffix.
+  void merge(folly::Executor* executor) {
+    // Below this many entries on either side, splitting the merge costs more
+    // than it saves.
+    constexpr size_t kMinParallelMergeSide = 64 * 1024;
+    constexpr size_t kMaxMergeTasks = 64;
+
+    const size_t prefix = suffixStart_;
+    const size_t suffix = vec().size() - suffixStart_;
+    if (suffix == 0) {
+      return;
+    }
+    // A move that throws part way through would leave the merged entries
+    // split between the two buffers.
+    if constexpr (std::is_nothrow_move_constructible_v<Pair>) {
+      if (executor && prefix >= kMinParallelMergeSide &&
+          suffix >= kMinParallelMergeSide) {
+        parallelMerge(executor, kMaxMergeTasks);
+        return;
+      }
+    }
     std::inplace_merge(
         vec().begin(), vec().begin() + suffixStart_, vec().end(), compare_);
+  }
 
-    suffixStart_ = vec().size();
+  /**
+   * Merge into uninitialized storage, splitting the output into equal parts
+   * and finding where each part starts in the two inputs with a binary search
+   * along the merge path. The merged entries are then moved back into vec(),
+   * whose capacity already fits them.
+   *
+   * Keys such as PathComponent have no default constructor, so the output
+   * cannot be a vector sized up front.
+   */
+  void parallelMerge(folly::Executor* executor, size_t maxTasks) {
+    auto& input = vec();
+    const auto a = input.begin();
+    const size_t aSize = suffixStart_;
+    const auto b = input.begin() + suffixStart_;
+    const size_t bSize = input.size() - suffixStart_;
+    const size_t total = aSize + bSize;
+    const size_t tasks =
+        std::min(maxTasks, std::max<size_t>(1, total / (16 * 1024)));
+
+    // The number of elements taken from a among the first k of the output.
+    // Ties take from a first, as std::merge does.
+    auto splitA = [&](size_t k) {
+      size_t low = k > bSize ? k - bSize : 0;
+      size_t high = std::min(k, aSize);
+      while (low < high) {
+        size_t i = low + (high - low) / 2;
+        if (compare_(b[k - i - 1].first, a[i].first)) {
+          high = i;
+        } else {
+          low = i + 1;
+        }
+      }
+      return low;
+    };
+
+    // Found up front: once tasks start, they move from entries that the
+    // search would compare.
+    std::vector<size_t> splits(tasks + 1);
+    for (size_t task = 0; task <= tasks; ++task) {
+      splits[task] = splitA(task * total / tasks);
+    }
+
+    std::allocator<Pair> allocator;
+    Pair* output = allocator.allocate(total);
+    detail::parallelForEach(tasks, executor, [&](size_t task) {
+      size_t begin = task * total / tasks;
+      size_t end = (task + 1) * total / tasks;
+      size_t aBegin = splits[task];
+      size_t aEnd = splits[task + 1];
+      auto ai = a + aBegin;
+      auto bi = b + (begin - aBegin);
+      const auto aLast = a + aEnd;
+      const auto bLast = b + (end - aEnd);
+      Pair* out = output + begin;
+      while (ai != aLast && bi != bLast) {
+        if (compare_(bi->first, ai->first)) {
+          std::construct_at(out++, std::move(*bi++));
+        } else {
+          std::construct_at(out++, std::move(*ai++));
+        }
+      }
+      out = std::uninitialized_move(ai, aLast, out);
+      std::uninitialized_move(bi, bLast, out);
+    });
+
+    input.clear();
+    input.insert(
+        input.end(),
+        std::make_move_iterator(output),
+        std::make_move_iterator(output + total));
+    std::destroy(output, output + total);
+    allocator.deallocate(output, total);
   }
 
   Compare compare_;
   CaseSensitivity caseSensitive_;
   Map map_;
   size_t suffixStart_{0};
-  std::unordered_set<size_t> erased_;
+  // One bit per index into vec(), allocated on the first erase.
+  std::vector<uint64_t> erased_;
+  size_t erasedCount_{0};
 };
 
 } // namespace facebook::eden
@@ -0,0 +1,636 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "eden/common/utils/PathScan.h"
+
+#include <folly/Portability.h>
+#include <bit>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <folly/CpuId.h>
+#include <immintrin.h>
+#define EDEN_PATH_SCAN_X86 1
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define EDEN_PATH_SCAN_NEON 1
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define EDEN_PATH_SCAN_AVX2 __attribute__((target("avx2")))
+#else
+#define EDEN_PATH_SCAN_AVX2
+#endif
+
+namespace facebook::eden::detail {
+
+namespace {
+
+// Duplicated from PathFuncs.h, which includes this header.
+constexpr char kDirSeparator = '/';
+constexpr char kAltDirSeparator = folly::kIsWindows ? '\\' : kDirSeparator;
+
+/**
+ * The bytes a scan is looking for. Unused slots repeat a used value so that
+ * the kernels can always compare against all of them.
+ */
+struct ScanChars {
+  // Bytes that delimit components. A single PathComponent has no separators,
+  // so both are set to NUL, which is also always rejected.
+  char sep0;
+  char sep1;
+  // Bytes that are never allowed.
+  char bad0;
+  char bad1;
+  char bad2;
+
+  bool isSep(char c) const {
+    return c == sep0 || c == sep1;
+  }
+
+  bool isBad(char c) const {
+    return c == bad0 || c == bad1 || c == bad2;
+  }
+};
+
+ScanChars componentChars() {
+  return {'\0', '\0', '\0', kDirSeparator, kAltDirSeparator};
+}
+
+ScanChars composedChars(std::optional<char> pathSeparator) {
+  if (!pathSeparator) {
+    return {kDirSeparator, kAltDirSeparator, '\0', '\0', '\0'};
+  }
+  // Any directory separator other than the requested one would end up inside
+  // a component, which PathComponentSanityCheck rejects.
+  char sep = *pathSeparator;
+  return {
+      sep,
+      sep,
+      '\0',
+      sep == kDirSeparator ? '\0' : kDirSeparator,
+      sep == kAltDirSeparator ? '\0' : kAltDirSeparator};
+}
+
+/**
+ * Byte-at-a-time reference implementation.
+ */
+PathScanResult scanScalar(std::string_view val, const ScanChars& chars) {
+  bool nonAscii = false;
+  size_t componentStart = 0;
+  for (size_t i = 0; i <= val.size(); ++i) {
+    if (i < val.size()) {
+      char c = val[i];
+      if (chars.isBad(c)) {
+        return PathScanResult::Invalid;
+      }
+      if (!chars.isSep(c)) {
+        nonAscii |= static_cast<unsigned char>(c) >= 0x80;
+        continue;
+      }
+    }
+    auto component = val.substr(componentStart, i - componentStart);
+    if (component.empty() || component == "." || component == "..") {
+      return PathScanResult::Invalid;
+    }
+    componentStart = i + 1;
+  }
+  return nonAscii ? PathScanResult::NonAscii : PathScanResult::Ascii;
+}
+
+/**
+ * Per-byte classification of a 64 byte block, one bit per byte.
+ */
+struct BlockMasks {
+  uint64_t sep;
+  uint64_t bad;
+  uint64_t dot;
+  uint64_t high;
+};
+
+struct Block {
+  const char* data;
+  // Bytes of data that belong to the string being scanned.
+  uint64_t valid;
+};
+
+/**
+ * Hands out the string 64 bytes at a time. The final partial block is copied
+ * into a zeroed buffer so the kernels never read past the end of the string.
+ */
+class BlockCursor {
+ public:
+  explicit BlockCursor(std::string_view val) : val_{val} {}
+
+  bool next(Block& block) {
+    size_t remaining = val_.size() - pos_;
+    if (remaining >= 64) {
+      block = Block{val_.data() + pos_, ~uint64_t{0}};
+      pos_ += 64;
+      return true;
+    }
+    if (remaining == 0) {
+      return false;
+    }
+    std::memset(tail_, 0, sizeof(tail_));
+    std::memcpy(tail_, val_.data() + pos_, remaining);
+    block = Block{tail_, (uint64_t{1} << remaining) - 1};
+    pos_ = val_.size();
+    return true;
+  }
+
+ private:
+  std::string_view val_;
+  size_t pos_{0};
+  alignas(64) char tail_[64];
+};
+
+/**
+ * Carries the structural checks from one block to the next.
+ *
+ * A component is empty, "." or ".." exactly when the separator that ends it is
+ * preceded by another separator, by "<sep>." or by "<sep>..". The start of
+ * the string counts as a separator; the end of the string is checked once in
+ * finish().
+ */
+class ScanState {
+ public:
+  bool consume(const BlockMasks& masks, uint64_t valid) {
+    uint64_t sep = masks.sep & valid;
+    uint64_t dot = masks.dot & valid;
+
+    uint64_t sep1 = (sep << 1) | (prevSep_ >> 63);
+    uint64_t sep2 = (sep << 2) | (prevSep_ >> 62);
+    uint64_t sep3 = (sep << 3) | (prevSep_ >> 61);
+    uint64_t dot1 = (dot << 1) | (prevDot_ >> 63);
+    uint64_t dot2 = (dot << 2) | (prevDot_ >> 62);
+
+    uint64_t errors = (masks.bad & valid) | (sep & sep1) |
+        (sep & dot1 & sep2) | (sep & dot1 & dot2 & sep3);
+
+    prevSep_ = sep;
+    prevDot_ = dot;
+    high_ |= masks.high & valid;
+    return errors == 0;
+  }
+
+  PathScanResult finish(std::string_view val, const ScanChars& chars) const {
+    size_t n = val.size();
+    if (n == 0 || chars.isSep(val[n - 1])) {
+      return PathScanResult::Invalid;
+    }
+    if (val[n - 1] == '.') {
+      if (n == 1 || chars.isSep(val[n - 2])) {
+        return PathScanResult::Invalid;
+      }
+      if (val[n - 2] == '.' && (n == 2 || chars.isSep(val[n - 3]))) {
+        return PathScanResult::Invalid;
+      }
+    }
+    return high_ ? PathScanResult::NonAscii : PathScanResult::Ascii;
+  }
+
+ private:
+  // The byte before the string behaves as a separator.
+  uint64_t prevSep_{uint64_t{1} << 63};
+  uint64_t prevDot_{0};
+  uint64_t high_{0};
+};
+
+/**
+ * Turns per-block separator masks into offsets for findPathSeparators().
+ */
+class SeparatorCollector {
+ public:
+  SeparatorCollector(uint32_t* out, size_t capacity)
+      : out_{out}, capacity_{capacity} {}
+
+  void consume(uint64_t sep, size_t blockOffset) {
+    if (count_ + std::popcount(sep) > capacity_) {
+      // Only the count matters once the buffer is full.
+      for (; sep && count_ < capacity_; sep &= sep - 1) {
+        out_[count_++] = offset(sep, blockOffset);
+      }
+      count_ += std::popcount(sep);
+      return;
+    }
+    for (; sep; sep &= sep - 1) {
+      out_[count_++] = offset(sep, blockOffset);
+    }
+  }
+
+  size_t count() const {
+    return count_;
+  }
+
+ private:
+  static uint32_t offset(uint64_t sep, size_t blockOffset) {
+    return static_cast<uint32_t>(blockOffset + std::countr_zero(sep));
+  }
+
+  uint32_t* out_;
+  size_t capacity_;
+  size_t count_{0};
+};
+
+size_t findSeparatorsScalar(
+    std::string_view val,
+    const ScanChars& chars,
+    uint32_t* out,
+    size_t capacity) {
+  size_t count = 0;
+  for (size_t i = 0; i < val.size(); ++i) {
+    if (chars.isSep(val[i])) {
+      if (count < capacity) {
+        out[count] = static_cast<uint32_t>(i);
+      }
+      ++count;
+    }
+  }
+  return count;
+}
+
+#ifdef EDEN_PATH_SCAN_X86
+
+class Sse2Classifier {
+ public:
+  explicit Sse2Classifier(const ScanChars& chars)
+      : sep0_{_mm_set1_epi8(chars.sep0)},
+        sep1_{_mm_set1_epi8(chars.sep1)},
+        bad0_{_mm_set1_epi8(chars.bad0)},
+        bad1_{_mm_set1_epi8(chars.bad1)},
+        bad2_{_mm_set1_epi8(chars.bad2)},
+        dot_{_mm_set1_epi8('.')} {}
+
+  BlockMasks operator()(const char* data) const {
+    BlockMasks masks{};
+    for (int i = 0; i < 4; ++i) {
+      __m128i v =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16 * i));
+      __m128i sep =
+          _mm_or_si128(_mm_cmpeq_epi8(v, sep0_), _mm_cmpeq_epi8(v, sep1_));
+      __m128i bad = _mm_or_si128(
+          _mm_or_si128(_mm_cmpeq_epi8(v, bad0_), _mm_cmpeq_epi8(v, bad1_)),
+          _mm_cmpeq_epi8(v, bad2_));
+      __m128i dot = _mm_cmpeq_epi8(v, dot_);
+      int shift = 16 * i;
+      masks.sep |= uint64_t{movemask(sep)} << shift;
+      masks.bad |= uint64_t{movemask(bad)} << shift;
+      masks.dot |= uint64_t{movemask(dot)} << shift;
+      masks.high |= uint64_t{movemask(v)} << shift;
+    }
+    return masks;
+  }
+
+ private:
+  static uint32_t movemask(__m128i v) {
+    return static_cast<uint32_t>(_mm_movemask_epi8(v));
+  }
+
+  __m128i sep0_;
+  __m128i sep1_;
+  __m128i bad0_;
+  __m128i bad1_;
+  __m128i bad2_;
+  __m128i dot_;
+};
+
+PathScanResult scanSse2(std::string_view val, const ScanChars& chars) {
+  Sse2Classifier classify{chars};
+  ScanState state;
+  BlockCursor cursor{val};
+  Block block;
+  while (cursor.next(block)) {
+    if (!state.consume(classify(block.data), block.valid)) {
+      return PathScanResult::Invalid;
+    }
+  }
+  return state.finish(val, chars);
+}
+
+size_t findSeparatorsSse2(
+    std::string_view val,
+    const ScanChars& chars,
+    uint32_t* out,
+    size_t capacity) {
+  Sse2Classifier classify{chars};
+  SeparatorCollector collector{out, capacity};
+  BlockCursor cursor{val};
+  Block block;
+  for (size_t offset = 0; cursor.next(block); offset += 64) {
+    collector.consume(classify(block.data).sep & block.valid, offset);
+  }
+  return collector.count();
+}
+
+class Avx2Classifier {
+ public:
+  EDEN_PATH_SCAN_AVX2 explicit Avx2Classifier(const ScanChars& chars)
+      : sep0_{_mm256_set1_epi8(chars.sep0)},
+        sep1_{_mm256_set1_epi8(chars.sep1)},
+        bad0_{_mm256_set1_epi8(chars.bad0)},
+        bad1_{_mm256_set1_epi8(chars.bad1)},
+        bad2_{_mm256_set1_epi8(chars.bad2)},
+        dot_{_mm256_set1_epi8('.')} {}
+
+  EDEN_PATH_SCAN_AVX2 BlockMasks operator()(const char* data) const {
+    BlockMasks masks{};
+    for (int i = 0; i < 2; ++i) {
+      __m256i v =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + 32 * i));
+      __m256i sep = _mm256_or_si256(
+          _mm256_cmpeq_epi8(v, sep0_), _mm256_cmpeq_epi8(v, sep1_));
+      __m256i bad = _mm256_or_si256(
+          _mm256_or_si256(
+              _mm256_cmpeq_epi8(v, bad0_), _mm256_cmpeq_epi8(v, bad1_)),
+          _mm256_cmpeq_epi8(v, bad2_));
+      __m256i dot = _mm256_cmpeq_epi8(v, dot_);
+      int shift = 32 * i;
+      masks.sep |= uint64_t{movemask(sep)} << shift;
+      masks.bad |= uint64_t{movemask(bad)} << shift;
+      masks.dot |= uint64_t{movemask(dot)} << shift;
+      masks.high |= uint64_t{movemask(v)} << shift;
+    }
+    return masks;
+  }
+
+ private:
+  EDEN_PATH_SCAN_AVX2 static uint32_t movemask(__m256i v) {
+    return static_cast<uint32_t>(_mm256_movemask_epi8(v));
+  }
+
+  __m256i sep0_;
+  __m256i sep1_;
+  __m256i bad0_;
+  __m256i bad1_;
+  __m256i bad2_;
+  __m256i dot_;
+};
+
+EDEN_PATH_SCAN_AVX2 PathScanResult
+scanAvx2(std::string_view val, const ScanChars& chars) {
+  Avx2Classifier classify{chars};
+  ScanState state;
+  BlockCursor cursor{val};
+  Block block;
+  while (cursor.next(block)) {
+    if (!state.consume(classify(block.data), block.valid)) {
+      return PathScanResult::Invalid;
+    }
+  }
+  return state.finish(val, chars);
+}
+
+EDEN_PATH_SCAN_AVX2 size_t findSeparatorsAvx2(
+    std::string_view val,
+    const ScanChars& chars,
+    uint32_t* out,
+    size_t capacity) {
+  Avx2Classifier classify{chars};
+  SeparatorCollector collector{out, capacity};
+  BlockCursor cursor{val};
+  Block block;
+  for (size_t offset = 0; cursor.next(block); offset += 64) {
+    collector.consume(classify(block.data).sep & block.valid, offset);
+  }
+  return collector.count();
+}
+
+#endif // EDEN_PATH_SCAN_X86
+
+#ifdef EDEN_PATH_SCAN_NEON
+
+class NeonClassifier {
+ public:
+  explicit NeonClassifier(const ScanChars& chars)
+      : sep0_{vdupq_n_u8(static_cast<uint8_t>(chars.sep0))},
+        sep1_{vdupq_n_u8(static_cast<uint8_t>(chars.sep1))},
+        bad0_{vdupq_n_u8(static_cast<uint8_t>(chars.bad0))},
+        bad1_{vdupq_n_u8(static_cast<uint8_t>(chars.bad1))},
+        bad2_{vdupq_n_u8(static_cast<uint8_t>(chars.bad2))},
+        dot_{vdupq_n_u8('.')},
+        high_{vdupq_n_u8(0x80)},
+        bits_{vld1q_u8(kBits)} {}
+
+  BlockMasks operator()(const char* data) const {
+    const auto* bytes = reinterpret_cast<const uint8_t*>(data);
+    uint8x16_t sep[4];
+    uint8x16_t bad[4];
+    uint8x16_t dot[4];
+    uint8x16_t high[4];
+    for (int i = 0; i < 4; ++i) {
+      uint8x16_t v = vld1q_u8(bytes + 16 * i);
+      sep[i] = vorrq_u8(vceqq_u8(v, sep0_), vceqq_u8(v, sep1_));
+      bad[i] = vorrq_u8(
+          vorrq_u8(vceqq_u8(v, bad0_), vceqq_u8(v, bad1_)),
+          vceqq_u8(v, bad2_));
+      dot[i] = vceqq_u8(v, dot_);
+      high[i] = vcgeq_u8(v, high_);
+    }
+    return BlockMasks{
+        movemask(sep), movemask(bad), movemask(dot), movemask(high)};
+  }
+
+ private:
+  static constexpr uint8_t kBits[16] = {
+      0x01,
+      0x02,
+      0x04,
+      0x08,
+      0x10,
+      0x20,
+      0x40,
+      0x80,
+      0x01,
+      0x02,
+      0x04,
+      0x08,
+      0x10,
+      0x20,
+      0x40,
+      0x80};
+
+  /**
+   * NEON has no movemask; fold four all-or-nothing comparison results into
+   * one bit per byte with pairwise adds.
+   */
+  uint64_t movemask(const uint8x16_t (&cmp)[4]) const {
+    uint8x16_t sum0 =
+        vpaddq_u8(vandq_u8(cmp[0], bits_), vandq_u8(cmp[1], bits_));
+    uint8x16_t sum1 =
+        vpaddq_u8(vandq_u8(cmp[2], bits_), vandq_u8(cmp[3], bits_));
+    sum0 = vpaddq_u8(sum0, sum1);
+    sum0 = vpaddq_u8(sum0, sum0);
+    return vgetq_lane_u64(vreinterpretq_u64_u8(sum0), 0);
+  }
+
+  uint8x16_t sep0_;
+  uint8x16_t sep1_;
+  uint8x16_t bad0_;
+  uint8x16_t bad1_;
+  uint8x16_t bad2_;
+  uint8x16_t dot_;
+  uint8x16_t high_;
+  uint8x16_t bits_;
+};
+
+PathScanResult scanNeon(std::string_view val, const ScanChars& chars) {
+  NeonClassifier classify{chars};
+  ScanState state;
+  BlockCursor cursor{val};
+  Block block;
+  while (cursor.next(block)) {
+    if (!state.consume(classify(block.data), block.valid)) {
+      return PathScanResult::Invalid;
+    }
+  }
+  return state.finish(val, chars);
+}
+
+size_t findSeparatorsNeon(
+    std::string_view val,
+    const ScanChars& chars,
+    uint32_t* out,
+    size_t capacity) {
+  NeonClassifier classify{chars};
+  SeparatorCollector collector{out, capacity};
+  BlockCursor cursor{val};
+  Block block;
+  for (size_t offset = 0; cursor.next(block); offset += 64) {
+    collector.consume(classify(block.data).sep & block.valid, offset);
+  }
+  return collector.count();
+}
+
+#endif // EDEN_PATH_SCAN_NEON
+
+// Below this length the fixed cost of setting up a block outweighs the
+// per-byte savings; see PathFuncsBenchmark.
+constexpr size_t kMinVectorScanLength = 16;
+
+PathScanResult
+scan(std::string_view val, const ScanChars& chars, PathScanImpl impl) {
+  if (val.size() < kMinVectorScanLength) {
+    impl = PathScanImpl::Scalar;
+  }
+  switch (impl) {
+    case PathScanImpl::Scalar:
+      break;
+    case PathScanImpl::SSE2:
+#ifdef EDEN_PATH_SCAN_X86
+      return scanSse2(val, chars);
+#else
+      break;
+#endif
+    case PathScanImpl::AVX2:
+#ifdef EDEN_PATH_SCAN_X86
+      if (isPathScanImplSupported(PathScanImpl::AVX2)) {
+        return scanAvx2(val, chars);
+      }
+#endif
+      break;
+    case PathScanImpl::NEON:
+#ifdef EDEN_PATH_SCAN_NEON
+      return scanNeon(val, chars);
+#else
+      break;
+#endif
+  }
+  return scanScalar(val, chars);
+}
+
+} // namespace
+
+bool isPathScanImplSupported(PathScanImpl impl) {
+  switch (impl) {
+    case PathScanImpl::Scalar:
+      return true;
+    case PathScanImpl::SSE2:
+#ifdef EDEN_PATH_SCAN_X86
+      // SSE2 is part of the x86-64 baseline.
+      return true;
+#else
+      return false;
+#endif
+    case PathScanImpl::AVX2: {
+#ifdef EDEN_PATH_SCAN_X86
+      static const bool hasAvx2 = folly::CpuId().avx2();
+      return hasAvx2;
+#else
+      return false;
+#endif
+    }
+    case PathScanImpl::NEON:
+#ifdef EDEN_PATH_SCAN_NEON
+      return true;
+#else
+      return false;
+#endif
+  }
+  return false;
+}
+
+PathScanImpl bestPathScanImpl() {
+  static const PathScanImpl best = [] {
+    for (auto impl :
+         {PathScanImpl::AVX2, PathScanImpl::NEON, PathScanImpl::SSE2}) {
+      if (isPathScanImplSupported(impl)) {
+        return impl;
+      }
+    }
+    return PathScanImpl::Scalar;
+  }();
+  return best;
+}
+
+PathScanResult scanPathComponent(std::string_view val, PathScanImpl impl) {
+  return scan(val, componentChars(), impl);
+}
+
+PathScanResult scanComposedPath(
+    std::string_view val,
+    std::optional<char> pathSeparator,
+    PathScanImpl impl) {
+  return scan(val, composedChars(pathSeparator), impl);
+}
+
+size_t findPathSeparators(
+    std::string_view val,
+    uint32_t* out,
+    size_t capacity,
+    PathScanImpl impl) {
+  auto chars = composedChars(std::nullopt);
+  if (val.size() < kMinVectorScanLength) {
+    impl = PathScanImpl::Scalar;
+  }
+  switch (impl) {
+    case PathScanImpl::Scalar:
+      break;
+    case PathScanImpl::SSE2:
+#ifdef EDEN_PATH_SCAN_X86
+      return findSeparatorsSse2(val, chars, out, capacity);
+#else
+      break;
+#endif
+    case PathScanImpl::AVX2:
+#ifdef EDEN_PATH_SCAN_X86
+      if (isPathScanImplSupported(PathScanImpl::AVX2)) {
+        return findSeparatorsAvx2(val, chars, out, capacity);
+      }
+#endif
+      break;
+    case PathScanImpl::NEON:
+#ifdef EDEN_PATH_SCAN_NEON
+      return findSeparatorsNeon(val, chars, out, capacity);
+#else
+      break;
+#endif
+  }
+  return findSeparatorsScalar(val, chars, out, capacity);
+}
+
+} // namespace facebook::eden::detail
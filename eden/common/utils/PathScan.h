@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+namespace facebook::eden::detail {
+
+/**
+ * Outcome of a vectorized path validation scan.
+ *
+ * The scan only answers "definitely fine" quickly; whenever something is
+ * wrong it reports Invalid without saying what, and the caller is expected to
+ * rerun the byte-at-a-time checks to produce the precise error.
+ */
+enum class PathScanResult : uint8_t {
+  /// Structurally valid and entirely ASCII, so also valid UTF-8.
+  Ascii,
+  /// Structurally valid, but contains bytes >= 0x80 whose UTF-8 encoding has
+  /// not been checked.
+  NonAscii,
+  /// Contains a NUL, a misplaced directory separator, or an empty, "." or ".."
+  /// component.
+  Invalid,
+};
+
+/**
+ * Instruction set used by the path scanning kernels. Exposed so that tests
+ * and benchmarks can compare each implementation against the scalar one.
+ */
+enum class PathScanImpl : uint8_t {
+  Scalar,
+  SSE2,
+  AVX2,
+  NEON,
+};
+
+/**
+ * Returns whether impl can run on this machine.
+ */
+bool isPathScanImplSupported(PathScanImpl impl);
+
+/**
+ * Returns the fastest implementation supported by this machine. The CPU is
+ * only probed on the first call.
+ */
+PathScanImpl bestPathScanImpl();
+
+/**
+ * Scan val with the same rules as PathComponentSanityCheck, minus the UTF-8
+ * check.
+ */
+PathScanResult scanPathComponent(std::string_view val, PathScanImpl impl);
+
+inline PathScanResult scanPathComponent(std::string_view val) {
+  return scanPathComponent(val, bestPathScanImpl());
+}
+
+/**
+ * Scan val with the same rules as ComposedPathSanityCheck, minus the UTF-8
+ * check. When pathSeparator is set, it is the only character accepted
+ * between components and any other directory separator is an error.
+ */
+PathScanResult scanComposedPath(
+    std::string_view val,
+    std::optional<char> pathSeparator,
+    PathScanImpl impl);
+
+inline PathScanResult scanComposedPath(
+    std::string_view val,
+    std::optional<char> pathSeparator = std::nullopt) {
+  return scanComposedPath(val, pathSeparator, bestPathScanImpl());
+}
+
+/**
+ * Write the offsets of the directory separators in val to out, in order,
+ * until capacity offsets have been written. Returns the total number of
+ * separators in val, which may exceed capacity; the caller can then retry with
+ * a large enough buffer.
+ *
+ * Both '/' and, on Windows, '\\' count as separators. val must be shorter
+ * than 4GiB.
+ */
+size_t findPathSeparators(
+    std::string_view val,
+    uint32_t* out,
+    size_t capacity,
+    PathScanImpl impl);
+
+inline size_t
+findPathSeparators(std::string_view val, uint32_t* out, size_t capacity) {
+  return findPathSeparators(val, out, capacity, bestPathScanImpl());
+}
+
+} // namespace facebook::eden::detail
@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "eden/common/utils/PathTrie.h"
+
+#include <folly/hash/Hash.h>
+#include <cstring>
+#include <limits>
+
+#include "eden/common/utils/HashedPathMap.h"
+#include "eden/common/utils/Throw.h"
+
+namespace facebook::eden {
+
+namespace {
+// Names are copied into chunks of this size, or larger for longer names.
+constexpr size_t kArenaChunkSize = 16 * 1024;
+} // namespace
+
+PathTrie::PathTrie(CaseSensitivity caseSensitive)
+    : caseSensitive_{caseSensitive},
+      children_{0, ChildHash{caseSensitive}, ChildEqual{caseSensitive}} {
+  nodes_.emplace_back();
+}
+
+size_t PathTrie::ChildHash::operator()(const ChildKey& key) const {
+  PathComponentPiece name{key.name, detail::SkipPathSanityCheck{}};
+  size_t nameHash = caseSensitive == CaseSensitivity::Sensitive
+      ? std::hash<std::string_view>{}(key.name)
+      : detail::hashPathPieceCaseInsensitive(name);
+  return folly::hash::hash_128_to_64(key.parent, nameHash);
+}
+
+bool PathTrie::ChildEqual::operator()(const ChildKey& a, const ChildKey& b)
+    const {
+  return a.parent == b.parent &&
+      isPathPieceEqual(
+             PathComponentPiece{a.name, detail::SkipPathSanityCheck{}},
+             PathComponentPiece{b.name, detail::SkipPathSanityCheck{}},
+             caseSensitive);
+}
+
+std::string_view PathTrie::storeName(std::string_view name) {
+  if (arena_.empty() || arenaChunkSize_ - arenaChunkUsed_ < name.size()) {
+    arenaChunkSize_ = std::max(kArenaChunkSize, name.size());
+    arena_.push_back(std::make_unique<char[]>(arenaChunkSize_));
+    arenaChunkUsed_ = 0;
+    arenaBytes_ += arenaChunkSize_;
+  }
+  char* out = arena_.back().get() + arenaChunkUsed_;
+  std::memcpy(out, name.data(), name.size());
+  arenaChunkUsed_ += name.size();
+  return std::string_view{out, name.size()};
+}
+
+std::optional<uint32_t> PathTrie::findChild(
+    uint32_t parent,
+    std::string_view name) const {
+  auto it = children_.find(ChildKey{parent, name});
+  if (it == children_.end()) {
+    return std::nullopt;
+  }
+  return it->second;
+}
+
+std::optional<uint32_t> PathTrie::findNode(RelativePathPiece path) const {
+  uint32_t node = kRoot;
+  for (auto component : path.components()) {
+    auto child = findChild(node, component.view());
+    if (!child) {
+      return std::nullopt;
+    }
+    node = *child;
+  }
+  return node;
+}
+
+bool PathTrie::insert(RelativePathPiece path) {
+  uint32_t node = kRoot;
+  for (auto component : path.components()) {
+    if (auto child = findChild(node, component.view())) {
+      node = *child;
+      continue;
+    }
+    if (nodes_.size() >= kNoNode) {
+      throwf<std::length_error>(
+          "PathTrie cannot hold more than {} nodes", kNoNode);
+    }
+    auto child = static_cast<uint32_t>(nodes_.size());
+    auto name = storeName(component.view());
+    nodes_.push_back(Node{name, kNoNode, nodes_[node].firstChild, false});
+    nodes_[node].firstChild = child;
+    children_.emplace(ChildKey{node, name}, child);
+    node = child;
+  }
+
+  if (nodes_[node].terminal) {
+    return false;
+  }
+  nodes_[node].terminal = true;
+  ++size_;
+  return true;
+}
+
+bool PathTrie::contains(RelativePathPiece path) const {
+  auto node = findNode(path);
+  return node && nodes_[*node].terminal;
+}
+
+bool PathTrie::containsAncestorOf(RelativePathPiece path) const {
+  uint32_t node = kRoot;
+  for (auto component : path.components()) {
+    if (nodes_[node].terminal) {
+      return true;
+    }
+    auto child = findChild(node, component.view());
+    if (!child) {
+      return false;
+    }
+    node = *child;
+  }
+  return false;
+}
+
+std::optional<RelativePathPiece> PathTrie::longestPrefixMatch(
+    RelativePathPiece path) const {
+  std::optional<RelativePathPiece> match;
+  uint32_t node = kRoot;
+  if (nodes_[node].terminal) {
+    match = RelativePathPiece{};
+  }
+  for (auto prefix : path.paths()) {
+    auto child = findChild(node, prefix.basename().view());
+    if (!child) {
+      break;
+    }
+    node = *child;
+    if (nodes_[node].terminal) {
+      match = prefix;
+    }
+  }
+  return match;
+}
+
+size_t PathTrie::memoryUsage() const {
+  return nodes_.capacity() * sizeof(Node) +
+      children_.getAllocatedMemorySize() +
+      arena_.capacity() * sizeof(arena_[0]) + arenaBytes_;
+}
+
+} // namespace facebook::eden
@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <folly/container/F14Map.h>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "eden/common/utils/CaseSensitivity.h"
+#include "eden/common/utils/PathFuncs.h"
+
+namespace facebook::eden {
+
+/**
+ * A set of RelativePaths stored as a tree of their components, for answering
+ * questions about directories rather than individual paths:
+ *
+ * - which paths in the set are at or under a directory (forEachUnder)
+ * - whether a path has an ancestor in the set (containsAncestorOf)
+ * - which member is the deepest ancestor of a path (longestPrefixMatch)
+ *
+ * Each of these walks one node per component of the query, so costs
+ * O(depth) no matter how many paths are in the set. With a std::set or
+ * PathMap they would take a lower_bound per ancestor.
+ *
+ * Components are compared with the given CaseSensitivity. The set only
+ * grows: nodes live in one vector and are referred to by index, their names
+ * are copied once into a chunked arena, and the children of every node are
+ * found through a single hash table keyed by (parent, name).
+ */
+class PathTrie {
+ public:
+  explicit PathTrie(
+      CaseSensitivity caseSensitive = kPathMapDefaultCaseSensitive);
+
+  PathTrie(const PathTrie&) = delete;
+  PathTrie& operator=(const PathTrie&) = delete;
+  PathTrie(PathTrie&&) noexcept = default;
+  PathTrie& operator=(PathTrie&&) noexcept = default;
+
+  /// Adds path to the set. Returns false if it was already there.
+  bool insert(RelativePathPiece path);
+
+  bool contains(RelativePathPiece path) const;
+
+  /// The number of paths in the set.
+  size_t size() const {
+    return size_;
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  CaseSensitivity getCaseSensitivity() const {
+    return caseSensitive_;
+  }
+
+  /**
+   * Returns true if a strict ancestor of path is in the set. The empty path
+   * is an ancestor of every non-empty path.
+   */
+  bool containsAncestorOf(RelativePathPiece path) const;
+
+  /**
+   * Returns true if the set contains dir or any path under it. Since the set
+   * only grows, this is true exactly when some inserted path ran through dir.
+   */
+  bool containsAnyUnder(RelativePathPiece dir) const {
+    return findNode(dir).has_value();
+  }
+
+  /**
+   * Returns the longest prefix of path that is in the set: path itself, or
+   * its deepest ancestor in the set. The result refers to path's storage.
+   * Returns std::nullopt if neither path nor any ancestor is in the set.
+   */
+  std::optional<RelativePathPiece> longestPrefixMatch(
+      RelativePathPiece path) const;
+
+  /**
+   * Calls fn(RelativePathPiece) for dir, if it is in the set, and for every
+   * path in the set under dir, in no particular order. The piece passed to fn
+   * is only valid for the duration of the call. It starts with dir as passed
+   * in, and the rest is spelled as it was first inserted.
+   */
+  template <typename Fn>
+  void forEachUnder(RelativePathPiece dir, Fn&& fn) const {
+    auto start = findNode(dir);
+    if (!start) {
+      return;
+    }
+
+    std::string path{dir.view()};
+    // Pairs of (node, length of path before its name was appended).
+    std::vector<std::pair<uint32_t, size_t>> stack;
+    if (nodes_[*start].terminal) {
+      fn(RelativePathPiece{path, detail::SkipPathSanityCheck{}});
+    }
+    auto pushChildren = [&](uint32_t parent) {
+      for (auto child = nodes_[parent].firstChild; child != kNoNode;
+           child = nodes_[child].nextSibling) {
+        stack.emplace_back(child, path.size());
+      }
+    };
+    pushChildren(*start);
+    while (!stack.empty()) {
+      auto [node, length] = stack.back();
+      stack.pop_back();
+      path.resize(length);
+      if (length != 0) {
+        path.push_back(kDirSeparator);
+      }
+      path.append(nodes_[node].name);
+      if (nodes_[node].terminal) {
+        fn(RelativePathPiece{path, detail::SkipPathSanityCheck{}});
+      }
+      pushChildren(node);
+    }
+  }
+
+  /// The heap memory held by this set.
+  size_t memoryUsage() const;
+
+ private:
+  static constexpr uint32_t kNoNode = ~uint32_t{0};
+  static constexpr uint32_t kRoot = 0;
+
+  struct Node {
+    /// Points into the arena. Empty for the root.
+    std::string_view name;
+    uint32_t firstChild{kNoNode};
+    uint32_t nextSibling{kNoNode};
+    /// True if the path ending at this node is in the set.
+    bool terminal{false};
+  };
+
+  struct ChildKey {
+    uint32_t parent;
+    std::string_view name;
+  };
+
+  struct ChildHash {
+    size_t operator()(const ChildKey& key) const;
+    CaseSensitivity caseSensitive;
+  };
+
+  struct ChildEqual {
+    bool operator()(const ChildKey& a, const ChildKey& b) const;
+    CaseSensitivity caseSensitive;
+  };
+
+  std::optional<uint32_t> findChild(uint32_t parent, std::string_view name)
+      const;
+
+  /// Returns the node for path, if any inserted path runs through it.
+  std::optional<uint32_t> findNode(RelativePathPiece path) const;
+
+  /// Copies name into the arena, which never moves it afterwards.
+  std::string_view storeName(std::string_view name);
+
+  CaseSensitivity caseSensitive_;
+  size_t size_{0};
+  std::vector<Node> nodes_;
+  folly::F14FastMap<ChildKey, uint32_t, ChildHash, ChildEqual> children_;
+
+  std::vector<std::unique_ptr<char[]>> arena_;
+  size_t arenaChunkUsed_{0};
+  size_t arenaChunkSize_{0};
+  size_t arenaBytes_{0};
+};
+
+} // namespace facebook::eden
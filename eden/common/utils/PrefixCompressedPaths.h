@@ -0,0 +1,281 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <folly/Range.h>
+#include <folly/Varint.h>
+#include <folly/logging/xlog.h>
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "eden/common/utils/PathFuncs.h"
+#include "eden/common/utils/Throw.h"
+
+namespace facebook::eden {
+
+/**
+ * A compact, append-only list of RelativePaths kept in sorted order.
+ *
+ * Sorted paths tend to share long prefixes with their predecessor, such as
+ * every file under "fbcode/eden/fs/...". Rather than storing each path in its
+ * own string, the paths are front coded: each one is stored as the length of
+ * the prefix it shares with the previous path, followed by the bytes that
+ * differ. Every kBlockSize-th path is stored in full, so that a path can be
+ * decoded from the nearest block start and binary searched by block.
+ *
+ * Iteration decodes into a buffer owned by the iterator, so the
+ * RelativePathPiece it yields is only valid until the iterator is advanced.
+ * Random access decodes into a new RelativePath.
+ *
+ * Paths must be appended in increasing order, as defined by RelativePathPiece's
+ * operator<, with no duplicates.
+ */
+class PrefixCompressedPaths {
+ public:
+  /// Every kBlockSize-th path is stored in full.
+  static constexpr size_t kBlockSize = 16;
+
+  class const_iterator {
+   public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = RelativePathPiece;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = RelativePathPiece;
+
+    const_iterator() = default;
+
+    RelativePathPiece operator*() const {
+      XDCHECK_LT(index_, paths_->size_);
+      return RelativePathPiece{current_, detail::SkipPathSanityCheck{}};
+    }
+
+    const_iterator& operator++() {
+      ++index_;
+      decode();
+      return *this;
+    }
+
+    /// The position of this path in the list.
+    size_t index() const {
+      return index_;
+    }
+
+    bool operator==(const const_iterator& other) const {
+      XDCHECK_EQ(paths_, other.paths_);
+      return index_ == other.index_;
+    }
+
+    bool operator!=(const const_iterator& other) const {
+      return !(*this == other);
+    }
+
+   private:
+    friend class PrefixCompressedPaths;
+
+    const_iterator(const PrefixCompressedPaths* paths, size_t index)
+        : paths_{paths}, index_{index} {
+      if (index_ < paths_->size_) {
+        offset_ = paths_->decodeEntry(
+            paths_->blockOffsets_[index_ / kBlockSize], true, current_);
+        for (size_t i = index_ - index_ % kBlockSize; i < index_; ++i) {
+          offset_ = paths_->decodeEntry(offset_, false, current_);
+        }
+      }
+    }
+
+    void decode() {
+      if (index_ < paths_->size_) {
+        offset_ =
+            paths_->decodeEntry(offset_, index_ % kBlockSize == 0, current_);
+      }
+    }
+
+    const PrefixCompressedPaths* paths_{nullptr};
+    size_t index_{0};
+    // Where the path after current_ starts in data_.
+    size_t offset_{0};
+    std::string current_;
+  };
+  using iterator = const_iterator;
+
+  PrefixCompressedPaths() = default;
+
+  /// Builds the list from a range of sorted paths.
+  template <typename InputIterator>
+  PrefixCompressedPaths(InputIterator first, InputIterator last) {
+    for (; first != last; ++first) {
+      push_back(RelativePathPiece{*first});
+    }
+    shrink_to_fit();
+  }
+
+  /**
+   * Appends path, which must sort after every path already in the list.
+   * Throws std::invalid_argument otherwise.
+   */
+  void push_back(RelativePathPiece path) {
+    auto view = path.view();
+    if (size_ > 0 &&
+        !(RelativePathPiece{last_, detail::SkipPathSanityCheck{}} < path)) {
+      throwf<std::invalid_argument>(
+          "PrefixCompressedPaths: {} does not sort after {}", path, last_);
+    }
+
+    if (size_ % kBlockSize == 0) {
+      blockOffsets_.push_back(data_.size());
+      appendVarint(view.size());
+      data_.append(view);
+    } else {
+      auto common = std::min(view.size(), last_.size());
+      size_t shared =
+          std::mismatch(view.begin(), view.begin() + common, last_.begin())
+              .first -
+          view.begin();
+      appendVarint(shared);
+      appendVarint(view.size() - shared);
+      data_.append(view.substr(shared));
+    }
+    last_.assign(view);
+    ++size_;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  const_iterator begin() const {
+    return const_iterator{this, 0};
+  }
+
+  const_iterator end() const {
+    return const_iterator{this, size_};
+  }
+
+  /// Decodes the path at index. Throws std::out_of_range if there is none.
+  RelativePath at(size_t index) const {
+    if (index >= size_) {
+      throwf<std::out_of_range>(
+          "PrefixCompressedPaths index {} out of range {}", index, size_);
+    }
+    return (*this)[index];
+  }
+
+  /// Decodes the path at index, which must be less than size().
+  RelativePath operator[](size_t index) const {
+    return RelativePath{*const_iterator{this, index}};
+  }
+
+  /**
+   * Returns an iterator to the first path that is not less than key. This is
+   * a binary search over the full paths at the start of each block, followed
+   * by a scan of at most one block.
+   */
+  const_iterator lower_bound(RelativePathPiece key) const {
+    // The first block whose first path is greater than key.
+    size_t lo = 0;
+    size_t hi = blockOffsets_.size();
+    while (lo < hi) {
+      size_t mid = lo + (hi - lo) / 2;
+      if (key < blockHead(mid)) {
+        hi = mid;
+      } else {
+        lo = mid + 1;
+      }
+    }
+    if (lo == 0) {
+      return begin();
+    }
+
+    const_iterator it{this, (lo - 1) * kBlockSize};
+    size_t blockEnd = std::min(lo * kBlockSize, size_);
+    while (it.index_ < blockEnd && *it < key) {
+      ++it;
+    }
+    return it;
+  }
+
+  /// Returns an iterator to key, or end() if it is not in the list.
+  const_iterator find(RelativePathPiece key) const {
+    auto it = lower_bound(key);
+    if (it != end() && *it == key) {
+      return it;
+    }
+    return end();
+  }
+
+  bool contains(RelativePathPiece key) const {
+    return find(key) != end();
+  }
+
+  /// Releases the spare capacity left over from appending.
+  void shrink_to_fit() {
+    data_.shrink_to_fit();
+    blockOffsets_.shrink_to_fit();
+  }
+
+  /// The heap memory held by this list.
+  size_t memoryUsage() const {
+    return data_.capacity() + blockOffsets_.capacity() * sizeof(size_t) +
+        last_.capacity();
+  }
+
+ private:
+  void appendVarint(uint64_t value) {
+    uint8_t buf[folly::kMaxVarintLength64];
+    size_t length = folly::encodeVarint(value, buf);
+    data_.append(reinterpret_cast<const char*>(buf), length);
+  }
+
+  uint64_t readVarint(size_t& offset) const {
+    folly::ByteRange range{
+        reinterpret_cast<const uint8_t*>(data_.data()) + offset,
+        data_.size() - offset};
+    auto begin = range.begin();
+    auto value = folly::decodeVarint(range);
+    offset += range.begin() - begin;
+    return value;
+  }
+
+  /// The path at the start of the given block, which is stored in full.
+  RelativePathPiece blockHead(size_t block) const {
+    size_t offset = blockOffsets_[block];
+    size_t length = readVarint(offset);
+    return RelativePathPiece{
+        std::string_view{data_}.substr(offset, length),
+        detail::SkipPathSanityCheck{}};
+  }
+
+  /**
+   * Decodes the entry at offset into path, which holds the previous path
+   * unless the entry starts a block. Returns the offset of the next entry.
+   */
+  size_t decodeEntry(size_t offset, bool blockStart, std::string& path) const {
+    size_t shared = blockStart ? 0 : readVarint(offset);
+    size_t length = readVarint(offset);
+    XDCHECK_LE(shared, path.size());
+    path.resize(shared);
+    path.append(data_, offset, length);
+    return offset + length;
+  }
+
+  std::string data_;
+  std::vector<size_t> blockOffsets_;
+  size_t size_{0};
+  // The last path appended, to front code the next one against.
+  std::string last_;
+};
+
+} // namespace facebook::eden
@@ -8,17 +8,633 @@
 #include "eden/common/utils/Utf8.h"
 
 #include <folly/Unicode.h>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <folly/CpuId.h>
+#include <immintrin.h>
+#define EDEN_UTF8_X86 1
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define EDEN_UTF8_NEON 1
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define EDEN_UTF8_SSSE3 __attribute__((target("ssse3")))
+#define EDEN_UTF8_AVX2 __attribute__((target("avx2")))
+#else
+#define EDEN_UTF8_SSSE3
+#define EDEN_UTF8_AVX2
+#endif
 
 namespace facebook::eden {
 
+namespace detail {
+
+namespace {
+
+/**
+ * Lookup tables for the vector kernels, indexed by the high nibble of the
+ * previous byte, the low nibble of the previous byte, and the high nibble of
+ * the current byte. A pair of bytes is invalid when the three entries have a
+ * bit in common. The one error the tables cannot see, a continuation byte
+ * missing from or added to a 3 or 4 byte sequence, shows up as a mismatch
+ * between kTwoConts and the bytes two and three positions back.
+ */
+struct Utf8Tables {
+  uint8_t byte1High[16];
+  uint8_t byte1Low[16];
+  uint8_t byte2High[16];
+};
+
+// Lead byte followed by ASCII or another lead byte.
+constexpr uint8_t kTooShort = 1 << 0;
+// ASCII followed by a continuation byte.
+constexpr uint8_t kTooLong = 1 << 1;
+// 11100000 100xxxxx
+constexpr uint8_t kOverlong3 = 1 << 2;
+// Strict: 11110100 1001xxxx and above. Encoding: 11111xxx 10xxxxxx.
+constexpr uint8_t kTooLarge = 1 << 3;
+// 11101101 101xxxxx
+constexpr uint8_t kSurrogate = 1 << 4;
+// 1100000x 10xxxxxx
+constexpr uint8_t kOverlong2 = 1 << 5;
+// 11110000 1000xxxx, and for Strict also 11110101 1000xxxx and above.
+constexpr uint8_t kOverlong4OrTooLarge1000 = 1 << 6;
+// Continuation byte followed by a continuation byte.
+constexpr uint8_t kTwoConts = 1 << 7;
+
+// Errors that only depend on the high nibble of the previous byte.
+constexpr uint8_t kCarry = kTooShort | kTooLong | kTwoConts;
+
+constexpr uint8_t kLarge1000 = kOverlong4OrTooLarge1000;
+constexpr uint8_t kLarge = kTooLarge | kLarge1000;
+
+constexpr Utf8Tables kStrictTables = {
+    {
+        // 0xxxxxxx
+        kTooLong,
+        kTooLong,
+        kTooLong,
+        kTooLong,
+        kTooLong,
+        kTooLong,
+        kTooLong,
+        kTooLong,
+        // 10xxxxxx
+        kTwoConts,
+        kTwoConts,
+        kTwoConts,
+        kTwoConts,
+        // 1100xxxx
+        kTooShort | kOverlong2,
+        // 1101xxxx
+        kTooShort,
+        // 1110xxxx
+        kTooShort | kOverlong3 | kSurrogate,
+        // 1111xxxx
+        kTooShort | kTooLarge | kOverlong4OrTooLarge1000,
+    },
+    {
+        // xxxx0000
+        kCarry | kOverlong3 | kOverlong2 | kOverlong4OrTooLarge1000,
+        // xxxx0001
+        kCarry | kOverlong2,
+        // xxxx001x
+        kCarry,
+        kCarry,
+        // xxxx0100
+        kCarry | kTooLarge,
+        // xxxx0101 and above
+        kCarry | kLarge,
+        kCarry | kLarge,
+        kCarry | kLarge,
+        kCarry | kLarge,
+        kCarry | kLarge,
+        kCarry | kLarge,
+        kCarry | kLarge,
+        kCarry | kLarge,
+        // xxxx1101
+        kCarry | kLarge | kSurrogate,
+        kCarry | kLarge,
+        kCarry | kLarge,
+    },
+    {
+        // 0xxxxxxx
+        kTooShort,
+        kTooShort,
+        kTooShort,
+        kTooShort,
+        kTooShort,
+        kTooShort,
+        kTooShort,
+        kTooShort,
+        // 1000xxxx
+        kTooLong | kOverlong2 | kTwoConts | kOverlong3 |
+            kOverlong4OrTooLarge1000,
+        // 1001xxxx
+        kTooLong | kOverlong2 | kTwoConts | kOverlong3 | kTooLarge,
+        // 101xxxxx
+        kTooLong | kOverlong2 | kTwoConts | kSurrogate | kTooLarge,
+        kTooLong | kOverlong2 | kTwoConts | kSurrogate | kTooLarge,
+        // 11xxxxxx
+        kTooShort,
+        kTooShort,
+        kTooShort,
+        kTooShort,
+    },
+};
+
+// Without the surrogate and U+10FFFF checks, the only lead bytes that are
+// too large are 11111xxx, whatever follows them.
+constexpr Utf8Tables kEncodingTables = {
+    {
+        kTooLong,
+        kTooLong,
+        kTooLong,
+        kTooLong,
+        kTooLong,
+        kTooLong,
+        kTooLong,
+        kTooLong,
+        kTwoConts,
+        kTwoConts,
+        kTwoConts,
+        kTwoConts,
+        kTooShort | kOverlong2,
+        kTooShort,
+        kTooShort | kOverlong3,
+        kTooShort | kTooLarge | kOverlong4OrTooLarge1000,
+    },
+    {
+        kCarry | kOverlong3 | kOverlong2 | kOverlong4OrTooLarge1000,
+        kCarry | kOverlong2,
+        kCarry,
+        kCarry,
+        kCarry,
+        kCarry,
+        kCarry,
+        kCarry,
+        // xxxx1xxx
+        kCarry | kTooLarge,
+        kCarry | kTooLarge,
+        kCarry | kTooLarge,
+        kCarry | kTooLarge,
+        kCarry | kTooLarge,
+        kCarry | kTooLarge,
+        kCarry | kTooLarge,
+        kCarry | kTooLarge,
+    },
+    {
+        kTooShort,
+        kTooShort,
+        kTooShort,
+        kTooShort,
+        kTooShort,
+        kTooShort,
+        kTooShort,
+        kTooShort,
+        kTooLong | kOverlong2 | kTwoConts | kOverlong3 | kTooLarge |
+            kOverlong4OrTooLarge1000,
+        kTooLong | kOverlong2 | kTwoConts | kOverlong3 | kTooLarge,
+        kTooLong | kOverlong2 | kTwoConts | kTooLarge,
+        kTooLong | kOverlong2 | kTwoConts | kTooLarge,
+        kTooShort,
+        kTooShort,
+        kTooShort,
+        kTooShort,
+    },
+};
+
+const Utf8Tables& tablesFor(Utf8Rules rules) {
+  return rules == Utf8Rules::Strict ? kStrictTables : kEncodingTables;
+}
+
+/**
+ * Called with the offset of the first block in which a kernel found an error.
+ * Everything before the sequence that straddles blockStart, if any, is
+ * known to be valid, so only the rest needs the scalar check that finds the
+ * exact offset.
+ */
+size_t refinePrefix(std::string_view str, size_t blockStart, Utf8Rules rules) {
+  size_t start = blockStart;
+  for (size_t back = 1; back <= 3 && back <= blockStart; ++back) {
+    auto c = static_cast<uint8_t>(str[blockStart - back]);
+    if (c >= 0xC0) {
+      start = blockStart - back;
+      break;
+    }
+    if (c < 0x80) {
+      break;
+    }
+  }
+  return start + validUtf8PrefixScalar(str.substr(start), rules);
+}
+
+#ifdef EDEN_UTF8_X86
+
+class Ssse3Checker {
+ public:
+  EDEN_UTF8_SSSE3 explicit Ssse3Checker(const Utf8Tables& tables)
+      : byte1High_{load(tables.byte1High)},
+        byte1Low_{load(tables.byte1Low)},
+        byte2High_{load(tables.byte2High)} {}
+
+  /**
+   * Checks the next 16 bytes. Returns false if they contain an error, or
+   * complete a sequence that started in an earlier block incorrectly.
+   */
+  EDEN_UTF8_SSSE3 bool consume(__m128i input) {
+    __m128i error;
+    if (_mm_movemask_epi8(input) == 0) {
+      // All ASCII: only a sequence left open by the previous block can fail.
+      error = prevIncomplete_;
+    } else {
+      const __m128i nibble = _mm_set1_epi8(0x0F);
+      __m128i prev1 = _mm_alignr_epi8(input, prev_, 15);
+      __m128i special = _mm_and_si128(
+          _mm_and_si128(
+              _mm_shuffle_epi8(
+                  byte1High_, _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble)),
+              _mm_shuffle_epi8(byte1Low_, _mm_and_si128(prev1, nibble))),
+          _mm_shuffle_epi8(
+              byte2High_, _mm_and_si128(_mm_srli_epi16(input, 4), nibble)));
+
+      // Bytes that must be the second or third continuation of a 3 or 4
+      // byte sequence have their top bit set.
+      __m128i prev2 = _mm_alignr_epi8(input, prev_, 14);
+      __m128i prev3 = _mm_alignr_epi8(input, prev_, 13);
+      __m128i must23 = _mm_or_si128(
+          _mm_subs_epu8(prev2, _mm_set1_epi8(0xE0 - 0x80)),
+          _mm_subs_epu8(prev3, _mm_set1_epi8(0xF0 - 0x80)));
+      __m128i must23High =
+          _mm_and_si128(must23, _mm_set1_epi8(static_cast<char>(0x80)));
+      error = _mm_xor_si128(must23High, special);
+
+      // Nonzero where a sequence starting in the last three bytes needs more
+      // bytes than the block has left.
+      prevIncomplete_ = _mm_subs_epu8(input, kMaxComplete());
+    }
+    prev_ = input;
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) ==
+        0xFFFF;
+  }
+
+ private:
+  EDEN_UTF8_SSSE3 static __m128i load(const uint8_t (&table)[16]) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(table));
+  }
+
+  EDEN_UTF8_SSSE3 static __m128i kMaxComplete() {
+    return _mm_setr_epi8(
+        -1,
+        -1,
+        -1,
+        -1,
+        -1,
+        -1,
+        -1,
+        -1,
+        -1,
+        -1,
+        -1,
+        -1,
+        -1,
+        static_cast<char>(0xF0 - 1),
+        static_cast<char>(0xE0 - 1),
+        static_cast<char>(0xC0 - 1));
+  }
+
+  __m128i byte1High_;
+  __m128i byte1Low_;
+  __m128i byte2High_;
+  __m128i prev_{_mm_setzero_si128()};
+  __m128i prevIncomplete_{_mm_setzero_si128()};
+};
+
+EDEN_UTF8_SSSE3 size_t
+validUtf8PrefixSsse3(std::string_view str, Utf8Rules rules) {
+  Ssse3Checker checker{tablesFor(rules)};
+  size_t pos = 0;
+  for (; pos + 16 <= str.size(); pos += 16) {
+    if (!checker.consume(_mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(str.data() + pos)))) {
+      return refinePrefix(str, pos, rules);
+    }
+  }
+  // The zero padding is ASCII, which fails any sequence the string leaves
+  // open.
+  alignas(16) char tail[16] = {};
+  std::memcpy(tail, str.data() + pos, str.size() - pos);
+  if (!checker.consume(_mm_load_si128(reinterpret_cast<const __m128i*>(tail)))) {
+    return refinePrefix(str, pos, rules);
+  }
+  return str.size();
+}
+
+class Avx2Checker {
+ public:
+  EDEN_UTF8_AVX2 explicit Avx2Checker(const Utf8Tables& tables)
+      : byte1High_{load(tables.byte1High)},
+        byte1Low_{load(tables.byte1Low)},
+        byte2High_{load(tables.byte2High)},
+        prev_{_mm256_setzero_si256()},
+        prevIncomplete_{_mm256_setzero_si256()} {}
+
+  /// Same as Ssse3Checker::consume(), for 32 bytes.
+  EDEN_UTF8_AVX2 bool consume(__m256i input) {
+    __m256i error;
+    if (_mm256_movemask_epi8(input) == 0) {
+      error = prevIncomplete_;
+    } else {
+      const __m256i nibble = _mm256_set1_epi8(0x0F);
+      // The last 16 bytes of prev_ followed by the first 16 of input, so
+      // that alignr, which works within 128 bit lanes, can shift across the
+      // lane boundary.
+      __m256i shifted = _mm256_permute2x128_si256(prev_, input, 0x21);
+      __m256i prev1 = _mm256_alignr_epi8(input, shifted, 15);
+      __m256i special = _mm256_and_si256(
+          _mm256_and_si256(
+              _mm256_shuffle_epi8(
+                  byte1High_,
+                  _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble)),
+              _mm256_shuffle_epi8(byte1Low_, _mm256_and_si256(prev1, nibble))),
+          _mm256_shuffle_epi8(
+              byte2High_,
+              _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble)));
+
+      __m256i prev2 = _mm256_alignr_epi8(input, shifted, 14);
+      __m256i prev3 = _mm256_alignr_epi8(input, shifted, 13);
+      __m256i must23 = _mm256_or_si256(
+          _mm256_subs_epu8(prev2, _mm256_set1_epi8(0xE0 - 0x80)),
+          _mm256_subs_epu8(prev3, _mm256_set1_epi8(0xF0 - 0x80)));
+      __m256i must23High = _mm256_and_si256(
+          must23, _mm256_set1_epi8(static_cast<char>(0x80)));
+      error = _mm256_xor_si256(must23High, special);
+
+      prevIncomplete_ = _mm256_subs_epu8(input, kMaxComplete());
+    }
+    prev_ = input;
+    return _mm256_testz_si256(error, error);
+  }
+
+ private:
+  EDEN_UTF8_AVX2 static __m256i load(const uint8_t (&table)[16]) {
+    return _mm256_broadcastsi128_si256(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(table)));
+  }
+
+  EDEN_UTF8_AVX2 static __m256i kMaxComplete() {
+    return _mm256_setr_epi8(
+        -1,
+        -1,
+        -1,
+        -1,
+        -1,
+        -1,
+        -1,
+        -1,
+        -1,
+        -1,
+        -1,
+        -1,
+        -1,
+        -1,
+        -1,
+        -1,
+        -1,
+        -1,
+        -1,
+        -1,
+        -1,
+        -1,
+        -1,
+        -1,
+        -1,
+        -1,
+        -1,
+        -1,
+        -1,
+        static_cast<char>(0xF0 - 1),
+        static_cast<char>(0xE0 - 1),
+        static_cast<char>(0xC0 - 1));
+  }
+
+  __m256i byte1High_;
+  __m256i byte1Low_;
+  __m256i byte2High_;
+  __m256i prev_;
+  __m256i prevIncomplete_;
+};
+
+EDEN_UTF8_AVX2 size_t
+validUtf8PrefixAvx2(std::string_view str, Utf8Rules rules) {
+  Avx2Checker checker{tablesFor(rules)};
+  size_t pos = 0;
+  for (; pos + 32 <= str.size(); pos += 32) {
+    if (!checker.consume(_mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(str.data() + pos)))) {
+      return refinePrefix(str, pos, rules);
+    }
+  }
+  alignas(32) char tail[32] = {};
+  std::memcpy(tail, str.data() + pos, str.size() - pos);
+  if (!checker.consume(
+          _mm256_load_si256(reinterpret_cast<const __m256i*>(tail)))) {
+    return refinePrefix(str, pos, rules);
+  }
+  return str.size();
+}
+
+#endif // EDEN_UTF8_X86
+
+#ifdef EDEN_UTF8_NEON
+
+class NeonChecker {
+ public:
+  explicit NeonChecker(const Utf8Tables& tables)
+      : byte1High_{vld1q_u8(tables.byte1High)},
+        byte1Low_{vld1q_u8(tables.byte1Low)},
+        byte2High_{vld1q_u8(tables.byte2High)},
+        maxComplete_{vld1q_u8(kMaxComplete)},
+        prev_{vdupq_n_u8(0)},
+        prevIncomplete_{vdupq_n_u8(0)} {}
+
+  /// Same as Ssse3Checker::consume().
+  bool consume(uint8x16_t input) {
+    uint8x16_t error;
+    if (vmaxvq_u8(input) < 0x80) {
+      error = prevIncomplete_;
+    } else {
+      const uint8x16_t nibble = vdupq_n_u8(0x0F);
+      uint8x16_t prev1 = vextq_u8(prev_, input, 15);
+      uint8x16_t special = vandq_u8(
+          vandq_u8(
+              vqtbl1q_u8(byte1High_, vshrq_n_u8(prev1, 4)),
+              vqtbl1q_u8(byte1Low_, vandq_u8(prev1, nibble))),
+          vqtbl1q_u8(byte2High_, vshrq_n_u8(input, 4)));
+
+      uint8x16_t prev2 = vextq_u8(prev_, input, 14);
+      uint8x16_t prev3 = vextq_u8(prev_, input, 13);
+      uint8x16_t must23 = vorrq_u8(
+          vqsubq_u8(prev2, vdupq_n_u8(0xE0 - 0x80)),
+          vqsubq_u8(prev3, vdupq_n_u8(0xF0 - 0x80)));
+      uint8x16_t must23High = vandq_u8(must23, vdupq_n_u8(0x80));
+      error = veorq_u8(must23High, special);
+
+      prevIncomplete_ = vqsubq_u8(input, maxComplete_);
+    }
+    prev_ = input;
+    return vmaxvq_u8(error) == 0;
+  }
+
+ private:
+  static constexpr uint8_t kMaxComplete[16] = {
+      0xFF,
+      0xFF,
+      0xFF,
+      0xFF,
+      0xFF,
+      0xFF,
+      0xFF,
+      0xFF,
+      0xFF,
+      0xFF,
+      0xFF,
+      0xFF,
+      0xFF,
+      0xF0 - 1,
+      0xE0 - 1,
+      0xC0 - 1};
+
+  uint8x16_t byte1High_;
+  uint8x16_t byte1Low_;
+  uint8x16_t byte2High_;
+  uint8x16_t maxComplete_;
+  uint8x16_t prev_;
+  uint8x16_t prevIncomplete_;
+};
+
+size_t validUtf8PrefixNeon(std::string_view str, Utf8Rules rules) {
+  NeonChecker checker{tablesFor(rules)};
+  const auto* bytes = reinterpret_cast<const uint8_t*>(str.data());
+  size_t pos = 0;
+  for (; pos + 16 <= str.size(); pos += 16) {
+    if (!checker.consume(vld1q_u8(bytes + pos))) {
+      return refinePrefix(str, pos, rules);
+    }
+  }
+  alignas(16) uint8_t tail[16] = {};
+  std::memcpy(tail, bytes + pos, str.size() - pos);
+  if (!checker.consume(vld1q_u8(tail))) {
+    return refinePrefix(str, pos, rules);
+  }
+  return str.size();
+}
+
+#endif // EDEN_UTF8_NEON
+
+// Most file names are shorter than this, and for them the scalar loop, which
+// is only a comparison per byte for ASCII, beats setting up a vector block.
+constexpr size_t kMinVectorLength = 16;
+
+} // namespace
+
+bool isUtf8ImplSupported(Utf8Impl impl) {
+  switch (impl) {
+    case Utf8Impl::Scalar:
+      return true;
+    case Utf8Impl::SSSE3: {
+#ifdef EDEN_UTF8_X86
+      static const bool hasSsse3 = folly::CpuId().ssse3();
+      return hasSsse3;
+#else
+      return false;
+#endif
+    }
+    case Utf8Impl::AVX2: {
+#ifdef EDEN_UTF8_X86
+      static const bool hasAvx2 = folly::CpuId().avx2();
+      return hasAvx2;
+#else
+      return false;
+#endif
+    }
+    case Utf8Impl::NEON:
+#ifdef EDEN_UTF8_NEON
+      return true;
+#else
+      return false;
+#endif
+  }
+  return false;
+}
+
+Utf8Impl bestUtf8Impl() {
+  static const Utf8Impl best = [] {
+    for (auto impl : {Utf8Impl::AVX2, Utf8Impl::NEON, Utf8Impl::SSSE3}) {
+      if (isUtf8ImplSupported(impl)) {
+        return impl;
+      }
+    }
+    return Utf8Impl::Scalar;
+  }();
+  return best;
+}
+
+size_t validUtf8Prefix(std::string_view str, Utf8Rules rules, Utf8Impl impl) {
+  if (str.size() < kMinVectorLength) {
+    impl = Utf8Impl::Scalar;
+  }
+  switch (impl) {
+    case Utf8Impl::Scalar:
+      break;
+    case Utf8Impl::SSSE3:
+#ifdef EDEN_UTF8_X86
+      if (isUtf8ImplSupported(Utf8Impl::SSSE3)) {
+        return validUtf8PrefixSsse3(str, rules);
+      }
+#endif
+      break;
+    case Utf8Impl::AVX2:
+#ifdef EDEN_UTF8_X86
+      if (isUtf8ImplSupported(Utf8Impl::AVX2)) {
+        return validUtf8PrefixAvx2(str, rules);
+      }
+#endif
+      break;
+    case Utf8Impl::NEON:
+#ifdef EDEN_UTF8_NEON
+      return validUtf8PrefixNeon(str, rules);
+#else
+      break;
+#endif
+  }
+  return validUtf8PrefixScalar(str, rules);
+}
+
+} // namespace detail
+
 std::string ensureValidUtf8(folly::ByteRange str) {
   std::string output;
   output.reserve(str.size());
-  const unsigned char* begin = str.begin();
-  const unsigned char* const end = str.end();
-  while (begin != end) {
+  while (!str.empty()) {
+    // Copy the valid run in one go. Strict matches what utf8ToCodePoint
+    // accepts, so the result is the same as decoding every code point.
+    size_t valid = detail::validUtf8Prefix(
+        std::string_view{reinterpret_cast<const char*>(str.data()), str.size()},
+        detail::Utf8Rules::Strict);
+    output.append(reinterpret_cast<const char*>(str.data()), valid);
+    str.advance(valid);
+    if (str.empty()) {
+      break;
+    }
+
+    // Replace the invalid sequence, one byte at a time.
+    const unsigned char* begin = str.begin();
     folly::appendCodePointToUtf8(
-        folly::utf8ToCodePoint(begin, end, true), output);
+        folly::utf8ToCodePoint(begin, str.end(), true), output);
+    str.advance(begin - str.begin());
   }
   return output;
 }
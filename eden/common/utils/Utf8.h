@@ -9,6 +9,10 @@
 
 #include <folly/Range.h>
 #include <folly/Utility.h>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
 
 namespace facebook::eden {
 
@@ -43,7 +47,7 @@ constexpr bool isValidContinuation(
     const char* const end,
     size_t num,
     uint32_t& codepoint) {
-  if (begin + num - 1 > end) {
+  if (static_cast<size_t>(end - begin) < num) {
     return false;
   }
 
@@ -57,65 +61,139 @@ constexpr bool isValidContinuation(
 
   return true;
 }
-} // namespace detail
 
 /**
- * Returns whether the given string is correctly-encoded UTF-8.
+ * Which byte sequences count as valid UTF-8.
+ */
+enum class Utf8Rules : uint8_t {
+  /// The rules of isValidUtf8: sequences of 1 to 4 bytes without overlong
+  /// encodings. Surrogates and code points above U+10FFFF are accepted.
+  Encoding,
+  /// RFC 3629, which also rejects surrogates and code points above U+10FFFF.
+  /// This matches what folly::utf8ToCodePoint decodes.
+  Strict,
+};
+
+/**
+ * Returns the length of the longest prefix of str that is valid UTF-8 under
+ * rules. The prefix never ends in the middle of a sequence.
  *
- * This doesn't verify whether the codepoints are actually valid unicode
- * characters.
+ * Byte-at-a-time reference implementation, also used in constant
+ * expressions.
  */
-constexpr bool isValidUtf8(folly::StringPiece str) {
-  const char* begin = str.begin();
-  const char* const end = str.end();
+constexpr size_t validUtf8PrefixScalar(std::string_view str, Utf8Rules rules) {
+  const char* const start = str.data();
+  const char* begin = start;
+  const char* const end = start + str.size();
 
   while (begin != end) {
+    const char* sequence = begin;
     char first = *begin++;
-    if (!detail::isBitSet(first, 7)) {
+    if (!isBitSet(first, 7)) {
       // ASCII character, nothing to do.
-    } else if (!detail::isBitSet(first, 6)) {
+    } else if (!isBitSet(first, 6)) {
       // 10xxxxxx isn't a valid for the first byte.
-      return false;
-    } else if (!detail::isBitSet(first, 5)) {
+      return sequence - start;
+    } else if (!isBitSet(first, 5)) {
       // 110xxxxx: 2 bytes
       uint32_t codepoint = folly::to_unsigned(first) & 0x1F;
-      if (!detail::isValidContinuation(begin, end, 1, codepoint)) {
-        return false;
+      if (!isValidContinuation(begin, end, 1, codepoint)) {
+        return sequence - start;
       }
 
       // Is this an overlong encoding?
       if (codepoint < 0x80) {
-        return false;
+        return sequence - start;
       }
-    } else if (!detail::isBitSet(first, 4)) {
+    } else if (!isBitSet(first, 4)) {
       // 1110xxxx: 3 bytes
       uint32_t codepoint = folly::to_unsigned(first) & 0xF;
-      if (!detail::isValidContinuation(begin, end, 2, codepoint)) {
-        return false;
+      if (!isValidContinuation(begin, end, 2, codepoint)) {
+        return sequence - start;
       }
 
       // Is this an overlong encoding?
       if (codepoint < 0x800) {
-        return false;
+        return sequence - start;
+      }
+      if (rules == Utf8Rules::Strict && codepoint >= 0xD800 &&
+          codepoint <= 0xDFFF) {
+        return sequence - start;
       }
-    } else if (!detail::isBitSet(first, 3)) {
+    } else if (!isBitSet(first, 3)) {
       // 11110xxx: 4 bytes
       uint32_t codepoint = folly::to_unsigned(first) & 0x7;
-      if (!detail::isValidContinuation(begin, end, 3, codepoint)) {
-        return false;
+      if (!isValidContinuation(begin, end, 3, codepoint)) {
+        return sequence - start;
       }
 
       // Is this an overlong encoding?
       if (codepoint < 0x10000) {
-        return false;
+        return sequence - start;
+      }
+      if (rules == Utf8Rules::Strict && codepoint > 0x10FFFF) {
+        return sequence - start;
       }
     } else {
       // 11111xxx isn't ever valid.
-      return false;
+      return sequence - start;
     }
   }
 
-  return true;
+  return str.size();
+}
+
+/**
+ * Instruction set used by the UTF-8 validation kernels. Exposed so that tests
+ * and benchmarks can compare each implementation against the scalar one.
+ */
+enum class Utf8Impl : uint8_t {
+  Scalar,
+  SSSE3,
+  AVX2,
+  NEON,
+};
+
+/**
+ * Returns whether impl can run on this machine.
+ */
+bool isUtf8ImplSupported(Utf8Impl impl);
+
+/**
+ * Returns the fastest implementation supported by this machine. The CPU is
+ * only probed on the first call.
+ */
+Utf8Impl bestUtf8Impl();
+
+/**
+ * Same result as validUtf8PrefixScalar, computed with impl.
+ *
+ * The vector kernels check 16 or 32 bytes at a time with the table lookup
+ * algorithm of Keiser and Lemire, "Validating UTF-8 In Less Than One
+ * Instruction Per Byte", and skip blocks that are entirely ASCII with a
+ * single comparison.
+ */
+size_t validUtf8Prefix(std::string_view str, Utf8Rules rules, Utf8Impl impl);
+
+inline size_t validUtf8Prefix(std::string_view str, Utf8Rules rules) {
+  return validUtf8Prefix(str, rules, bestUtf8Impl());
+}
+} // namespace detail
+
+/**
+ * Returns whether the given string is correctly-encoded UTF-8.
+ *
+ * This doesn't verify whether the codepoints are actually valid unicode
+ * characters.
+ */
+constexpr bool isValidUtf8(folly::StringPiece str) {
+  std::string_view view{str.data(), str.size()};
+  if (std::is_constant_evaluated()) {
+    return detail::validUtf8PrefixScalar(view, detail::Utf8Rules::Encoding) ==
+        view.size();
+  }
+  return detail::validUtf8Prefix(view, detail::Utf8Rules::Encoding) ==
+      view.size();
 }
 
 std::string ensureValidUtf8(folly::ByteRange str);
@@ -123,6 +201,9 @@ std::string ensureValidUtf8(folly::ByteRange str);
 /**
  * Returns a valid UTF-8 encoding of str, with all invalid code points replaced
  * with FFFD, the Unicode replacement character.
+ *
+ * Valid runs are found with validUtf8Prefix and copied as is; only the bytes
+ * around an error are decoded one code point at a time.
  */
 inline std::string ensureValidUtf8(folly::StringPiece str) {
   return ensureValidUtf8(folly::ByteRange{str});
@@ -0,0 +1,244 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "eden/common/utils/ChunkedPathMap.h"
+
+#include <folly/portability/GTest.h>
+#include <numeric>
+#include <random>
+#include <type_traits>
+#include <vector>
+
+#include "eden/common/utils/PathMap.h"
+
+using namespace facebook::eden;
+using namespace facebook::eden::path_literals;
+
+namespace {
+
+PathComponent makeName(size_t i) {
+  return PathComponent{fmt::format("name{:06}", i)};
+}
+
+/// Asserts that map holds the same entries, in the same order, as expected.
+template <typename Value>
+void expectSameEntries(
+    const PathMap<Value>& expected,
+    const ChunkedPathMap<Value>& map) {
+  ASSERT_EQ(expected.size(), map.size());
+  auto it = map.begin();
+  for (const auto& entry : expected) {
+    ASSERT_NE(map.end(), it);
+    EXPECT_EQ(entry.first, it->first);
+    EXPECT_EQ(entry.second, it->second);
+    ++it;
+  }
+  EXPECT_EQ(map.end(), it);
+}
+
+} // namespace
+
+TEST(ChunkedPathMap, caseSensitive) {
+  ChunkedPathMap<bool> map(CaseSensitivity::Sensitive);
+
+  map.insert(std::make_pair(PathComponent("foo"), true));
+  EXPECT_TRUE(map.at("foo"_pc));
+  EXPECT_EQ(map.find("Foo"_pc), map.end());
+
+  EXPECT_TRUE(map.insert(std::make_pair(PathComponent("FOO"), false)).second);
+  EXPECT_EQ(map.size(), 2);
+  EXPECT_TRUE(map.at("foo"_pc));
+  EXPECT_FALSE(map.at("FOO"_pc));
+  EXPECT_EQ(map.erase("FOO"_pc), 1);
+  EXPECT_EQ(map.size(), 1);
+
+  map["FOO"_pc] = true;
+  map["Foo"_pc] = false;
+  EXPECT_EQ(map.size(), 3);
+  EXPECT_THROW(map.at("nope"_pc), std::out_of_range);
+}
+
+TEST(ChunkedPathMap, caseInSensitive) {
+  ChunkedPathMap<bool> map(CaseSensitivity::Insensitive);
+
+  map.insert(std::make_pair(PathComponent("foo"), true));
+  EXPECT_TRUE(map.at("foo"_pc));
+  EXPECT_TRUE(map.at("Foo"_pc));
+
+  EXPECT_FALSE(map.insert(std::make_pair(PathComponent("FOO"), false)).second);
+  EXPECT_FALSE(map.emplace(PathComponent("FOO"), false).second);
+  EXPECT_EQ(map.size(), 1);
+
+  EXPECT_EQ(map.erase("FOO"_pc), 1);
+  EXPECT_EQ(map.size(), 0);
+
+  map["FOO"_pc] = true;
+  map["Foo"_pc] = false;
+  EXPECT_EQ(map.size(), 1);
+  EXPECT_EQ(map["FOO"_pc], false);
+  // The assignment above didn't change the case of the key!
+  EXPECT_EQ(map.begin()->first, "FOO"_pc);
+}
+
+TEST(ChunkedPathMap, matchesPathMapForRandomOperations) {
+  for (auto caseSensitive :
+       {CaseSensitivity::Sensitive, CaseSensitivity::Insensitive}) {
+    PathMap<int> expected(caseSensitive);
+    ChunkedPathMap<int> map(caseSensitive);
+    std::mt19937 gen{1};
+    std::uniform_int_distribution<size_t> keys{0, 5000};
+    std::uniform_int_distribution<int> ops{0, 3};
+    for (int i = 0; i < 20000; ++i) {
+      auto name = makeName(keys(gen));
+      switch (ops(gen)) {
+        case 0:
+        case 1:
+          EXPECT_EQ(
+              expected.emplace(name, i).second, map.emplace(name, i).second);
+          break;
+        case 2:
+          EXPECT_EQ(expected.erase(name), map.erase(name));
+          break;
+        case 3:
+          EXPECT_EQ(expected.count(name), map.count(name));
+          break;
+      }
+    }
+    expectSameEntries(expected, map);
+
+    // Walk backwards too.
+    auto rit = map.rbegin();
+    for (auto it = expected.rbegin(); it != expected.rend(); ++it, ++rit) {
+      EXPECT_EQ(it->first, rit->first);
+    }
+  }
+}
+
+TEST(ChunkedPathMap, iteratorsStayValidAcrossInserts) {
+  ChunkedPathMap<size_t> map(CaseSensitivity::Sensitive);
+  auto middle = map.emplace(makeName(50000), 50000).first;
+  const auto* address = &*middle;
+
+  std::vector<size_t> order(100000);
+  std::iota(order.begin(), order.end(), 0);
+  std::shuffle(order.begin(), order.end(), std::mt19937{2});
+  for (auto i : order) {
+    map.emplace(makeName(i), i);
+  }
+  EXPECT_EQ(100000, map.size());
+
+  EXPECT_EQ(address, &*middle);
+  EXPECT_EQ(makeName(50000), middle->first);
+  EXPECT_EQ(makeName(50001), std::next(middle)->first);
+  EXPECT_EQ(makeName(49999), std::prev(middle)->first);
+
+  // Erasing every other entry leaves the remaining iterators intact too.
+  for (size_t i = 1; i < 100000; i += 2) {
+    EXPECT_EQ(1, map.erase(makeName(i)));
+  }
+  EXPECT_EQ(address, &*middle);
+  EXPECT_EQ(makeName(50002), std::next(middle)->first);
+
+  size_t expected = 0;
+  for (const auto& entry : map) {
+    EXPECT_EQ(expected, entry.second);
+    expected += 2;
+  }
+}
+
+TEST(ChunkedPathMap, eraseByIterator) {
+  ChunkedPathMap<int> map(CaseSensitivity::Sensitive);
+  for (int i = 0; i < 1000; ++i) {
+    map.emplace(makeName(i), i);
+  }
+  auto it = map.find(makeName(10));
+  it = map.erase(it);
+  EXPECT_EQ(makeName(11), it->first);
+  it = map.erase(it, map.find(makeName(500)));
+  EXPECT_EQ(makeName(500), it->first);
+  EXPECT_EQ(1000 - 1 - 489, map.size());
+
+  map.erase(map.begin(), map.end());
+  EXPECT_TRUE(map.empty());
+  EXPECT_EQ(map.begin(), map.end());
+}
+
+using IntMap = ChunkedPathMap<int>;
+static_assert(std::is_convertible_v<IntMap::iterator, IntMap::const_iterator>);
+static_assert(
+    !std::is_convertible_v<IntMap::const_iterator, IntMap::iterator>);
+
+TEST(ChunkedPathMap, sparseErasesAndRefills) {
+  // Erasing most entries everywhere shrinks every chunk below the low-water
+  // mark, so chunks get merged and refilled from their neighbours.
+  PathMap<int> expected(CaseSensitivity::Sensitive);
+  ChunkedPathMap<int> map(CaseSensitivity::Sensitive);
+  std::mt19937 gen{3};
+  for (int round = 0; round < 5; ++round) {
+    for (int i = 0; i < 20000; ++i) {
+      auto name = makeName(gen() % 30000);
+      EXPECT_EQ(expected.emplace(name, i).second, map.emplace(name, i).second);
+    }
+    for (int i = 0; i < 40000; ++i) {
+      auto key = gen() % 30000;
+      if (key % 64 != 0) {
+        auto name = makeName(key);
+        EXPECT_EQ(expected.erase(name), map.erase(name));
+      }
+    }
+    expectSameEntries(expected, map);
+  }
+}
+
+TEST(ChunkedPathMap, fromVector) {
+  folly::fbvector<std::pair<PathComponent, int>> entries;
+  entries.emplace_back(PathComponent{"b"}, 1);
+  entries.emplace_back(PathComponent{"A"}, 2);
+  entries.emplace_back(PathComponent{"a"}, 3);
+  entries.emplace_back(PathComponent{"B"}, 4);
+
+  ChunkedPathMap<int> map{std::move(entries), CaseSensitivity::Insensitive};
+  ASSERT_EQ(2, map.size());
+  EXPECT_EQ("A"_pc, map.begin()->first);
+  EXPECT_EQ(2, map.at("a"_pc));
+  EXPECT_EQ("b"_pc, std::next(map.begin())->first);
+  EXPECT_EQ(1, map.at("B"_pc));
+}
+
+TEST(ChunkedPathMap, copyMoveAndCompare) {
+  ChunkedPathMap<int> map(CaseSensitivity::Insensitive);
+  for (int i = 0; i < 1000; ++i) {
+    map.emplace(makeName(i), i);
+  }
+
+  ChunkedPathMap<int> copied(map);
+  EXPECT_EQ(map, copied);
+  copied["extra"_pc] = 1;
+  EXPECT_NE(map, copied);
+
+  ChunkedPathMap<int> moved(std::move(copied));
+  EXPECT_EQ(1001, moved.size());
+  EXPECT_EQ(1, moved.at("EXTRA"_pc));
+  EXPECT_EQ(CaseSensitivity::Insensitive, moved.getCaseSensitivity());
+  EXPECT_EQ(makeName(999), moved.rbegin()->first);
+
+  ChunkedPathMap<int> assigned(CaseSensitivity::Sensitive);
+  assigned["x"_pc] = 0;
+  assigned = map;
+  EXPECT_EQ(map, assigned);
+  assigned = std::move(moved);
+  EXPECT_EQ(1001, assigned.size());
+  EXPECT_EQ("extra"_pc, assigned.begin()->first);
+  EXPECT_EQ(makeName(0), std::next(assigned.begin())->first);
+  EXPECT_EQ(makeName(999), std::prev(assigned.end())->first);
+
+  ChunkedPathMap<int> empty(CaseSensitivity::Sensitive);
+  empty.swap(assigned);
+  EXPECT_TRUE(assigned.empty());
+  EXPECT_EQ(assigned.begin(), assigned.end());
+  EXPECT_EQ(1001, empty.size());
+}
@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "eden/common/utils/HashedPathMap.h"
+
+#include <folly/portability/GTest.h>
+
+using namespace facebook::eden;
+
+TEST(HashedPath, hashMatchesUnhashedPath) {
+  HashedRelativePath hashed{"foo/bar/baz"};
+  EXPECT_EQ("foo/bar/baz", hashed.view());
+  EXPECT_EQ(
+      std::hash<RelativePath>{}(RelativePath{"foo/bar/baz"}),
+      std::hash<HashedRelativePath>{}(hashed));
+  EXPECT_EQ(hash_value("foo/bar/baz"_relpath), hash_value(hashed));
+
+  HashedRelativePath empty;
+  EXPECT_TRUE(empty.empty());
+  EXPECT_EQ(hash_value(RelativePathPiece{}), hash_value(empty));
+}
+
+TEST(HashedPath, validates) {
+  EXPECT_THROW(HashedRelativePath{"/foo"}, std::domain_error);
+  EXPECT_THROW(HashedRelativePath{"foo//bar"}, std::domain_error);
+}
+
+TEST(HashedPath, copiesAndMovesKeepHash) {
+  HashedRelativePath original{
+      std::string{"some/long/enough/path/to/avoid/sso"}};
+  auto expected = hash_value(original);
+
+  HashedRelativePath copied{original};
+  EXPECT_EQ(expected, hash_value(copied));
+
+  HashedRelativePath moved{std::move(copied)};
+  EXPECT_EQ(expected, hash_value(moved));
+  EXPECT_EQ(original, moved);
+
+  HashedRelativePath assigned;
+  assigned = std::move(moved);
+  EXPECT_EQ(expected, hash_value(assigned));
+  EXPECT_EQ(original.view(), assigned.view());
+}
+
+TEST(HashedPath, constructFromStoredPath) {
+  RelativePath stored{"foo/bar"};
+  HashedRelativePath hashed{std::move(stored)};
+  EXPECT_EQ("foo/bar"_relpath, hashed);
+  EXPECT_EQ(hash_value("foo/bar"_relpath), hash_value(hashed));
+
+  HashedRelativePath fromPiece{"a/b"_relpath};
+  EXPECT_EQ("a/b", fromPiece.view());
+  EXPECT_EQ(hash_value("a/b"_relpath), hash_value(fromPiece));
+}
+
+TEST(HashedPath, absolutePath) {
+  auto root = canonicalPath("/");
+  HashedAbsolutePath hashed{root + "foo/bar"_relpath};
+  EXPECT_EQ(hash_value(root + "foo/bar"_relpath), hash_value(hashed));
+  EXPECT_EQ("bar"_pc, hashed.basename());
+  EXPECT_STREQ(hashed.view().data(), hashed.c_str());
+}
+
+TEST(HashedPathMap, insertFindErase) {
+  HashedPathMap<int> map{CaseSensitivity::Sensitive};
+  EXPECT_TRUE(map.empty());
+
+  EXPECT_TRUE(map.emplace("foo/bar"_relpath, 1).second);
+  EXPECT_FALSE(map.emplace("foo/bar"_relpath, 2).second);
+  EXPECT_TRUE(map.insert({HashedRelativePath{"foo"}, 3}).second);
+  map["baz"_relpath] = 4;
+
+  EXPECT_EQ(3, map.size());
+  EXPECT_EQ(1, map.at("foo/bar"_relpath));
+  EXPECT_EQ(3, map.at("foo"_relpath));
+  EXPECT_EQ(4, map.at("baz"_relpath));
+  EXPECT_EQ(1, map.find(HashedRelativePath{"foo/bar"})->second);
+  EXPECT_EQ(map.end(), map.find("FOO"_relpath));
+  EXPECT_THROW(map.at("nope"_relpath), std::out_of_range);
+
+  EXPECT_EQ(1, map.count("foo"_relpath));
+  EXPECT_EQ(1, map.erase("foo"_relpath));
+  EXPECT_EQ(0, map.erase("foo"_relpath));
+  EXPECT_EQ(0, map.count("foo"_relpath));
+  EXPECT_EQ(2, map.size());
+}
+
+TEST(HashedPathMap, caseInsensitive) {
+  HashedPathMap<int> map{CaseSensitivity::Insensitive};
+  map.emplace("Foo/Bar"_relpath, 1);
+  EXPECT_FALSE(map.emplace("foo/bar"_relpath, 2).second);
+
+  EXPECT_EQ(1, map.size());
+  EXPECT_EQ(1, map.at("FOO/BAR"_relpath));
+  EXPECT_EQ(1, map.at("foo/bar"_relpath));
+  EXPECT_EQ(map.end(), map.find("foo/baz"_relpath));
+
+  // The original spelling is kept.
+  EXPECT_EQ("Foo/Bar", map.begin()->first.view());
+}
+
+TEST(HashedPathMap, literals) {
+  HashedPathMap<int> map{CaseSensitivity::Sensitive};
+  map.emplace("foo/.hg"_relpath, 1);
+  EXPECT_EQ(1, map.find("foo/.hg"_hrelpath)->second);
+  EXPECT_EQ(1, map.count("foo/.hg"_hrelpath));
+  EXPECT_EQ(map.end(), map.find("foo/.HG"_hrelpath));
+  EXPECT_EQ(1, map.at("foo/.hg"_hrelpath));
+
+  HashedPathMap<int> insensitive{CaseSensitivity::Insensitive};
+  insensitive.emplace("foo/.hg"_relpath, 2);
+  EXPECT_EQ(2, insensitive.find("FOO/.HG"_hrelpath)->second);
+
+  HashedPathMap<int, PathComponent> names{CaseSensitivity::Sensitive};
+  names.emplace("BUCK"_pc, 3);
+  EXPECT_EQ(3, names.find("BUCK"_hpc)->second);
+  EXPECT_EQ(0, names.count(".eden"_hpc));
+}
+
+TEST(HashedPathMap, caseInsensitiveLongPaths) {
+  // Longer than the folding buffer in hashPathPieceCaseInsensitive.
+  std::string lower;
+  std::string upper;
+  for (int i = 0; i < 100; ++i) {
+    if (i) {
+      lower += "/";
+      upper += "/";
+    }
+    lower += "component";
+    upper += "COMPONENT";
+  }
+  HashedPathMap<int> map{CaseSensitivity::Insensitive};
+  map.emplace(RelativePathPiece{lower}, 1);
+  EXPECT_EQ(1, map.at(RelativePathPiece{upper}));
+}
+
+TEST(HashedPathMap, unhashedKeys) {
+  HashedPathMap<int, PathComponent> map{
+      {{PathComponent{"a"}, 1}, {PathComponent{"b"}, 2}},
+      CaseSensitivity::Sensitive};
+  EXPECT_EQ(2, map.size());
+  EXPECT_EQ(2, map.at("b"_pc));
+
+  HashedPathMap<int, RelativePath> paths{CaseSensitivity::Sensitive};
+  paths["a/b"_relpath] = 5;
+  EXPECT_EQ(5, paths.at("a/b"_relpath));
+}
+
+TEST(HashedPathMap, equality) {
+  HashedPathMap<int> a{CaseSensitivity::Sensitive};
+  HashedPathMap<int> b{CaseSensitivity::Sensitive};
+  a["x"_relpath] = 1;
+  a["y"_relpath] = 2;
+  b["y"_relpath] = 2;
+  EXPECT_NE(a, b);
+  b["x"_relpath] = 1;
+  EXPECT_EQ(a, b);
+}
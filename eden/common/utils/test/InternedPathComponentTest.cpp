@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "eden/common/utils/InternedPathComponent.h"
+
+#include <folly/portability/GTest.h>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "eden/common/utils/PathMap.h"
+
+using namespace facebook::eden;
+
+TEST(InternedPathComponent, sameNameSameId) {
+  InternedPathComponent a{"BUCK"_pc};
+  InternedPathComponent b{"BUCK"_pc};
+  InternedPathComponent c{"src"_pc};
+
+  EXPECT_EQ(a.id(), b.id());
+  EXPECT_EQ(a, b);
+  EXPECT_NE(a, c);
+  EXPECT_EQ("BUCK", a.view());
+  EXPECT_EQ("BUCK"_pc, a.piece());
+  EXPECT_EQ(a, InternedPathComponent::fromId(a.id()));
+  EXPECT_EQ(std::hash<InternedPathComponent>{}(a), hash_value(b));
+  EXPECT_EQ("src", fmt::to_string(c));
+}
+
+TEST(InternedPathComponent, validates) {
+  EXPECT_THROW(InternedPathComponent{"foo/bar"}, std::domain_error);
+  EXPECT_THROW(InternedPathComponent{".."}, std::domain_error);
+  EXPECT_EQ("foo", InternedPathComponent{"foo"}.view());
+}
+
+TEST(InternedPathComponent, ordering) {
+  InternedPathComponent a{"a"_pc};
+  InternedPathComponent b{"b"_pc};
+  InternedPathComponent upperA{"A"_pc};
+  EXPECT_TRUE(a < b);
+  EXPECT_FALSE(b < a);
+  EXPECT_FALSE(a < a);
+  EXPECT_TRUE(isPathPieceLess(a, b, CaseSensitivity::Sensitive));
+  EXPECT_FALSE(isPathPieceEqual(a, upperA, CaseSensitivity::Sensitive));
+  EXPECT_TRUE(isPathPieceEqual(a, upperA, CaseSensitivity::Insensitive));
+}
+
+TEST(InternedPathComponent, pathMapKey) {
+  PathMap<int, InternedPathComponent> map{CaseSensitivity::Sensitive};
+  map.emplace("src"_pc, 1);
+  map.insert({InternedPathComponent{"BUCK"_pc}, 2});
+  map["__init__.py"_pc] = 3;
+
+  EXPECT_EQ(3, map.size());
+  EXPECT_EQ(1, map.at("src"_pc));
+  EXPECT_EQ(2, map.at("BUCK"_pc));
+  EXPECT_EQ(3, map.at("__init__.py"_pc));
+  EXPECT_EQ(map.end(), map.find("SRC"_pc));
+
+  // Sorted by name, not by id.
+  std::vector<std::string_view> names;
+  for (const auto& [name, value] : map) {
+    names.push_back(name.view());
+  }
+  EXPECT_EQ(
+      (std::vector<std::string_view>{"BUCK", "__init__.py", "src"}), names);
+}
+
+TEST(InternedPathComponent, pathMapFromVectorDedupes) {
+  using Map = PathMap<int, InternedPathComponent>;
+  folly::fbvector<std::pair<InternedPathComponent, int>> entries;
+  entries.emplace_back(InternedPathComponent{"b"_pc}, 1);
+  entries.emplace_back(InternedPathComponent{"A"_pc}, 2);
+  entries.emplace_back(InternedPathComponent{"a"_pc}, 3);
+
+  Map map{std::move(entries), CaseSensitivity::Insensitive};
+  EXPECT_EQ(2, map.size());
+  // The earliest entry wins.
+  EXPECT_EQ(2, map.at("a"_pc));
+  EXPECT_EQ(1, map.at("B"_pc));
+}
+
+TEST(InternedPathComponent, hashSet) {
+  std::unordered_set<InternedPathComponent> set;
+  set.insert(InternedPathComponent{"one"_pc});
+  set.insert(InternedPathComponent{"two"_pc});
+  set.insert(InternedPathComponent{"one"_pc});
+  EXPECT_EQ(2, set.size());
+}
+
+TEST(InternedPathComponent, concurrentInterning) {
+  constexpr size_t kThreads = 8;
+  constexpr size_t kNames = 2000;
+  std::vector<std::vector<uint32_t>> ids(kThreads);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < kThreads; ++t) {
+    ids[t].resize(kNames);
+    threads.emplace_back([t, &ids] {
+      for (size_t i = 0; i < kNames; ++i) {
+        // Start each thread at a different name.
+        auto n = (i + t * kNames / kThreads) % kNames;
+        auto name = fmt::format("concurrent_{}", n);
+        ids[t][n] = InternedPathComponent{PathComponentPiece{name}}.id();
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  for (size_t t = 1; t < kThreads; ++t) {
+    EXPECT_EQ(ids[0], ids[t]);
+  }
+  for (size_t n = 0; n < kNames; ++n) {
+    EXPECT_EQ(
+        fmt::format("concurrent_{}", n),
+        InternedPathComponent::fromId(ids[0][n]).view());
+  }
+}
+
+TEST(InternedPathComponent, stats) {
+  auto name = "a_rather_long_file_name_that_does_not_fit_inline.txt"_pc;
+  PathComponent owned{name};
+  InternedPathComponent interned{name};
+  EXPECT_EQ(0, estimateIndirectMemoryUsage(interned));
+  EXPECT_GT(estimateIndirectMemoryUsage(owned), 0);
+  EXPECT_GT(estimateInterningSavings(interned), 0);
+  EXPECT_EQ(0, estimateInterningSavings(InternedPathComponent{"src"_pc}));
+
+  auto before = InternedPathComponent::getStats();
+  for (int i = 0; i < 1000; ++i) {
+    InternedPathComponent{name};
+  }
+  auto after = InternedPathComponent::getStats();
+  EXPECT_EQ(before.uniqueNames, after.uniqueNames);
+  EXPECT_EQ(before.internCalls + 1000, after.internCalls);
+  EXPECT_EQ(before.tableBytes, after.tableBytes);
+  EXPECT_EQ(
+      before.bytesSaved +
+          1000 * static_cast<int64_t>(estimateInterningSavings(interned)),
+      after.bytesSaved);
+}
@@ -10,13 +10,17 @@
 #include "eden/common/utils/MappedDiskVector.h"
 
 #include <benchmark/benchmark.h>
+#include <fcntl.h>
 #include <folly/testing/TestUtil.h>
 #include <sys/mman.h>
 #include <unistd.h>
+#include <optional>
+#include <random>
 
 namespace {
 
 using facebook::eden::MappedDiskVector;
+using facebook::eden::MappedDiskVectorOptions;
 
 struct Small {
   enum { VERSION = 100 };
@@ -108,6 +112,177 @@ void BM_Madvise_AlreadyFaulted(benchmark::State& state) {
 BENCHMARK(BM_Madvise_AlreadyFaulted);
 #endif
 
+/**
+ * Mapping modes compared by the scan benchmarks: regular pages, transparent
+ * huge pages, and a file on hugetlbfs.  The last one needs a hugetlbfs mount
+ * with enough reserved pages at $MDV_BENCH_HUGETLBFS (default
+ * /dev/hugepages) and is skipped otherwise.
+ */
+enum class MappingMode { Regular, TransparentHugePages, Hugetlbfs };
+
+/**
+ * A populated vector of count Realistic records, kept open for the duration
+ * of a benchmark.
+ */
+class ScanFixture {
+ public:
+  ScanFixture(benchmark::State& state, MappingMode mode, size_t count) {
+    std::string dir;
+    MappedDiskVectorOptions options;
+    if (mode == MappingMode::Hugetlbfs) {
+      auto* env = getenv("MDV_BENCH_HUGETLBFS");
+      dir = env ? env : "/dev/hugepages";
+      if (access(dir.c_str(), W_OK) != 0) {
+        state.SkipWithError("no writable hugetlbfs mount");
+        return;
+      }
+    } else {
+      tmpDir_.emplace("mdv_bench_");
+      dir = tmpDir_->path().string();
+      options.hugePages = mode == MappingMode::TransparentHugePages;
+    }
+    path_ = dir + "/scan.mdv";
+    ::unlink(path_.c_str());
+
+    try {
+      mdv_.emplace(MappedDiskVector<Realistic>::open(path_, options));
+      for (size_t i = 0; i < count; ++i) {
+        mdv_->emplace_back(Realistic{.ino = i});
+      }
+    } catch (const std::exception& ex) {
+      state.SkipWithError(ex.what());
+      mdv_.reset();
+    }
+  }
+
+  ~ScanFixture() {
+    mdv_.reset();
+    if (!path_.empty()) {
+      ::unlink(path_.c_str());
+    }
+  }
+
+  MappedDiskVector<Realistic>* get() {
+    return mdv_ ? &*mdv_ : nullptr;
+  }
+
+ private:
+  std::optional<folly::test::TemporaryDirectory> tmpDir_;
+  std::string path_;
+  std::optional<MappedDiskVector<Realistic>> mdv_;
+};
+
+void BM_SequentialScan(benchmark::State& state, MappingMode mode) {
+  auto count = static_cast<size_t>(state.range(0));
+  ScanFixture fixture{state, mode, count};
+  auto* mdv = fixture.get();
+  if (!mdv) {
+    return;
+  }
+
+  for (auto _ : state) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < count; ++i) {
+      sum += (*mdv)[i].ino;
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * count);
+  state.SetBytesProcessed(state.iterations() * count * sizeof(Realistic));
+}
+
+void BM_RandomAccess(benchmark::State& state, MappingMode mode) {
+  auto count = static_cast<size_t>(state.range(0));
+  ScanFixture fixture{state, mode, count};
+  auto* mdv = fixture.get();
+  if (!mdv) {
+    return;
+  }
+
+  // Precomputed so the generator stays out of the measurement.
+  std::vector<uint32_t> indices(1 << 16);
+  std::mt19937 rng{0};
+  std::uniform_int_distribution<uint32_t> dist{
+      0, static_cast<uint32_t>(count - 1)};
+  for (auto& index : indices) {
+    index = dist(rng);
+  }
+
+  for (auto _ : state) {
+    uint64_t sum = 0;
+    for (auto index : indices) {
+      sum += (*mdv)[index].ino;
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * indices.size());
+}
+
+// 48 MB and 768 MB of records: the second is far beyond what the TLB covers
+// with 4 KB pages.
+#define SCAN_ARGS Arg(1 << 20)->Arg(1 << 24)->Unit(benchmark::kMillisecond)
+
+BENCHMARK_CAPTURE(BM_SequentialScan, regular, MappingMode::Regular)
+    ->SCAN_ARGS;
+BENCHMARK_CAPTURE(BM_SequentialScan, thp, MappingMode::TransparentHugePages)
+    ->SCAN_ARGS;
+BENCHMARK_CAPTURE(BM_SequentialScan, hugetlbfs, MappingMode::Hugetlbfs)
+    ->SCAN_ARGS;
+BENCHMARK_CAPTURE(BM_RandomAccess, regular, MappingMode::Regular)->SCAN_ARGS;
+BENCHMARK_CAPTURE(BM_RandomAccess, thp, MappingMode::TransparentHugePages)
+    ->SCAN_ARGS;
+BENCHMARK_CAPTURE(BM_RandomAccess, hugetlbfs, MappingMode::Hugetlbfs)
+    ->SCAN_ARGS;
+
+/**
+ * Opening a vector whose pages are not in the page cache and scanning every
+ * record, as the daemon does at startup, with open() pre-faulting on
+ * state.range(1) threads.
+ *
+ * Pages are evicted with POSIX_FADV_DONTNEED, which needs no privileges but
+ * has no effect on tmpfs: point TMPDIR at a disk-backed filesystem.
+ */
+void BM_ColdStartup(benchmark::State& state) {
+  folly::test::TemporaryDirectory tmpDir{"mdv_bench_"};
+  auto path = (tmpDir.path() / "cold.mdv").string();
+  auto count = static_cast<size_t>(state.range(0));
+  {
+    auto mdv = MappedDiskVector<Realistic>::open(path);
+    for (size_t i = 0; i < count; ++i) {
+      mdv.emplace_back(Realistic{.ino = i});
+    }
+  }
+
+  MappedDiskVectorOptions options;
+  options.openPopulateThreads = static_cast<size_t>(state.range(1));
+  std::optional<MappedDiskVector<Realistic>> mdv;
+  for (auto _ : state) {
+    state.PauseTiming();
+    mdv.reset();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    ::close(fd);
+    state.ResumeTiming();
+
+    mdv.emplace(MappedDiskVector<Realistic>::open(path, options));
+    uint64_t sum = 0;
+    for (size_t i = 0; i < mdv->size(); ++i) {
+      sum += (*mdv)[i].ino;
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * count);
+}
+
+// 192 MB of records.
+BENCHMARK(BM_ColdStartup)
+    ->Args({1 << 22, 1})
+    ->Args({1 << 22, 2})
+    ->Args({1 << 22, 4})
+    ->Args({1 << 22, 8})
+    ->Unit(benchmark::kMillisecond);
+
 } // namespace
 
 #endif // __linux__
@@ -26,8 +26,13 @@
 #include <folly/portability/GTest.h>
 #include <folly/test/TestUtils.h>
 #include <folly/testing/TestUtil.h>
+#include <atomic>
+#include <thread>
+#include <vector>
 
 using facebook::eden::MappedDiskVector;
+using facebook::eden::MappedDiskVectorMigration;
+using facebook::eden::MappedDiskVectorOptions;
 using folly::test::TemporaryDirectory;
 
 TEST(MappedDiskVector, roundUpToNonzeroPageSize) {
@@ -570,4 +575,430 @@ TEST_F(MappedDiskVectorTest, migrate_overwrites_existing_tmp_file) {
   }
 }
 
+namespace {
+MappedDiskVectorOptions durableOptions(std::chrono::milliseconds interval) {
+  MappedDiskVectorOptions options;
+  options.durable = true;
+  options.commitInterval = interval;
+  return options;
+}
+} // namespace
+
+TEST_F(MappedDiskVectorTest, durable_open_drops_uncommitted_records) {
+  // The child exits without running destructors, like a crash would. Its
+  // shared mapping still reaches the page cache, so only the committed count
+  // keeps the last two records from reappearing.
+  EXPECT_EXIT(
+      {
+        auto mdv = MappedDiskVector<U64>::open(
+            mdvPath, durableOptions(std::chrono::hours{1}));
+        mdv.emplace_back(1ull);
+        mdv.emplace_back(2ull);
+        mdv.emplace_back(3ull);
+        mdv.commit();
+        mdv.emplace_back(4ull);
+        mdv.emplace_back(5ull);
+        _exit(mdv.committedSize() == 3 && mdv.size() == 5 ? 0 : 1);
+      },
+      testing::ExitedWithCode(0),
+      "");
+
+  auto mdv = MappedDiskVector<U64>::open(
+      mdvPath, durableOptions(std::chrono::hours{1}));
+  EXPECT_EQ(3, mdv.size());
+  EXPECT_EQ(3, mdv.committedSize());
+  EXPECT_EQ(1, mdv[0]);
+  EXPECT_EQ(3, mdv[2]);
+
+  // The dropped slots are reused by new appends.
+  mdv.emplace_back(6ull);
+  EXPECT_EQ(6, mdv[3]);
+}
+
+TEST_F(MappedDiskVectorTest, durable_zero_interval_commits_every_append) {
+  EXPECT_EXIT(
+      {
+        auto mdv = MappedDiskVector<U64>::open(
+            mdvPath, durableOptions(std::chrono::milliseconds{0}));
+        for (uint64_t i = 0; i < 10; ++i) {
+          mdv.emplace_back(i);
+        }
+        _exit(0);
+      },
+      testing::ExitedWithCode(0),
+      "");
+
+  auto mdv = MappedDiskVector<U64>::open(
+      mdvPath, durableOptions(std::chrono::milliseconds{0}));
+  EXPECT_EQ(10, mdv.size());
+  EXPECT_EQ(9, mdv[9]);
+}
+
+TEST_F(MappedDiskVectorTest, durable_interval_counts_from_first_append) {
+  auto mdv = MappedDiskVector<U64>::open(
+      mdvPath, durableOptions(std::chrono::milliseconds{50}));
+
+  // Being idle for longer than the interval does not make the next append
+  // commit on its own.
+  std::this_thread::sleep_for(std::chrono::milliseconds{100});
+  mdv.emplace_back(1ull);
+  EXPECT_EQ(0, mdv.committedSize());
+
+  // Once that append is old enough, the next one commits both.
+  std::this_thread::sleep_for(std::chrono::milliseconds{100});
+  mdv.emplace_back(2ull);
+  EXPECT_EQ(2, mdv.committedSize());
+
+  // And the interval starts over from the following append.
+  mdv.emplace_back(3ull);
+  EXPECT_EQ(2, mdv.committedSize());
+}
+
+TEST_F(MappedDiskVectorTest, durable_destructor_commits) {
+  {
+    auto mdv = MappedDiskVector<U64>::open(
+        mdvPath, durableOptions(std::chrono::hours{1}));
+    mdv.emplace_back(7ull);
+    mdv.emplace_back(8ull);
+    EXPECT_EQ(0, mdv.committedSize());
+  }
+
+  auto mdv = MappedDiskVector<U64>::open(
+      mdvPath, durableOptions(std::chrono::hours{1}));
+  EXPECT_EQ(2, mdv.size());
+  EXPECT_EQ(2, mdv.committedSize());
+}
+
+TEST_F(MappedDiskVectorTest, durable_pop_back_commits_shrink) {
+  auto mdv = MappedDiskVector<U64>::open(
+      mdvPath, durableOptions(std::chrono::hours{1}));
+  mdv.emplace_back(1ull);
+  mdv.emplace_back(2ull);
+  mdv.commit();
+  mdv.pop_back();
+  EXPECT_EQ(1, mdv.committedSize());
+}
+
+TEST_F(MappedDiskVectorTest, switches_between_durable_and_plain_files) {
+  {
+    auto mdv = MappedDiskVector<U64>::open(mdvPath);
+    mdv.emplace_back(1ull);
+    mdv.emplace_back(2ull);
+  }
+
+  // A plain file keeps every record when first opened as durable.
+  {
+    auto mdv = MappedDiskVector<U64>::open(
+        mdvPath, durableOptions(std::chrono::hours{1}));
+    EXPECT_EQ(2, mdv.size());
+    EXPECT_EQ(2, mdv.committedSize());
+    mdv.emplace_back(3ull);
+  }
+
+  // And a durable file opens without durability, keeping committed records.
+  {
+    auto mdv = MappedDiskVector<U64>::open(mdvPath);
+    EXPECT_EQ(3, mdv.size());
+    mdv.emplace_back(4ull);
+  }
+
+  auto mdv = MappedDiskVector<U64>::open(mdvPath);
+  EXPECT_EQ(4, mdv.size());
+  EXPECT_EQ(4, mdv[3]);
+}
+
+TEST_F(MappedDiskVectorTest, durable_migration) {
+  {
+    auto mdv = MappedDiskVector<Old>::open(
+        mdvPath, durableOptions(std::chrono::hours{1}));
+    mdv.emplace_back(Old{1});
+    mdv.emplace_back(Old{2});
+  }
+
+  auto mdv = MappedDiskVector<New>::open<Old>(
+      mdvPath, durableOptions(std::chrono::hours{1}));
+  EXPECT_EQ(2, mdv.size());
+  EXPECT_EQ(2, mdv.committedSize());
+  EXPECT_EQ(-2, mdv[1].x);
+}
+
+TEST_F(MappedDiskVectorTest, failed_migration_keeps_durable_original) {
+  {
+    auto mdv = MappedDiskVector<Old>::open(
+        mdvPath, durableOptions(std::chrono::hours{1}));
+    mdv.emplace_back(Old{1});
+    mdv.emplace_back(Old{2});
+  }
+
+  // A directory in the way of the temporary file makes the migration fail
+  // after the original has been opened.
+  auto tmpPath = mdvPath + ".tmp";
+  ASSERT_EQ(0, mkdir(tmpPath.c_str(), 0700));
+  EXPECT_THROW(
+      MappedDiskVector<New>::open<Old>(
+          mdvPath, durableOptions(std::chrono::hours{1})),
+      std::system_error);
+  ASSERT_EQ(0, rmdir(tmpPath.c_str()));
+
+  // The header still says durable, with both records committed.
+  uint32_t header[8];
+  int fd = ::open(mdvPath.c_str(), O_RDONLY);
+  ASSERT_NE(-1, fd);
+  ASSERT_EQ(sizeof(header), pread(fd, header, sizeof(header), 0));
+  close(fd);
+  EXPECT_EQ(2, header[1]); // version
+  EXPECT_EQ(2, header[6]); // committedCount, low half
+}
+
+TEST_F(MappedDiskVectorTest, huge_pages_keep_file_huge_page_aligned) {
+  using facebook::eden::detail::kHugePageSize;
+  MappedDiskVectorOptions options;
+  options.hugePages = true;
+
+  // A file created without huge pages is extended on first huge-page open.
+  {
+    auto mdv = MappedDiskVector<U64>::open(mdvPath);
+    mdv.emplace_back(0ull);
+  }
+
+  constexpr uint64_t N = 300000; // grows past the first 2 MB
+  {
+    auto mdv = MappedDiskVector<U64>::open(mdvPath, options);
+    EXPECT_EQ(1, mdv.size());
+    for (uint64_t i = 1; i < N; ++i) {
+      mdv.emplace_back(i);
+    }
+  }
+
+  struct stat st;
+  ASSERT_EQ(0, stat(mdvPath.c_str(), &st));
+  EXPECT_EQ(0, st.st_size % kHugePageSize);
+  EXPECT_GT(st.st_size, kHugePageSize);
+
+  // The file is still an ordinary MappedDiskVector.
+  auto mdv = MappedDiskVector<U64>::open(mdvPath);
+  EXPECT_EQ(N, mdv.size());
+  for (uint64_t i = 0; i < N; ++i) {
+    ASSERT_EQ(i, mdv[i]);
+  }
+}
+
+TEST_F(MappedDiskVectorTest, reservation_keeps_records_in_place) {
+  MappedDiskVectorOptions options;
+  options.addressSpaceReservation = 4 * 1024 * 1024;
+  auto mdv = MappedDiskVector<U64>::open(mdvPath, options);
+  mdv.emplace_back(0ull);
+  const U64* first = &mdv[0];
+
+  // Fill the whole 4 MB reservation, growing three times along the way.
+  uint64_t i = 1;
+  try {
+    for (;; ++i) {
+      mdv.emplace_back(i);
+    }
+  } catch (const std::length_error&) {
+  }
+  EXPECT_EQ(i, mdv.size());
+  EXPECT_EQ(mdv.capacity(), mdv.size());
+  EXPECT_EQ(first, &mdv[0]);
+  for (uint64_t j = 0; j < i; ++j) {
+    ASSERT_EQ(j, mdv[j]);
+  }
+}
+
+TEST_F(MappedDiskVectorTest, concurrent_readers_with_one_writer) {
+  MappedDiskVectorOptions options;
+  options.addressSpaceReservation = size_t{1} << 30;
+  auto mdv = MappedDiskVector<U64>::open(mdvPath, options);
+
+  constexpr uint64_t N = 1000000; // 8 MB, several rounds of growth
+  std::atomic<bool> done{false};
+  std::atomic<uint64_t> mismatches{0};
+  std::vector<std::thread> readers;
+  for (int r = 0; r < 4; ++r) {
+    readers.emplace_back([&, r] {
+      uint64_t seen = 0;
+      while (!done.load(std::memory_order_relaxed)) {
+        size_t size = mdv.size();
+        if (size == 0) {
+          continue;
+        }
+        // The newest record and a spread of older ones must be complete.
+        if (mdv[size - 1] != size - 1 ||
+            mdv[(seen * 7919 + r) % size] != (seen * 7919 + r) % size) {
+          ++mismatches;
+        }
+        ++seen;
+      }
+    });
+  }
+
+  for (uint64_t i = 0; i < N; ++i) {
+    mdv.emplace_back(i);
+  }
+  done = true;
+  for (auto& reader : readers) {
+    reader.join();
+  }
+
+  EXPECT_EQ(0, mismatches.load());
+  EXPECT_EQ(N, mdv.size());
+}
+
+TEST_F(MappedDiskVectorTest, compact_removes_tombstones_and_truncates) {
+  constexpr uint64_t N = 300000; // a bit over 2 MB
+  {
+    auto mdv = MappedDiskVector<U64>::open(mdvPath);
+    for (uint64_t i = 0; i < N; ++i) {
+      mdv.emplace_back(i);
+    }
+
+    struct stat st;
+    ASSERT_EQ(0, stat(mdvPath.c_str(), &st));
+    auto oldFileSize = st.st_size;
+
+    // Keep every tenth record.
+    size_t moves = 0;
+    auto removed = mdv.compact(
+        [](uint64_t value) { return value % 10 != 0; },
+        [&](size_t from, size_t to) {
+          // Moves are reported once the new layout is in place.
+          EXPECT_EQ(N / 10, mdv.size());
+          EXPECT_EQ(from, mdv[to]);
+          EXPECT_EQ(from, to * 10);
+          ++moves;
+        });
+    EXPECT_EQ(N - N / 10, removed);
+    EXPECT_EQ(N / 10 - 1, moves);
+    ASSERT_EQ(N / 10, mdv.size());
+    EXPECT_EQ(10, mdv[1]);
+    EXPECT_EQ(N - 10, mdv[N / 10 - 1]);
+
+    ASSERT_EQ(0, stat(mdvPath.c_str(), &st));
+    EXPECT_LT(st.st_size, oldFileSize);
+
+    // The vector stays usable.
+    mdv.emplace_back(N);
+    EXPECT_EQ(0, mdv.compact([](uint64_t) { return false; }));
+  }
+
+  auto mdv = MappedDiskVector<U64>::open(mdvPath);
+  EXPECT_EQ(N / 10 + 1, mdv.size());
+  EXPECT_EQ(N, mdv[N / 10]);
+}
+
+TEST_F(MappedDiskVectorTest, compact_rejects_durable_vectors) {
+  MappedDiskVectorOptions options;
+  options.durable = true;
+  auto mdv = MappedDiskVector<U64>::open(mdvPath, options);
+  mdv.emplace_back(1ull);
+  mdv.emplace_back(2ull);
+  EXPECT_THROW(
+      mdv.compact([](uint64_t value) { return value == 1; }),
+      std::logic_error);
+  EXPECT_EQ(2, mdv.size());
+}
+
+TEST_F(MappedDiskVectorTest, compact_within_reservation) {
+  MappedDiskVectorOptions options;
+  options.addressSpaceReservation = 8 * 1024 * 1024;
+  auto mdv = MappedDiskVector<U64>::open(mdvPath, options);
+  for (uint64_t i = 0; i < 300000; ++i) {
+    mdv.emplace_back(i);
+  }
+  const U64* first = &mdv[0];
+  mdv.compact([](uint64_t value) { return value != 0; });
+  EXPECT_EQ(1, mdv.size());
+  EXPECT_EQ(first, &mdv[0]);
+
+  // The released range can be grown back into.
+  for (uint64_t i = 1; i < 300000; ++i) {
+    mdv.emplace_back(i);
+  }
+  EXPECT_EQ(299999, mdv[299999]);
+}
+
+TEST_F(MappedDiskVectorTest, lazy_migration_serves_reads_while_converting) {
+  constexpr unsigned N = 10000;
+  {
+    auto mdv = MappedDiskVector<Old>::open(mdvPath);
+    for (unsigned i = 0; i < N; ++i) {
+      mdv.emplace_back(Old{i});
+    }
+  }
+
+  auto migration =
+      MappedDiskVectorMigration<New, Old>::start(mdvPath, {}, 1000);
+  EXPECT_EQ(N, migration.size());
+  EXPECT_FALSE(migration.done());
+
+  // Both unconverted and converted records read as New.
+  EXPECT_EQ(-5u, migration.get(5).x);
+  EXPECT_TRUE(migration.migrateChunk());
+  EXPECT_EQ(1000, migration.migrated());
+  EXPECT_EQ(-5u, migration.get(5).x);
+  EXPECT_EQ(5000, migration.get(5000).y);
+
+  migration.runInBackground();
+  for (unsigned i = 0; i < N; ++i) {
+    ASSERT_EQ(i, migration.get(i).y);
+  }
+
+  {
+    auto mdv = migration.finish();
+    ASSERT_EQ(N, mdv.size());
+    EXPECT_EQ(-7u, mdv[7].x);
+    EXPECT_EQ(N - 1, mdv[N - 1].y);
+  }
+  EXPECT_NE(0, access((mdvPath + ".tmp").c_str(), F_OK));
+
+  // The file now holds New records, so there is nothing left to migrate.
+  auto again = MappedDiskVectorMigration<New, Old>::start(mdvPath);
+  EXPECT_TRUE(again.done());
+  EXPECT_EQ(N, again.size());
+  EXPECT_EQ(3, again.get(3).y);
+}
+
+TEST_F(MappedDiskVectorTest, abandoned_lazy_migration_keeps_original) {
+  {
+    auto mdv = MappedDiskVector<Old>::open(mdvPath);
+    mdv.emplace_back(Old{1});
+    mdv.emplace_back(Old{2});
+  }
+  {
+    auto migration = MappedDiskVectorMigration<New, Old>::start(mdvPath);
+    migration.migrateChunk();
+  }
+  EXPECT_NE(0, access((mdvPath + ".tmp").c_str(), F_OK));
+
+  auto mdv = MappedDiskVector<Old>::open(mdvPath);
+  EXPECT_EQ(2, mdv.size());
+  EXPECT_EQ(2, mdv[1].x);
+}
+
+TEST_F(MappedDiskVectorTest, prefetch_and_parallel_populate) {
+  constexpr uint64_t N = 500000;
+  {
+    auto mdv = MappedDiskVector<U64>::open(mdvPath);
+    for (uint64_t i = 0; i < N; ++i) {
+      mdv.emplace_back(i);
+    }
+  }
+
+  MappedDiskVectorOptions options;
+  options.openPopulateThreads = 4;
+  auto mdv = MappedDiskVector<U64>::open(mdvPath, options);
+  ASSERT_EQ(N, mdv.size());
+
+  mdv.prefetch(0, N);
+  mdv.prefetch(N, N); // empty
+  mdv.prefetch(10, N * 2); // clamped to size()
+  mdv.prefetchAsync(1000, 200000).get();
+  mdv.prefetchAsync(N, 0).get();
+
+  for (uint64_t i = 0; i < N; ++i) {
+    ASSERT_EQ(i, mdv[i]);
+  }
+}
+
 #endif
@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#ifndef _WIN32
+
+#include "eden/common/utils/MappedPathMap.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+#include <folly/portability/GTest.h>
+#include <folly/testing/TestUtil.h>
+
+using namespace facebook::eden;
+using namespace facebook::eden::path_literals;
+using folly::test::TemporaryDirectory;
+
+namespace {
+struct Record {
+  enum { VERSION = 3 };
+  uint64_t inode;
+  uint32_t mode;
+};
+
+struct OtherRecord {
+  enum { VERSION = 4 };
+  uint64_t inode;
+  uint32_t mode;
+};
+
+struct MappedPathMapTest : ::testing::Test {
+  MappedPathMapTest()
+      : tmpDir{"eden_mpm_"}, path{(tmpDir.path() / "test.mpm").string()} {}
+  TemporaryDirectory tmpDir;
+  std::string path;
+};
+} // namespace
+
+TEST_F(MappedPathMapTest, roundTrip) {
+  PathMap<Record> map{CaseSensitivity::Sensitive};
+  for (uint32_t i = 0; i < 1000; ++i) {
+    map.emplace(PathComponent{fmt::format("name{}", i)}, Record{i * 7, i});
+  }
+  writeMappedPathMap(path, map);
+
+  auto mapped = MappedPathMap<Record>::open(path);
+  ASSERT_EQ(map.size(), mapped.size());
+  EXPECT_EQ(CaseSensitivity::Sensitive, mapped.getCaseSensitivity());
+
+  auto it = mapped.begin();
+  for (const auto& [key, value] : map) {
+    ASSERT_NE(mapped.end(), it);
+    EXPECT_EQ(key, it->first);
+    EXPECT_EQ(value.inode, it->second.inode);
+    EXPECT_EQ(value.mode, (*it).second.mode);
+    ++it;
+  }
+  EXPECT_EQ(mapped.end(), it);
+
+  EXPECT_EQ(42 * 7, mapped.at("name42"_pc).inode);
+  EXPECT_EQ(1, mapped.count("name999"_pc));
+  EXPECT_EQ(mapped.end(), mapped.find("name1000"_pc));
+  EXPECT_EQ(mapped.end(), mapped.find("NAME42"_pc));
+  EXPECT_THROW(mapped.at("missing"_pc), std::out_of_range);
+
+  EXPECT_EQ("name42"_pc, mapped.lower_bound("name42"_pc)->first);
+  EXPECT_EQ("name420"_pc, mapped.lower_bound("name42-"_pc)->first);
+  EXPECT_EQ(mapped.begin(), mapped.lower_bound("a"_pc));
+  EXPECT_EQ(mapped.end(), mapped.lower_bound("z"_pc));
+  EXPECT_EQ(map.size(), static_cast<size_t>(mapped.end() - mapped.begin()));
+}
+
+TEST_F(MappedPathMapTest, caseInsensitive) {
+  PathMap<Record> map{CaseSensitivity::Insensitive};
+  map.emplace("Foo"_pc, Record{1, 0});
+  map.emplace("bar"_pc, Record{2, 0});
+  writeMappedPathMap(path, map);
+
+  auto mapped = MappedPathMap<Record>::open(path);
+  EXPECT_EQ(CaseSensitivity::Insensitive, mapped.getCaseSensitivity());
+  EXPECT_EQ(1, mapped.at("FOO"_pc).inode);
+  EXPECT_EQ(2, mapped.at("Bar"_pc).inode);
+  EXPECT_EQ("bar"_pc, mapped.begin()->first);
+}
+
+TEST_F(MappedPathMapTest, empty) {
+  writeMappedPathMap(path, PathMap<Record>{CaseSensitivity::Sensitive});
+  auto mapped = MappedPathMap<Record>::open(path);
+  EXPECT_TRUE(mapped.empty());
+  EXPECT_EQ(mapped.begin(), mapped.end());
+  EXPECT_EQ(mapped.end(), mapped.find("foo"_pc));
+}
+
+TEST_F(MappedPathMapTest, rewriteKeepsOpenViewValid) {
+  PathMap<Record> map{CaseSensitivity::Sensitive};
+  map.emplace("foo"_pc, Record{1, 0});
+  writeMappedPathMap(path, map);
+  auto before = MappedPathMap<Record>::open(path);
+
+  map.emplace("bar"_pc, Record{2, 0});
+  writeMappedPathMap(path, map);
+  auto after = MappedPathMap<Record>::open(path);
+
+  EXPECT_EQ(1, before.size());
+  EXPECT_EQ(1, before.at("foo"_pc).inode);
+  EXPECT_EQ(2, after.size());
+  EXPECT_EQ(2, after.at("bar"_pc).inode);
+
+  auto moved = std::move(before);
+  EXPECT_EQ(1, moved.at("foo"_pc).inode);
+}
+
+TEST_F(MappedPathMapTest, rejectsMismatchedFiles) {
+  PathMap<Record> map{CaseSensitivity::Sensitive};
+  map.emplace("foo"_pc, Record{1, 0});
+  writeMappedPathMap(path, map);
+
+  EXPECT_THROW(MappedPathMap<OtherRecord>::open(path), std::runtime_error);
+
+  // Truncate the file, dropping part of the key blob.
+  struct stat st;
+  ASSERT_EQ(0, stat(path.c_str(), &st));
+  ASSERT_EQ(0, truncate(path.c_str(), st.st_size - 1));
+  EXPECT_THROW(MappedPathMap<Record>::open(path), std::runtime_error);
+
+  ASSERT_EQ(0, truncate(path.c_str(), 10));
+  EXPECT_THROW(MappedPathMap<Record>::open(path), std::runtime_error);
+
+  folly::writeFile(std::string(64, 'x'), path.c_str());
+  EXPECT_THROW(MappedPathMap<Record>::open(path), std::runtime_error);
+}
+
+TEST_F(MappedPathMapTest, rejectsKeysOutsideTheBlob) {
+  PathMap<Record> map{CaseSensitivity::Sensitive};
+  map.emplace("bar"_pc, Record{1, 0});
+  map.emplace("foo"_pc, Record{2, 0});
+  writeMappedPathMap(path, map);
+
+  // Point the second key past the end of the blob, keeping the file size.
+  detail::MappedPathMapKey key{3, 100};
+  {
+    folly::File file{path, O_RDWR};
+    ASSERT_EQ(
+        static_cast<ssize_t>(sizeof(key)),
+        folly::pwriteFull(
+            file.fd(),
+            &key,
+            sizeof(key),
+            sizeof(detail::MappedPathMapHeader) + sizeof(key)));
+  }
+  EXPECT_THROW(MappedPathMap<Record>::open(path), std::runtime_error);
+}
+
+#endif
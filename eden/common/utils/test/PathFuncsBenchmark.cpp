@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "eden/common/utils/PathFuncs.h"
+
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+using namespace facebook::eden;
+using detail::PathScanImpl;
+
+namespace {
+
+/**
+ * Names of the given length, varied a little so the branch predictor does not
+ * learn a single string.
+ */
+std::vector<std::string> makeComponents(size_t length) {
+  std::vector<std::string> names;
+  for (size_t i = 0; i < 64; ++i) {
+    std::string name(length, 'a');
+    name[i % length] = static_cast<char>('a' + i % 26);
+    names.push_back(std::move(name));
+  }
+  return names;
+}
+
+/**
+ * Repository-like relative paths of roughly the given length.
+ */
+std::vector<std::string> makePaths(size_t length) {
+  std::vector<std::string> paths;
+  for (size_t i = 0; i < 64; ++i) {
+    std::string path;
+    while (path.size() < length) {
+      if (!path.empty()) {
+        path.push_back('/');
+      }
+      path += fmt::format("dir{}_{}", i, path.size());
+    }
+    path += ".cpp";
+    paths.push_back(std::move(path));
+  }
+  return paths;
+}
+
+void BM_scanPathComponent(benchmark::State& state, PathScanImpl impl) {
+  if (!detail::isPathScanImplSupported(impl)) {
+    state.SkipWithError("unsupported on this CPU");
+    return;
+  }
+  auto names = makeComponents(state.range(0));
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        detail::scanPathComponent(names[i++ % names.size()], impl));
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+void BM_scanComposedPath(benchmark::State& state, PathScanImpl impl) {
+  if (!detail::isPathScanImplSupported(impl)) {
+    state.SkipWithError("unsupported on this CPU");
+    return;
+  }
+  auto paths = makePaths(state.range(0));
+  size_t i = 0;
+  size_t bytes = 0;
+  for (auto _ : state) {
+    const auto& path = paths[i++ % paths.size()];
+    benchmark::DoNotOptimize(detail::scanComposedPath(path, std::nullopt, impl));
+    bytes += path.size();
+  }
+  state.SetBytesProcessed(bytes);
+}
+
+/**
+ * End to end cost of the sanity check, including UTF-8 validation for
+ * non-ASCII input.
+ */
+void BM_PathComponentPiece(benchmark::State& state) {
+  auto names = makeComponents(state.range(0));
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(PathComponentPiece{names[i++ % names.size()]});
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+void BM_RelativePathPiece(benchmark::State& state) {
+  auto paths = makePaths(state.range(0));
+  size_t i = 0;
+  size_t bytes = 0;
+  for (auto _ : state) {
+    const auto& path = paths[i++ % paths.size()];
+    benchmark::DoNotOptimize(RelativePathPiece{path});
+    bytes += path.size();
+  }
+  state.SetBytesProcessed(bytes);
+}
+
+#define PATH_SCAN_ARGS \
+  Arg(8)->Arg(16)->Arg(32)->Arg(64)->Arg(128)->Arg(256)
+
+BENCHMARK_CAPTURE(BM_scanPathComponent, scalar, PathScanImpl::Scalar)
+    ->PATH_SCAN_ARGS;
+BENCHMARK_CAPTURE(BM_scanPathComponent, sse2, PathScanImpl::SSE2)
+    ->PATH_SCAN_ARGS;
+BENCHMARK_CAPTURE(BM_scanPathComponent, avx2, PathScanImpl::AVX2)
+    ->PATH_SCAN_ARGS;
+BENCHMARK_CAPTURE(BM_scanPathComponent, neon, PathScanImpl::NEON)
+    ->PATH_SCAN_ARGS;
+
+BENCHMARK_CAPTURE(BM_scanComposedPath, scalar, PathScanImpl::Scalar)
+    ->PATH_SCAN_ARGS;
+BENCHMARK_CAPTURE(BM_scanComposedPath, sse2, PathScanImpl::SSE2)
+    ->PATH_SCAN_ARGS;
+BENCHMARK_CAPTURE(BM_scanComposedPath, avx2, PathScanImpl::AVX2)
+    ->PATH_SCAN_ARGS;
+BENCHMARK_CAPTURE(BM_scanComposedPath, neon, PathScanImpl::NEON)
+    ->PATH_SCAN_ARGS;
+
+BENCHMARK(BM_PathComponentPiece)->PATH_SCAN_ARGS;
+BENCHMARK(BM_RelativePathPiece)->PATH_SCAN_ARGS;
+
+/**
+ * Pairs of names that compare equal ignoring case: "short" names of 8 bytes,
+ * "long" names of 64 bytes, and "prefix" names that share the first 48 bytes
+ * and differ only in the last few.
+ */
+std::vector<std::pair<std::string, std::string>> makeComparePairs(
+    std::string_view kind) {
+  std::vector<std::pair<std::string, std::string>> pairs;
+  for (size_t i = 0; i < 64; ++i) {
+    std::string a;
+    if (kind == "short") {
+      a = fmt::format("Name{:04}", i);
+    } else if (kind == "long") {
+      a = fmt::format("{:064}", i);
+      for (size_t j = 0; j < a.size(); j += 3) {
+        a[j] = static_cast<char>('A' + (i + j) % 26);
+      }
+    } else {
+      a = fmt::format("{}Generated_{:04}.h", std::string(36, 'P'), i);
+    }
+    std::string b = a;
+    for (auto& c : b) {
+      c = AsciiLessThanCaseInsensitive::toLower(c);
+    }
+    pairs.emplace_back(std::move(a), std::move(b));
+  }
+  if (kind == "prefix") {
+    // Make neighbours differ after the shared prefix.
+    for (size_t i = 0; i + 1 < pairs.size(); ++i) {
+      pairs[i].second = pairs[i + 1].second;
+    }
+  }
+  return pairs;
+}
+
+void BM_caseInsensitiveLessBytewise(
+    benchmark::State& state,
+    std::string_view kind) {
+  auto pairs = makeComparePairs(kind);
+  size_t i = 0;
+  for (auto _ : state) {
+    const auto& [a, b] = pairs[i++ % pairs.size()];
+    benchmark::DoNotOptimize(std::lexicographical_compare(
+        a.begin(), a.end(), b.begin(), b.end(), AsciiLessThanCaseInsensitive{}));
+  }
+}
+
+void BM_caseInsensitiveLess(benchmark::State& state, std::string_view kind) {
+  auto pairs = makeComparePairs(kind);
+  size_t i = 0;
+  for (auto _ : state) {
+    const auto& [a, b] = pairs[i++ % pairs.size()];
+    benchmark::DoNotOptimize(isPathPieceLess(
+        PathComponentPiece{a, detail::SkipPathSanityCheck{}},
+        PathComponentPiece{b, detail::SkipPathSanityCheck{}},
+        CaseSensitivity::Insensitive));
+  }
+}
+
+void BM_caseInsensitiveEqual(benchmark::State& state, std::string_view kind) {
+  auto pairs = makeComparePairs(kind);
+  size_t i = 0;
+  for (auto _ : state) {
+    const auto& [a, b] = pairs[i++ % pairs.size()];
+    benchmark::DoNotOptimize(isPathPieceEqual(
+        PathComponentPiece{a, detail::SkipPathSanityCheck{}},
+        PathComponentPiece{b, detail::SkipPathSanityCheck{}},
+        CaseSensitivity::Insensitive));
+  }
+}
+
+BENCHMARK_CAPTURE(BM_caseInsensitiveLessBytewise, short, "short");
+BENCHMARK_CAPTURE(BM_caseInsensitiveLessBytewise, long, "long");
+BENCHMARK_CAPTURE(BM_caseInsensitiveLessBytewise, prefix, "prefix");
+BENCHMARK_CAPTURE(BM_caseInsensitiveLess, short, "short");
+BENCHMARK_CAPTURE(BM_caseInsensitiveLess, long, "long");
+BENCHMARK_CAPTURE(BM_caseInsensitiveLess, prefix, "prefix");
+BENCHMARK_CAPTURE(BM_caseInsensitiveEqual, short, "short");
+BENCHMARK_CAPTURE(BM_caseInsensitiveEqual, long, "long");
+BENCHMARK_CAPTURE(BM_caseInsensitiveEqual, prefix, "prefix");
+
+} // namespace
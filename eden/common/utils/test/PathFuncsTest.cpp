@@ -17,6 +17,7 @@
 #include <folly/portability/Unistd.h>
 #include <folly/test/TestUtils.h>
 #include <folly/testing/TestUtil.h>
+#include <random>
 #include <sstream>
 
 #include "eden/common/testharness/TempFile.h"
@@ -502,6 +503,110 @@ TEST(PathFuncs, IterateSuffixes) {
   EXPECT_THAT(emptyRParts, ElementsAre());
 }
 
+namespace {
+
+template <typename Range>
+auto collect(const Range& range) {
+  using Value = std::remove_const_t<typename std::iterator_traits<
+      typename Range::iterator>::value_type>;
+  return std::vector<Value>(range.begin(), range.end());
+}
+
+/// Checks that the index of path agrees with path's own iterators.
+template <typename Path>
+void expectIndexMatchesIterators(const Path& path) {
+  SCOPED_TRACE(path.view());
+  auto index = path.componentIndex();
+  auto components = collect(path.components());
+  ASSERT_EQ(components.size(), index.size());
+  for (size_t i = 0; i < components.size(); ++i) {
+    EXPECT_EQ(components[i], index.component(i));
+    EXPECT_EQ(components[i], index[i]);
+  }
+  EXPECT_EQ(components, collect(index.components()));
+  EXPECT_EQ(collect(path.rcomponents()), collect(index.rcomponents()));
+  EXPECT_EQ(collect(path.paths()), collect(index.paths()));
+  EXPECT_EQ(collect(path.rpaths()), collect(index.rpaths()));
+  std::vector<RelativePathPiece> suffixes;
+  for (size_t i = 0; i < index.size(); ++i) {
+    suffixes.push_back(index.suffix(i));
+  }
+  EXPECT_EQ(collect(path.suffixes()), suffixes);
+  EXPECT_EQ(path.piece(), index.prefix(index.size()));
+  EXPECT_TRUE(index.suffix(index.size()).empty());
+}
+
+} // namespace
+
+static_assert(std::bidirectional_iterator<
+              PathComponentIndex<RelativePathPiece>::component_iterator>);
+static_assert(std::bidirectional_iterator<
+              PathComponentIndex<AbsolutePathPiece>::iterator>);
+
+TEST(PathFuncs, ComponentIndex) {
+  RelativePath rel{"foo/bar/baz"};
+  auto index = rel.componentIndex();
+  EXPECT_EQ(3, index.size());
+  EXPECT_EQ("bar"_pc, index.component(1));
+  EXPECT_EQ(""_relpath, index.prefix(0));
+  EXPECT_EQ("foo/bar"_relpath, index.prefix(2));
+  EXPECT_EQ("foo/bar/baz"_relpath, index.suffix(0));
+  EXPECT_EQ("baz"_relpath, index.suffix(2));
+  EXPECT_THAT(
+      collect(index.allPaths()),
+      ElementsAre(
+          ""_relpath, "foo"_relpath, "foo/bar"_relpath, "foo/bar/baz"_relpath));
+  EXPECT_EQ(collect(rel.allPaths()), collect(index.allPaths()));
+  auto last = std::prev(index.components().end());
+  EXPECT_EQ("baz"_pc, *last--);
+  EXPECT_EQ("bar"_pc, *last);
+  EXPECT_EQ("foo"_relpath, *std::next(index.rpaths().begin(), 2));
+
+  auto abs = canonicalPath("/foo/bar");
+  auto absIndex = abs.componentIndex();
+  EXPECT_EQ(2, absIndex.size());
+  EXPECT_EQ(canonicalPath("/"), absIndex.prefix(0));
+  EXPECT_EQ(canonicalPath("/foo"), absIndex.prefix(1));
+  EXPECT_EQ("foo/bar"_relpath, absIndex.suffix(0));
+
+  RelativePath empty;
+  auto emptyIndex = empty.componentIndex();
+  EXPECT_TRUE(emptyIndex.empty());
+  EXPECT_EQ(""_relpath, emptyIndex.prefix(0));
+  EXPECT_TRUE(emptyIndex.suffix(0).empty());
+  EXPECT_THAT(collect(emptyIndex.allPaths()), ElementsAre(""_relpath));
+
+  expectIndexMatchesIterators(rel);
+  expectIndexMatchesIterators(empty);
+  expectIndexMatchesIterators(abs);
+  expectIndexMatchesIterators(canonicalPath("/"));
+  expectIndexMatchesIterators(RelativePath{"a"});
+  expectIndexMatchesIterators(RelativePath{"a/much/longer/path/than/fits/"
+                                           "in/a/single/vector/register"});
+}
+
+TEST(PathFuncs, ComponentIndexDeepPaths) {
+  // Paths around the inline capacity, and one that spans several 64 byte
+  // blocks of the separator scan.
+  for (size_t depth = 1; depth < 40; ++depth) {
+    RelativePath path{"d0"};
+    for (size_t i = 1; i < depth; ++i) {
+      path = path + PathComponent{fmt::format("d{}", i)};
+    }
+    expectIndexMatchesIterators(path);
+
+    auto index = path.componentIndex();
+    auto copy = index;
+    auto moved = std::move(copy);
+    ASSERT_EQ(depth, moved.size());
+    EXPECT_EQ(PathComponent{fmt::format("d{}", depth - 1)}, moved[depth - 1]);
+    EXPECT_EQ(index.prefix(depth / 2), moved.prefix(depth / 2));
+
+    auto abs = canonicalPath("/") + path;
+    expectIndexMatchesIterators(abs);
+  }
+}
+
 TEST(PathFuncs, InitializeFromIter) {
   // Assert that we can build a vector of path components and convert
   // it to a RelativePath
@@ -549,6 +654,44 @@ TEST(PathFuncs, ImplicitPiece) {
   [](PathComponentPiece piece) { EXPECT_EQ("stored", piece.view()); }(comp);
 }
 
+TEST(PathFuncs, Literals) {
+  // Literals are checked when compiling, so these are constants. Invalid ones
+  // such as "a/b"_pc or "foo/"_relpath do not compile.
+  constexpr PathComponentPiece hg = ".hg"_pc;
+  constexpr RelativePathPiece buck = "foo/bar/BUCK"_relpath;
+  constexpr RelativePathPiece empty = ""_relpath;
+  EXPECT_EQ(".hg", hg.view());
+  EXPECT_EQ("foo/bar/BUCK", buck.view());
+  EXPECT_TRUE(empty.empty());
+
+  constexpr auto eden = ".eden"_hpc;
+  static_assert(eden.hash() != 0);
+  EXPECT_EQ(".eden", eden.view());
+  EXPECT_EQ(hash_value(".eden"_pc), eden.hash());
+  EXPECT_EQ(eden, PathComponent{".eden"}.piece());
+  EXPECT_NE(eden, ".hg"_pc);
+  PathComponentPiece piece = eden;
+  EXPECT_EQ(".eden"_pc, piece);
+
+  // Check the hash on either side of each of SpookyHash's short message
+  // boundaries, and that composed paths hash like hash_value on Windows too.
+  EXPECT_EQ(hash_value("a"_pc), "a"_hpc.hash());
+  EXPECT_EQ(hash_value("abcdefgh"_pc), "abcdefgh"_hpc.hash());
+  EXPECT_EQ(hash_value("abcdefghijklmno"_pc), "abcdefghijklmno"_hpc.hash());
+  EXPECT_EQ(hash_value("abcdefghijklmnop"_pc), "abcdefghijklmnop"_hpc.hash());
+  EXPECT_EQ(
+      hash_value("abcdefghijklmnopqrstuvwxyz012345"_pc),
+      "abcdefghijklmnopqrstuvwxyz012345"_hpc.hash());
+  EXPECT_EQ(
+      hash_value("abcdefghijklmnopqrstuvwxyz0123456789ABCDEFGHIJKLMNOPQ"_pc),
+      "abcdefghijklmnopqrstuvwxyz0123456789ABCDEFGHIJKLMNOPQ"_hpc.hash());
+  EXPECT_EQ(hash_value(""_relpath), ""_hrelpath.hash());
+  EXPECT_EQ(
+      hash_value("a/b/c/d/e/f/g/h/i/j"_relpath),
+      "a/b/c/d/e/f/g/h/i/j"_hrelpath.hash());
+  EXPECT_EQ("a/b/c/d/e/f/g/h/i/j"_relpath, "a/b/c/d/e/f/g/h/i/j"_hrelpath);
+}
+
 TEST(PathFuncs, PathComponent) {
   PathComponent comp("hello");
   EXPECT_EQ("hello", comp.view());
@@ -974,6 +1117,56 @@ TEST(PathFuncs, joinAndNormalize) {
   EXPECT_EQ(bad("a", "b/../../.."), EXDEV);
 }
 
+TEST(PathFuncs, joinAndNormalizeBatch) {
+  const std::vector<std::string_view> paths{
+      "d", "../../e", "", "./x//y/.", "/b/c", "../../../..", "e/../f"};
+  for (const char* base : {"a/b/c", "", "a"}) {
+    SCOPED_TRACE(base);
+    RelativePath basePath{base};
+    auto batch = joinAndNormalizeBatch(basePath, paths);
+    ASSERT_EQ(paths.size(), batch.size());
+    for (size_t i = 0; i < paths.size(); ++i) {
+      SCOPED_TRACE(paths[i]);
+      auto expected = joinAndNormalize(basePath, paths[i]);
+      auto actual = batch[i];
+      ASSERT_EQ(expected.hasValue(), actual.hasValue());
+      if (expected.hasValue()) {
+        EXPECT_EQ(expected.value(), actual.value());
+      } else {
+        EXPECT_EQ(expected.error(), actual.error());
+      }
+    }
+  }
+
+  auto batch = joinAndNormalizeBatch("a/b"_relpath, paths);
+  EXPECT_EQ("a/b/d"_relpath, batch[0].value());
+  EXPECT_EQ("e"_relpath, batch[1].value());
+  EXPECT_EQ("a/b/x/y"_relpath, batch[3].value());
+  EXPECT_EQ(EPERM, batch[4].error());
+  EXPECT_EQ(EXDEV, batch[5].error());
+
+  EXPECT_TRUE(joinAndNormalizeBatch("a"_relpath, {}).empty());
+}
+
+TEST(PathFuncs, joinAndNormalizeBatchValidatesComponents) {
+  using namespace std::string_view_literals;
+  for (auto bad : {"x/a\0b"sv, "x/\xff\xfe"sv}) {
+    SCOPED_TRACE(bad);
+    const std::vector<std::string_view> paths{"ok", bad};
+    EXPECT_THROW(
+        joinAndNormalize("a"_relpath, bad), PathComponentValidationError);
+    EXPECT_THROW(
+        joinAndNormalizeBatch("a"_relpath, paths),
+        PathComponentValidationError);
+  }
+
+  // A component that a later ".." removes never makes it into a path, so it
+  // is not checked.
+  const std::vector<std::string_view> paths{"x/a\0b/../y"sv};
+  EXPECT_EQ("x/y"_relpath, joinAndNormalize(""_relpath, paths[0]).value());
+  EXPECT_EQ("x/y"_relpath, joinAndNormalizeBatch(""_relpath, paths)[0].value());
+}
+
 // Disable the realpath tests on Windows, since we normally don't have
 // permissions to create symlinks.
 #ifndef _WIN32
@@ -1333,6 +1526,125 @@ TEST(PathFuncs, HashEquality) {
   EXPECT_EQ(absHasher(abs1), absHasher(abs2));
 }
 
+TEST(PathFuncs, asciiCaseInsensitiveKernels) {
+  // Reference implementations: the byte at a time comparisons these replace.
+  auto referenceLess = [](std::string_view a, std::string_view b) {
+    return std::lexicographical_compare(
+        a.begin(), a.end(), b.begin(), b.end(), AsciiLessThanCaseInsensitive{});
+  };
+  auto referenceEqual = [](std::string_view a, std::string_view b) {
+    return std::equal(
+        a.begin(), a.end(), b.begin(), b.end(), folly::AsciiCaseInsensitive{});
+  };
+
+  // Characters around the edges of the upper and lower case ranges, plus
+  // bytes with the high bit set.
+  const std::string alphabet{"@AZ[`az{09_.-\x80\xc3\xa9\xff"};
+  std::mt19937 gen{0};
+  std::uniform_int_distribution<size_t> pick{0, alphabet.size() - 1};
+  std::uniform_int_distribution<size_t> length{0, 40};
+  auto randomString = [&](size_t size) {
+    std::string result;
+    for (size_t i = 0; i < size; ++i) {
+      result.push_back(alphabet[pick(gen)]);
+    }
+    return result;
+  };
+
+  for (int i = 0; i < 20000; ++i) {
+    auto a = randomString(length(gen));
+    // Mostly compare strings that share a prefix, so that the first
+    // difference lands at every offset within a word.
+    auto b = a.substr(0, std::min(a.size(), length(gen))) +
+        randomString(length(gen) % 3);
+    for (auto& c : b) {
+      if (pick(gen) % 4 == 0) {
+        c = AsciiLessThanCaseInsensitive::toLower(c);
+      }
+    }
+
+    auto cmp = detail::compareAsciiCaseInsensitive(a, b);
+    EXPECT_EQ(referenceLess(a, b), cmp < 0) << a << " " << b;
+    EXPECT_EQ(referenceLess(b, a), cmp > 0) << a << " " << b;
+    EXPECT_EQ(referenceEqual(a, b), cmp == 0) << a << " " << b;
+    EXPECT_EQ(referenceEqual(a, b), detail::equalAsciiCaseInsensitive(a, b))
+        << a << " " << b;
+  }
+
+  EXPECT_EQ(
+      0,
+      detail::compareAsciiCaseInsensitive(
+          "Some/Long/Path/NAME.txt", "some/long/path/name.TXT"));
+  EXPECT_LT(detail::compareAsciiCaseInsensitive("abcdefghZ", "ABCDEFGHz1"), 0);
+}
+
+TEST(PathFuncs, InlinePathComponent) {
+  static_assert(sizeof(InlinePathComponent) == 32);
+
+  std::string longest(detail::InlinePathString::kMaxInlineSize, 'x');
+  std::string spilled(detail::InlinePathString::kMaxInlineSize + 1, 'y');
+
+  InlinePathComponent small{"foo"};
+  InlinePathComponent inlined{longest};
+  InlinePathComponent heap{spilled};
+  EXPECT_EQ("foo"_pc, small);
+  EXPECT_EQ(longest, inlined.view());
+  EXPECT_EQ(spilled, heap.view());
+  EXPECT_TRUE(small.value().isInline());
+  EXPECT_TRUE(inlined.value().isInline());
+  EXPECT_FALSE(heap.value().isInline());
+  EXPECT_EQ('\0', inlined.value().c_str()[longest.size()]);
+  EXPECT_EQ('\0', heap.value().c_str()[spilled.size()]);
+
+  EXPECT_EQ(0, estimateIndirectMemoryUsage(inlined));
+  EXPECT_EQ(
+      folly::goodMallocSize(spilled.size() + 1),
+      estimateIndirectMemoryUsage(heap));
+
+  EXPECT_THROW(InlinePathComponent{"foo/bar"}, std::domain_error);
+  EXPECT_EQ(
+      hash_value(PathComponentPiece{spilled}), hash_value(heap.piece()));
+  EXPECT_EQ("foo", fmt::to_string(small));
+}
+
+TEST(PathFuncs, InlinePathComponentCopyAndMove) {
+  std::string spilled(detail::InlinePathString::kMaxInlineSize + 10, 'y');
+  for (const auto& name : {std::string{"short"}, spilled}) {
+    InlinePathComponent original{name};
+
+    InlinePathComponent copied{original};
+    EXPECT_EQ(original, copied);
+    EXPECT_NE(original.view().data(), copied.view().data());
+
+    InlinePathComponent moved{std::move(copied)};
+    EXPECT_EQ(name, moved.view());
+
+    InlinePathComponent assigned{"other"};
+    assigned = moved;
+    EXPECT_EQ(name, assigned.view());
+    assigned = InlinePathComponent{spilled};
+    EXPECT_EQ(spilled, assigned.view());
+    assigned = std::move(moved);
+    EXPECT_EQ(name, assigned.view());
+  }
+
+  // Heap allocated names keep their address when the storage is moved.
+  detail::InlinePathString heap{spilled.data(), spilled.size()};
+  const char* data = heap.data();
+  detail::InlinePathString moved{std::move(heap)};
+  EXPECT_EQ(data, moved.data());
+  EXPECT_TRUE(heap.empty());
+}
+
+TEST(PathFuncs, InlinePathComponentComparison) {
+  InlinePathComponent a{"a"};
+  InlinePathComponent b{"b"};
+  EXPECT_LT(a, b);
+  EXPECT_EQ(PathComponent{"a"}, a);
+  EXPECT_EQ(a, "a"_pc);
+  EXPECT_EQ(PathComponent{"b"}, b.copy());
+}
+
 TEST(PathFuncs, move_or_copy) {
   class T {
    public:
@@ -0,0 +1,231 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "eden/common/utils/PathMap.h"
+
+#include <benchmark/benchmark.h>
+#include <folly/FBVector.h>
+#include <folly/executors/CPUThreadPoolExecutor.h>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "eden/common/utils/ChunkedPathMap.h"
+#include "eden/common/utils/PathMapMutator.h"
+
+using namespace facebook::eden;
+
+namespace {
+
+constexpr size_t kEntries = 1'000'000;
+
+/**
+ * kEntries distinct file names with a length distribution resembling a large
+ * monorepo: mostly short names, a tail of long generated ones.
+ */
+const std::vector<std::string>& getNames() {
+  static const auto names = [] {
+    std::mt19937 gen{0};
+    std::discrete_distribution<int> lengthClass{70, 25, 5};
+    std::vector<std::string> result;
+    result.reserve(kEntries);
+    for (size_t i = 0; i < kEntries; ++i) {
+      auto name = fmt::format("f{}", i);
+      size_t target = 0;
+      switch (lengthClass(gen)) {
+        case 0:
+          target = std::uniform_int_distribution<size_t>{8, 22}(gen);
+          break;
+        case 1:
+          target = std::uniform_int_distribution<size_t>{23, 31}(gen);
+          break;
+        default:
+          target = std::uniform_int_distribution<size_t>{32, 80}(gen);
+          break;
+      }
+      while (name.size() < target) {
+        name.push_back(static_cast<char>('a' + name.size() % 26));
+      }
+      result.push_back(std::move(name));
+    }
+    std::shuffle(result.begin(), result.end(), gen);
+    return result;
+  }();
+  return names;
+}
+
+template <typename Key>
+PathMap<uint32_t, Key> buildMap() {
+  const auto& names = getNames();
+  folly::fbvector<std::pair<Key, uint32_t>> entries;
+  entries.reserve(names.size());
+  for (uint32_t i = 0; i < names.size(); ++i) {
+    entries.emplace_back(
+        Key{names[i], detail::SkipPathSanityCheck{}}, i);
+  }
+  return PathMap<uint32_t, Key>{
+      std::move(entries), CaseSensitivity::Sensitive};
+}
+
+/**
+ * Builds an unsorted 1M entry PathMap and reports the memory it holds: the
+ * vector of entries plus whatever the keys allocate on the heap.
+ */
+template <typename Key>
+void BM_PathMapBuild(benchmark::State& state) {
+  getNames();
+  size_t bytes = 0;
+  for (auto _ : state) {
+    auto map = buildMap<Key>();
+    state.PauseTiming();
+    bytes = map.capacity() * sizeof(typename decltype(map)::value_type);
+    for (const auto& entry : map) {
+      bytes += estimateIndirectMemoryUsage(entry.first);
+    }
+    benchmark::DoNotOptimize(map);
+    state.ResumeTiming();
+  }
+  state.counters["bytes"] = bytes;
+  state.counters["bytes_per_entry"] = static_cast<double>(bytes) / kEntries;
+}
+
+template <typename Key>
+void BM_PathMapLookup(benchmark::State& state) {
+  auto map = buildMap<Key>();
+  const auto& names = getNames();
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(map.find(
+        PathComponentPiece{names[i], detail::SkipPathSanityCheck{}}));
+    i = (i + 1) % names.size();
+  }
+}
+
+template <typename Key>
+void BM_PathMapIterate(benchmark::State& state) {
+  auto map = buildMap<Key>();
+  for (auto _ : state) {
+    size_t total = 0;
+    for (const auto& entry : map) {
+      total += entry.first.view().size();
+    }
+    benchmark::DoNotOptimize(total);
+  }
+}
+
+using StdStringPathComponent = detail::PathComponentBase<std::string>;
+
+BENCHMARK_TEMPLATE(BM_PathMapBuild, PathComponent)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_PathMapBuild, StdStringPathComponent)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_PathMapBuild, InlinePathComponent)
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_TEMPLATE(BM_PathMapLookup, PathComponent);
+BENCHMARK_TEMPLATE(BM_PathMapLookup, StdStringPathComponent);
+BENCHMARK_TEMPLATE(BM_PathMapLookup, InlinePathComponent);
+
+BENCHMARK_TEMPLATE(BM_PathMapIterate, PathComponent)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_PathMapIterate, StdStringPathComponent)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_PathMapIterate, InlinePathComponent)
+    ->Unit(benchmark::kMillisecond);
+
+enum class InsertOrder { Sorted, Reversed, Random };
+
+/**
+ * Inserts state.range(0) names one at a time, in the given order, the way a
+ * stream of file creations populates a directory.
+ */
+template <typename Map, InsertOrder order>
+void BM_insertOrder(benchmark::State& state) {
+  std::vector<PathComponent> names;
+  for (int64_t i = 0; i < state.range(0); ++i) {
+    names.emplace_back(fmt::format("file{:08}.txt", i));
+  }
+  switch (order) {
+    case InsertOrder::Sorted:
+      break;
+    case InsertOrder::Reversed:
+      std::reverse(names.begin(), names.end());
+      break;
+    case InsertOrder::Random:
+      std::shuffle(names.begin(), names.end(), std::mt19937{0});
+      break;
+  }
+
+  for (auto _ : state) {
+    Map map{CaseSensitivity::Sensitive};
+    for (const auto& name : names) {
+      map.emplace(name, 0);
+    }
+    benchmark::DoNotOptimize(map);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+using VectorPathMap = PathMap<int>;
+using ChunkedMap = ChunkedPathMap<int>;
+
+#define INSERT_ORDER_BENCHMARK(Map, order)             \
+  BENCHMARK_TEMPLATE(BM_insertOrder, Map, order)       \
+      ->RangeMultiplier(10)                            \
+      ->Range(1000, 100000)                            \
+      ->Unit(benchmark::kMillisecond)
+
+INSERT_ORDER_BENCHMARK(VectorPathMap, InsertOrder::Sorted);
+INSERT_ORDER_BENCHMARK(ChunkedMap, InsertOrder::Sorted);
+INSERT_ORDER_BENCHMARK(VectorPathMap, InsertOrder::Reversed);
+INSERT_ORDER_BENCHMARK(ChunkedMap, InsertOrder::Reversed);
+INSERT_ORDER_BENCHMARK(VectorPathMap, InsertOrder::Random);
+INSERT_ORDER_BENCHMARK(ChunkedMap, InsertOrder::Random);
+
+/**
+ * A checkout-like batch against a 1M entry map: one in state.range(0) entries
+ * is erased, and as many new names are emplaced in sorted order, interleaved
+ * with the existing ones. Measures finalize() alone, on state.range(1)
+ * threads (0 for the calling thread only).
+ */
+void BM_PathMapMutatorFinalize(benchmark::State& state) {
+  const auto stride = static_cast<size_t>(state.range(0));
+  const auto threads = static_cast<size_t>(state.range(1));
+  std::unique_ptr<folly::CPUThreadPoolExecutor> executor;
+  if (threads > 0) {
+    executor = std::make_unique<folly::CPUThreadPoolExecutor>(threads);
+  }
+
+  const auto base = buildMap<PathComponent>();
+  std::vector<PathComponent> added;
+  for (size_t i = 0; i < base.size(); i += stride) {
+    added.emplace_back(fmt::format("{}.new", base.begin()[i].first));
+  }
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    PathMapMutator<uint32_t> mutator{PathMap<uint32_t>{base}};
+    for (size_t i = 0; i < base.size(); i += stride) {
+      mutator.erase(base.begin()[i].first);
+      mutator.emplace(added[i / stride], 0);
+    }
+    state.ResumeTiming();
+
+    auto result = mutator.finalize(executor.get());
+    benchmark::DoNotOptimize(result);
+  }
+  state.SetItemsProcessed(state.iterations() * base.size());
+}
+
+BENCHMARK(BM_PathMapMutatorFinalize)
+    ->ArgNames({"stride", "threads"})
+    ->ArgsProduct({{1, 10, 1000}, {0, 8}})
+    ->Unit(benchmark::kMillisecond);
+
+} // namespace
+
@@ -6,7 +6,9 @@
  */
 
 #include "eden/common/utils/PathMapMutator.h"
+#include <folly/executors/CPUThreadPoolExecutor.h>
 #include <folly/portability/GTest.h>
+#include <atomic>
 
 using namespace facebook::eden;
 using namespace facebook::eden::path_literals;
@@ -659,3 +661,132 @@ TEST(PathMapMutator, insertOrAssignRevivesErasedSlot) {
   EXPECT_EQ(1u, result.size());
   EXPECT_EQ(7, result.find("foo"_pc)->second);
 }
+
+TEST(PathMapMutator, eraseAcrossBitmapWords) {
+  PathMap<int> map(CaseSensitivity::Sensitive);
+  for (int i = 0; i < 300; ++i) {
+    map.emplace(PathComponent(fmt::format("k{:03d}", i)), i);
+  }
+
+  PathMapMutator<int> mutator(std::move(map));
+  for (int i = 0; i < 300; i += 3) {
+    EXPECT_EQ(1, mutator.erase(PathComponent(fmt::format("k{:03d}", i))));
+  }
+  // Erase and then revive an entry emplaced after the bitmap was allocated.
+  mutator.emplace("z"_pc, 1000);
+  EXPECT_EQ(1, mutator.erase("z"_pc));
+  EXPECT_TRUE(mutator.emplace("z"_pc, 1001).second);
+
+  auto result = std::move(mutator).finalize();
+  ASSERT_EQ(201, result.size());
+  for (int i = 0; i < 300; ++i) {
+    auto it = result.find(PathComponent(fmt::format("k{:03d}", i)));
+    EXPECT_EQ(i % 3 == 0, it == result.end()) << i;
+  }
+  EXPECT_EQ(1001, result.at("z"_pc));
+}
+
+namespace {
+
+/**
+ * Forwards to another executor, counting the tasks it was given.
+ */
+class CountingExecutor final : public folly::Executor {
+ public:
+  explicit CountingExecutor(folly::Executor& inner) : inner_{inner} {}
+
+  void add(folly::Func func) override {
+    ++added;
+    inner_.add(std::move(func));
+  }
+
+  std::atomic<size_t> added{0};
+
+ private:
+  folly::Executor& inner_;
+};
+
+} // namespace
+
+TEST(PathMapMutator, parallelFinalize) {
+  // Large enough on both sides for finalize() to split the merge.
+  constexpr int kEntries = 200'000;
+  static_assert(!std::is_default_constructible_v<PathComponent>);
+  PathMap<int> map(CaseSensitivity::Sensitive);
+  map.reserve(kEntries);
+  for (int i = 0; i < kEntries; i += 2) {
+    map.emplace(PathComponent(fmt::format("{:08d}", i)), i);
+  }
+
+  PathMapMutator<int> mutator(std::move(map));
+  for (int i = 1; i < kEntries; i += 2) {
+    mutator.emplace(PathComponent(fmt::format("{:08d}", i)), i);
+  }
+  for (int i = 0; i < kEntries; i += 1000) {
+    mutator.erase(PathComponent(fmt::format("{:08d}", i)));
+  }
+
+  folly::CPUThreadPoolExecutor pool{4};
+  CountingExecutor executor{pool};
+  auto result = mutator.finalize(&executor);
+  EXPECT_GT(executor.added.load(), 0);
+  ASSERT_EQ(kEntries - kEntries / 1000, result.size());
+  int expected = 0;
+  for (const auto& [key, value] : result) {
+    if (expected % 1000 == 0) {
+      ++expected;
+    }
+    ASSERT_EQ(expected, value);
+    ASSERT_EQ(fmt::format("{:08d}", expected), key.view());
+    ++expected;
+  }
+}
+
+TEST(PathMapMutator, applyChanges) {
+  PathMap<int> map(CaseSensitivity::Sensitive);
+  map.emplace("a"_pc, 1);
+  map.emplace("c"_pc, 3);
+  map.emplace("e"_pc, 5);
+  map.emplace("g"_pc, 7);
+
+  PathMapMutator<int> mutator(std::move(map));
+  mutator.erase("g"_pc);
+  std::vector<PathMapChange<int>> changes{
+      {PathMapChangeKind::Add, PathComponent{"b"}, 2},
+      {PathMapChangeKind::Add, PathComponent{"c"}, 30},
+      {PathMapChangeKind::Remove, PathComponent{"d"}, 0},
+      {PathMapChangeKind::Remove, PathComponent{"e"}, 0},
+      {PathMapChangeKind::Update, PathComponent{"f"}, 6},
+      {PathMapChangeKind::Update, PathComponent{"a"}, 10},
+  };
+  // "a" after "f" is out of order, so it is applied on its own.
+  mutator.applyChanges(std::move(changes));
+
+  auto result = std::move(mutator).finalize();
+  EXPECT_EQ(4, result.size());
+  EXPECT_EQ(10, result.at("a"_pc));
+  EXPECT_EQ(2, result.at("b"_pc));
+  EXPECT_EQ(3, result.at("c"_pc)); // Add leaves existing entries alone
+  EXPECT_EQ(6, result.at("f"_pc));
+  EXPECT_EQ(result.find("e"_pc), result.end());
+  EXPECT_EQ(result.find("g"_pc), result.end());
+}
+
+TEST(PathMapMutator, caseInsensitiveApplyChanges) {
+  PathMap<int> map(CaseSensitivity::Insensitive);
+  map.emplace("Foo"_pc, 1);
+  map.emplace("Bar"_pc, 2);
+
+  PathMapMutator<int> mutator(std::move(map));
+  const std::vector<PathMapChange<int>> changes{
+      {PathMapChangeKind::Remove, PathComponent{"bar"}, 0},
+      {PathMapChangeKind::Update, PathComponent{"FOO"}, 10},
+  };
+  mutator.applyChanges(changes);
+  EXPECT_EQ("bar"_pc, changes[0].key); // copied, not moved from
+
+  auto result = std::move(mutator).finalize();
+  ASSERT_EQ(1, result.size());
+  EXPECT_EQ("Foo"_pc, result.begin()->first); // original casing preserved
+  EXPECT_EQ(10, result.begin()->second);
+}
@@ -6,6 +6,7 @@
  */
 
 #include "eden/common/utils/PathMap.h"
+#include <folly/executors/CPUThreadPoolExecutor.h>
 #include <folly/portability/GTest.h>
 #include <folly/portability/Unistd.h>
 
@@ -415,3 +416,66 @@ TEST(PathMapTest, vecConstructorInsensitive) {
     ASSERT_EQ(1, m.size());
   }
 }
+
+TEST(PathMapTest, iteratorConstructorKeepsFirst) {
+  std::vector<std::pair<PathComponent, int>> entries{
+      {PathComponent{"b"}, 1},
+      {PathComponent{"A"}, 2},
+      {PathComponent{"a"}, 3},
+  };
+  PathMap<int> m{entries.begin(), entries.end(), CaseSensitivity::Insensitive};
+  ASSERT_EQ(2, m.size());
+  EXPECT_EQ("A"_pc, m.begin()->first);
+  EXPECT_EQ(2, m.at("a"_pc));
+  EXPECT_EQ(1, m.at("b"_pc));
+}
+
+TEST(PathMapTest, buildPathMap) {
+  // Large enough to be split into several chunks.
+  constexpr int kCount = 200000;
+  std::vector<std::pair<PathComponent, int>> entries;
+  for (int i = 0; i < kCount; ++i) {
+    // Every name appears twice, once in upper case; the first one wins.
+    auto name = fmt::format("name{}", (i * 7919) % (kCount / 2));
+    if (i >= kCount / 2) {
+      std::transform(name.begin(), name.end(), name.begin(), ::toupper);
+    }
+    entries.emplace_back(PathComponent{name}, i);
+  }
+
+  folly::CPUThreadPoolExecutor executor{4};
+  for (auto* exec : {static_cast<folly::Executor*>(nullptr),
+                     static_cast<folly::Executor*>(&executor)}) {
+    auto sensitive =
+        buildPathMap<int>(entries, CaseSensitivity::Sensitive, exec);
+    EXPECT_EQ(kCount, sensitive.size());
+    EXPECT_TRUE(std::is_sorted(
+        sensitive.begin(),
+        sensitive.end(),
+        [](const auto& a, const auto& b) { return a.first < b.first; }));
+
+    auto insensitive =
+        buildPathMap<int>(entries, CaseSensitivity::Insensitive, exec);
+    ASSERT_EQ(kCount / 2, insensitive.size());
+    for (const auto& [name, value] : insensitive) {
+      EXPECT_LT(value, kCount / 2) << name.view();
+    }
+
+    // Matches what the vector constructor builds.
+    folly::fbvector<std::pair<PathComponent, int>> copy{
+        entries.begin(), entries.end()};
+    EXPECT_EQ(
+        PathMap<int>(std::move(copy), CaseSensitivity::Insensitive),
+        insensitive);
+  }
+
+  // Moving from an rvalue range.
+  auto moved = buildPathMap<int>(
+      std::move(entries), CaseSensitivity::Sensitive, &executor);
+  EXPECT_EQ(kCount, moved.size());
+  EXPECT_TRUE(buildPathMap<int>(
+                  std::vector<std::pair<PathComponent, int>>{},
+                  CaseSensitivity::Sensitive,
+                  &executor)
+                  .empty());
+}
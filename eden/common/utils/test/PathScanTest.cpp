@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "eden/common/utils/PathScan.h"
+
+#include <folly/portability/GTest.h>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace facebook::eden::detail;
+
+namespace {
+
+std::vector<PathScanImpl> supportedImpls() {
+  std::vector<PathScanImpl> impls;
+  for (auto impl :
+       {PathScanImpl::Scalar,
+        PathScanImpl::SSE2,
+        PathScanImpl::AVX2,
+        PathScanImpl::NEON}) {
+    if (isPathScanImplSupported(impl)) {
+      impls.push_back(impl);
+    }
+  }
+  return impls;
+}
+
+void expectComponent(std::string_view val, PathScanResult expected) {
+  for (auto impl : supportedImpls()) {
+    EXPECT_EQ(expected, scanPathComponent(val, impl))
+        << "impl " << static_cast<int>(impl) << " on \"" << val << "\"";
+  }
+}
+
+void expectComposed(std::string_view val, PathScanResult expected) {
+  for (auto impl : supportedImpls()) {
+    EXPECT_EQ(expected, scanComposedPath(val, std::nullopt, impl))
+        << "impl " << static_cast<int>(impl) << " on \"" << val << "\"";
+  }
+}
+
+} // namespace
+
+TEST(PathScan, scalarAlwaysSupported) {
+  EXPECT_TRUE(isPathScanImplSupported(PathScanImpl::Scalar));
+  EXPECT_TRUE(isPathScanImplSupported(bestPathScanImpl()));
+}
+
+TEST(PathScan, component) {
+  expectComponent("foo", PathScanResult::Ascii);
+  expectComponent("...", PathScanResult::Ascii);
+  expectComponent(".foo", PathScanResult::Ascii);
+  expectComponent("foo.", PathScanResult::Ascii);
+  expectComponent("\xc3\xa9t\xc3\xa9", PathScanResult::NonAscii);
+  // UTF-8 is not validated by the scan.
+  expectComponent("\xff", PathScanResult::NonAscii);
+
+  expectComponent("", PathScanResult::Invalid);
+  expectComponent(".", PathScanResult::Invalid);
+  expectComponent("..", PathScanResult::Invalid);
+  expectComponent("foo/bar", PathScanResult::Invalid);
+  expectComponent(std::string_view{"foo\0bar", 7}, PathScanResult::Invalid);
+}
+
+TEST(PathScan, composed) {
+  expectComposed("foo", PathScanResult::Ascii);
+  expectComposed("foo/bar/baz", PathScanResult::Ascii);
+  expectComposed("foo/.../bar", PathScanResult::Ascii);
+  expectComposed(".a/..b/c.", PathScanResult::Ascii);
+  expectComposed("foo/\xc3\xa9", PathScanResult::NonAscii);
+
+  expectComposed("", PathScanResult::Invalid);
+  expectComposed("/foo", PathScanResult::Invalid);
+  expectComposed("foo/", PathScanResult::Invalid);
+  expectComposed("foo//bar", PathScanResult::Invalid);
+  expectComposed("./foo", PathScanResult::Invalid);
+  expectComposed("../foo", PathScanResult::Invalid);
+  expectComposed("foo/./bar", PathScanResult::Invalid);
+  expectComposed("foo/../bar", PathScanResult::Invalid);
+  expectComposed("foo/.", PathScanResult::Invalid);
+  expectComposed("foo/..", PathScanResult::Invalid);
+  expectComposed(std::string_view{"foo/b\0r", 7}, PathScanResult::Invalid);
+}
+
+TEST(PathScan, errorsAcrossBlockBoundaries) {
+  // Place each error so that it straddles the 64 byte blocks used by the
+  // vectorized kernels.
+  for (size_t prefix = 55; prefix < 70; ++prefix) {
+    std::string base(prefix, 'a');
+    expectComposed(base + "/b", PathScanResult::Ascii);
+    expectComposed(base + "//b", PathScanResult::Invalid);
+    expectComposed(base + "/./b", PathScanResult::Invalid);
+    expectComposed(base + "/../b", PathScanResult::Invalid);
+    expectComposed(base + "/...", PathScanResult::Ascii);
+    expectComposed(base + "/\xc3\xa9", PathScanResult::NonAscii);
+    expectComponent(base + "/", PathScanResult::Invalid);
+    expectComponent(base + std::string(1, '\0'), PathScanResult::Invalid);
+  }
+}
+
+TEST(PathScan, explicitSeparator) {
+  for (auto impl : supportedImpls()) {
+    EXPECT_EQ(
+        PathScanResult::Ascii, scanComposedPath("foo/bar", '/', impl));
+    EXPECT_EQ(
+        PathScanResult::Invalid, scanComposedPath("foo//bar", '/', impl));
+  }
+}
+
+TEST(PathScan, randomInputsMatchScalar) {
+  // Small alphabet so that separators, dots and NULs are common.
+  const char alphabet[] = {'a', 'b', '.', '/', '\0', '\xc3', '\xa9', '\\'};
+  std::mt19937 rng{12345};
+  std::uniform_int_distribution<size_t> lengthDist{0, 200};
+  std::uniform_int_distribution<size_t> charDist{0, sizeof(alphabet) - 1};
+  std::uniform_int_distribution<int> replaceDist{0, 15};
+
+  for (int iter = 0; iter < 20000; ++iter) {
+    std::string val(lengthDist(rng), 'a');
+    for (auto& c : val) {
+      // Mostly plain bytes so that valid paths are generated too.
+      if (replaceDist(rng) == 0) {
+        c = alphabet[charDist(rng)];
+      }
+    }
+    auto component = scanPathComponent(val, PathScanImpl::Scalar);
+    auto composed = scanComposedPath(val, std::nullopt, PathScanImpl::Scalar);
+    for (auto impl : supportedImpls()) {
+      ASSERT_EQ(component, scanPathComponent(val, impl));
+      ASSERT_EQ(composed, scanComposedPath(val, std::nullopt, impl));
+    }
+  }
+}
+
+TEST(PathScan, findPathSeparatorsMatchesScalar) {
+  std::mt19937 rng{6789};
+  std::uniform_int_distribution<size_t> lengthDist{0, 300};
+  std::uniform_int_distribution<int> sepDist{0, 5};
+
+  for (int iter = 0; iter < 5000; ++iter) {
+    std::string val(lengthDist(rng), 'a');
+    std::vector<uint32_t> expected;
+    for (size_t i = 0; i < val.size(); ++i) {
+      if (sepDist(rng) == 0) {
+        val[i] = '/';
+        expected.push_back(static_cast<uint32_t>(i));
+      }
+    }
+    for (auto impl : supportedImpls()) {
+      std::vector<uint32_t> found(val.size());
+      ASSERT_EQ(
+          expected.size(),
+          findPathSeparators(val, found.data(), found.size(), impl));
+      found.resize(expected.size());
+      ASSERT_EQ(expected, found) << "impl " << static_cast<int>(impl);
+
+      // A short buffer is filled and the rest only counted.
+      uint32_t first[3] = {};
+      ASSERT_EQ(expected.size(), findPathSeparators(val, first, 3, impl));
+      for (size_t i = 0; i < std::min<size_t>(3, expected.size()); ++i) {
+        ASSERT_EQ(expected[i], first[i]);
+      }
+    }
+  }
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "eden/common/utils/PathTrie.h"
+
+#include <folly/portability/GMock.h>
+#include <folly/portability/GTest.h>
+#include <string>
+#include <vector>
+
+using namespace facebook::eden;
+using namespace facebook::eden::path_literals;
+using ::testing::UnorderedElementsAre;
+
+namespace {
+std::vector<std::string> under(const PathTrie& trie, RelativePathPiece dir) {
+  std::vector<std::string> result;
+  trie.forEachUnder(
+      dir, [&](RelativePathPiece path) { result.emplace_back(path.view()); });
+  return result;
+}
+} // namespace
+
+TEST(PathTrie, insertAndContains) {
+  PathTrie trie{CaseSensitivity::Sensitive};
+  EXPECT_TRUE(trie.empty());
+  EXPECT_TRUE(trie.insert("a/b/c"_relpath));
+  EXPECT_FALSE(trie.insert("a/b/c"_relpath));
+  EXPECT_TRUE(trie.insert("a/b"_relpath));
+  EXPECT_TRUE(trie.insert("a/d"_relpath));
+  EXPECT_EQ(3, trie.size());
+
+  EXPECT_TRUE(trie.contains("a/b/c"_relpath));
+  EXPECT_TRUE(trie.contains("a/b"_relpath));
+  EXPECT_FALSE(trie.contains("a"_relpath));
+  EXPECT_FALSE(trie.contains("A/b"_relpath));
+  EXPECT_FALSE(trie.contains(""_relpath));
+
+  EXPECT_TRUE(trie.containsAnyUnder("a"_relpath));
+  EXPECT_TRUE(trie.containsAnyUnder(""_relpath));
+  EXPECT_FALSE(trie.containsAnyUnder("a/e"_relpath));
+}
+
+TEST(PathTrie, forEachUnder) {
+  PathTrie trie{CaseSensitivity::Sensitive};
+  trie.insert("fbcode/eden/fs/a.cpp"_relpath);
+  trie.insert("fbcode/eden/fs/b.cpp"_relpath);
+  trie.insert("fbcode/eden/common"_relpath);
+  trie.insert("fbcode/folly/String.h"_relpath);
+  trie.insert("www/index.php"_relpath);
+
+  EXPECT_THAT(
+      under(trie, "fbcode/eden"_relpath),
+      UnorderedElementsAre(
+          "fbcode/eden/fs/a.cpp", "fbcode/eden/fs/b.cpp", "fbcode/eden/common"));
+  EXPECT_THAT(
+      under(trie, "fbcode/eden/common"_relpath),
+      UnorderedElementsAre("fbcode/eden/common"));
+  EXPECT_EQ(5, under(trie, ""_relpath).size());
+  EXPECT_TRUE(under(trie, "fbcode/eden/f"_relpath).empty());
+}
+
+TEST(PathTrie, ancestors) {
+  PathTrie trie{CaseSensitivity::Sensitive};
+  trie.insert("a/b"_relpath);
+  trie.insert("a/b/c/d"_relpath);
+
+  EXPECT_TRUE(trie.containsAncestorOf("a/b/c"_relpath));
+  EXPECT_TRUE(trie.containsAncestorOf("a/b/c/d/e"_relpath));
+  EXPECT_FALSE(trie.containsAncestorOf("a/b"_relpath));
+  EXPECT_FALSE(trie.containsAncestorOf("a"_relpath));
+  EXPECT_FALSE(trie.containsAncestorOf("x/y"_relpath));
+
+  EXPECT_EQ("a/b"_relpath, trie.longestPrefixMatch("a/b"_relpath));
+  EXPECT_EQ("a/b"_relpath, trie.longestPrefixMatch("a/b/c"_relpath));
+  EXPECT_EQ("a/b/c/d"_relpath, trie.longestPrefixMatch("a/b/c/d/e/f"_relpath));
+  EXPECT_EQ(std::nullopt, trie.longestPrefixMatch("a/c"_relpath));
+  EXPECT_EQ(std::nullopt, trie.longestPrefixMatch(""_relpath));
+
+  // The empty path is an ancestor of everything.
+  trie.insert(""_relpath);
+  EXPECT_TRUE(trie.containsAncestorOf("x/y"_relpath));
+  EXPECT_EQ(""_relpath, trie.longestPrefixMatch("x/y"_relpath));
+}
+
+TEST(PathTrie, caseInsensitive) {
+  PathTrie trie{CaseSensitivity::Insensitive};
+  EXPECT_TRUE(trie.insert("Foo/Bar"_relpath));
+  EXPECT_FALSE(trie.insert("foo/BAR"_relpath));
+  EXPECT_TRUE(trie.contains("FOO/bar"_relpath));
+  EXPECT_TRUE(trie.containsAncestorOf("foo/bar/baz"_relpath));
+  EXPECT_EQ("FOO/BAR"_relpath, trie.longestPrefixMatch("FOO/BAR/x"_relpath));
+
+  // Paths are enumerated as they were first spelled.
+  EXPECT_THAT(under(trie, "foo"_relpath), UnorderedElementsAre("foo/Bar"));
+}
+
+TEST(PathTrie, longNamesAndManyNodes) {
+  PathTrie trie{CaseSensitivity::Sensitive};
+  std::string longName(20000, 'x');
+  RelativePath longPath{longName};
+  EXPECT_TRUE(trie.insert(longPath));
+  for (int i = 0; i < 5000; ++i) {
+    trie.insert(RelativePath{fmt::format("dir{}/file{}", i % 50, i)});
+  }
+  EXPECT_TRUE(trie.contains(longPath));
+  EXPECT_EQ(5001, trie.size());
+  EXPECT_EQ(100, under(trie, "dir7"_relpath).size());
+  EXPECT_GT(trie.memoryUsage(), longName.size());
+}
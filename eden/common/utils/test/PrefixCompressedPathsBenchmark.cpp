@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "eden/common/utils/PrefixCompressedPaths.h"
+
+#include <benchmark/benchmark.h>
+#include <fmt/format.h>
+#include <algorithm>
+#include <array>
+#include <random>
+#include <string_view>
+#include <vector>
+
+using namespace facebook::eden;
+
+namespace {
+
+constexpr size_t kPaths = 500'000;
+constexpr size_t kMaxDepth = 12;
+
+constexpr std::array<std::string_view, 16> kWords{
+    "fbcode",
+    "eden",
+    "fs",
+    "common",
+    "utils",
+    "inodes",
+    "store",
+    "service",
+    "test",
+    "src",
+    "include",
+    "lib",
+    "third_party",
+    "integration",
+    "python",
+    "rust"};
+
+constexpr std::array<std::string_view, 8> kExtensions{
+    ".cpp", ".h", ".py", ".rs", ".thrift", ".md", ".json", "_test.cpp"};
+
+std::string_view pickWord(std::mt19937& gen) {
+  return kWords[std::uniform_int_distribution<size_t>{
+      0, kWords.size() - 1}(gen)];
+}
+
+/**
+ * Adds a random subtree under dir: a few files per directory and a branching
+ * factor just above one, so paths run several directories deep and sorted
+ * neighbours share most of their bytes, as in a monorepo.
+ */
+void addDirectory(
+    std::mt19937& gen,
+    const RelativePath& dir,
+    size_t depth,
+    std::vector<RelativePath>& paths) {
+  auto files = std::uniform_int_distribution<size_t>{0, 16}(gen);
+  for (size_t i = 0; i < files; ++i) {
+    auto extension = kExtensions[std::uniform_int_distribution<size_t>{
+        0, kExtensions.size() - 1}(gen)];
+    auto name = fmt::format("{}_{}{}", pickWord(gen), i, extension);
+    paths.push_back(dir + PathComponent{name});
+  }
+  if (depth == kMaxDepth) {
+    return;
+  }
+  auto subdirs = std::geometric_distribution<size_t>{0.45}(gen);
+  for (size_t i = 0; i < subdirs; ++i) {
+    addDirectory(
+        gen,
+        dir + PathComponent{fmt::format("{}{}", pickWord(gen), i)},
+        depth + 1,
+        paths);
+  }
+}
+
+/// kPaths distinct, sorted paths.
+const std::vector<RelativePath>& getPaths() {
+  static const auto paths = [] {
+    std::mt19937 gen{0};
+    std::vector<RelativePath> result;
+    for (size_t i = 0; result.size() < kPaths; ++i) {
+      addDirectory(
+          gen,
+          RelativePath{PathComponent{fmt::format("{}{}", pickWord(gen), i)}},
+          1,
+          result);
+    }
+    result.resize(kPaths);
+    std::sort(result.begin(), result.end());
+    return result;
+  }();
+  return paths;
+}
+
+/// The average path length, for comparing against the bytes per path.
+void reportPathLength(benchmark::State& state) {
+  size_t length = 0;
+  for (const auto& path : getPaths()) {
+    length += path.view().size();
+  }
+  state.counters["path_length"] = static_cast<double>(length) / kPaths;
+}
+
+} // namespace
+
+/**
+ * Copies the paths into a std::vector<RelativePath> and reports the memory it
+ * holds: the vector itself plus whatever the paths allocate on the heap.
+ */
+void BM_vectorBuild(benchmark::State& state) {
+  const auto& paths = getPaths();
+  size_t bytes = 0;
+  for (auto _ : state) {
+    std::vector<RelativePath> copy{paths.begin(), paths.end()};
+    state.PauseTiming();
+    bytes = copy.capacity() * sizeof(RelativePath);
+    for (const auto& path : copy) {
+      bytes += estimateIndirectMemoryUsage(path);
+    }
+    benchmark::DoNotOptimize(copy);
+    state.ResumeTiming();
+  }
+  state.counters["bytes"] = bytes;
+  state.counters["bytes_per_path"] = static_cast<double>(bytes) / kPaths;
+  reportPathLength(state);
+}
+BENCHMARK(BM_vectorBuild)->Unit(benchmark::kMillisecond);
+
+/// Front codes the same paths and reports the memory the list holds.
+void BM_prefixCompressedBuild(benchmark::State& state) {
+  const auto& paths = getPaths();
+  size_t bytes = 0;
+  for (auto _ : state) {
+    PrefixCompressedPaths compressed{paths.begin(), paths.end()};
+    state.PauseTiming();
+    bytes = sizeof(compressed) + compressed.memoryUsage();
+    benchmark::DoNotOptimize(compressed);
+    state.ResumeTiming();
+  }
+  state.counters["bytes"] = bytes;
+  state.counters["bytes_per_path"] = static_cast<double>(bytes) / kPaths;
+  reportPathLength(state);
+}
+BENCHMARK(BM_prefixCompressedBuild)->Unit(benchmark::kMillisecond);
+
+void BM_vectorFind(benchmark::State& state) {
+  const auto& paths = getPaths();
+  std::vector<RelativePath> copy{paths.begin(), paths.end()};
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        std::lower_bound(copy.begin(), copy.end(), paths[i]));
+    i = (i + 7919) % kPaths;
+  }
+}
+BENCHMARK(BM_vectorFind);
+
+void BM_prefixCompressedFind(benchmark::State& state) {
+  const auto& paths = getPaths();
+  PrefixCompressedPaths compressed{paths.begin(), paths.end()};
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(compressed.find(paths[i]));
+    i = (i + 7919) % kPaths;
+  }
+}
+BENCHMARK(BM_prefixCompressedFind);
+
+void BM_vectorIterate(benchmark::State& state) {
+  const auto& paths = getPaths();
+  std::vector<RelativePath> copy{paths.begin(), paths.end()};
+  for (auto _ : state) {
+    size_t total = 0;
+    for (const auto& path : copy) {
+      total += path.view().size();
+    }
+    benchmark::DoNotOptimize(total);
+  }
+  state.SetItemsProcessed(state.iterations() * kPaths);
+}
+BENCHMARK(BM_vectorIterate)->Unit(benchmark::kMillisecond);
+
+void BM_prefixCompressedIterate(benchmark::State& state) {
+  const auto& paths = getPaths();
+  PrefixCompressedPaths compressed{paths.begin(), paths.end()};
+  for (auto _ : state) {
+    size_t total = 0;
+    for (auto path : compressed) {
+      total += path.view().size();
+    }
+    benchmark::DoNotOptimize(total);
+  }
+  state.SetItemsProcessed(state.iterations() * kPaths);
+}
+BENCHMARK(BM_prefixCompressedIterate)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "eden/common/utils/PrefixCompressedPaths.h"
+
+#include <fmt/format.h>
+#include <folly/portability/GTest.h>
+#include <algorithm>
+#include <vector>
+
+using namespace facebook::eden;
+using namespace facebook::eden::path_literals;
+
+namespace {
+/// A sorted tree of paths, deep enough that they share long prefixes.
+std::vector<RelativePath> makePaths() {
+  std::vector<RelativePath> paths;
+  for (int a = 0; a < 5; ++a) {
+    for (int b = 0; b < 7; ++b) {
+      for (int c = 0; c < 11; ++c) {
+        paths.emplace_back(
+            fmt::format("fbcode/eden/fs/dir{}/sub{}/file{:02}.cpp", a, b, c));
+      }
+    }
+  }
+  std::sort(paths.begin(), paths.end());
+  return paths;
+}
+} // namespace
+
+TEST(PrefixCompressedPaths, empty) {
+  PrefixCompressedPaths paths;
+  EXPECT_TRUE(paths.empty());
+  EXPECT_EQ(paths.begin(), paths.end());
+  EXPECT_EQ(paths.end(), paths.lower_bound("foo"_relpath));
+  EXPECT_FALSE(paths.contains("foo"_relpath));
+  EXPECT_THROW(paths.at(0), std::out_of_range);
+}
+
+TEST(PrefixCompressedPaths, iterateAndIndex) {
+  auto expected = makePaths();
+  PrefixCompressedPaths paths{expected.begin(), expected.end()};
+  ASSERT_EQ(expected.size(), paths.size());
+
+  size_t i = 0;
+  for (auto path : paths) {
+    ASSERT_EQ(expected[i], path) << i;
+    ++i;
+  }
+  EXPECT_EQ(expected.size(), i);
+
+  for (i = 0; i < expected.size(); ++i) {
+    EXPECT_EQ(expected[i], paths[i]);
+  }
+  EXPECT_EQ(expected.back(), paths.at(expected.size() - 1));
+  EXPECT_THROW(paths.at(expected.size()), std::out_of_range);
+
+  // Front coding should store far less than the paths themselves.
+  size_t rawBytes = 0;
+  for (const auto& path : expected) {
+    rawBytes += path.view().size();
+  }
+  EXPECT_LT(paths.memoryUsage() * 3, rawBytes);
+}
+
+TEST(PrefixCompressedPaths, search) {
+  auto expected = makePaths();
+  PrefixCompressedPaths paths{expected.begin(), expected.end()};
+
+  for (size_t i = 0; i < expected.size(); ++i) {
+    auto it = paths.find(expected[i]);
+    ASSERT_NE(paths.end(), it);
+    EXPECT_EQ(i, it.index());
+    EXPECT_EQ(expected[i], *it);
+  }
+
+  EXPECT_EQ(0, paths.lower_bound("a"_relpath).index());
+  EXPECT_EQ(paths.end(), paths.lower_bound("zzz"_relpath));
+  EXPECT_FALSE(paths.contains("fbcode/eden/fs/dir1/sub2"_relpath));
+
+  auto it = paths.lower_bound("fbcode/eden/fs/dir1/sub2/file05.h"_relpath);
+  ASSERT_NE(paths.end(), it);
+  EXPECT_EQ("fbcode/eden/fs/dir1/sub2/file06.cpp"_relpath, *it);
+  ++it;
+  EXPECT_EQ("fbcode/eden/fs/dir1/sub2/file07.cpp"_relpath, *it);
+}
+
+TEST(PrefixCompressedPaths, rejectsUnsorted) {
+  PrefixCompressedPaths paths;
+  paths.push_back("a/b"_relpath);
+  paths.push_back("a/c"_relpath);
+  EXPECT_THROW(paths.push_back("a/c"_relpath), std::invalid_argument);
+  EXPECT_THROW(paths.push_back("a/a"_relpath), std::invalid_argument);
+  paths.push_back("b"_relpath);
+  EXPECT_EQ(3, paths.size());
+  EXPECT_EQ("b"_relpath, paths[2]);
+}
@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "eden/common/utils/Utf8.h"
+
+#include <benchmark/benchmark.h>
+#include <fmt/format.h>
+#include <string>
+#include <vector>
+
+using namespace facebook::eden;
+using detail::Utf8Impl;
+using detail::Utf8Rules;
+
+namespace {
+
+/**
+ * File names of roughly the given length, built from words of one script:
+ * "ascii" (1 byte per character), "cjk" (3 bytes), "emoji" (4 bytes), or
+ * "mixed", which alternates all three like names in a shared repository do.
+ */
+std::vector<std::string> makeNames(std::string_view kind, size_t length) {
+  const char* ascii[] = {"build", "src", "test", "README", "util", "_v2"};
+  const char* cjk[] = {
+      "\xE6\x96\x87\xE4\xBB\xB6", // U+6587 U+4EF6
+      "\xE8\xB5\x84\xE6\x96\x99", // U+8D44 U+6599
+      "\xE3\x83\x86\xE3\x82\xB9\xE3\x83\x88", // U+30C6 U+30B9 U+30C8
+      "\xEB\xAC\xB8\xEC\x84\x9C", // U+BB38 U+C11C
+  };
+  const char* emoji[] = {
+      "\xF0\x9F\x93\x81", // U+1F4C1
+      "\xF0\x9F\x9A\x80", // U+1F680
+      "\xF0\x9F\x98\x80", // U+1F600
+  };
+
+  std::vector<std::string> names;
+  for (size_t i = 0; i < 64; ++i) {
+    std::string name;
+    for (size_t word = i; name.size() < length; ++word) {
+      if (kind == "ascii" || (kind == "mixed" && word % 3 == 0)) {
+        name += ascii[word % std::size(ascii)];
+      } else if (kind == "cjk" || (kind == "mixed" && word % 3 == 1)) {
+        name += cjk[word % std::size(cjk)];
+      } else {
+        name += emoji[word % std::size(emoji)];
+      }
+    }
+    name += fmt::format(".{}", i);
+    names.push_back(std::move(name));
+  }
+  return names;
+}
+
+void BM_isValidUtf8(
+    benchmark::State& state,
+    std::string_view kind,
+    Utf8Impl impl) {
+  if (!detail::isUtf8ImplSupported(impl)) {
+    state.SkipWithError("unsupported on this CPU");
+    return;
+  }
+  auto names = makeNames(kind, state.range(0));
+  size_t i = 0;
+  size_t bytes = 0;
+  for (auto _ : state) {
+    const auto& name = names[i++ % names.size()];
+    benchmark::DoNotOptimize(
+        detail::validUtf8Prefix(name, Utf8Rules::Encoding, impl));
+    bytes += name.size();
+  }
+  state.SetBytesProcessed(bytes);
+}
+
+/**
+ * Repair cost for valid input, and for input with one invalid byte in the
+ * middle of every name.
+ */
+void BM_ensureValidUtf8(
+    benchmark::State& state,
+    std::string_view kind,
+    bool damaged) {
+  auto names = makeNames(kind, state.range(0));
+  if (damaged) {
+    for (auto& name : names) {
+      name.insert(name.size() / 2, "\xFF");
+    }
+  }
+  size_t i = 0;
+  size_t bytes = 0;
+  for (auto _ : state) {
+    const auto& name = names[i++ % names.size()];
+    benchmark::DoNotOptimize(ensureValidUtf8(folly::StringPiece{name}));
+    bytes += name.size();
+  }
+  state.SetBytesProcessed(bytes);
+}
+
+#define UTF8_ARGS Arg(16)->Arg(32)->Arg(64)->Arg(256)->Arg(4096)
+
+#define UTF8_IMPL_BENCHMARKS(kind)                                          \
+  BENCHMARK_CAPTURE(BM_isValidUtf8, kind##_scalar, #kind, Utf8Impl::Scalar) \
+      ->UTF8_ARGS;                                                          \
+  BENCHMARK_CAPTURE(BM_isValidUtf8, kind##_ssse3, #kind, Utf8Impl::SSSE3)   \
+      ->UTF8_ARGS;                                                          \
+  BENCHMARK_CAPTURE(BM_isValidUtf8, kind##_avx2, #kind, Utf8Impl::AVX2)     \
+      ->UTF8_ARGS;                                                          \
+  BENCHMARK_CAPTURE(BM_isValidUtf8, kind##_neon, #kind, Utf8Impl::NEON)     \
+      ->UTF8_ARGS;                                                          \
+  BENCHMARK_CAPTURE(BM_ensureValidUtf8, kind##_valid, #kind, false)         \
+      ->UTF8_ARGS;                                                          \
+  BENCHMARK_CAPTURE(BM_ensureValidUtf8, kind##_damaged, #kind, true)        \
+      ->UTF8_ARGS
+
+UTF8_IMPL_BENCHMARKS(ascii);
+UTF8_IMPL_BENCHMARKS(cjk);
+UTF8_IMPL_BENCHMARKS(emoji);
+UTF8_IMPL_BENCHMARKS(mixed);
+
+} // namespace
@@ -7,6 +7,9 @@
 
 #include "eden/common/utils/Utf8.h"
 #include <folly/portability/GTest.h>
+#include <random>
+#include <string>
+#include <vector>
 
 using namespace facebook::eden;
 
@@ -51,3 +54,86 @@ TEST(Utf8String, ensureValidUtf8) {
       reinterpret_cast<const char*>(u8"\uFFFDprefix\uFFFD"),
       ensureValidUtf8("\xA0prefix\xB0"));
 }
+
+namespace {
+std::vector<detail::Utf8Impl> supportedImpls() {
+  std::vector<detail::Utf8Impl> impls;
+  for (auto impl :
+       {detail::Utf8Impl::Scalar,
+        detail::Utf8Impl::SSSE3,
+        detail::Utf8Impl::AVX2,
+        detail::Utf8Impl::NEON}) {
+    if (detail::isUtf8ImplSupported(impl)) {
+      impls.push_back(impl);
+    }
+  }
+  return impls;
+}
+} // namespace
+
+TEST(Utf8Test, validUtf8PrefixRules) {
+  using detail::Utf8Rules;
+  // A surrogate and a code point above U+10FFFF are well formed, but not
+  // allowed by RFC 3629.
+  for (std::string_view str : {"\xED\xA0\x80", "\xF4\x90\x80\x80"}) {
+    EXPECT_TRUE(isValidUtf8(str));
+    EXPECT_EQ(str.size(), detail::validUtf8Prefix(str, Utf8Rules::Encoding));
+    EXPECT_EQ(0, detail::validUtf8Prefix(str, Utf8Rules::Strict));
+  }
+  // The prefix stops before an incomplete sequence.
+  EXPECT_EQ(3, detail::validUtf8Prefix("abc\xE4\xB8", Utf8Rules::Strict));
+  static_assert(isValidUtf8("abc"));
+  static_assert(!isValidUtf8("abc\xE4\xB8"));
+}
+
+TEST(Utf8Test, vectorImplsMatchScalar) {
+  using detail::Utf8Rules;
+  const std::string_view pieces[] = {
+      "a",
+      "\xC3\xA9",
+      "\xE4\xB8\xAD",
+      "\xF0\x9F\x98\x80",
+      "\x80",
+      "\xC0\x80",
+      "\xE0\x9F\xBF",
+      "\xED\xA0\x80",
+      "\xF0\x8F\xBF\xBF",
+      "\xF4\x90\x80\x80",
+      "\xF7\xBF\xBF\xBF",
+      "\xF8\x88\x80\x80",
+      "\xFF",
+      "\xC2",
+      "\xE4\xB8",
+      "\xF0\x9F\x98",
+  };
+  std::mt19937 rng{0};
+  for (int iteration = 0; iteration < 20000; ++iteration) {
+    std::string str;
+    size_t length = rng() % 100;
+    while (str.size() < length) {
+      // Mostly valid text, so that errors land at every offset in a block.
+      str += pieces[rng() % 8 ? rng() % 4 : rng() % std::size(pieces)];
+    }
+    for (auto rules : {Utf8Rules::Encoding, Utf8Rules::Strict}) {
+      auto expected = detail::validUtf8PrefixScalar(str, rules);
+      for (auto impl : supportedImpls()) {
+        ASSERT_EQ(expected, detail::validUtf8Prefix(str, rules, impl))
+            << "impl " << static_cast<int>(impl) << " on \"" << str << "\"";
+      }
+    }
+  }
+}
+
+TEST(Utf8String, ensureValidUtf8LongRuns) {
+  std::string valid;
+  for (int i = 0; i < 20; ++i) {
+    valid += reinterpret_cast<const char*>(u8"file_\u4E2D\u6587_\U0001F600");
+  }
+  EXPECT_EQ(valid, ensureValidUtf8(folly::StringPiece{valid}));
+
+  auto damaged = valid + "\xE4\xB8" + valid + "\xED\xA0\x80";
+  EXPECT_EQ(
+      valid + reinterpret_cast<const char*>(u8"\uFFFD\uFFFD") + valid +
+          reinterpret_cast<const char*>(u8"\uFFFD\uFFFD\uFFFD"),
+      ensureValidUtf8(folly::StringPiece{damaged}));
+}